@@ -19,6 +19,7 @@
 ===========================================================================
 */ 
 #include "Common.h"
+#include "TIM.h"
 #include "Config.c"
 
 char *AppName = NULL;
@@ -41,6 +42,23 @@ int SignExtend(int Temp)
     return Temp;
 }
 
+/*
+ * FNV-1a hash of Size bytes,start with HASH_FNV1A_INITIAL_VALUE and keep feeding the
+ * returned value to hash multiple blocks.
+ */
+unsigned int HashFNV1a(unsigned int Hash,const void *Data,int Size)
+{
+    const Byte *Bytes;
+    int i;
+    
+    Bytes = (const Byte *) Data;
+    for( i = 0; i < Size; i++ ) {
+        Hash ^= Bytes[i];
+        Hash *= 16777619u;
+    }
+    return Hash;
+}
+
 float Rand01()
 {
     return (rand() / (float)(RAND_MAX));
@@ -289,6 +307,14 @@ int SysMilliseconds()
 {
     return SDL_GetTicks64();
 }
+/*
+ Returns the elapsed time in milliseconds with sub-millisecond precision.
+ Useful when profiling code that runs multiple times per frame.
+ */
+double SysPreciseMilliseconds()
+{
+    return (double) SDL_GetPerformanceCounter() * 1000.0 / (double) SDL_GetPerformanceFrequency();
+}
 
 void DPrintf(const char *Fmt, ...)
 {
@@ -326,6 +352,13 @@ void CommonRegisterSettings()
     ConfigRegister("GUIShowFPS","1",NULL);
     
     ConfigRegister("SoundVolume","128","Sets the sound volume, the value must be in range 0-128, values outside that range will be clamped.");
+    
+    ConfigRegister("PNGCompressionMode","0","Sets how the exported PNG images are compressed.\nPossible values are:0 Deflate,1 Run-length "
+                    "encoding (faster,larger files) and 2 Store (no compression).");
+    ConfigRegister("PNGCompressionLevel","6","Sets the deflate compression level used for the exported PNG images, the value must be in "
+                    "range 0-9.");
+    ConfigRegister("PNGFilter","5","Sets the row filter used for the exported PNG images.\nPossible values are:0 None,1 Sub,2 Up,"
+                    "3 Average,4 Paeth and 5 Adaptive (picks the best filter for each row).");
 
 }
 void CommonShutdown()
@@ -342,4 +375,5 @@ void CommonInit(const char *ApplicationName)
     }
     CommonRegisterSettings();
     AppName = StringCopy(ApplicationName != NULL ? ApplicationName : "UnknownApp");
+    TIMInit();
 }
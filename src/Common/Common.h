@@ -70,6 +70,8 @@
 
 #define Square( x ) ( ( x ) * ( x ) )
 
+#define HASH_FNV1A_INITIAL_VALUE 2166136261u
+
 #define GetProcAddr(Name) SDL_GL_GetProcAddress(Name);
 
 #ifndef MAX
@@ -103,7 +105,9 @@ int         RandRangeI(int Min,int Max);
 Byte        HighNibble(Byte In);
 Byte        LowNibble(Byte In);
 int         SignExtend(int Temp);
+unsigned int HashFNV1a(unsigned int Hash,const void *Data,int Size);
 int         SysMilliseconds();
+double      SysPreciseMilliseconds();
 char        *AppGetConfigPath();
 void        SysShowCursor();
 void        SysHideCursor();
@@ -0,0 +1,118 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2018-2024 Adriano Di Dio.
+    
+    Medal-Of-Honor-PSX-File-Viewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Medal-Of-Honor-PSX-File-Viewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Medal-Of-Honor-PSX-File-Viewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/ 
+#include "Intern.h"
+
+static InternEntry_t *InternBucketList[INTERN_NUM_BUCKETS];
+static InternStats_t InternStats[INTERN_NUM_TYPES];
+static SDL_SpinLock InternLock;
+
+static void *InternGetData(InternEntry_t *Entry)
+{
+    return (Byte *) Entry + sizeof(InternEntry_t);
+}
+
+/*
+ * Returns a shared copy of Data,if the same content was already acquired the stored copy is returned and its
+ * reference count incremented.
+ * Every pointer that was returned must be released using InternRelease.
+ * Returns NULL if the memory for the copy could not be allocated.
+ */
+void *InternAcquire(InternType_t Type,const void *Data,int Size)
+{
+    InternEntry_t *Entry;
+    unsigned int Hash;
+    int Bucket;
+    
+    if( !Data || Size < 0 || Type < 0 || Type >= INTERN_NUM_TYPES ) {
+        DPrintf("InternAcquire:Invalid data\n");
+        return NULL;
+    }
+    Hash = HashFNV1a(HASH_FNV1A_INITIAL_VALUE,Data,Size);
+    Bucket = Hash % INTERN_NUM_BUCKETS;
+    SDL_AtomicLock(&InternLock);
+    for( Entry = InternBucketList[Bucket]; Entry; Entry = Entry->Next ) {
+        if( Entry->Hash == Hash && Entry->Size == Size && Entry->Type == Type && !memcmp(InternGetData(Entry),Data,Size) ) {
+            Entry->RefCount++;
+            InternStats[Type].NumReferences++;
+            InternStats[Type].SavedSize += Size;
+            SDL_AtomicUnlock(&InternLock);
+            return InternGetData(Entry);
+        }
+    }
+    Entry = malloc(sizeof(InternEntry_t) + Size);
+    if( !Entry ) {
+        DPrintf("InternAcquire:Failed to allocate memory for %i bytes\n",Size);
+        SDL_AtomicUnlock(&InternLock);
+        return NULL;
+    }
+    Entry->Hash = Hash;
+    Entry->Size = Size;
+    Entry->RefCount = 1;
+    Entry->Type = Type;
+    memcpy(InternGetData(Entry),Data,Size);
+    Entry->Next = InternBucketList[Bucket];
+    InternBucketList[Bucket] = Entry;
+    InternStats[Type].NumEntries++;
+    InternStats[Type].NumReferences++;
+    InternStats[Type].StoredSize += Size;
+    SDL_AtomicUnlock(&InternLock);
+    return InternGetData(Entry);
+}
+
+/*
+ * Releases a pointer returned by InternAcquire,the data is freed when no one references it anymore.
+ */
+void InternRelease(const void *Data)
+{
+    InternEntry_t *Entry;
+    InternEntry_t **Iterator;
+    
+    if( !Data ) {
+        return;
+    }
+    Entry = (InternEntry_t *) ((const Byte *) Data - sizeof(InternEntry_t));
+    SDL_AtomicLock(&InternLock);
+    InternStats[Entry->Type].NumReferences--;
+    Entry->RefCount--;
+    if( Entry->RefCount > 0 ) {
+        InternStats[Entry->Type].SavedSize -= Entry->Size;
+        SDL_AtomicUnlock(&InternLock);
+        return;
+    }
+    for( Iterator = &InternBucketList[Entry->Hash % INTERN_NUM_BUCKETS]; *Iterator; Iterator = &(*Iterator)->Next ) {
+        if( *Iterator == Entry ) {
+            *Iterator = Entry->Next;
+            break;
+        }
+    }
+    InternStats[Entry->Type].NumEntries--;
+    InternStats[Entry->Type].StoredSize -= Entry->Size;
+    SDL_AtomicUnlock(&InternLock);
+    free(Entry);
+}
+
+const InternStats_t *InternGetStats(InternType_t Type)
+{
+    if( Type < 0 || Type >= INTERN_NUM_TYPES ) {
+        return NULL;
+    }
+    return &InternStats[Type];
+}
@@ -0,0 +1,51 @@
+/*
+===========================================================================
+    Copyright (C) 2018-2024 Adriano Di Dio.
+    
+    Medal-Of-Honor-PSX-File-Viewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Medal-Of-Honor-PSX-File-Viewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Medal-Of-Honor-PSX-File-Viewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/ 
+#ifndef __INTERN_H_
+#define __INTERN_H_
+
+#include "Common.h"
+
+#define INTERN_NUM_BUCKETS 4096
+
+typedef enum {
+    INTERN_TYPE_IMAGE,
+    INTERN_TYPE_GEOMETRY,
+    INTERN_NUM_TYPES
+} InternType_t;
+
+//NOTE(Adriano):Data is stored right after the entry so that it can be found again from the pointer that was returned.
+typedef struct InternEntry_s {
+    unsigned int            Hash;
+    int                     Size;
+    int                     RefCount;
+    InternType_t            Type;
+    struct InternEntry_s    *Next;
+} InternEntry_t;
+
+typedef struct InternStats_s {
+    int         NumEntries;
+    int         NumReferences;
+    long long   StoredSize;
+    long long   SavedSize;
+} InternStats_t;
+
+void                *InternAcquire(InternType_t Type,const void *Data,int Size);
+void                InternRelease(const void *Data);
+const InternStats_t *InternGetStats(InternType_t Type);
+#endif//__INTERN_H_
@@ -0,0 +1,642 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2018-2024 Adriano Di Dio.
+    
+    Medal-Of-Honor-PSX-File-Viewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Medal-Of-Honor-PSX-File-Viewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Medal-Of-Honor-PSX-File-Viewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/ 
+#include "PNGWriter.h"
+#include "ThreadPool.h"
+#include "TIM.h"
+#include <zlib.h>
+
+//NOTE(Adriano):Rows are compressed in bands of about this size,each band is an independent deflate run that
+//              uses the end of the previous band as dictionary so that the result is a single valid stream.
+#define PNG_WRITER_BAND_SIZE (128 * 1024)
+#define PNG_WRITER_WINDOW_SIZE 32768
+#define PNG_WRITER_IDAT_SIZE (1024 * 1024)
+#define PNG_WRITER_BENCHMARK_PAGE_WIDTH 4096
+#define PNG_WRITER_BENCHMARK_PAGE_HEIGHT 1024
+
+Config_t *PNGCompressionMode;
+Config_t *PNGCompressionLevel;
+Config_t *PNGFilter;
+
+typedef struct PNGWriterBand_s {
+    int     FirstRow;
+    int     NumRows;
+    Byte    *Output;
+    int     OutputSize;
+    uLong   Adler;
+    bool    Failed;
+} PNGWriterBand_t;
+
+typedef struct PNGWriterContext_s {
+    const Byte                  *Data;
+    int                         Width;
+    int                         Height;
+    int                         Pitch;
+    int                         Channels;
+    int                         RowSize;
+    Byte                        *FilteredData;
+    PNGWriterBand_t             *BandList;
+    int                         NumBands;
+    const PNGWriterOptions_t    *Options;
+} PNGWriterContext_t;
+
+static const char *PNGWriterModeNames[PNG_WRITER_NUM_MODES] = {
+    "Deflate",
+    "RLE",
+    "Store"
+};
+
+static const char *PNGWriterFilterNames[PNG_WRITER_NUM_FILTERS] = {
+    "None",
+    "Sub",
+    "Up",
+    "Average",
+    "Paeth",
+    "Adaptive"
+};
+
+void PNGWriterInit()
+{
+    PNGCompressionMode = ConfigGet("PNGCompressionMode");
+    PNGCompressionLevel = ConfigGet("PNGCompressionLevel");
+    PNGFilter = ConfigGet("PNGFilter");
+}
+
+/*
+ * Fills the options using the settings,when they are not available (E.G:Command line tools) the
+ * libpng defaults are used.
+ */
+void PNGWriterGetDefaultOptions(PNGWriterOptions_t *Options)
+{
+    Options->Mode = PNG_WRITER_MODE_DEFLATE;
+    Options->CompressionLevel = Z_DEFAULT_COMPRESSION;
+    Options->Filter = PNG_WRITER_FILTER_ADAPTIVE;
+    if( PNGCompressionMode && PNGCompressionMode->IValue >= 0 && PNGCompressionMode->IValue < PNG_WRITER_NUM_MODES ) {
+        Options->Mode = PNGCompressionMode->IValue;
+    }
+    if( PNGCompressionLevel ) {
+        Options->CompressionLevel = PNGCompressionLevel->IValue < 0 ? 0 :
+                                    PNGCompressionLevel->IValue > 9 ? 9 : PNGCompressionLevel->IValue;
+    }
+    if( PNGFilter && PNGFilter->IValue >= 0 && PNGFilter->IValue < PNG_WRITER_NUM_FILTERS ) {
+        Options->Filter = PNGFilter->IValue;
+    }
+}
+
+const char *PNGWriterGetModeName(PNGWriterMode_t Mode)
+{
+    if( Mode < 0 || Mode >= PNG_WRITER_NUM_MODES ) {
+        return "Unknown";
+    }
+    return PNGWriterModeNames[Mode];
+}
+
+const char *PNGWriterGetFilterName(PNGWriterFilter_t Filter)
+{
+    if( Filter < 0 || Filter >= PNG_WRITER_NUM_FILTERS ) {
+        return "Unknown";
+    }
+    return PNGWriterFilterNames[Filter];
+}
+
+static void PNGWriterPutInt(Byte *Dest,unsigned int Value)
+{
+    Dest[0] = (Value >> 24) & 0xFF;
+    Dest[1] = (Value >> 16) & 0xFF;
+    Dest[2] = (Value >> 8) & 0xFF;
+    Dest[3] = Value & 0xFF;
+}
+
+static inline Byte PNGWriterPaethPredictor(int a,int b,int c)
+{
+    int p;
+    int pa;
+    int pb;
+    int pc;
+    
+    p = a + b - c;
+    pa = abs(p - a);
+    pb = abs(p - b);
+    pc = abs(p - c);
+    if( pa <= pb && pa <= pc ) {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+/*
+ * Writes the filter type followed by the filtered row,Prior is NULL for the first row of the image.
+ * Returns the sum of the filtered bytes seen as signed values,used to pick the filter in adaptive mode.
+ */
+static int PNGWriterFilterRow(Byte *Dest,const Byte *Row,const Byte *Prior,int RowSize,int BytesPerPixel,int Filter)
+{
+    int Sum;
+    int a;
+    int b;
+    int c;
+    int i;
+    
+    Dest[0] = Filter;
+    Dest++;
+    Sum = 0;
+    for( i = 0; i < RowSize; i++ ) {
+        a = i >= BytesPerPixel ? Row[i - BytesPerPixel] : 0;
+        b = Prior ? Prior[i] : 0;
+        c = Prior && i >= BytesPerPixel ? Prior[i - BytesPerPixel] : 0;
+        switch( Filter ) {
+            case PNG_WRITER_FILTER_SUB:
+                Dest[i] = Row[i] - a;
+                break;
+            case PNG_WRITER_FILTER_UP:
+                Dest[i] = Row[i] - b;
+                break;
+            case PNG_WRITER_FILTER_AVERAGE:
+                Dest[i] = Row[i] - ((a + b) >> 1);
+                break;
+            case PNG_WRITER_FILTER_PAETH:
+                Dest[i] = Row[i] - PNGWriterPaethPredictor(a,b,c);
+                break;
+            default:
+                Dest[i] = Row[i];
+                break;
+        }
+        Sum += abs((signed char) Dest[i]);
+    }
+    return Sum;
+}
+
+static void PNGWriterFilterBand(void *UserData,int TaskIndex)
+{
+    PNGWriterContext_t *Context;
+    PNGWriterBand_t *Band;
+    const Byte *Row;
+    const Byte *Prior;
+    Byte *Dest;
+    Byte *Scratch;
+    int BestSum;
+    int Sum;
+    int Filter;
+    int y;
+    
+    Context = (PNGWriterContext_t *) UserData;
+    Band = &Context->BandList[TaskIndex];
+    Scratch = NULL;
+    if( Context->Options->Filter == PNG_WRITER_FILTER_ADAPTIVE ) {
+        Scratch = malloc(Context->RowSize + 1);
+        if( !Scratch ) {
+            Band->Failed = true;
+            return;
+        }
+    }
+    for( y = Band->FirstRow; y < Band->FirstRow + Band->NumRows; y++ ) {
+        Row = Context->Data + y * Context->Pitch;
+        Prior = y > 0 ? Row - Context->Pitch : NULL;
+        Dest = Context->FilteredData + y * (Context->RowSize + 1);
+        if( !Scratch ) {
+            PNGWriterFilterRow(Dest,Row,Prior,Context->RowSize,Context->Channels,Context->Options->Filter);
+            continue;
+        }
+        //NOTE(Adriano):Same heuristic used by libpng,keep the filter with the smallest sum of absolute differences.
+        BestSum = PNGWriterFilterRow(Dest,Row,Prior,Context->RowSize,Context->Channels,PNG_WRITER_FILTER_NONE);
+        for( Filter = PNG_WRITER_FILTER_SUB; Filter <= PNG_WRITER_FILTER_PAETH; Filter++ ) {
+            Sum = PNGWriterFilterRow(Scratch,Row,Prior,Context->RowSize,Context->Channels,Filter);
+            if( Sum < BestSum ) {
+                BestSum = Sum;
+                memcpy(Dest,Scratch,Context->RowSize + 1);
+            }
+        }
+    }
+    free(Scratch);
+}
+
+static void PNGWriterCompressBand(void *UserData,int TaskIndex)
+{
+    PNGWriterContext_t *Context;
+    PNGWriterBand_t *Band;
+    z_stream Stream;
+    const Byte *Input;
+    int InputSize;
+    int DictionarySize;
+    int Level;
+    int Strategy;
+    int Flush;
+    int Result;
+    
+    Context = (PNGWriterContext_t *) UserData;
+    Band = &Context->BandList[TaskIndex];
+    if( Band->Failed ) {
+        return;
+    }
+    Input = Context->FilteredData + Band->FirstRow * (Context->RowSize + 1);
+    InputSize = Band->NumRows * (Context->RowSize + 1);
+    Band->Adler = adler32(adler32(0L,Z_NULL,0),Input,InputSize);
+    
+    switch( Context->Options->Mode ) {
+        case PNG_WRITER_MODE_STORE:
+            Level = 0;
+            Strategy = Z_DEFAULT_STRATEGY;
+            break;
+        case PNG_WRITER_MODE_RLE:
+            Level = Context->Options->CompressionLevel > 0 ? Context->Options->CompressionLevel : 1;
+            Strategy = Z_RLE;
+            break;
+        default:
+            Level = Context->Options->CompressionLevel;
+            Strategy = Z_DEFAULT_STRATEGY;
+            break;
+    }
+    memset(&Stream,0,sizeof(Stream));
+    if( deflateInit2(&Stream,Level,Z_DEFLATED,-15,8,Strategy) != Z_OK ) {
+        Band->Failed = true;
+        return;
+    }
+    if( Band->FirstRow > 0 && Level != 0 ) {
+        DictionarySize = Input - Context->FilteredData;
+        if( DictionarySize > PNG_WRITER_WINDOW_SIZE ) {
+            DictionarySize = PNG_WRITER_WINDOW_SIZE;
+        }
+        deflateSetDictionary(&Stream,Input - DictionarySize,DictionarySize);
+    }
+    //NOTE(Adriano):Sync flush ends the band on a byte boundary without closing the stream,only the last one finishes it.
+    Band->OutputSize = deflateBound(&Stream,InputSize) + 16;
+    Band->Output = malloc(Band->OutputSize);
+    if( !Band->Output ) {
+        deflateEnd(&Stream);
+        Band->Failed = true;
+        return;
+    }
+    Flush = TaskIndex == Context->NumBands - 1 ? Z_FINISH : Z_SYNC_FLUSH;
+    Stream.next_in = (Bytef *) Input;
+    Stream.avail_in = InputSize;
+    Stream.next_out = Band->Output;
+    Stream.avail_out = Band->OutputSize;
+    Result = deflate(&Stream,Flush);
+    if( (Flush == Z_FINISH && Result != Z_STREAM_END) || (Flush == Z_SYNC_FLUSH && (Result != Z_OK || Stream.avail_in != 0)) ) {
+        Band->Failed = true;
+    }
+    Band->OutputSize = Stream.total_out;
+    deflateEnd(&Stream);
+}
+
+/*
+ * Appends a chunk to the buffer,Buffer must be large enough to store it.
+ */
+static int PNGWriterPutChunk(Byte *Buffer,const char *Type,const Byte *Data,int Size)
+{
+    uLong CRC;
+    
+    PNGWriterPutInt(Buffer,Size);
+    memcpy(&Buffer[4],Type,4);
+    if( Size ) {
+        memcpy(&Buffer[8],Data,Size);
+    }
+    CRC = crc32(0L,Z_NULL,0);
+    CRC = crc32(CRC,&Buffer[4],Size + 4);
+    PNGWriterPutInt(&Buffer[8 + Size],CRC);
+    return Size + 12;
+}
+
+/*
+ * Encodes an 8-bit RGB (Channels == 3) or RGBA (Channels == 4) image into a PNG stored in memory.
+ * Row bands are filtered and compressed in parallel using the thread pool.
+ * Options can be NULL to use the settings.
+ * Returns 1 on success and the caller owns the output buffer,0 otherwise.
+ */
+int PNGWriterEncode(const Byte *Data,int Width,int Height,int Pitch,int Channels,const PNGWriterOptions_t *Options,
+                    Byte **Output,int *OutputSize)
+{
+    static const Byte Signature[8] = { 0x89,'P','N','G','\r','\n',0x1A,'\n' };
+    PNGWriterOptions_t DefaultOptions;
+    PNGWriterContext_t Context;
+    Byte Header[13];
+    Byte *Stream;
+    Byte *Buffer;
+    uLong Adler;
+    int StreamSize;
+    int BandRows;
+    int NumChunks;
+    int Offset;
+    int Size;
+    int Level;
+    int Result;
+    int i;
+    
+    if( !Data || !Output || !OutputSize || Width <= 0 || Height <= 0 || (Channels != 3 && Channels != 4) ) {
+        DPrintf("PNGWriterEncode:Invalid image\n");
+        return 0;
+    }
+    if( !Options ) {
+        PNGWriterGetDefaultOptions(&DefaultOptions);
+        Options = &DefaultOptions;
+    }
+    Result = 0;
+    Stream = NULL;
+    memset(&Context,0,sizeof(Context));
+    Context.Data = Data;
+    Context.Width = Width;
+    Context.Height = Height;
+    Context.Pitch = Pitch;
+    Context.Channels = Channels;
+    Context.RowSize = Width * Channels;
+    Context.Options = Options;
+    BandRows = PNG_WRITER_BAND_SIZE / (Context.RowSize + 1);
+    if( BandRows < 1 ) {
+        BandRows = 1;
+    }
+    Context.NumBands = (Height + BandRows - 1) / BandRows;
+    Context.FilteredData = malloc(Height * (Context.RowSize + 1));
+    Context.BandList = calloc(Context.NumBands,sizeof(PNGWriterBand_t));
+    if( !Context.FilteredData || !Context.BandList ) {
+        DPrintf("PNGWriterEncode:Failed to allocate memory for a %ix%i image\n",Width,Height);
+        goto Cleanup;
+    }
+    for( i = 0; i < Context.NumBands; i++ ) {
+        Context.BandList[i].FirstRow = i * BandRows;
+        Context.BandList[i].NumRows = MIN(BandRows,Height - i * BandRows);
+    }
+    ThreadPoolParallelFor(Context.NumBands,PNGWriterFilterBand,&Context);
+    ThreadPoolParallelFor(Context.NumBands,PNGWriterCompressBand,&Context);
+    
+    //NOTE(Adriano):The zlib stream is made by the header,every band and the checksum of the filtered data.
+    StreamSize = 2 + 4;
+    for( i = 0; i < Context.NumBands; i++ ) {
+        if( Context.BandList[i].Failed ) {
+            DPrintf("PNGWriterEncode:Failed to compress band %i\n",i);
+            goto Cleanup;
+        }
+        StreamSize += Context.BandList[i].OutputSize;
+    }
+    Stream = malloc(StreamSize);
+    if( !Stream ) {
+        DPrintf("PNGWriterEncode:Failed to allocate memory for the compressed data\n");
+        goto Cleanup;
+    }
+    Level = Options->Mode == PNG_WRITER_MODE_STORE ? 0 : Options->CompressionLevel;
+    Stream[0] = 0x78;
+    if( Level == Z_DEFAULT_COMPRESSION || Level == 6 ) {
+        Stream[1] = 2 << 6;
+    } else if( Level < 2 ) {
+        Stream[1] = 0;
+    } else if( Level < 6 ) {
+        Stream[1] = 1 << 6;
+    } else {
+        Stream[1] = 3 << 6;
+    }
+    Stream[1] += 31 - ((Stream[0] * 256 + Stream[1]) % 31);
+    Offset = 2;
+    Adler = Context.BandList[0].Adler;
+    for( i = 0; i < Context.NumBands; i++ ) {
+        memcpy(&Stream[Offset],Context.BandList[i].Output,Context.BandList[i].OutputSize);
+        Offset += Context.BandList[i].OutputSize;
+        if( i > 0 ) {
+            Adler = adler32_combine(Adler,Context.BandList[i].Adler,Context.BandList[i].NumRows * (Context.RowSize + 1));
+        }
+    }
+    PNGWriterPutInt(&Stream[Offset],Adler);
+    
+    NumChunks = (StreamSize + PNG_WRITER_IDAT_SIZE - 1) / PNG_WRITER_IDAT_SIZE;
+    Size = sizeof(Signature) + (12 + sizeof(Header)) + NumChunks * 12 + StreamSize + 12;
+    Buffer = malloc(Size);
+    if( !Buffer ) {
+        DPrintf("PNGWriterEncode:Failed to allocate memory for the output\n");
+        goto Cleanup;
+    }
+    memcpy(Buffer,Signature,sizeof(Signature));
+    Offset = sizeof(Signature);
+    PNGWriterPutInt(&Header[0],Width);
+    PNGWriterPutInt(&Header[4],Height);
+    Header[8] = 8;
+    Header[9] = Channels == 4 ? 6 : 2;
+    Header[10] = 0;
+    Header[11] = 0;
+    Header[12] = 0;
+    Offset += PNGWriterPutChunk(&Buffer[Offset],"IHDR",Header,sizeof(Header));
+    for( i = 0; i < NumChunks; i++ ) {
+        Offset += PNGWriterPutChunk(&Buffer[Offset],"IDAT",&Stream[i * PNG_WRITER_IDAT_SIZE],
+                                    MIN(PNG_WRITER_IDAT_SIZE,StreamSize - i * PNG_WRITER_IDAT_SIZE));
+    }
+    Offset += PNGWriterPutChunk(&Buffer[Offset],"IEND",NULL,0);
+    *Output = Buffer;
+    *OutputSize = Offset;
+    Result = 1;
+Cleanup:
+    if( Context.BandList ) {
+        for( i = 0; i < Context.NumBands; i++ ) {
+            free(Context.BandList[i].Output);
+        }
+        free(Context.BandList);
+    }
+    free(Context.FilteredData);
+    free(Stream);
+    return Result;
+}
+
+/*
+ * Encodes the image using PNGWriterEncode and writes it to File.
+ * Returns 1 on success,0 otherwise.
+ */
+int PNGWriterSave(const char *File,const Byte *Data,int Width,int Height,int Pitch,int Channels,
+                  const PNGWriterOptions_t *Options)
+{
+    FILE *OutFile;
+    Byte *Buffer;
+    int Size;
+    int Result;
+    
+    if( !PNGWriterEncode(Data,Width,Height,Pitch,Channels,Options,&Buffer,&Size) ) {
+        printf("Couldn't encode %s\n",File);
+        return 0;
+    }
+    OutFile = fopen(File,"wb");
+    if( !OutFile ) {
+        printf("Error creating image %s!\n",File);
+        free(Buffer);
+        return 0;
+    }
+    Result = fwrite(Buffer,Size,1,OutFile) == 1;
+    if( !Result ) {
+        printf("Error writing image %s!\n",File);
+    }
+    fclose(OutFile);
+    free(Buffer);
+    return Result;
+}
+
+/*
+ * Encodes the image with the given options,decodes it using libpng and compares the result with the source.
+ * Channels is 3 for RGB and 4 for RGBA data.
+ * Returns 1 if the decoded image matches.
+ */
+static int PNGWriterRoundTrip(const Byte *Data,int Width,int Height,int Channels,const PNGWriterOptions_t *Options,
+                              int *OutputSize,double *Time)
+{
+    png_image Image;
+    Byte *Output;
+    Byte *Decoded;
+    double StartTime;
+    int Size;
+    int Match;
+    
+    StartTime = SysPreciseMilliseconds();
+    if( !PNGWriterEncode(Data,Width,Height,Width * Channels,Channels,Options,&Output,&Size) ) {
+        return 0;
+    }
+    *Time += SysPreciseMilliseconds() - StartTime;
+    *OutputSize += Size;
+    memset(&Image,0,sizeof(Image));
+    Image.version = PNG_IMAGE_VERSION;
+    if( !png_image_begin_read_from_memory(&Image,Output,Size) ) {
+        printf("PNGWriterRoundTrip:libpng failed to read the image (%s)\n",Image.message);
+        free(Output);
+        return 0;
+    }
+    Image.format = Channels == 3 ? PNG_FORMAT_RGB : PNG_FORMAT_RGBA;
+    Decoded = malloc(PNG_IMAGE_SIZE(Image));
+    Match = Decoded && Image.width == Width && Image.height == Height &&
+            png_image_finish_read(&Image,NULL,Decoded,0,NULL) && !memcmp(Decoded,Data,Width * Height * Channels);
+    png_image_free(&Image);
+    free(Decoded);
+    free(Output);
+    return Match;
+}
+
+/*
+ * Converts every image of the TAF file to RGBA and RGB and checks that each compression mode produces a PNG that
+ * libpng decodes back to the same pixels,the RGBA images are also packed together inside a page as large as the VRAM
+ * to measure the throughput on a full export.
+ * Returns 1 if every image matches.
+ */
+int PNGWriterRunBenchmark(const char *File)
+{
+    PNGWriterOptions_t Options;
+    TIMImage_t *ImageList;
+    TIMImage_t *Iterator;
+    Byte **DataList;
+    Byte **RGBDataList;
+    Byte *Page;
+    double Time;
+    double RGBTime;
+    double PageTime;
+    long long NumBytes;
+    long long NumRGBBytes;
+    int OutputSize;
+    int RGBOutputSize;
+    int PageSize;
+    int NumImages;
+    int NumMismatches;
+    int PageX;
+    int PageY;
+    int ShelfHeight;
+    int Mode;
+    int i;
+    int y;
+    
+    ImageList = TIMLoadAllImages(File,&NumImages);
+    if( !ImageList ) {
+        printf("PNGWriterRunBenchmark:Failed to load images from %s\n",File);
+        return 0;
+    }
+    DataList = calloc(NumImages,sizeof(Byte *));
+    RGBDataList = calloc(NumImages,sizeof(Byte *));
+    Page = calloc(PNG_WRITER_BENCHMARK_PAGE_WIDTH * PNG_WRITER_BENCHMARK_PAGE_HEIGHT,4);
+    if( !DataList || !RGBDataList || !Page ) {
+        printf("PNGWriterRunBenchmark:Failed to allocate memory\n");
+        free(DataList);
+        free(RGBDataList);
+        free(Page);
+        TIMImageListFree(ImageList);
+        return 0;
+    }
+    PageX = 0;
+    PageY = 0;
+    ShelfHeight = 0;
+    NumBytes = 0;
+    NumRGBBytes = 0;
+    for( Iterator = ImageList, i = 0; Iterator; Iterator = Iterator->Next, i++ ) {
+        //NOTE(Adriano):TAF exports are written as RGB,make sure the 3 channel path is checked as well.
+        RGBDataList[i] = TIMToOpenGL24(Iterator);
+        if( RGBDataList[i] ) {
+            NumRGBBytes += Iterator->Width * Iterator->Height * 3;
+        }
+        DataList[i] = TIMToOpenGL32(Iterator);
+        if( !DataList[i] || Iterator->Width > PNG_WRITER_BENCHMARK_PAGE_WIDTH ) {
+            continue;
+        }
+        NumBytes += Iterator->Width * Iterator->Height * 4;
+        if( PageX + Iterator->Width > PNG_WRITER_BENCHMARK_PAGE_WIDTH ) {
+            PageX = 0;
+            PageY += ShelfHeight;
+            ShelfHeight = 0;
+        }
+        for( y = 0; y < Iterator->Height && PageY + y < PNG_WRITER_BENCHMARK_PAGE_HEIGHT; y++ ) {
+            memcpy(&Page[((PageY + y) * PNG_WRITER_BENCHMARK_PAGE_WIDTH + PageX) * 4],&DataList[i][y * Iterator->Width * 4],
+                   Iterator->Width * 4);
+        }
+        PageX += Iterator->Width;
+        ShelfHeight = MAX(ShelfHeight,Iterator->Height);
+    }
+    printf("Loaded %i images from %s,using %i threads.\n",NumImages,File,ThreadPoolGetNumThreads());
+    NumMismatches = 0;
+    PNGWriterGetDefaultOptions(&Options);
+    for( Mode = 0; Mode < PNG_WRITER_NUM_MODES; Mode++ ) {
+        Options.Mode = Mode;
+        Time = 0.;
+        RGBTime = 0.;
+        OutputSize = 0;
+        RGBOutputSize = 0;
+        for( Iterator = ImageList, i = 0; Iterator; Iterator = Iterator->Next, i++ ) {
+            if( DataList[i] && !PNGWriterRoundTrip(DataList[i],Iterator->Width,Iterator->Height,4,&Options,&OutputSize,&Time) ) {
+                printf("PNGWriterRunBenchmark:%s image %s does not match\n",PNGWriterGetModeName(Mode),Iterator->Name);
+                NumMismatches++;
+            }
+            if( RGBDataList[i] && !PNGWriterRoundTrip(RGBDataList[i],Iterator->Width,Iterator->Height,3,&Options,&RGBOutputSize,
+                &RGBTime) ) {
+                printf("PNGWriterRunBenchmark:%s RGB image %s does not match\n",PNGWriterGetModeName(Mode),Iterator->Name);
+                NumMismatches++;
+            }
+        }
+        PageTime = 0.;
+        PageSize = 0;
+        if( !PNGWriterRoundTrip(Page,PNG_WRITER_BENCHMARK_PAGE_WIDTH,PNG_WRITER_BENCHMARK_PAGE_HEIGHT,4,&Options,&PageSize,&PageTime) ) {
+            printf("PNGWriterRunBenchmark:%s page does not match\n",PNGWriterGetModeName(Mode));
+            NumMismatches++;
+        }
+        printf("%-8s images %8.2f MB/sec ratio %.3f page %8.2f ms ratio %.3f\n",PNGWriterGetModeName(Mode),
+               Time > 0. ? (NumBytes / (1024. * 1024.)) / (Time / 1000.) : 0.,NumBytes ? (double) OutputSize / NumBytes : 0.,
+               PageTime,(double) PageSize / (PNG_WRITER_BENCHMARK_PAGE_WIDTH * PNG_WRITER_BENCHMARK_PAGE_HEIGHT * 4));
+        printf("%-8s rgb    %8.2f MB/sec ratio %.3f\n",PNGWriterGetModeName(Mode),
+               RGBTime > 0. ? (NumRGBBytes / (1024. * 1024.)) / (RGBTime / 1000.) : 0.,
+               NumRGBBytes ? (double) RGBOutputSize / NumRGBBytes : 0.);
+    }
+    for( i = 0; i < NumImages; i++ ) {
+        free(DataList[i]);
+        free(RGBDataList[i]);
+    }
+    free(DataList);
+    free(RGBDataList);
+    free(Page);
+    TIMImageListFree(ImageList);
+    if( NumMismatches ) {
+        printf("PNGWriterRunBenchmark:%i images do not match\n",NumMismatches);
+        return 0;
+    }
+    printf("Every image was decoded correctly by libpng.\n");
+    return 1;
+}
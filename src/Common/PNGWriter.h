@@ -0,0 +1,62 @@
+/*
+===========================================================================
+    Copyright (C) 2018-2024 Adriano Di Dio.
+    
+    Medal-Of-Honor-PSX-File-Viewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Medal-Of-Honor-PSX-File-Viewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Medal-Of-Honor-PSX-File-Viewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/ 
+#ifndef __PNG_WRITER_H_
+#define __PNG_WRITER_H_
+
+#include "Common.h"
+#include "Config.h"
+
+typedef enum {
+    PNG_WRITER_MODE_DEFLATE,
+    PNG_WRITER_MODE_RLE,
+    PNG_WRITER_MODE_STORE,
+    PNG_WRITER_NUM_MODES
+} PNGWriterMode_t;
+
+//NOTE(Adriano):The first five values match the filter types stored inside the PNG rows.
+typedef enum {
+    PNG_WRITER_FILTER_NONE,
+    PNG_WRITER_FILTER_SUB,
+    PNG_WRITER_FILTER_UP,
+    PNG_WRITER_FILTER_AVERAGE,
+    PNG_WRITER_FILTER_PAETH,
+    PNG_WRITER_FILTER_ADAPTIVE,
+    PNG_WRITER_NUM_FILTERS
+} PNGWriterFilter_t;
+
+typedef struct PNGWriterOptions_s {
+    PNGWriterMode_t     Mode;
+    int                 CompressionLevel;
+    PNGWriterFilter_t   Filter;
+} PNGWriterOptions_t;
+
+extern Config_t *PNGCompressionMode;
+extern Config_t *PNGCompressionLevel;
+extern Config_t *PNGFilter;
+
+void        PNGWriterInit();
+void        PNGWriterGetDefaultOptions(PNGWriterOptions_t *Options);
+const char  *PNGWriterGetModeName(PNGWriterMode_t Mode);
+const char  *PNGWriterGetFilterName(PNGWriterFilter_t Filter);
+int         PNGWriterEncode(const Byte *Data,int Width,int Height,int Pitch,int Channels,const PNGWriterOptions_t *Options,
+                            Byte **Output,int *OutputSize);
+int         PNGWriterSave(const char *File,const Byte *Data,int Width,int Height,int Pitch,int Channels,
+                          const PNGWriterOptions_t *Options);
+int         PNGWriterRunBenchmark(const char *File);
+#endif//__PNG_WRITER_H_
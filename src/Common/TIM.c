@@ -20,20 +20,155 @@
 */ 
 
 #include "TIM.h"
+#include "PNGWriter.h"
+#include "Intern.h"
 
+#if defined(__AVX2__)
+#define TIM_USE_AVX2
+#define TIM_USE_SSSE3
+#define TIM_USE_SSE2
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#define TIM_USE_SSSE3
+#define TIM_USE_SSE2
+#include <tmmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TIM_USE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define TIM_USE_NEON
+#include <arm_neon.h>
+#endif
+
+//NOTE(Adriano):GCC and Clang can build the SSSE3 and AVX2 kernels without enabling them for the whole program,
+//              TIMInit then picks the ones supported by the CPU.
+#if defined(TIM_USE_SSE2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define TIM_USE_RUNTIME_DISPATCH
+#include <immintrin.h>
+#define TIM_TARGET(Features) __attribute__((target(Features)))
+#else
+#define TIM_TARGET(Features)
+#endif
+#if defined(TIM_USE_RUNTIME_DISPATCH) || defined(TIM_USE_SSSE3)
+#define TIM_HAS_SSSE3_KERNELS
+#endif
+#if defined(TIM_USE_RUNTIME_DISPATCH) || defined(TIM_USE_AVX2)
+#define TIM_HAS_AVX2_KERNELS
+#endif
+
+#define TIM_BENCHMARK_NUM_ITERATIONS 8
+
+typedef struct TIMKernels_s {
+    const char  *Name;
+    //NOTE(Adriano):NULL when only the scalar loop is available.
+    int         (*Convert4BPP)(const Byte *In,int NumBytes,const unsigned int *Palette,Byte *Out);
+    int         (*Convert8BPP)(const Byte *In,int NumPixels,const unsigned int *Palette,Byte *Out);
+    int         (*Convert16BPP)(const unsigned short *In,int NumPixels,Byte *Out);
+} TIMKernels_t;
+
+/*
+ * Images loaded by TIMLoadAllImages live in a single array that is owned by the first image together with
+ * the file buffer that their pixel and CLUT data points into.
+ */
 void TIMImageListFree(TIMImage_t *ImageList)
 {
-    TIMImage_t *Temp;
+    TIMImage_t *Iterator;
     
-    while( ImageList ) {
-        Temp = ImageList;
-        ImageList = ImageList->Next;
-        if( Temp->CLUT ) {
-            free(Temp->CLUT);
+    if( !ImageList ) {
+        return;
+    }
+    if( ImageList->Interned ) {
+        for( Iterator = ImageList; Iterator; Iterator = Iterator->Next ) {
+            InternRelease(Iterator->Data);
+            InternRelease(Iterator->CLUT);
         }
-        free(Temp->Data);
-        free(Temp);
     }
+    if( ImageList->FileData ) {
+        free(ImageList->FileData);
+    }
+    free(ImageList);
+}
+
+static int TIMGetDataSize(const TIMImage_t *Image)
+{
+    return Image->RowCount * Image->Height * sizeof(unsigned short);
+}
+
+static int TIMGetCLUTSize(const TIMImage_t *Image)
+{
+    return Image->Header.NumCLUTColors * sizeof(unsigned short);
+}
+
+/*
+ * Moves the pixel and CLUT data of every image inside the intern table,images that are contained inside
+ * more than one TAF file are stored only once and the file buffer is released.
+ * Returns 1 on success,0 if the data could not be moved,in that case the list is left untouched.
+ */
+int TIMInternImageList(TIMImage_t *ImageList)
+{
+    TIMImage_t *Iterator;
+    void **SharedList;
+    int NumImages;
+    int i;
+    
+    if( !ImageList || ImageList->Interned ) {
+        return 0;
+    }
+    NumImages = 0;
+    for( Iterator = ImageList; Iterator; Iterator = Iterator->Next ) {
+        NumImages++;
+    }
+    SharedList = calloc(NumImages * 2,sizeof(void *));
+    if( !SharedList ) {
+        DPrintf("TIMInternImageList:Failed to allocate memory for %i images\n",NumImages);
+        return 0;
+    }
+    for( Iterator = ImageList, i = 0; Iterator; Iterator = Iterator->Next, i++ ) {
+        SharedList[i * 2] = InternAcquire(INTERN_TYPE_IMAGE,Iterator->Data,TIMGetDataSize(Iterator));
+        if( Iterator->CLUT ) {
+            SharedList[i * 2 + 1] = InternAcquire(INTERN_TYPE_IMAGE,Iterator->CLUT,TIMGetCLUTSize(Iterator));
+        }
+        if( !SharedList[i * 2] || (Iterator->CLUT && !SharedList[i * 2 + 1]) ) {
+            DPrintf("TIMInternImageList:Failed to intern image %s\n",Iterator->Name);
+            for( i = 0; i < NumImages * 2; i++ ) {
+                InternRelease(SharedList[i]);
+            }
+            free(SharedList);
+            return 0;
+        }
+    }
+    for( Iterator = ImageList, i = 0; Iterator; Iterator = Iterator->Next, i++ ) {
+        Iterator->Data = SharedList[i * 2];
+        Iterator->CLUT = SharedList[i * 2 + 1];
+    }
+    free(SharedList);
+    free(ImageList->FileData);
+    ImageList->FileData = NULL;
+    ImageList->Interned = true;
+    return 1;
+}
+
+/*
+ * Returns true if both lists contain the same images at the same position,the content of interned lists is
+ * compared using the address of their data.
+ */
+bool TIMImageListEquals(const TIMImage_t *ImageList,const TIMImage_t *OtherImageList)
+{
+    if( !ImageList || !OtherImageList || !ImageList->Interned || !OtherImageList->Interned ) {
+        return false;
+    }
+    while( ImageList && OtherImageList ) {
+        if( ImageList->Data != OtherImageList->Data || ImageList->CLUT != OtherImageList->CLUT ||
+            memcmp(&ImageList->Header,&OtherImageList->Header,sizeof(TIMHeader_t)) ||
+            ImageList->FrameBufferX != OtherImageList->FrameBufferX || ImageList->FrameBufferY != OtherImageList->FrameBufferY ||
+            ImageList->Width != OtherImageList->Width || ImageList->Height != OtherImageList->Height ||
+            ImageList->RowCount != OtherImageList->RowCount ) {
+            return false;
+        }
+        ImageList = ImageList->Next;
+        OtherImageList = OtherImageList->Next;
+    }
+    return ImageList == NULL && OtherImageList == NULL;
 }
 const char *TIMGetBPPFromImage(TIMImage_t *Image)
 {
@@ -114,8 +249,9 @@ TIMImage_t *GetTIMByClutPage(TIMImage_t *List,int clutx,int cluty,int texpage)
 /*
     Given a valid TIM Image it returns a byte array containing all the indices
     layed out as a regular image.
+    NOTE(Adriano):This is the original per-pixel path,kept as reference for TIMRunConversionBenchmark.
 */
-Byte *TIMExpandCLUTImageData(TIMImage_t *Image)
+static Byte *TIMExpandCLUTImageDataReference(TIMImage_t *Image)
 {
     Byte *Data;
     int x;
@@ -163,7 +299,7 @@ Byte *TIMExpandCLUTImageData(TIMImage_t *Image)
     return Data;
 }
 
-Byte *TIMToOpenGL32(TIMImage_t *Image)
+static Byte *TIMToOpenGL32Reference(TIMImage_t *Image)
 {
     Byte *Data;
     int x;
@@ -250,7 +386,7 @@ Byte *TIMToOpenGL32(TIMImage_t *Image)
     }
     return Data;
 }
-Byte *TIMToOpenGL24(TIMImage_t *Image)
+static Byte *TIMToOpenGL24Reference(TIMImage_t *Image)
 {
     Byte *Data;
     int x;
@@ -322,9 +458,591 @@ Byte *TIMToOpenGL24(TIMImage_t *Image)
     return Data;
 }
 
-Byte **TIMSetRowPointer(png_structp PNGPtr,TIMImage_t *Image)
+static unsigned int TIMColorToRGBA(unsigned short Color)
+{
+    return GetR(Color) | (GetG(Color) << 8) | (GetB(Color) << 16) | ((unsigned int) GetAlphaValue(Color) << 24);
+}
+
+/*
+ * Converts the image CLUT to RGBA once so that every pixel only costs a table lookup.
+ * Entries past the end of the CLUT are left transparent.
+ */
+static void TIMBuildPalette(TIMImage_t *Image,unsigned int *Palette,int NumColors)
+{
+    int i;
+    
+    for( i = 0; i < NumColors; i++ ) {
+        Palette[i] = i < Image->Header.NumCLUTColors ? TIMColorToRGBA(Image->CLUT[i]) : 0;
+    }
+}
+
+/*
+ * Unpacks 4-BPP indices,each input byte becomes two output bytes starting from the low nibble.
+ */
+static void TIMExpandNibbles(const Byte *In,int NumBytes,Byte *Out)
+{
+    int i;
+    
+    i = 0;
+#if defined(TIM_USE_SSE2)
+    {
+        __m128i Mask;
+        __m128i Value;
+        __m128i Low;
+        __m128i High;
+        
+        Mask = _mm_set1_epi8(0x0F);
+        for( ; i + 16 <= NumBytes; i += 16 ) {
+            Value = _mm_loadu_si128((const __m128i *) &In[i]);
+            Low = _mm_and_si128(Value,Mask);
+            High = _mm_and_si128(_mm_srli_epi16(Value,4),Mask);
+            _mm_storeu_si128((__m128i *) &Out[i * 2],_mm_unpacklo_epi8(Low,High));
+            _mm_storeu_si128((__m128i *) &Out[i * 2 + 16],_mm_unpackhi_epi8(Low,High));
+        }
+    }
+#elif defined(TIM_USE_NEON)
+    {
+        uint8x16_t Value;
+        uint8x16x2_t Result;
+        
+        for( ; i + 16 <= NumBytes; i += 16 ) {
+            Value = vld1q_u8(&In[i]);
+            Result.val[0] = vandq_u8(Value,vdupq_n_u8(0x0F));
+            Result.val[1] = vshrq_n_u8(Value,4);
+            vst2q_u8(&Out[i * 2],Result);
+        }
+    }
+#endif
+    for( ; i < NumBytes; i++ ) {
+        Out[i * 2] = In[i] & 0xF;
+        Out[i * 2 + 1] = In[i] >> 4;
+    }
+}
+
+#if defined(TIM_HAS_SSSE3_KERNELS) || defined(TIM_USE_NEON)
+/*
+ * Splits the 16 colors of a 4-BPP palette into one byte plane for each channel,the planes are used as
+ * lookup tables by the shuffle based kernels.
+ */
+static void TIMBuildPalettePlanes(const unsigned int *Palette,Byte Plane[4][16])
+{
+    int i;
+    
+    for( i = 0; i < 16; i++ ) {
+        Plane[0][i] = Palette[i] & 0xFF;
+        Plane[1][i] = (Palette[i] >> 8) & 0xFF;
+        Plane[2][i] = (Palette[i] >> 16) & 0xFF;
+        Plane[3][i] = (Palette[i] >> 24) & 0xFF;
+    }
+}
+#endif
+
+//NOTE(Adriano):Every kernel converts as many elements as it can and returns their number,the remaining ones
+//              are converted by the scalar loops inside TIMConvert4BPP,TIMConvert8BPP and TIMConvert16BPP.
+#if defined(TIM_USE_SSE2)
+static int TIMConvert16BPPSSE2(const unsigned short *In,int NumPixels,Byte *Out)
+{
+    __m128i Value;
+    __m128i RG;
+    __m128i BA;
+    int i;
+    
+    for( i = 0; i + 8 <= NumPixels; i += 8 ) {
+        Value = _mm_loadu_si128((const __m128i *) &In[i]);
+        RG = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(Value,_mm_set1_epi16(0x1F)),3),
+                          _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(Value,2),_mm_set1_epi16(0xF8)),8));
+        //NOTE(Adriano):Alpha is 255 for every color but pure black without the STP bit (see GetAlphaValue).
+        BA = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(Value,7),_mm_set1_epi16(0xF8)),
+                          _mm_andnot_si128(_mm_cmpeq_epi16(Value,_mm_setzero_si128()),_mm_set1_epi16((short) 0xFF00)));
+        _mm_storeu_si128((__m128i *) &Out[i * 4],_mm_unpacklo_epi16(RG,BA));
+        _mm_storeu_si128((__m128i *) &Out[i * 4 + 16],_mm_unpackhi_epi16(RG,BA));
+    }
+    return i;
+}
+#endif
+
+#if defined(TIM_USE_NEON)
+static int TIMConvert4BPPNEON(const Byte *In,int NumBytes,const unsigned int *Palette,Byte *Out)
+{
+    uint8x16_t PlaneList[4];
+    uint8x16_t Value;
+    uint8x16x2_t Index;
+    uint8x16x4_t Pixel;
+    Byte Plane[4][16];
+    int i;
+    int j;
+    
+    TIMBuildPalettePlanes(Palette,Plane);
+    for( j = 0; j < 4; j++ ) {
+        PlaneList[j] = vld1q_u8(Plane[j]);
+    }
+    for( i = 0; i + 16 <= NumBytes; i += 16 ) {
+        Value = vld1q_u8(&In[i]);
+        Index = vzipq_u8(vandq_u8(Value,vdupq_n_u8(0x0F)),vshrq_n_u8(Value,4));
+        for( j = 0; j < 2; j++ ) {
+            Pixel.val[0] = vqtbl1q_u8(PlaneList[0],Index.val[j]);
+            Pixel.val[1] = vqtbl1q_u8(PlaneList[1],Index.val[j]);
+            Pixel.val[2] = vqtbl1q_u8(PlaneList[2],Index.val[j]);
+            Pixel.val[3] = vqtbl1q_u8(PlaneList[3],Index.val[j]);
+            vst4q_u8(&Out[i * 8 + j * 64],Pixel);
+        }
+    }
+    return i;
+}
+
+static int TIMConvert16BPPNEON(const unsigned short *In,int NumPixels,Byte *Out)
+{
+    uint16x8_t Value;
+    uint8x8x4_t Pixel;
+    int i;
+    
+    for( i = 0; i + 8 <= NumPixels; i += 8 ) {
+        Value = vld1q_u16(&In[i]);
+        Pixel.val[0] = vmovn_u16(vshlq_n_u16(vandq_u16(Value,vdupq_n_u16(0x1F)),3));
+        Pixel.val[1] = vmovn_u16(vandq_u16(vshrq_n_u16(Value,2),vdupq_n_u16(0xF8)));
+        Pixel.val[2] = vmovn_u16(vandq_u16(vshrq_n_u16(Value,7),vdupq_n_u16(0xF8)));
+        Pixel.val[3] = vmovn_u16(vmvnq_u16(vceqq_u16(Value,vdupq_n_u16(0))));
+        vst4_u8(&Out[i * 4],Pixel);
+    }
+    return i;
+}
+#endif
+
+#if defined(TIM_HAS_SSSE3_KERNELS)
+/*
+ * Looks up 16 4-BPP indices inside the palette planes and stores the resulting 16 RGBA pixels.
+ */
+TIM_TARGET("ssse3") static void TIMLookUpPalette16SSSE3(__m128i Index,const __m128i *PlaneList,Byte *Out)
+{
+    __m128i R;
+    __m128i G;
+    __m128i B;
+    __m128i A;
+    __m128i RG;
+    __m128i BA;
+    
+    R = _mm_shuffle_epi8(PlaneList[0],Index);
+    G = _mm_shuffle_epi8(PlaneList[1],Index);
+    B = _mm_shuffle_epi8(PlaneList[2],Index);
+    A = _mm_shuffle_epi8(PlaneList[3],Index);
+    RG = _mm_unpacklo_epi8(R,G);
+    BA = _mm_unpacklo_epi8(B,A);
+    _mm_storeu_si128((__m128i *) &Out[0],_mm_unpacklo_epi16(RG,BA));
+    _mm_storeu_si128((__m128i *) &Out[16],_mm_unpackhi_epi16(RG,BA));
+    RG = _mm_unpackhi_epi8(R,G);
+    BA = _mm_unpackhi_epi8(B,A);
+    _mm_storeu_si128((__m128i *) &Out[32],_mm_unpacklo_epi16(RG,BA));
+    _mm_storeu_si128((__m128i *) &Out[48],_mm_unpackhi_epi16(RG,BA));
+}
+
+TIM_TARGET("ssse3") static int TIMConvert4BPPSSSE3(const Byte *In,int NumBytes,const unsigned int *Palette,Byte *Out)
+{
+    __m128i PlaneList[4];
+    __m128i Mask;
+    __m128i Value;
+    __m128i Low;
+    __m128i High;
+    Byte Plane[4][16];
+    int i;
+    
+    TIMBuildPalettePlanes(Palette,Plane);
+    for( i = 0; i < 4; i++ ) {
+        PlaneList[i] = _mm_loadu_si128((const __m128i *) Plane[i]);
+    }
+    Mask = _mm_set1_epi8(0x0F);
+    for( i = 0; i + 16 <= NumBytes; i += 16 ) {
+        Value = _mm_loadu_si128((const __m128i *) &In[i]);
+        Low = _mm_and_si128(Value,Mask);
+        High = _mm_and_si128(_mm_srli_epi16(Value,4),Mask);
+        TIMLookUpPalette16SSSE3(_mm_unpacklo_epi8(Low,High),PlaneList,&Out[i * 8]);
+        TIMLookUpPalette16SSSE3(_mm_unpackhi_epi8(Low,High),PlaneList,&Out[i * 8 + 64]);
+    }
+    return i;
+}
+#endif
+
+#if defined(TIM_HAS_AVX2_KERNELS)
+/*
+ * Same as TIMLookUpPalette16SSSE3 but working on two 128 bit lanes.
+ * The first lane is stored at Out,the second one 32 pixels later (see TIMConvert4BPPAVX2).
+ */
+TIM_TARGET("avx2") static void TIMLookUpPalette16AVX2(__m256i Index,const __m256i *PlaneList,Byte *Out)
 {
-    Byte **RowPointer;
+    __m256i R;
+    __m256i G;
+    __m256i B;
+    __m256i A;
+    __m256i RG;
+    __m256i BA;
+    __m256i Pixel0;
+    __m256i Pixel1;
+    __m256i Pixel2;
+    __m256i Pixel3;
+    
+    R = _mm256_shuffle_epi8(PlaneList[0],Index);
+    G = _mm256_shuffle_epi8(PlaneList[1],Index);
+    B = _mm256_shuffle_epi8(PlaneList[2],Index);
+    A = _mm256_shuffle_epi8(PlaneList[3],Index);
+    RG = _mm256_unpacklo_epi8(R,G);
+    BA = _mm256_unpacklo_epi8(B,A);
+    Pixel0 = _mm256_unpacklo_epi16(RG,BA);
+    Pixel1 = _mm256_unpackhi_epi16(RG,BA);
+    RG = _mm256_unpackhi_epi8(R,G);
+    BA = _mm256_unpackhi_epi8(B,A);
+    Pixel2 = _mm256_unpacklo_epi16(RG,BA);
+    Pixel3 = _mm256_unpackhi_epi16(RG,BA);
+    _mm256_storeu_si256((__m256i *) &Out[0],_mm256_permute2x128_si256(Pixel0,Pixel1,0x20));
+    _mm256_storeu_si256((__m256i *) &Out[32],_mm256_permute2x128_si256(Pixel2,Pixel3,0x20));
+    _mm256_storeu_si256((__m256i *) &Out[128],_mm256_permute2x128_si256(Pixel0,Pixel1,0x31));
+    _mm256_storeu_si256((__m256i *) &Out[160],_mm256_permute2x128_si256(Pixel2,Pixel3,0x31));
+}
+
+TIM_TARGET("avx2") static int TIMConvert4BPPAVX2(const Byte *In,int NumBytes,const unsigned int *Palette,Byte *Out)
+{
+    __m256i PlaneList[4];
+    __m256i Mask;
+    __m256i Value;
+    __m256i Low;
+    __m256i High;
+    Byte Plane[4][16];
+    int i;
+    
+    TIMBuildPalettePlanes(Palette,Plane);
+    for( i = 0; i < 4; i++ ) {
+        PlaneList[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) Plane[i]));
+    }
+    Mask = _mm256_set1_epi8(0x0F);
+    //NOTE(Adriano):Unpacking works inside each lane so the first lane holds pixels 0-15 and 16-31
+    //while the second one holds pixels 32-47 and 48-63.
+    for( i = 0; i + 32 <= NumBytes; i += 32 ) {
+        Value = _mm256_loadu_si256((const __m256i *) &In[i]);
+        Low = _mm256_and_si256(Value,Mask);
+        High = _mm256_and_si256(_mm256_srli_epi16(Value,4),Mask);
+        TIMLookUpPalette16AVX2(_mm256_unpacklo_epi8(Low,High),PlaneList,&Out[i * 8]);
+        TIMLookUpPalette16AVX2(_mm256_unpackhi_epi8(Low,High),PlaneList,&Out[i * 8 + 64]);
+    }
+    return i + TIMConvert4BPPSSSE3(&In[i],NumBytes - i,Palette,&Out[i * 8]);
+}
+
+TIM_TARGET("avx2") static int TIMConvert8BPPAVX2(const Byte *In,int NumPixels,const unsigned int *Palette,Byte *Out)
+{
+    __m256i Index;
+    int i;
+    
+    for( i = 0; i + 8 <= NumPixels; i += 8 ) {
+        Index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) &In[i]));
+        _mm256_storeu_si256((__m256i *) &Out[i * 4],_mm256_i32gather_epi32((const int *) Palette,Index,4));
+    }
+    return i;
+}
+
+TIM_TARGET("avx2") static int TIMConvert16BPPAVX2(const unsigned short *In,int NumPixels,Byte *Out)
+{
+    __m256i Value;
+    __m256i RG;
+    __m256i BA;
+    __m256i Pixel0;
+    __m256i Pixel1;
+    int i;
+    
+    for( i = 0; i + 16 <= NumPixels; i += 16 ) {
+        Value = _mm256_loadu_si256((const __m256i *) &In[i]);
+        RG = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(Value,_mm256_set1_epi16(0x1F)),3),
+                             _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(Value,2),_mm256_set1_epi16(0xF8)),8));
+        BA = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(Value,7),_mm256_set1_epi16(0xF8)),
+                             _mm256_andnot_si256(_mm256_cmpeq_epi16(Value,_mm256_setzero_si256()),
+                                                 _mm256_set1_epi16((short) 0xFF00)));
+        Pixel0 = _mm256_unpacklo_epi16(RG,BA);
+        Pixel1 = _mm256_unpackhi_epi16(RG,BA);
+        _mm256_storeu_si256((__m256i *) &Out[i * 4],_mm256_permute2x128_si256(Pixel0,Pixel1,0x20));
+        _mm256_storeu_si256((__m256i *) &Out[i * 4 + 32],_mm256_permute2x128_si256(Pixel0,Pixel1,0x31));
+    }
+    return i + TIMConvert16BPPSSE2(&In[i],NumPixels - i,&Out[i * 4]);
+}
+#endif
+
+static const TIMKernels_t TIMBaselineKernels = {
+#if defined(TIM_USE_SSE2)
+    "SSE2",NULL,NULL,TIMConvert16BPPSSE2
+#elif defined(TIM_USE_NEON)
+    "NEON",TIMConvert4BPPNEON,NULL,TIMConvert16BPPNEON
+#else
+    "Scalar",NULL,NULL,NULL
+#endif
+};
+#if defined(TIM_HAS_SSSE3_KERNELS)
+static const TIMKernels_t TIMSSSE3Kernels = {
+    "SSSE3",TIMConvert4BPPSSSE3,NULL,TIMConvert16BPPSSE2
+};
+#endif
+#if defined(TIM_HAS_AVX2_KERNELS)
+static const TIMKernels_t TIMAVX2Kernels = {
+    "AVX2",TIMConvert4BPPAVX2,TIMConvert8BPPAVX2,TIMConvert16BPPAVX2
+};
+#endif
+static const TIMKernels_t *TIMKernels = &TIMBaselineKernels;
+
+/*
+ * Picks the fastest conversion kernels supported by the CPU,the baseline ones are used until this is called.
+ * Must be called before any image is converted from another thread.
+ */
+void TIMInit()
+{
+#if defined(TIM_USE_RUNTIME_DISPATCH)
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports("avx2") ) {
+        TIMKernels = &TIMAVX2Kernels;
+    } else if( __builtin_cpu_supports("ssse3") ) {
+        TIMKernels = &TIMSSSE3Kernels;
+    }
+#elif defined(TIM_HAS_AVX2_KERNELS)
+    TIMKernels = &TIMAVX2Kernels;
+#elif defined(TIM_HAS_SSSE3_KERNELS)
+    TIMKernels = &TIMSSSE3Kernels;
+#endif
+    DPrintf("TIMInit:Using %s kernels\n",TIMKernels->Name);
+}
+
+const char *TIMGetSIMDName()
+{
+    return TIMKernels->Name;
+}
+
+/*
+ * Converts packed 4-BPP indices to RGBA,each input byte produces two pixels.
+ */
+static void TIMConvert4BPP(const Byte *In,int NumBytes,const unsigned int *Palette,Byte *Out)
+{
+    int i;
+    
+    i = TIMKernels->Convert4BPP ? TIMKernels->Convert4BPP(In,NumBytes,Palette,Out) : 0;
+    for( ; i < NumBytes; i++ ) {
+        memcpy(&Out[i * 8],&Palette[In[i] & 0xF],4);
+        memcpy(&Out[i * 8 + 4],&Palette[In[i] >> 4],4);
+    }
+}
+
+/*
+ * Converts 8-BPP indices to RGBA.
+ */
+static void TIMConvert8BPP(const Byte *In,int NumPixels,const unsigned int *Palette,Byte *Out)
+{
+    int i;
+    
+    i = TIMKernels->Convert8BPP ? TIMKernels->Convert8BPP(In,NumPixels,Palette,Out) : 0;
+    for( ; i < NumPixels; i++ ) {
+        memcpy(&Out[i * 4],&Palette[In[i]],4);
+    }
+}
+
+/*
+ * Converts RGB5551 pixels to RGBA.
+ */
+static void TIMConvert16BPP(const unsigned short *In,int NumPixels,Byte *Out)
+{
+    unsigned int Color;
+    int i;
+    
+    i = TIMKernels->Convert16BPP ? TIMKernels->Convert16BPP(In,NumPixels,Out) : 0;
+    for( ; i < NumPixels; i++ ) {
+        Color = TIMColorToRGBA(In[i]);
+        memcpy(&Out[i * 4],&Color,4);
+    }
+}
+
+/*
+    Given a valid TIM Image it returns a byte array containing all the indices
+    layed out as a regular image.
+*/
+Byte *TIMExpandCLUTImageData(TIMImage_t *Image)
+{
+    Byte *Data;
+    
+    if( !Image ) {
+        DPrintf("TIMExpandCLUTImageData:Invalid Image\n");
+        return NULL;
+    }
+    if( Image->Header.BPP != TIM_IMAGE_BPP_4 && Image->Header.BPP != TIM_IMAGE_BPP_8 ) {
+        DPrintf("TIMExpandCLUTImageData:Cannot expand CLUT data on a non-paletted image.\n");
+        return NULL;
+    }
+    Data = malloc(Image->Width * Image->Height );
+    if( !Data ) {
+        DPrintf("TIMExpandCLUTImageData:Couldn't allocate memory for image.\n");
+        return NULL;
+    }
+    if( Image->Header.BPP == TIM_IMAGE_BPP_8  ) {
+        //NOTE(Adriano):Indices are already stored one per byte in the right order.
+        memcpy(Data,Image->Data,Image->RowCount * Image->Height * sizeof(unsigned short));
+    } else {
+        TIMExpandNibbles((const Byte *) Image->Data,Image->RowCount * Image->Height * sizeof(unsigned short),Data);
+    }
+    return Data;
+}
+
+Byte *TIMToOpenGL32(TIMImage_t *Image)
+{
+    unsigned int Palette[256];
+    Byte *Data;
+    
+    if( !Image ) {
+        DPrintf("TIMToOpenGL32:Invalid Image\n");
+        return NULL;
+    }
+    
+    Data = malloc(Image->Width * Image->Height * 4);
+    
+    if( !Data ) {
+        DPrintf("TIMToOpenGL32:Couldn't allocate memory for image.\n");
+        return NULL;
+    }
+    
+    if( Image->Header.BPP == TIM_IMAGE_BPP_8  ) {
+        TIMBuildPalette(Image,Palette,256);
+        TIMConvert8BPP((const Byte *) Image->Data,Image->RowCount * Image->Height * 2,Palette,Data);
+    } else if ( Image->Header.BPP == TIM_IMAGE_BPP_4 ) {
+        TIMBuildPalette(Image,Palette,16);
+        TIMConvert4BPP((const Byte *) Image->Data,Image->RowCount * Image->Height * 2,Palette,Data);
+    } else if ( Image->Header.BPP == TIM_IMAGE_BPP_16 ) {
+        TIMConvert16BPP(Image->Data,Image->RowCount * Image->Height,Data);
+    }
+    return Data;
+}
+
+Byte *TIMToOpenGL24(TIMImage_t *Image)
+{
+    unsigned int Palette[256];
+    Byte *Indices;
+    Byte *Data;
+    int NumPixels;
+    int i;
+    
+    if( !Image ) {
+        DPrintf("TIMToOpenGL24:Invalid Image\n");
+        return NULL;
+    }
+    
+    Data = malloc(Image->Width * Image->Height * 3);
+    
+    if( !Data ) {
+        DPrintf("TIMToOpenGL24:Couldn't allocate memory for image.\n");
+        return NULL;
+    }
+    if( Image->Header.BPP != TIM_IMAGE_BPP_8 && Image->Header.BPP != TIM_IMAGE_BPP_4 ) {
+        return Data;
+    }
+    Indices = TIMExpandCLUTImageData(Image);
+    if( !Indices ) {
+        free(Data);
+        return NULL;
+    }
+    TIMBuildPalette(Image,Palette,Image->Header.BPP == TIM_IMAGE_BPP_8 ? 256 : 16);
+    NumPixels = Image->Width * Image->Height;
+    for( i = 0; i < NumPixels; i++ ) {
+        memcpy(&Data[i * 3],&Palette[Indices[i]],3);
+    }
+    free(Indices);
+    return Data;
+}
+
+static int TIMBenchmarkCompare(const char *Name,TIMImage_t *Image,Byte *Reference,Byte *Result,int Size)
+{
+    int Match;
+    
+    Match = Reference && Result && !memcmp(Reference,Result,Size);
+    if( !Match ) {
+        printf("TIMRunConversionBenchmark:%s output of %s (%s) does not match the reference\n",Name,Image->Name,
+               TIMGetBPPFromImage(Image));
+    }
+    free(Reference);
+    free(Result);
+    return Match;
+}
+
+/*
+ Loads every image contained in the given TAF file and checks that the CLUT expansion and RGBA conversions
+ produce the same output as the per-pixel reference code,then measures the throughput of both.
+ Returns 1 if every output is bit-exact.
+ */
+int TIMRunConversionBenchmark(const char *File)
+{
+    TIMImage_t *ImageList;
+    TIMImage_t *Iterator;
+    Byte *(*ReferenceFunctionList[3])(TIMImage_t *Image) = {
+        TIMExpandCLUTImageDataReference,TIMToOpenGL32Reference,TIMToOpenGL24Reference
+    };
+    Byte *(*FunctionList[3])(TIMImage_t *Image) = {
+        TIMExpandCLUTImageData,TIMToOpenGL32,TIMToOpenGL24
+    };
+    const char *NameList[3] = {
+        "Expand CLUT","RGBA","RGB"
+    };
+    const int PixelSizeList[3] = {
+        1,4,3
+    };
+    double ReferenceTime;
+    double Time;
+    double StartTime;
+    long long NumPixels;
+    int NumImages;
+    int NumMismatches;
+    int Supported;
+    int i;
+    int j;
+    
+    ImageList = TIMLoadAllImages(File,&NumImages);
+    if( !ImageList ) {
+        printf("TIMRunConversionBenchmark:Failed to load images from %s\n",File);
+        return 0;
+    }
+    printf("Loaded %i images from %s,using %s kernels.\n",NumImages,File,TIMGetSIMDName());
+    NumMismatches = 0;
+    for( i = 0; i < 3; i++ ) {
+        NumPixels = 0;
+        ReferenceTime = 0.;
+        Time = 0.;
+        for( Iterator = ImageList; Iterator; Iterator = Iterator->Next ) {
+            //NOTE(Adriano):The reference code leaves direct color images untouched except for the 16-BPP RGBA one.
+            Supported = Iterator->Header.BPP == TIM_IMAGE_BPP_4 || Iterator->Header.BPP == TIM_IMAGE_BPP_8 ||
+                        (i == 1 && Iterator->Header.BPP == TIM_IMAGE_BPP_16);
+            if( !Supported ) {
+                continue;
+            }
+            if( !TIMBenchmarkCompare(NameList[i],Iterator,ReferenceFunctionList[i](Iterator),FunctionList[i](Iterator),
+                Iterator->Width * Iterator->Height * PixelSizeList[i]) ) {
+                NumMismatches++;
+            }
+            StartTime = SysPreciseMilliseconds();
+            for( j = 0; j < TIM_BENCHMARK_NUM_ITERATIONS; j++ ) {
+                free(ReferenceFunctionList[i](Iterator));
+            }
+            ReferenceTime += SysPreciseMilliseconds() - StartTime;
+            StartTime = SysPreciseMilliseconds();
+            for( j = 0; j < TIM_BENCHMARK_NUM_ITERATIONS; j++ ) {
+                free(FunctionList[i](Iterator));
+            }
+            Time += SysPreciseMilliseconds() - StartTime;
+            NumPixels += (long long) Iterator->Width * Iterator->Height * TIM_BENCHMARK_NUM_ITERATIONS;
+        }
+        printf("%-12s reference %10.2f MPixels/sec %s %10.2f MPixels/sec (%.2fx)\n",NameList[i],
+               ReferenceTime > 0. ? NumPixels / (ReferenceTime * 1000.) : 0.,TIMGetSIMDName(),
+               Time > 0. ? NumPixels / (Time * 1000.) : 0.,Time > 0. ? ReferenceTime / Time : 0.);
+    }
+    TIMImageListFree(ImageList);
+    if( NumMismatches ) {
+        printf("TIMRunConversionBenchmark:%i outputs do not match the reference\n",NumMismatches);
+        return 0;
+    }
+    printf("Every output matches the reference.\n");
+    return 1;
+}
+
+/*
+ * Converts the image to a contiguous RGB buffer that can be passed to the PNG writer.
+ */
+static Byte *TIMToRGB(TIMImage_t *Image)
+{
+    Byte *Data;
     int x;
     int y;
     int NumComponent;
@@ -336,11 +1054,14 @@ Byte **TIMSetRowPointer(png_structp PNGPtr,TIMImage_t *Image)
     Byte G2;
     Byte B2;
 
-    RowPointer = png_malloc  (PNGPtr, Image->Height * sizeof (Byte *));
+    Data = malloc(Image->Width * Image->Height * 3);
+    if( !Data ) {
+        DPrintf("TIMToRGB:Failed to allocate memory for image data\n");
+        return NULL;
+    }
     if( Image->Header.BPP == TIM_IMAGE_BPP_4  ) {
         for (y = 0; y < Image->Height; y++) {
-            Byte *Row = png_malloc (PNGPtr, sizeof (Byte) * Image->Width * 3);
-            RowPointer[y] = Row;
+            Byte *Row = &Data[y * Image->Width * 3];
             for (x = 0; x < Image->RowCount; x++) {
 //                 DPrintf("Pixel is %u 0x%08x\n",Image->Data[x+Image->RowCount*y],Image->Data[x+Image->RowCount*y]);
                 Byte ClutIndex0 = Image->Data[x+Image->RowCount*y] & 0xF;
@@ -364,8 +1085,7 @@ Byte **TIMSetRowPointer(png_structp PNGPtr,TIMImage_t *Image)
     }
     if( Image->Header.BPP == TIM_IMAGE_BPP_8  ) {
         for (y = 0; y < Image->Height; y++) {
-            Byte *Row = png_malloc (PNGPtr, sizeof (Byte) * Image->Width * 3);
-            RowPointer[y] = Row;
+            Byte *Row = &Data[y * Image->Width * 3];
             for (x = 0; x < Image->RowCount; x++) {
 //             DPrintf("Pixel is %u 0x%08x\n",Image->Data[x+Image->RowCount*y],Image->Data[x+Image->RowCount*y]);
                 Byte ClutIndex0 = Image->Data[x+Image->RowCount*y] & 0xFF;
@@ -382,8 +1102,7 @@ Byte **TIMSetRowPointer(png_structp PNGPtr,TIMImage_t *Image)
     
     if( Image->Header.BPP == TIM_IMAGE_BPP_16  ) {
         for (y = 0; y < Image->Height; y++) {
-            Byte *Row = png_malloc (PNGPtr, sizeof (Byte) * Image->Width * 3);
-            RowPointer[y] = Row;
+            Byte *Row = &Data[y * Image->Width * 3];
             for (x = 0; x < Image->RowCount; x++) {
 //             DPrintf("Pixel is %u 0x%08x\n",Image->Data[x+Image->RowCount*y],Image->Data[x+Image->RowCount*y]);
                 Byte R = GetR(Image->Data[x+Image->RowCount*y]);
@@ -398,8 +1117,7 @@ Byte **TIMSetRowPointer(png_structp PNGPtr,TIMImage_t *Image)
     if( Image->Header.BPP == TIM_IMAGE_BPP_24 ) {
         NumComponent = 0;
         for (y = 0; y < Image->Height; y++) {
-            Byte *Row = png_malloc (PNGPtr, sizeof (Byte) * Image->Width * 3);
-            RowPointer[y] = Row;
+            Byte *Row = &Data[y * Image->Width * 3];
             for (x = 0; x < Image->RowCount; x++) {
                 switch( NumComponent ) {
                     case 0:
@@ -424,7 +1142,7 @@ Byte **TIMSetRowPointer(png_structp PNGPtr,TIMImage_t *Image)
                         *Row++ = B2;
                         break;
                     default:
-                        printf("SetRowPointer: Uneven component count detected aborting....!\n");
+                        printf("TIMToRGB: Uneven component count detected aborting....!\n");
                         exit(0);
                         break;
                 }
@@ -433,134 +1151,64 @@ Byte **TIMSetRowPointer(png_structp PNGPtr,TIMImage_t *Image)
         }
     }
     
-    return RowPointer;
+    return Data;
 }
 
-void TIMWritePNGImage(TIMImage_t *Image,char *OutName)
+/*
+ * Saves the image as an RGB PNG file.
+ * Returns 1 on success,0 if the image could not be converted or written.
+ */
+int TIMWritePNGImage(TIMImage_t *Image,char *OutName)
 {
-    FILE *PNGImage;
-    png_structp PNGPtr;
-    png_infop PNGInfoPtr;
-    Byte **RowPointer;
-    int y;
-
-    
-    PNGImage = fopen(OutName,"wb");
+    Byte *Data;
+    int Result;
     
-    if( PNGImage == NULL ) {
+    Data = TIMToRGB(Image);
+    if( !Data ) {
         printf("Error creating image %s!\n",OutName);
-        return;
-    }
-
-    PNGPtr = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (PNGPtr == NULL) {
-        printf("PNG: Couldn't create write struct!\n");
-        free(PNGImage);
-        return;
-    }
-    
-    PNGInfoPtr = png_create_info_struct (PNGPtr);
-    if (PNGInfoPtr == NULL) {
-        printf("PNG: Couldn't create info struct!\n");
-        png_destroy_write_struct (&PNGPtr, NULL);
-        free(PNGImage);
-        return;
-    }
-
-    png_set_IHDR (PNGPtr,
-                  PNGInfoPtr,
-                  Image->Width,
-                  Image->Height,
-                  8, // Depth
-                  PNG_COLOR_TYPE_RGB,
-                  PNG_INTERLACE_NONE,
-                  PNG_COMPRESSION_TYPE_DEFAULT,
-                  PNG_FILTER_TYPE_DEFAULT);
-    RowPointer = TIMSetRowPointer(PNGPtr,Image);
-    
-    png_init_io (PNGPtr, PNGImage);
-    png_set_rows (PNGPtr, PNGInfoPtr, RowPointer);
-    png_write_png (PNGPtr, PNGInfoPtr, PNG_TRANSFORM_IDENTITY, NULL);
-    
-    for (y = 0; y < Image->Height; y++) {
-        png_free (PNGPtr, RowPointer[y]);
-    }
-    png_free (PNGPtr, RowPointer);
-    png_destroy_write_struct(&PNGPtr,&PNGInfoPtr);
-    fclose(PNGImage);
-}
-
-void TIMGetPalette(FILE *TIMIMage,TIMImage_t *Image)
-{
-    unsigned short i;
-    
-    fread(&Image->Header.CLUTSize,sizeof(Image->Header.CLUTSize),1,TIMIMage);
-    fread(&Image->Header.CLUTOrgX,sizeof(Image->Header.CLUTOrgX),1,TIMIMage);
-    fread(&Image->Header.CLUTOrgY,sizeof(Image->Header.CLUTOrgY),1,TIMIMage);
-    fread(&Image->Header.NumCLUTColors,sizeof(Image->Header.NumCLUTColors),1,TIMIMage);
-    fread(&Image->Header.NumCLUTs,sizeof(Image->Header.NumCLUTs),1,TIMIMage);
-
-    DPrintf("CLUTSize is %i\n",Image->Header.CLUTSize);
-    DPrintf("CLUTLocation is %ux%u\n",Image->Header.CLUTOrgX,Image->Header.CLUTOrgY);
-    DPrintf("NumCLUTColors is %u\n",Image->Header.NumCLUTColors);
-    DPrintf("NumCLUTs is %u\n",Image->Header.NumCLUTs);
-    Image->CLUT = malloc(Image->Header.NumCLUTColors * sizeof(unsigned short));
-    if( !Image->CLUT ) {
-        DPrintf("TIMGetPalette:Failed to allocate memory for CLUT data\n");
-        return;
-    }
-    for( i = 0; i < Image->Header.NumCLUTColors; i++ ) {
-        fread(&Image->CLUT[i],sizeof(Image->CLUT[i]),1,TIMIMage);
+        return 0;
     }
+    Result = PNGWriterSave(OutName,Data,Image->Width,Image->Height,Image->Width * 3,3,NULL);
+    free(Data);
+    return Result;
 }
 
-
-TIMImage_t *TIMLoadImage(FILE *TIMImage,const char *FileName,int NumImages)
+/*
+ * Parses the image found at *Offset inside the TAF file buffer.
+ * Header fields are copied while CLUT and pixel data are left inside Buffer and Image points to them.
+ * Returns 1 and moves Offset past the image on success,0 if no valid image was found at the given offset.
+ */
+int TIMLoadImage(TIMImage_t *Image,Byte *Buffer,int BufferSize,int *Offset,const char *BaseName,int NumImages)
 {
-    TIMImage_t *ResultImage;
-    char *BaseName;
-    char *FinalName;
     float ImageSizeOffset;
-    int Ret;
-    int i;
-
-    ResultImage = malloc(sizeof(TIMImage_t));
+    int Position;
+    int DataSize;
     
-    if( !ResultImage ) {
-        DPrintf("TIMLoadImage:Failed to allocate memory for image\n");
-        return NULL;
-    }
-    ResultImage->Next = NULL;
-    Ret = fread(&ResultImage->Header.Magic,sizeof(ResultImage->Header.Magic),1,TIMImage);
-    if( Ret != 1 ) {
+    Position = *Offset;
+    if( Position + 8 > BufferSize ) {
         DPrintf("EOF reached.\n");
-        free(ResultImage);
-        return NULL;
+        return 0;
     }
-    if( ResultImage->Header.Magic != 0x10 ) {
-        DPrintf("Wrong signature detected (%i (%#08x)).\n",ResultImage->Header.Magic,ResultImage->Header.Magic);
-        DPrintf("Current offset in file is %li\n",ftell(TIMImage));
-        //NOTE(Adriano):Rewind the stream if the Magic number doesn't match.
-        fseek(TIMImage,-sizeof(ResultImage->Header.Magic),SEEK_CUR);
-        free(ResultImage);
-        return NULL;
+    memset(Image,0,sizeof(TIMImage_t));
+    memcpy(&Image->Header.Magic,&Buffer[Position],sizeof(Image->Header.Magic));
+    if( Image->Header.Magic != 0x10 ) {
+        DPrintf("Wrong signature detected (%i (%#08x)).\n",Image->Header.Magic,Image->Header.Magic);
+        DPrintf("Current offset in file is %i\n",Position);
+        return 0;
     }
-    DPrintf("Found image at offset %li\n",ftell(TIMImage) - sizeof(ResultImage->Header.Magic));
-    fread(&ResultImage->Header.BPP,sizeof(ResultImage->Header.BPP),1,TIMImage);
-    if( FileName ) {
-        BaseName = GetBaseName(FileName);
-        FinalName = SwitchExt(BaseName,"");
-        sprintf(ResultImage->Name,"%s-Image-%i",FinalName,NumImages);
-        free(BaseName);
-        free(FinalName);
+    DPrintf("Found image at offset %i\n",Position);
+    memcpy(&Image->Header.BPP,&Buffer[Position + 4],sizeof(Image->Header.BPP));
+    Position += 8;
+    if( BaseName ) {
+        snprintf(Image->Name,sizeof(Image->Name),"%s-Image-%i",BaseName,NumImages);
     } else {
-        sprintf(ResultImage->Name,"Image-%i",NumImages);
+        sprintf(Image->Name,"Image-%i",NumImages);
     }
-    DPrintf("-- %s --\n",ResultImage->Name);
-    DPrintf("Magic is %i\n",ResultImage->Header.Magic);
-    DPrintf("Flags are %i\n",ResultImage->Header.BPP);
+    DPrintf("-- %s --\n",Image->Name);
+    DPrintf("Magic is %i\n",Image->Header.Magic);
+    DPrintf("Flags are %i\n",Image->Header.BPP);
     ImageSizeOffset = 1;
-    switch(ResultImage->Header.BPP) {
+    switch(Image->Header.BPP) {
         case TIM_IMAGE_BPP_4:
             DPrintf("Found image with 4 BPP and CLUT!\n");
             ImageSizeOffset = 4;
@@ -584,86 +1232,101 @@ TIMImage_t *TIMLoadImage(FILE *TIMImage,const char *FileName,int NumImages)
             ImageSizeOffset = 0.5f; //Or 2/3?
             break;
         default:
-            DPrintf("Unknown BPP %i found in tim file.\n",ResultImage->Header.BPP);
-            free(ResultImage);
-            return NULL;
+            DPrintf("Unknown BPP %i found in tim file.\n",Image->Header.BPP);
+            return 0;
     }
     
-    if( ResultImage->Header.BPP == TIM_IMAGE_BPP_4_NO_CLUT || ResultImage->Header.BPP == TIM_IMAGE_BPP_8_NO_CLUT ) {
-        DPrintf("Unsupported BPP %i\n",ResultImage->Header.BPP);
-        free(ResultImage);
-        return NULL;
+    if( Image->Header.BPP == TIM_IMAGE_BPP_4_NO_CLUT || Image->Header.BPP == TIM_IMAGE_BPP_8_NO_CLUT ) {
+        DPrintf("Unsupported BPP %i\n",Image->Header.BPP);
+        return 0;
     }
     
-    if( ResultImage->Header.BPP == TIM_IMAGE_BPP_24 ) {
+    if( Image->Header.BPP == TIM_IMAGE_BPP_24 ) {
         DPrintf("Warning: BPP 24 was not tested.\n");
     }
     
-    if( ResultImage->Header.BPP == TIM_IMAGE_BPP_4 || ResultImage->Header.BPP == TIM_IMAGE_BPP_8 ) {
-        TIMGetPalette(TIMImage,ResultImage);
-    } else {
-        ResultImage->CLUT = NULL;
+    if( Image->Header.BPP == TIM_IMAGE_BPP_4 || Image->Header.BPP == TIM_IMAGE_BPP_8 ) {
+        if( Position + 12 > BufferSize ) {
+            DPrintf("TIMLoadImage:Truncated CLUT header\n");
+            return 0;
+        }
+        memcpy(&Image->Header.CLUTSize,&Buffer[Position],sizeof(Image->Header.CLUTSize));
+        memcpy(&Image->Header.CLUTOrgX,&Buffer[Position + 4],sizeof(Image->Header.CLUTOrgX));
+        memcpy(&Image->Header.CLUTOrgY,&Buffer[Position + 6],sizeof(Image->Header.CLUTOrgY));
+        memcpy(&Image->Header.NumCLUTColors,&Buffer[Position + 8],sizeof(Image->Header.NumCLUTColors));
+        memcpy(&Image->Header.NumCLUTs,&Buffer[Position + 10],sizeof(Image->Header.NumCLUTs));
+        Position += 12;
+        DPrintf("CLUTSize is %i\n",Image->Header.CLUTSize);
+        DPrintf("CLUTLocation is %ux%u\n",Image->Header.CLUTOrgX,Image->Header.CLUTOrgY);
+        DPrintf("NumCLUTColors is %u\n",Image->Header.NumCLUTColors);
+        DPrintf("NumCLUTs is %u\n",Image->Header.NumCLUTs);
+        if( Position + Image->Header.NumCLUTColors * (int) sizeof(unsigned short) > BufferSize ) {
+            DPrintf("TIMLoadImage:Truncated CLUT data\n");
+            return 0;
+        }
+        Image->CLUT = (unsigned short *) &Buffer[Position];
+        Position += Image->Header.NumCLUTColors * sizeof(unsigned short);
     }
-    fread(&ResultImage->NumPixels,sizeof(ResultImage->NumPixels),1,TIMImage);
-    fread(&ResultImage->FrameBufferX,sizeof(ResultImage->FrameBufferX),1,TIMImage);
-    fread(&ResultImage->FrameBufferY,sizeof(ResultImage->FrameBufferY),1,TIMImage);
-    fread(&ResultImage->Width,sizeof(ResultImage->Width),1,TIMImage);
-    fread(&ResultImage->Height,sizeof(ResultImage->Height),1,TIMImage);
-    ResultImage->RowCount = ResultImage->Width;
+    if( Position + 12 > BufferSize ) {
+        DPrintf("TIMLoadImage:Truncated image header\n");
+        return 0;
+    }
+    memcpy(&Image->NumPixels,&Buffer[Position],sizeof(Image->NumPixels));
+    memcpy(&Image->FrameBufferX,&Buffer[Position + 4],sizeof(Image->FrameBufferX));
+    memcpy(&Image->FrameBufferY,&Buffer[Position + 6],sizeof(Image->FrameBufferY));
+    memcpy(&Image->Width,&Buffer[Position + 8],sizeof(Image->Width));
+    memcpy(&Image->Height,&Buffer[Position + 10],sizeof(Image->Height));
+    Position += 12;
+    Image->RowCount = Image->Width;
 
 
-    ResultImage->TexturePage = (ResultImage->FrameBufferX / 64);
-    ResultImage->CLUTTexturePage = (ResultImage->Header.CLUTOrgX / 64);
+    Image->TexturePage = (Image->FrameBufferX / 64);
+    Image->CLUTTexturePage = (Image->Header.CLUTOrgX / 64);
 
-    DPrintf("FrameBuffer Coordinates %ux%u page %i\n",ResultImage->FrameBufferX,ResultImage->FrameBufferY,ResultImage->TexturePage);
-    DPrintf("Image has calculated texture page as %i\n",ResultImage->TexturePage);
+    DPrintf("FrameBuffer Coordinates %ux%u page %i\n",Image->FrameBufferX,Image->FrameBufferY,Image->TexturePage);
+    DPrintf("Image has calculated texture page as %i\n",Image->TexturePage);
     //Texture Page is Zero based.
     //Next row.
-    if( ResultImage->FrameBufferY >= 256 ) {
-        ResultImage->TexturePage += 16;
+    if( Image->FrameBufferY >= 256 ) {
+        Image->TexturePage += 16;
     }
-    if( ResultImage->Header.CLUTOrgY >= 256 ) {
-        ResultImage->CLUTTexturePage += 16;
+    if( Image->Header.CLUTOrgY >= 256 ) {
+        Image->CLUTTexturePage += 16;
     }
     //Width is stored in 16-pixels unit so we need to offset it based on the current BPP.
-    ResultImage->Width *= ImageSizeOffset;
-    DPrintf("NumPixels is %i\n",ResultImage->NumPixels);
-    DPrintf("FrameBuffer Coordinates %ux%u page %i\n",ResultImage->FrameBufferX,ResultImage->FrameBufferY,ResultImage->TexturePage);
-    DPrintf("Image is %ux%u RowCount is %u\n",ResultImage->Width,ResultImage->Height,ResultImage->RowCount);
-
-    ResultImage->Data = malloc((ResultImage->RowCount * ResultImage->Height) * sizeof(unsigned short));
-    if( !ResultImage->Data ) {
-        DPrintf("TIMLoadImage:Failed to allocate memory for image data\n");
-        free(ResultImage);
-        return NULL;
-    }
-    for( i = 0; i < ResultImage->RowCount * ResultImage->Height; i++ ) {
-        Ret = fread(&ResultImage->Data[i],sizeof(ResultImage->Data[i]),1,TIMImage);
-        assert(Ret == 1);
-    }
-    return ResultImage;
-}
+    Image->Width *= ImageSizeOffset;
+    DPrintf("NumPixels is %i\n",Image->NumPixels);
+    DPrintf("FrameBuffer Coordinates %ux%u page %i\n",Image->FrameBufferX,Image->FrameBufferY,Image->TexturePage);
+    DPrintf("Image is %ux%u RowCount is %u\n",Image->Width,Image->Height,Image->RowCount);
 
-void TIMAppendImageToList(TIMImage_t **ImageList,TIMImage_t *Image)
-{
-    TIMImage_t *LastNode;
-    if( !*ImageList ) {
-        *ImageList = Image;
-    } else {
-        LastNode = *ImageList;
-        while( LastNode->Next ) {
-            LastNode = LastNode->Next;
-        }
-        LastNode->Next = Image;
+    DataSize = Image->RowCount * Image->Height * sizeof(unsigned short);
+    if( Position + DataSize > BufferSize ) {
+        DPrintf("TIMLoadImage:Truncated image data\n");
+        return 0;
     }
+    Image->Data = (unsigned short *) &Buffer[Position];
+    *Offset = Position + DataSize;
+    return 1;
 }
+
+/*
+ * Reads the whole TAF file with a single read and parses every image in place.
+ * Images are stored inside a contiguous array,linked in file order to keep the list interface.
+ */
 TIMImage_t *TIMLoadAllImages(const char *File,int *NumImages)
 {
-    TIMImage_t *List;
+    TIMImage_t *ImageArray;
+    TIMImage_t *Temp;
     FILE *TIMFile;
+    Byte *FileData;
+    char *BaseName;
+    char *FinalName;
+    int FileSize;
+    int Offset;
+    int Capacity;
     int LocalNumImages;
-    
-    List = NULL;
+    int Ret;
+    int i;
     
     TIMFile = fopen(File,"rb");
     
@@ -671,20 +1334,56 @@ TIMImage_t *TIMLoadAllImages(const char *File,int *NumImages)
         printf("TIMLoadAllImages:Error opening file %s!\n",File);
         return NULL;
     }
-    List = NULL;
+    FileSize = GetFileLength(TIMFile);
+    FileData = FileSize > 0 ? malloc(FileSize) : NULL;
+    if( !FileData ) {
+        DPrintf("TIMLoadAllImages:Failed to allocate memory for file %s\n",File);
+        fclose(TIMFile);
+        return NULL;
+    }
+    Ret = fread(FileData,1,FileSize,TIMFile);
+    fclose(TIMFile);
+    if( Ret != FileSize ) {
+        DPrintf("TIMLoadAllImages:Failed to read file %s\n",File);
+        free(FileData);
+        return NULL;
+    }
+    BaseName = GetBaseName(File);
+    FinalName = SwitchExt(BaseName,"");
+    ImageArray = NULL;
+    Capacity = 0;
     LocalNumImages = 0;
+    Offset = 0;
     while( 1 ) {
-        TIMImage_t *Image = TIMLoadImage(TIMFile,File,LocalNumImages);
-        if( Image == NULL ) {
+        if( LocalNumImages == Capacity ) {
+            Capacity = Capacity ? Capacity * 2 : 64;
+            Temp = realloc(ImageArray,Capacity * sizeof(TIMImage_t));
+            if( !Temp ) {
+                DPrintf("TIMLoadAllImages:Failed to allocate memory for %i images\n",Capacity);
+                break;
+            }
+            ImageArray = Temp;
+        }
+        if( !TIMLoadImage(&ImageArray[LocalNumImages],FileData,FileSize,&Offset,FinalName,LocalNumImages) ) {
             break;
         }
-        TIMAppendImageToList(&List,Image);
         LocalNumImages++;
     }
+    free(BaseName);
+    free(FinalName);
     DPrintf("TIMLoadAllImages:Loaded %i images\n",LocalNumImages);
+    if( !LocalNumImages ) {
+        free(ImageArray);
+        free(FileData);
+        ImageArray = NULL;
+    } else {
+        for( i = 0; i < LocalNumImages; i++ ) {
+            ImageArray[i].Next = i + 1 < LocalNumImages ? &ImageArray[i + 1] : NULL;
+        }
+        ImageArray[0].FileData = FileData;
+    }
     if( NumImages ) {
         *NumImages = LocalNumImages;
     }
-    fclose(TIMFile);
-    return List;
+    return ImageArray;
 }
@@ -53,15 +53,22 @@ typedef struct TIMImage_s {
     unsigned int   CLUTTexturePage;
     unsigned short *CLUT;
     unsigned short /*Byte*/ *Data;
+    Byte        *FileData; // Only set on the first image of the list,owns the buffer that CLUT and Data point into.
+    bool        Interned; // Only set on the first image of the list,CLUT and Data point inside the intern table.
     struct TIMImage_s *Next;
 } TIMImage_t;
 
-TIMImage_t  *TIMLoadImage(FILE *TIMImage,const char *FileName,int NumImages);
+int         TIMLoadImage(TIMImage_t *Image,Byte *Buffer,int BufferSize,int *Offset,const char *BaseName,int NumImages);
 TIMImage_t  *TIMLoadAllImages(const char *File,int *NumImages);
-void        TIMWritePNGImage(TIMImage_t *Image,char *OutName);
+int         TIMWritePNGImage(TIMImage_t *Image,char *OutName);
 const char  *TIMGetBPPFromImage(TIMImage_t *Image);
 Byte        *TIMExpandCLUTImageData(TIMImage_t *Image);
 Byte        *TIMToOpenGL24(TIMImage_t *Image);
 Byte        *TIMToOpenGL32(TIMImage_t *Image);
 void        TIMImageListFree(TIMImage_t *ImageList);
+int         TIMInternImageList(TIMImage_t *ImageList);
+bool        TIMImageListEquals(const TIMImage_t *ImageList,const TIMImage_t *OtherImageList);
+void        TIMInit();
+const char  *TIMGetSIMDName();
+int         TIMRunConversionBenchmark(const char *File);
 #endif //__TIM_H_
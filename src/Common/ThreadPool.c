@@ -0,0 +1,203 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2018-2024 Adriano Di Dio.
+    
+    Medal-Of-Honor-PSX-File-Viewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Medal-Of-Honor-PSX-File-Viewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Medal-Of-Honor-PSX-File-Viewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/ 
+#include "ThreadPool.h"
+
+ThreadPool_t *ThreadPool = NULL;
+
+/*
+ Runs tasks from the current job until there are none left.
+ Each task index is handed out exactly once through an atomic counter so that
+ workers (and the calling thread) can steal work without holding the lock.
+ */
+void ThreadPoolRunTasks(ThreadPool_t *Pool,ThreadPoolTask_t Task,void *UserData,int NumTasks)
+{
+    int TaskIndex;
+    while( 1 ) {
+        TaskIndex = SDL_AtomicAdd(&Pool->NextTask,1);
+        if( TaskIndex >= NumTasks ) {
+            break;
+        }
+        Task(UserData,TaskIndex);
+        if( SDL_AtomicAdd(&Pool->RemainingTasks,-1) == 1 ) {
+            SDL_LockMutex(Pool->Lock);
+            SDL_CondBroadcast(Pool->WorkDone);
+            SDL_UnlockMutex(Pool->Lock);
+        }
+    }
+}
+
+int ThreadPoolWorker(void *Data)
+{
+    ThreadPool_t *Pool;
+    ThreadPoolTask_t Task;
+    void *UserData;
+    int NumTasks;
+    int LastGeneration;
+    
+    Pool = (ThreadPool_t *) Data;
+    LastGeneration = 0;
+    while( 1 ) {
+        SDL_LockMutex(Pool->Lock);
+        while( !Pool->Quit && Pool->Generation == LastGeneration ) {
+            SDL_CondWait(Pool->WorkAvailable,Pool->Lock);
+        }
+        if( Pool->Quit ) {
+            SDL_UnlockMutex(Pool->Lock);
+            break;
+        }
+        LastGeneration = Pool->Generation;
+        Task = Pool->Task;
+        UserData = Pool->UserData;
+        NumTasks = Pool->NumTasks;
+        Pool->ActiveWorkers++;
+        SDL_UnlockMutex(Pool->Lock);
+        
+        ThreadPoolRunTasks(Pool,Task,UserData,NumTasks);
+        
+        SDL_LockMutex(Pool->Lock);
+        Pool->ActiveWorkers--;
+        if( Pool->ActiveWorkers == 0 ) {
+            SDL_CondBroadcast(Pool->WorkDone);
+        }
+        SDL_UnlockMutex(Pool->Lock);
+    }
+    return 0;
+}
+
+int ThreadPoolGetNumThreads()
+{
+    if( !ThreadPool ) {
+        return 1;
+    }
+    //NOTE(Adriano):The calling thread always takes part in the job.
+    return ThreadPool->NumThreads + 1;
+}
+
+/*
+ Executes Task for every index in [0;NumTasks) and returns when all of them are completed.
+ When the pool is not available, or it is already running a job (E.G:ParallelFor called from
+ inside a task), the tasks are executed serially on the calling thread.
+ */
+void ThreadPoolParallelFor(int NumTasks,ThreadPoolTask_t Task,void *UserData)
+{
+    int i;
+    
+    if( NumTasks <= 0 || !Task ) {
+        return;
+    }
+    if( !ThreadPool || ThreadPool->NumThreads == 0 || NumTasks == 1 || !SDL_AtomicCAS(&ThreadPool->Busy,0,1) ) {
+        for( i = 0; i < NumTasks; i++ ) {
+            Task(UserData,i);
+        }
+        return;
+    }
+    SDL_LockMutex(ThreadPool->Lock);
+    //NOTE(Adriano):Wait for any late worker from the previous job before resetting the counters.
+    while( ThreadPool->ActiveWorkers > 0 ) {
+        SDL_CondWait(ThreadPool->WorkDone,ThreadPool->Lock);
+    }
+    ThreadPool->Task = Task;
+    ThreadPool->UserData = UserData;
+    ThreadPool->NumTasks = NumTasks;
+    SDL_AtomicSet(&ThreadPool->NextTask,0);
+    SDL_AtomicSet(&ThreadPool->RemainingTasks,NumTasks);
+    ThreadPool->Generation++;
+    SDL_CondBroadcast(ThreadPool->WorkAvailable);
+    SDL_UnlockMutex(ThreadPool->Lock);
+    
+    ThreadPoolRunTasks(ThreadPool,Task,UserData,NumTasks);
+    
+    SDL_LockMutex(ThreadPool->Lock);
+    while( SDL_AtomicGet(&ThreadPool->RemainingTasks) > 0 || ThreadPool->ActiveWorkers > 0 ) {
+        SDL_CondWait(ThreadPool->WorkDone,ThreadPool->Lock);
+    }
+    SDL_UnlockMutex(ThreadPool->Lock);
+    SDL_AtomicSet(&ThreadPool->Busy,0);
+}
+
+void ThreadPoolShutdown()
+{
+    int i;
+    
+    if( !ThreadPool ) {
+        return;
+    }
+    SDL_LockMutex(ThreadPool->Lock);
+    ThreadPool->Quit = 1;
+    SDL_CondBroadcast(ThreadPool->WorkAvailable);
+    SDL_UnlockMutex(ThreadPool->Lock);
+    for( i = 0; i < ThreadPool->NumThreads; i++ ) {
+        SDL_WaitThread(ThreadPool->ThreadList[i],NULL);
+    }
+    SDL_DestroyCond(ThreadPool->WorkAvailable);
+    SDL_DestroyCond(ThreadPool->WorkDone);
+    SDL_DestroyMutex(ThreadPool->Lock);
+    free(ThreadPool);
+    ThreadPool = NULL;
+}
+
+/*
+ Creates a pool with NumThreads workers.
+ If NumThreads is less or equal than zero then the number of available CPUs minus one is used,
+ since the calling thread always participates in the work.
+ */
+int ThreadPoolInit(int NumThreads)
+{
+    int i;
+    
+    if( ThreadPool ) {
+        DPrintf("ThreadPoolInit:Pool was already initialized\n");
+        return 1;
+    }
+    if( NumThreads <= 0 ) {
+        NumThreads = SDL_GetCPUCount() - 1;
+    }
+    if( NumThreads < 0 ) {
+        NumThreads = 0;
+    }
+    if( NumThreads > THREAD_POOL_MAX_THREADS ) {
+        NumThreads = THREAD_POOL_MAX_THREADS;
+    }
+    ThreadPool = malloc(sizeof(ThreadPool_t));
+    if( !ThreadPool ) {
+        DPrintf("ThreadPoolInit:Failed to allocate memory for the pool\n");
+        return 0;
+    }
+    memset(ThreadPool,0,sizeof(ThreadPool_t));
+    ThreadPool->Lock = SDL_CreateMutex();
+    ThreadPool->WorkAvailable = SDL_CreateCond();
+    ThreadPool->WorkDone = SDL_CreateCond();
+    if( !ThreadPool->Lock || !ThreadPool->WorkAvailable || !ThreadPool->WorkDone ) {
+        DPrintf("ThreadPoolInit:Failed to create synchronization primitives\n");
+        ThreadPoolShutdown();
+        return 0;
+    }
+    for( i = 0; i < NumThreads; i++ ) {
+        ThreadPool->ThreadList[i] = SDL_CreateThread(ThreadPoolWorker,"ThreadPoolWorker",ThreadPool);
+        if( !ThreadPool->ThreadList[i] ) {
+            DPrintf("ThreadPoolInit:Failed to create worker %i...continuing with %i workers\n",i,i);
+            break;
+        }
+        ThreadPool->NumThreads++;
+    }
+    DPrintf("ThreadPoolInit:Started %i workers\n",ThreadPool->NumThreads);
+    return 1;
+}
@@ -0,0 +1,49 @@
+/*
+===========================================================================
+    Copyright (C) 2018-2024 Adriano Di Dio.
+    
+    Medal-Of-Honor-PSX-File-Viewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Medal-Of-Honor-PSX-File-Viewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Medal-Of-Honor-PSX-File-Viewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/ 
+#ifndef __THREAD_POOL_H_
+#define __THREAD_POOL_H_
+
+#include "Common.h"
+
+#define THREAD_POOL_MAX_THREADS 32
+
+typedef void (*ThreadPoolTask_t)(void *UserData,int TaskIndex);
+
+typedef struct ThreadPool_s {
+    SDL_Thread          *ThreadList[THREAD_POOL_MAX_THREADS];
+    int                 NumThreads;
+    SDL_mutex           *Lock;
+    SDL_cond            *WorkAvailable;
+    SDL_cond            *WorkDone;
+    SDL_atomic_t        Busy;
+    SDL_atomic_t        NextTask;
+    SDL_atomic_t        RemainingTasks;
+    int                 ActiveWorkers;
+    int                 Generation;
+    int                 Quit;
+    ThreadPoolTask_t    Task;
+    void                *UserData;
+    int                 NumTasks;
+} ThreadPool_t;
+
+int         ThreadPoolInit(int NumThreads);
+int         ThreadPoolGetNumThreads();
+void        ThreadPoolParallelFor(int NumTasks,ThreadPoolTask_t Task,void *UserData);
+void        ThreadPoolShutdown();
+#endif//__THREAD_POOL_H_
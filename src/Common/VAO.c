@@ -115,6 +115,7 @@ VAO_t *VAOInitXYZUVRGBCLUTColorModeTexturedInteger(int *Data,int DataSize,int St
     glEnableVertexAttribArray(5);
     
     VAO->Next = NULL;
+    VAO->IBOId[0] = 0;
     VAO->CurrentSize = 0;
     VAO->Stride = Stride;
     VAO->Size = DataSize;
@@ -125,6 +126,30 @@ VAO_t *VAOInitXYZUVRGBCLUTColorModeTexturedInteger(int *Data,int DataSize,int St
     
     return VAO;
 }
+/*
+ * Same layout as VAOInitXYZUVRGBCLUTColorModeTexturedInteger with an extra integer attribute (location 6)
+ * that stores the index of the animated light that drives the vertex color.
+ */
+VAO_t *VAOInitXYZUVRGBCLUTColorModeTexturedLightIndexInteger(int *Data,int DataSize,int Stride,int VertexOffset,int TextureOffset,
+                                                             int ColorOffset,int CLUTOffset,int ColorModeOffset,int TexturedOffset,
+                                                             int LightIndexOffset,int Count)
+{
+    VAO_t *VAO;
+    
+    VAO = VAOInitXYZUVRGBCLUTColorModeTexturedInteger(Data,DataSize,Stride,VertexOffset,TextureOffset,ColorOffset,CLUTOffset,
+                                                      ColorModeOffset,TexturedOffset,Count);
+    if( !VAO ) {
+        return NULL;
+    }
+    glBindVertexArray(VAO->VAOId[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, VAO->VBOId[0]);
+    glVertexAttribIPointer(6,1,GL_INT,Stride,BUFFER_INT_OFFSET(LightIndexOffset));
+    glEnableVertexAttribArray(6);
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+    glBindVertexArray(0);
+    
+    return VAO;
+}
 VAO_t *VAOInitXYUVRGB(float *Data,int DataSize,int Stride,int VertexOffset,int TextureOffset,int ColorOffset,bool StaticDraw)
 {
     VAO_t *VAO;
@@ -362,6 +387,20 @@ VAO_t *VAOInitXYZIBO(float *Data,int DataSize,int Stride,int *Index,int IndexSiz
     
     return VAO;
 }
+/*
+ * Adds an index buffer to an existing VAO,Count becomes the number of indices to draw using glDrawElements.
+ */
+void VAOAttachIndexBuffer(VAO_t *VAO,unsigned int *Index,int IndexSize,int Count)
+{
+    glBindVertexArray(VAO->VAOId[0]);
+    glGenBuffers(1, VAO->IBOId);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, VAO->IBOId[0]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, IndexSize,Index,GL_STATIC_DRAW);
+    //NOTE(Adriano):Unbind the VAO first,otherwise the element buffer would be detached from it.
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+    VAO->Count = Count;
+}
 VAO_t *VAOInitXYZ(float *Data,int DataSize,int Stride,int VertexOffset,int Count)
 {
     VAO_t *VAO;
@@ -40,12 +40,16 @@ typedef struct VAO_s
 VAO_t *VAOInitXYZUVRGB(float *Data,int DataSize,int Stride,int VertexOffset,int TextureOffset,int ColorOffset,int Count);
 VAO_t *VAOInitXYZUVRGBCLUTColorModeTexturedInteger(int *Data,int DataSize,int Stride,int VertexOffset,int TextureOffset,int ColorOffset,int CLUTOffset,
                                            int ColorModeOffset,int TexturedOffset,int Count);
+VAO_t *VAOInitXYZUVRGBCLUTColorModeTexturedLightIndexInteger(int *Data,int DataSize,int Stride,int VertexOffset,int TextureOffset,
+                                                             int ColorOffset,int CLUTOffset,int ColorModeOffset,int TexturedOffset,
+                                                             int LightIndexOffset,int Count);
 VAO_t *VAOInitXYZUV(float *Data,int DataSize,int Stride,int VertexOffset,int TextureOffset,int Count);
 VAO_t *VAOInitXYZRGB(float *Data,int DataSize,int Stride,int VertexOffset,int ColorOffset,int DynamicDraw);
 VAO_t *VAOInitXYZ(float *Data,int DataSize,int Stride,int VertexOffset,int Count);
 // 3D Indexed
 VAO_t *VAOInitXYZRGBIBO(float *Data,int DataSize,int Stride,unsigned short *Index,int IndexSize,int VertexOffset,int ColorOffset);
 VAO_t *VAOInitXYZIBO(float *Data,int DataSize,int Stride,int *Index,int IndexSize,int Count);
+void VAOAttachIndexBuffer(VAO_t *VAO,unsigned int *Index,int IndexSize,int Count);
 // 2D
 VAO_t *VAOInitXYUVRGB(float *Data,int DataSize,int Stride,int VertexOffset,int TextureOffset,int ColorOffset,bool StaticDraw);
 VAO_t *VAOInitXYUV(float *Data,int DataSize,int Stride,int VertexOffset,int TextureOffset,bool StaticDraw);
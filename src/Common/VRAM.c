@@ -20,76 +20,205 @@
 */ 
 
 #include "VRAM.h"
+#include "ThreadPool.h"
+#include "PNGWriter.h"
+
+#define VRAM_UPLOAD_BAND_HEIGHT 64
+
+typedef enum {
+    VRAM_UPLOAD_INDEX_PAGE,
+    VRAM_UPLOAD_PALETTE_PAGE,
+    VRAM_UPLOAD_NATIVE_PAGE,
+    VRAM_UPLOAD_NUM_PAGES
+} VRAMUploadPage_t;
+
+typedef struct VRAMUploadRect_s {
+    TIMImage_t  *Image;
+    int         Page;
+    const Byte  *Source;
+    Byte        *ExpandedData;
+    int         SourcePitch;
+    SDL_Rect    Rect;
+} VRAMUploadRect_t;
+
+typedef struct VRAMUploadContext_s {
+    VRAMUploadRect_t    *RectList;
+    int                 NumRects;
+    Byte                *PageData[VRAM_UPLOAD_NUM_PAGES];
+    int                 PixelSize[VRAM_UPLOAD_NUM_PAGES];
+    int                 Width[VRAM_UPLOAD_NUM_PAGES];
+    int                 Height[VRAM_UPLOAD_NUM_PAGES];
+    int                 MaxHeight;
+} VRAMUploadContext_t;
+
+typedef struct VRAMAtlasContext_s {
+    VRAMAtlas_t         *Atlas;
+    VRAMUploadContext_t *Staging;
+    Byte                *Data;
+    int                 Width;
+} VRAMAtlasContext_t;
+
+static VRAMAtlasStats_t VRAMAtlasStats;
 
 void VRAMFree(VRAM_t *VRAM)
 {
-    glDeleteTextures(1,&VRAM->Page.TextureId);
+    if( VRAM->Atlas ) {
+        glDeleteTextures(1,&VRAM->Atlas->Page.TextureId);
+        free(VRAM->Atlas->KeyList);
+        free(VRAM->Atlas);
+    }
+    glDeleteTextures(1,&VRAM->NativePage.TextureId);
     glDeleteTextures(1,&VRAM->TextureIndexPage.TextureId);
     glDeleteTextures(1,&VRAM->PalettePage.TextureId);
 
     SDL_FreeSurface(VRAM->Page.Surface);
     free(VRAM);
 }
-void VRAMWritePNG(SDL_Surface *ImageSurface,const char *OutName)
+int VRAMWritePNG(SDL_Surface *ImageSurface,const char *OutName)
 {
-    FILE *PNGImage;
-    png_structp PNGPtr;
-    png_infop PNGInfoPtr;
-    Byte **RowPointer;
-    int y;
-
     if( ImageSurface == NULL ) {
         printf("Couldn't dump %s\n",OutName);
-        return;
+        return 0;
     }
+    return PNGWriterSave(OutName,ImageSurface->pixels,ImageSurface->w,ImageSurface->h,ImageSurface->pitch,4,NULL);
+}
+/*
+ * Copies the RGBA data of the image inside the page surface.
+ * Transparent pixels are skipped to match the alpha blending done by SDL when images were blitted.
+ */
+void VRAMPutTexture(VRAM_t *VRAM,TIMImage_t *Image)
+{
+    SDL_Surface *Surface;
+    Byte *Data;
+    Byte *Src;
+    Byte *Dest;
+    int DestX;
+    int DestY;
+    int Width;
+    int Height;
+    int x;
+    int y;
     
-    PNGImage = fopen(OutName,"wb");
-    
-    if( PNGImage == NULL ) {
-        printf("Error creating image %s!\n",OutName);
+    Surface = VRAM->Page.Surface;
+    VRAMGetTIMImageCoordinates(Image,&DestX,&DestY);
+    DestX += VRAMGetTexturePageX(Image->TexturePage);
+    DestY += VRAMGetTexturePageY(Image->TexturePage,Image->Header.BPP);
+    if( DestX < 0 || DestY < 0 || DestX >= Surface->w || DestY >= Surface->h ) {
         return;
     }
-    
-    
-    PNGPtr = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (PNGPtr == NULL) {
-        printf("PNG: Couldn't create write struct!\n");
-        free(PNGImage);
+    Width = DestX + Image->Width > Surface->w ? Surface->w - DestX : Image->Width;
+    Height = DestY + Image->Height > Surface->h ? Surface->h - DestY : Image->Height;
+    Data = TIMToOpenGL32(Image);
+    if( !Data ) {
+        DPrintf("VRAMPutTexture:Failed to convert image %s\n",Image->Name);
         return;
     }
+    for( y = 0; y < Height; y++ ) {
+        Src = &Data[y * Image->Width * 4];
+        Dest = (Byte *) Surface->pixels + (DestY + y) * Surface->pitch + DestX * 4;
+        for( x = 0; x < Width; x++ ) {
+            if( Src[x * 4 + 3] != 0 ) {
+                memcpy(&Dest[x * 4],&Src[x * 4],4);
+            }
+        }
+    }
+    free(Data);
+}
+/*
+ * Returns the RGBA version of the VRAM,building it from the image list the first time.
+ * The renderer only uses the index and palette pages so this is only needed when exporting.
+ */
+SDL_Surface *VRAMGetPageSurface(VRAM_t *VRAM)
+{
+    TIMImage_t *Iterator;
     
-    PNGInfoPtr = png_create_info_struct (PNGPtr);
-    if (PNGInfoPtr == NULL) {
-        printf("PNG: Couldn't create info struct!\n");
-        png_destroy_write_struct (&PNGPtr, NULL);
-        free(PNGImage);
-        return;
+    if( !VRAM ) {
+        return NULL;
     }
-
-    png_set_IHDR (PNGPtr,
-                  PNGInfoPtr,
-                  ImageSurface->w,
-                  ImageSurface->h,
-                  8, // Depth
-                  PNG_COLOR_TYPE_RGBA,
-                  PNG_INTERLACE_NONE,
-                  PNG_COMPRESSION_TYPE_DEFAULT,
-                  PNG_FILTER_TYPE_DEFAULT);
+    if( VRAM->Page.Surface ) {
+        return VRAM->Page.Surface;
+    }
+    VRAM->Page.Surface = SDL_CreateRGBSurface(0,VRAM->Page.Width,VRAM->Page.Height,32,
+                                              0x000000FF,0x0000FF00,0x00FF0000, 0xFF000000);
+    if( !VRAM->Page.Surface ) {
+        DPrintf("VRAMGetPageSurface:Failed to create the surface (%s)\n",SDL_GetError());
+        return NULL;
+    }
+    for( Iterator = VRAM->ImageList; Iterator; Iterator = Iterator->Next ) {
+        VRAMPutTexture(VRAM,Iterator);
+    }
+    return VRAM->Page.Surface;
+}
+int VRAMSave(VRAM_t *VRAM,const char *File)
+{
+    return VRAMWritePNG(VRAMGetPageSurface(VRAM),File);
+}
+/*
+ * Saves the RGBA page built from the image list without creating any texture,this can be used by tools that
+ * do not have a GL context.
+ * Returns 1 on success,0 otherwise.
+ */
+int VRAMSaveImageList(TIMImage_t *ImageList,const char *File)
+{
+    VRAM_t VRAM;
+    int Result;
     
-    png_init_io (PNGPtr, PNGImage);
-    RowPointer = png_malloc  (PNGPtr, ImageSurface->h * sizeof (Byte *));
-    for (y = 0; y < ImageSurface->h; y++) {
-        RowPointer[y] = ImageSurface->pixels + y * ImageSurface->pitch;
+    memset(&VRAM,0,sizeof(VRAM_t));
+    VRAM.ImageList = ImageList;
+    VRAM.Page.Width = 4096.f;
+    VRAM.Page.Height = 1024.f;
+    Result = VRAMSave(&VRAM,File);
+    if( VRAM.Page.Surface ) {
+        SDL_FreeSurface(VRAM.Page.Surface);
     }
-    png_set_rows (PNGPtr, PNGInfoPtr, RowPointer);
-    png_write_png (PNGPtr, PNGInfoPtr, PNG_TRANSFORM_IDENTITY, NULL);
-    png_free (PNGPtr, RowPointer);
-    png_destroy_write_struct(&PNGPtr,&PNGInfoPtr);
-    fclose(PNGImage);
+    return Result;
 }
-void VRAMSave(VRAM_t *VRAM,const char *File)
+/*
+ * Saves only the given texture pages,placed side by side inside an image that is NumColumns pages wide.
+ */
+void VRAMSaveTiles(VRAM_t *VRAM,const char *File,const int *TileList,int NumTiles,int NumColumns)
 {
-    VRAMWritePNG(VRAM->Page.Surface,File);
+    SDL_Surface *Surface;
+    SDL_Surface *Source;
+    Byte *Src;
+    Byte *Dest;
+    int NumRows;
+    int SrcX;
+    int SrcY;
+    int DestX;
+    int DestY;
+    int i;
+    int y;
+    
+    if( !VRAM || !TileList || NumTiles <= 0 || NumColumns <= 0 ) {
+        DPrintf("VRAMSaveTiles:Invalid data\n");
+        return;
+    }
+    Source = VRAMGetPageSurface(VRAM);
+    if( !Source ) {
+        DPrintf("VRAMSaveTiles:Failed to build the VRAM page\n");
+        return;
+    }
+    NumRows = (NumTiles + NumColumns - 1) / NumColumns;
+    Surface = SDL_CreateRGBSurface(0,NumColumns * VRAM_TILE_SIZE,NumRows * VRAM_TILE_SIZE,32,
+                                   0x000000FF,0x0000FF00,0x00FF0000, 0xFF000000);
+    if( !Surface ) {
+        DPrintf("VRAMSaveTiles:Failed to create the surface for %i tiles\n",NumTiles);
+        return;
+    }
+    for( i = 0; i < NumTiles; i++ ) {
+        SrcX = (TileList[i] % VRAM_NUM_TILES_X) * VRAM_TILE_SIZE;
+        SrcY = (TileList[i] / VRAM_NUM_TILES_X) * VRAM_TILE_SIZE;
+        DestX = (i % NumColumns) * VRAM_TILE_SIZE;
+        DestY = (i / NumColumns) * VRAM_TILE_SIZE;
+        for( y = 0; y < VRAM_TILE_SIZE; y++ ) {
+            Src = (Byte *) Source->pixels + (SrcY + y) * Source->pitch + SrcX * 4;
+            Dest = (Byte *) Surface->pixels + (DestY + y) * Surface->pitch + DestX * 4;
+            memcpy(Dest,Src,VRAM_TILE_SIZE * 4);
+        }
+    }
+    VRAMWritePNG(Surface,File);
+    SDL_FreeSurface(Surface);
 }
 void VRAMDump(VRAM_t *VRAM)
 {
@@ -137,6 +266,15 @@ int VRAMGetTexturePageY(int VRAMPage,int ColorMode)
     return PageY;
 }
 
+/*
+ * Returns the index of the 256x256 tile that contains the given texture page inside the expanded VRAM.
+ */
+int VRAMGetTile(int VRAMPage,int ColorMode)
+{
+    return (VRAMGetTexturePageY(VRAMPage,ColorMode) / VRAM_TILE_SIZE) * VRAM_NUM_TILES_X +
+            VRAMGetTexturePageX(VRAMPage) / VRAM_TILE_SIZE;
+}
+
 int VRAMGetCLUTPage(int CLUTPosX,int CLUTPosY)
 {
     int CLUTPage;
@@ -194,171 +332,664 @@ void VRAMGetTIMImageCoordinates(TIMImage_t *Image,int *ImageX,int *ImageY)
         *ImageY = DestY;
     }
 }
-void VRAMPutTexture(VRAM_t *VRAM,TIMImage_t *Image)
+/*
+ * Adds a rectangle that will be copied inside the given page,rectangles are clipped against the page
+ * when they are copied.
+ */
+static void VRAMAddUploadRect(VRAMUploadContext_t *Context,TIMImage_t *Image,int Page,const void *Source,int SourcePitch,
+                              int DestX,int DestY,int Width,int Height)
 {
-    int VRAMPage;
-    SDL_Surface *Src;
-    SDL_Rect SrcRect;
-    int DestX;
-    int DestY;
-    float ColorOffsetMultiplier;
+    VRAMUploadRect_t *Rect;
     
-    VRAMPage = Image->TexturePage;
-    VRAMGetTIMImageCoordinates(Image,&DestX,&DestY);
-    SrcRect.x = VRAMGetTexturePageX(VRAMPage) + DestX;
-    SrcRect.y = VRAMGetTexturePageY(VRAMPage,Image->Header.BPP) + DestY;
-    SrcRect.w = Image->Width;
-    SrcRect.h = Image->Height;
-    Byte *Data = TIMToOpenGL32(Image);
-    Src = SDL_CreateRGBSurfaceFrom(Data,Image->Width,Image->Height,32,4 * Image->Width,0x000000FF,0x0000FF00,0x00FF0000, 0xFF000000);
-    SDL_BlitScaled(Src,NULL,VRAM->Page.Surface,&SrcRect);
-    SDL_FreeSurface(Src);
-    free(Data);
+    if( Width <= 0 || Height <= 0 || DestX + Width <= 0 || DestY + Height <= 0 ||
+        DestX >= Context->Width[Page] || DestY >= Context->Height[Page] ) {
+        return;
+    }
+    Rect = &Context->RectList[Context->NumRects++];
+    Rect->Image = Image;
+    Rect->Page = Page;
+    Rect->Source = Source;
+    Rect->ExpandedData = NULL;
+    Rect->SourcePitch = SourcePitch;
+    Rect->Rect.x = DestX;
+    Rect->Rect.y = DestY;
+    Rect->Rect.w = Width;
+    Rect->Rect.h = Height;
 }
-void VRAMPutRawTexture(VRAM_t *VRAM,TIMImage_t *Image)
+
+/*
+ * Collects every region that needs to be written inside the native page in list order.
+ * Image words and CLUTs are stored as they are at their position inside the PSX VRAM.
+ */
+static void VRAMBuildNativeUploadList(VRAMUploadContext_t *Context,TIMImage_t *ImageList)
 {
-    int VRAMPage;
-    SDL_Rect SrcRect;
-    int DestX;
-    int DestY;
-    float ColorOffsetMultiplier;
-    Byte *ImageData;
+    TIMImage_t *Iterator;
+    int NumCLUTs;
     
-    VRAMPage = Image->TexturePage;
-    VRAMGetTIMImageCoordinates(Image,&DestX,&DestY);
-    SrcRect.x = VRAMGetTexturePageX(VRAMPage) + DestX;
-    SrcRect.y = VRAMGetTexturePageY(VRAMPage,Image->Header.BPP) + DestY;
-    SrcRect.w = Image->Width;
-    SrcRect.h = Image->Height;    
-
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    ImageData = TIMExpandCLUTImageData(Image);
-    if( ImageData == NULL ) {
-        DPrintf("VRAMPutRAWTexture:Failed to expand image %s\n",Image->Name);
-        return;
+    for( Iterator = ImageList; Iterator; Iterator = Iterator->Next ) {
+        assert(Iterator->Header.BPP != TIM_IMAGE_BPP_24);
+        VRAMAddUploadRect(Context,Iterator,VRAM_UPLOAD_NATIVE_PAGE,Iterator->Data,Iterator->RowCount,Iterator->FrameBufferX,
+                          Iterator->FrameBufferY,Iterator->RowCount,Iterator->Height);
+        if( Iterator->Header.BPP == TIM_IMAGE_BPP_16 || Iterator->Header.NumCLUTColors == 0 ) {
+            continue;
+        }
+        //NOTE(Adriano):Only the first CLUT is stored inside TAF files (see TIMLoadImage).
+        NumCLUTs = Iterator->Header.NumCLUTs > 1 ? 1 : Iterator->Header.NumCLUTs;
+        VRAMAddUploadRect(Context,Iterator,VRAM_UPLOAD_NATIVE_PAGE,Iterator->CLUT,Iterator->Header.NumCLUTColors,
+                          Iterator->Header.CLUTOrgX,Iterator->Header.CLUTOrgY,Iterator->Header.NumCLUTColors,NumCLUTs);
     }
-    glBindTexture(GL_TEXTURE_2D,VRAM->TextureIndexPage.TextureId);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, SrcRect.x, SrcRect.y, SrcRect.w, SrcRect.h, GL_RED_INTEGER, GL_UNSIGNED_BYTE, ImageData);
-    glBindTexture(GL_TEXTURE_2D,0);
-    free(ImageData);
 }
-void VRAMPutCLUT(VRAM_t *VRAM,TIMImage_t *Image)
+
+/*
+ * Collects every region that needs to be written inside the index and palette page in list order.
+ */
+static void VRAMBuildUploadList(VRAMUploadContext_t *Context,TIMImage_t *ImageList)
 {
-    SDL_Rect SrcRect;
+    TIMImage_t *Iterator;
     int DestX;
     int DestY;
+    int CLUTWidth;
+    int NumCLUTs;
+    
+    for( Iterator = ImageList; Iterator; Iterator = Iterator->Next ) {
+        //NOTE(Adriano):This guard is used in case there are 24-bits textures that requires loading.
+        //At the moment only 16-BPP are used in MOH:MSN7LVL2.
+        assert(Iterator->Header.BPP != TIM_IMAGE_BPP_24);
+        VRAMGetTIMImageCoordinates(Iterator,&DestX,&DestY);
+        DestX += VRAMGetTexturePageX(Iterator->TexturePage);
+        DestY += VRAMGetTexturePageY(Iterator->TexturePage,Iterator->Header.BPP);
+        if( Iterator->Header.BPP == TIM_IMAGE_BPP_16 ) {
+            //NOTE(Adriano):Direct color images are stored inside the palette page.
+            VRAMAddUploadRect(Context,Iterator,VRAM_UPLOAD_PALETTE_PAGE,Iterator->Data,Iterator->Width,DestX,DestY,
+                              Iterator->Width,Iterator->Height);
+            continue;
+        }
+        VRAMAddUploadRect(Context,Iterator,VRAM_UPLOAD_INDEX_PAGE,NULL,Iterator->Width,DestX,DestY,
+                          Iterator->Width,Iterator->Height);
+        CLUTWidth = Iterator->Header.NumCLUTColors;
+        if( Iterator->Header.BPP == TIM_IMAGE_BPP_4 ) {
+            if( CLUTWidth > 16 ) {
+                CLUTWidth = 16;
+            }
+        } else {
+            if( CLUTWidth > 256 ) {
+                CLUTWidth = 256;
+            }
+        }
+        if( CLUTWidth <= 0 ) {
+            continue;
+        }
+        //NOTE(Adriano):Never read past the CLUT colors stored inside the file.
+        NumCLUTs = Iterator->Header.NumCLUTs;
+        if( NumCLUTs > Iterator->Header.NumCLUTColors / CLUTWidth ) {
+            NumCLUTs = Iterator->Header.NumCLUTColors / CLUTWidth;
+        }
+        DestX = VRAMGetCLUTPositionX(Iterator->Header.CLUTOrgX,Iterator->Header.CLUTOrgY,Iterator->CLUTTexturePage);
+        DestX += VRAMGetTexturePageX(Iterator->CLUTTexturePage);
+        DestY = Iterator->Header.CLUTOrgY + VRAMGetCLUTOffsetY(Iterator->Header.BPP);
+        VRAMAddUploadRect(Context,Iterator,VRAM_UPLOAD_PALETTE_PAGE,Iterator->CLUT,CLUTWidth,DestX,DestY,CLUTWidth,NumCLUTs);
+    }
+}
 
-    //TODO:Special case decide whether we want to blit image into CLUT or
-    //     create a new storage for direct textures to be bind and passed to shaders.
-    //     Either way we need to pass ColorMode to shader in order to fetch the correct data!
-    //     (NOTE):An example of 16-bit texture can be found in MOH:Mission 7 Level 2!
-    if( Image->Header.BPP == TIM_IMAGE_BPP_16 ) {
+static void VRAMExpandUploadRect(void *UserData,int TaskIndex)
+{
+    VRAMUploadContext_t *Context;
+    VRAMUploadRect_t *Rect;
+    
+    Context = (VRAMUploadContext_t *) UserData;
+    Rect = &Context->RectList[TaskIndex];
+    if( Rect->Source ) {
         return;
     }
+    Rect->ExpandedData = TIMExpandCLUTImageData(Rect->Image);
+    Rect->Source = Rect->ExpandedData;
+}
 
-    DestX = VRAMGetCLUTPositionX(Image->Header.CLUTOrgX,Image->Header.CLUTOrgY,Image->CLUTTexturePage);
-    DestY = Image->Header.CLUTOrgY + VRAMGetCLUTOffsetY(Image->Header.BPP);
-    DestX += VRAMGetTexturePageX(Image->CLUTTexturePage);
-
-    SrcRect.x = DestX;
-    SrcRect.y = DestY;
-    SrcRect.w = Image->Header.NumCLUTColors;
-    SrcRect.h = Image->Header.NumCLUTs;
-    if( Image->Header.BPP == TIM_IMAGE_BPP_4 ) {
-        if( SrcRect.w > 16 ) {
-            SrcRect.w = 16;
+/*
+ * Copies the part of every rectangle that falls inside the band,since rectangles are walked in list order
+ * overlapping images are resolved as if they were uploaded one by one.
+ */
+static void VRAMCopyUploadBand(void *UserData,int TaskIndex)
+{
+    VRAMUploadContext_t *Context;
+    VRAMUploadRect_t *Rect;
+    const Byte *Source;
+    Byte *Dest;
+    int BandStart;
+    int BandEnd;
+    int StartX;
+    int EndX;
+    int StartY;
+    int EndY;
+    int PixelSize;
+    int y;
+    int i;
+    
+    Context = (VRAMUploadContext_t *) UserData;
+    BandStart = TaskIndex * VRAM_UPLOAD_BAND_HEIGHT;
+    BandEnd = BandStart + VRAM_UPLOAD_BAND_HEIGHT;
+    for( i = 0; i < Context->NumRects; i++ ) {
+        Rect = &Context->RectList[i];
+        if( !Rect->Source ) {
+            continue;
         }
-    } else {
-        if( SrcRect.w > 256 ) {
-            SrcRect.w = 256;
+        StartX = MAX(Rect->Rect.x,0);
+        EndX = MIN(Rect->Rect.x + Rect->Rect.w,Context->Width[Rect->Page]);
+        StartY = MAX(Rect->Rect.y,BandStart);
+        EndY = MIN(Rect->Rect.y + Rect->Rect.h,MIN(BandEnd,Context->Height[Rect->Page]));
+        PixelSize = Context->PixelSize[Rect->Page];
+        for( y = StartY; y < EndY; y++ ) {
+            Source = Rect->Source + ((y - Rect->Rect.y) * Rect->SourcePitch + StartX - Rect->Rect.x) * PixelSize;
+            Dest = Context->PageData[Rect->Page] + (y * Context->Width[Rect->Page] + StartX) * PixelSize;
+            memcpy(Dest,Source,(EndX - StartX) * PixelSize);
         }
     }
-    glBindTexture(GL_TEXTURE_2D,VRAM->PalettePage.TextureId);
-    glTexSubImage2D(GL_TEXTURE_2D,0, SrcRect.x, SrcRect.y, SrcRect.w, SrcRect.h, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV, Image->CLUT);
-    glBindTexture(GL_TEXTURE_2D,0);
 }
 
-void VRAMPutDirectModeIntoCLUT(VRAM_t *VRAM,TIMImage_t *Image)
+/*
+ * Uploads the smallest rectangle that contains every region written to the page with a single call.
+ */
+static void VRAMUploadPage(VRAMUploadContext_t *Context,int Page,VRAMPage_t *VRAMPage,GLenum Format,GLenum Type)
 {
-    int VRAMPage;
-    SDL_Rect SrcRect;
-    int DestX;
-    int DestY;
-    
-    VRAMPage = Image->TexturePage;
+    VRAMUploadRect_t *Rect;
+    int MinX;
+    int MinY;
+    int MaxX;
+    int MaxY;
+    int i;
     
-    //NOTE:Guarding against 24-bpp images which are not tested yet.
-    assert(Image->Header.BPP == TIM_IMAGE_BPP_16);
-    VRAMGetTIMImageCoordinates(Image,&DestX,&DestY);
-    SrcRect.x = VRAMGetTexturePageX(VRAMPage) + DestX;
-    SrcRect.y = VRAMGetTexturePageY(VRAMPage,Image->Header.BPP) + DestY;
-    SrcRect.w = Image->Width;
-    SrcRect.h = Image->Height;
-    glBindTexture(GL_TEXTURE_2D,VRAM->PalettePage.TextureId);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, SrcRect.x, SrcRect.y, SrcRect.w, SrcRect.h, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV, 
-                        Image->Data);
+    MinX = Context->Width[Page];
+    MinY = Context->Height[Page];
+    MaxX = 0;
+    MaxY = 0;
+    for( i = 0; i < Context->NumRects; i++ ) {
+        Rect = &Context->RectList[i];
+        if( Rect->Page != Page || !Rect->Source ) {
+            continue;
+        }
+        MinX = MIN(MinX,MAX(Rect->Rect.x,0));
+        MinY = MIN(MinY,MAX(Rect->Rect.y,0));
+        MaxX = MAX(MaxX,MIN(Rect->Rect.x + Rect->Rect.w,Context->Width[Page]));
+        MaxY = MAX(MaxY,MIN(Rect->Rect.y + Rect->Rect.h,Context->Height[Page]));
+    }
+    if( MinX >= MaxX || MinY >= MaxY ) {
+        return;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH,Context->Width[Page]);
+    glBindTexture(GL_TEXTURE_2D,VRAMPage->TextureId);
+    glTexSubImage2D(GL_TEXTURE_2D,0,MinX,MinY,MaxX - MinX,MaxY - MinY,Format,Type,
+                    Context->PageData[Page] + (MinY * Context->Width[Page] + MinX) * Context->PixelSize[Page]);
     glBindTexture(GL_TEXTURE_2D,0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH,0);
 }
 
-VRAM_t *VRAMInit(TIMImage_t *ImageList)
+/*
+ * Builds the index and palette page (or the native page) inside system memory,regions are copied in list order.
+ */
+static int VRAMBuildStagingPages(VRAMUploadContext_t *Context,VRAM_t *VRAM,TIMImage_t *ImageList,bool NativeLayout)
 {
-    VRAM_t *VRAM;
     TIMImage_t *Iterator;
+    int NumImages;
+    int i;
     
-    VRAM = malloc(sizeof(VRAM_t));
+    memset(Context,0,sizeof(VRAMUploadContext_t));
+    Context->Width[VRAM_UPLOAD_INDEX_PAGE] = VRAM->Page.Width;
+    Context->Height[VRAM_UPLOAD_INDEX_PAGE] = VRAM->Page.Height;
+    Context->PixelSize[VRAM_UPLOAD_INDEX_PAGE] = sizeof(Byte);
+    Context->Width[VRAM_UPLOAD_PALETTE_PAGE] = VRAM->Page.Width;
+    Context->Height[VRAM_UPLOAD_PALETTE_PAGE] = VRAM->Page.Height;
+    Context->PixelSize[VRAM_UPLOAD_PALETTE_PAGE] = sizeof(unsigned short);
+    Context->Width[VRAM_UPLOAD_NATIVE_PAGE] = VRAM_NATIVE_WIDTH;
+    Context->Height[VRAM_UPLOAD_NATIVE_PAGE] = VRAM_NATIVE_HEIGHT;
+    Context->PixelSize[VRAM_UPLOAD_NATIVE_PAGE] = sizeof(unsigned short);
+    NumImages = 0;
+    for( Iterator = ImageList; Iterator; Iterator = Iterator->Next ) {
+        NumImages++;
+    }
+    if( !NumImages ) {
+        return 0;
+    }
+    Context->RectList = malloc(NumImages * 2 * sizeof(VRAMUploadRect_t));
+    if( !Context->RectList ) {
+        DPrintf("VRAMBuildStagingPages:Failed to allocate memory for %i images\n",NumImages);
+        return 0;
+    }
+    for( i = 0; i < VRAM_UPLOAD_NUM_PAGES; i++ ) {
+        if( (i == VRAM_UPLOAD_NATIVE_PAGE) != NativeLayout ) {
+            continue;
+        }
+        Context->PageData[i] = calloc(Context->Width[i] * Context->Height[i],Context->PixelSize[i]);
+        if( !Context->PageData[i] ) {
+            DPrintf("VRAMBuildStagingPages:Failed to allocate memory for the staging pages\n");
+            return 0;
+        }
+        Context->MaxHeight = MAX(Context->MaxHeight,Context->Height[i]);
+    }
+    if( NativeLayout ) {
+        //NOTE(Adriano):Image data is stored as it is so there is nothing to expand.
+        VRAMBuildNativeUploadList(Context,ImageList);
+    } else {
+        VRAMBuildUploadList(Context,ImageList);
+        ThreadPoolParallelFor(Context->NumRects,VRAMExpandUploadRect,Context);
+    }
+    ThreadPoolParallelFor((Context->MaxHeight + VRAM_UPLOAD_BAND_HEIGHT - 1) / VRAM_UPLOAD_BAND_HEIGHT,VRAMCopyUploadBand,Context);
+    return 1;
+}
+
+static void VRAMFreeStagingPages(VRAMUploadContext_t *Context)
+{
+    int i;
     
-    if( !VRAM ) {
-        DPrintf("VRAMInit:Failed to allocate memory for struct\n");
-        return NULL;
+    if( Context->RectList ) {
+        for( i = 0; i < Context->NumRects; i++ ) {
+            if( Context->RectList[i].ExpandedData ) {
+                free(Context->RectList[i].ExpandedData);
+            }
+        }
+        free(Context->RectList);
+    }
+    for( i = 0; i < VRAM_UPLOAD_NUM_PAGES; i++ ) {
+        free(Context->PageData[i]);
     }
+}
 
-    VRAM->Page.Width = 4096.f;
-    VRAM->Page.Height = 1024.f;
+/*
+ * Uploads each one of the staging pages with a single call instead of updating the textures once per image.
+ */
+static void VRAMUploadImageList(VRAM_t *VRAM,TIMImage_t *ImageList)
+{
+    VRAMUploadContext_t Context;
+    double StartTime;
     
-    VRAM->Page.Surface = SDL_CreateRGBSurface(0,VRAM->Page.Width,VRAM->Page.Height,32, 0x000000FF,0x0000FF00,0x00FF0000, 0xFF000000);
+    StartTime = SysPreciseMilliseconds();
+    if( !VRAMBuildStagingPages(&Context,VRAM,ImageList,VRAM->NativeLayout) ) {
+        VRAMFreeStagingPages(&Context);
+        return;
+    }
+    if( VRAM->NativeLayout ) {
+        VRAMUploadPage(&Context,VRAM_UPLOAD_NATIVE_PAGE,&VRAM->NativePage,GL_RED_INTEGER,GL_UNSIGNED_SHORT);
+    } else {
+        VRAMUploadPage(&Context,VRAM_UPLOAD_INDEX_PAGE,&VRAM->TextureIndexPage,GL_RED_INTEGER,GL_UNSIGNED_BYTE);
+        VRAMUploadPage(&Context,VRAM_UPLOAD_PALETTE_PAGE,&VRAM->PalettePage,GL_RGBA,GL_UNSIGNED_SHORT_1_5_5_5_REV);
+    }
+    DPrintf("VRAMUploadImageList:Uploaded %i regions in %f ms\n",Context.NumRects,SysPreciseMilliseconds() - StartTime);
+    VRAMFreeStagingPages(&Context);
+}
 
-    glGenTextures(1,&VRAM->PalettePage.TextureId);
-    glBindTexture(GL_TEXTURE_2D,VRAM->PalettePage.TextureId);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+static void VRAMCreatePage(VRAMPage_t *Page,int Width,int Height,GLenum InternalFormat,GLint Filter)
+{
+    Page->Width = Width;
+    Page->Height = Height;
+    Page->Surface = NULL;
+    Page->Data = NULL;
+    glGenTextures(1,&Page->TextureId);
+    glBindTexture(GL_TEXTURE_2D,Page->TextureId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, Filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, Filter);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
-    glTexStorage2D(GL_TEXTURE_2D,1,GL_RGB5_A1,VRAM->Page.Width, VRAM->Page.Height);
+    glTexStorage2D(GL_TEXTURE_2D,1,InternalFormat,Width,Height);
     glBindTexture(GL_TEXTURE_2D,0);
+}
 
-    glGenTextures(1,&VRAM->TextureIndexPage.TextureId);
-    glBindTexture(GL_TEXTURE_2D,VRAM->TextureIndexPage.TextureId);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
-    glTexStorage2D(GL_TEXTURE_2D,1,GL_R8UI,VRAM->Page.Width, VRAM->Page.Height);
-    glBindTexture(GL_TEXTURE_2D,0);
+//NOTE(Adriano):16-bpp faces do not use a CLUT so they share the same tile regardless of their CBA.
+static unsigned int VRAMAtlasGetKey(int VRAMPage,int ColorMode,int CBA)
+{
+    if( ColorMode == 2 ) {
+        CBA = 0;
+    }
+    return ((ColorMode & 0x3) << 20) | ((VRAMPage & 0x1F) << 15) | (CBA & 0x7FFF);
+}
 
+static int VRAMAtlasCompareKey(const void *a,const void *b)
+{
+    unsigned int KeyA;
+    unsigned int KeyB;
+    
+    KeyA = *(const unsigned int *) a;
+    KeyB = *(const unsigned int *) b;
+    return (KeyA > KeyB) - (KeyA < KeyB);
+}
 
-    for( Iterator = ImageList; Iterator; Iterator = Iterator->Next ) {
-        //NOTE(Adriano):This guard is used in case there are 24-bits textures that requires loading.
-        //At the moment only 16-BPP are used in MOH:MSN7LVL2.
-        assert(Iterator->Header.BPP != TIM_IMAGE_BPP_24);
-        VRAMPutTexture(VRAM,Iterator);
-        if( Iterator->Header.BPP == TIM_IMAGE_BPP_16 ) {
-            VRAMPutDirectModeIntoCLUT(VRAM,Iterator);
-        } else {
-            VRAMPutRawTexture(VRAM,Iterator);
-            VRAMPutCLUT(VRAM,Iterator);
+/*
+ * Registers a texture page and CLUT pair used by a face,it must be called for every textured face before
+ * building the atlas.
+ */
+void VRAMAtlasAddTexture(VRAM_t *VRAM,int VRAMPage,int ColorMode,int CBA)
+{
+    VRAMAtlas_t *Atlas;
+    unsigned int *KeyList;
+    
+    if( !VRAM->Atlas ) {
+        VRAM->Atlas = malloc(sizeof(VRAMAtlas_t));
+        if( !VRAM->Atlas ) {
+            DPrintf("VRAMAtlasAddTexture:Failed to allocate memory for the atlas\n");
+            return;
+        }
+        memset(VRAM->Atlas,0,sizeof(VRAMAtlas_t));
+        //NOTE(Adriano):Statistics always refer to the last atlas.
+        memset(&VRAMAtlasStats,0,sizeof(VRAMAtlasStats));
+    }
+    Atlas = VRAM->Atlas;
+    if( Atlas->NumKeys == Atlas->KeyListSize ) {
+        Atlas->KeyListSize = Atlas->KeyListSize ? Atlas->KeyListSize * 2 : 256;
+        KeyList = realloc(Atlas->KeyList,Atlas->KeyListSize * sizeof(unsigned int));
+        if( !KeyList ) {
+            DPrintf("VRAMAtlasAddTexture:Failed to grow the key list\n");
+            Atlas->KeyListSize = Atlas->NumKeys;
+            return;
+        }
+        Atlas->KeyList = KeyList;
+    }
+    Atlas->KeyList[Atlas->NumKeys++] = VRAMAtlasGetKey(VRAMPage,ColorMode,CBA);
+    if( ColorMode == 2 ) {
+        VRAMAtlasStats.NumDirectFaces++;
+    } else {
+        VRAMAtlasStats.NumIndexedFaces++;
+    }
+}
+
+static inline void VRAMAtlasPutColor(Byte *Dest,unsigned short Color)
+{
+    Byte R;
+    Byte G;
+    Byte B;
+    
+    R = Color & 0x1F;
+    G = (Color >> 5) & 0x1F;
+    B = (Color >> 10) & 0x1F;
+    Dest[0] = (R << 3) | (R >> 2);
+    Dest[1] = (G << 3) | (G >> 2);
+    Dest[2] = (B << 3) | (B >> 2);
+    //NOTE(Adriano):Same rule used by the shader,only a color of 0 is transparent.
+    Dest[3] = Color == 0 ? 0 : 255;
+}
+
+/*
+ * Decodes one tile of the atlas using the expanded pages,the same lookup done by the shader.
+ */
+static void VRAMAtlasDecodeTile(void *UserData,int TaskIndex)
+{
+    VRAMAtlasContext_t *Context;
+    const Byte *IndexPage;
+    const unsigned short *PalettePage;
+    const unsigned short *CLUT;
+    Byte *Dest;
+    unsigned int Key;
+    int PageWidth;
+    int VRAMPage;
+    int ColorMode;
+    int CLUTPosX;
+    int CLUTPosY;
+    int CLUTPage;
+    int CLUTDestX;
+    int CLUTDestY;
+    int PageX;
+    int PageY;
+    int Index;
+    int x;
+    int y;
+    
+    Context = (VRAMAtlasContext_t *) UserData;
+    Key = Context->Atlas->KeyList[TaskIndex];
+    ColorMode = (Key >> 20) & 0x3;
+    VRAMPage = (Key >> 15) & 0x1F;
+    CLUTPosX = (Key << 4) & 0x3F0;
+    CLUTPosY = (Key >> 6) & 0x1FF;
+    CLUTPage = VRAMGetCLUTPage(CLUTPosX,CLUTPosY);
+    CLUTDestX = VRAMGetCLUTPositionX(CLUTPosX,CLUTPosY,CLUTPage) + VRAMGetTexturePageX(CLUTPage);
+    CLUTDestY = CLUTPosY + VRAMGetCLUTOffsetY(ColorMode);
+    PageX = VRAMGetTexturePageX(VRAMPage);
+    PageY = VRAMGetTexturePageY(VRAMPage,ColorMode);
+    PageWidth = Context->Staging->Width[VRAM_UPLOAD_PALETTE_PAGE];
+    IndexPage = Context->Staging->PageData[VRAM_UPLOAD_INDEX_PAGE];
+    PalettePage = (const unsigned short *) Context->Staging->PageData[VRAM_UPLOAD_PALETTE_PAGE];
+    CLUT = NULL;
+    if( CLUTDestY >= 0 && CLUTDestY < Context->Staging->Height[VRAM_UPLOAD_PALETTE_PAGE] ) {
+        CLUT = &PalettePage[CLUTDestY * PageWidth];
+    }
+    for( y = 0; y < VRAM_TILE_SIZE; y++ ) {
+        Dest = Context->Data + (((TaskIndex / VRAM_ATLAS_TILES_PER_ROW) * VRAM_TILE_SIZE + y) * Context->Width +
+                                (TaskIndex % VRAM_ATLAS_TILES_PER_ROW) * VRAM_TILE_SIZE) * 4;
+        if( PageY + y >= Context->Staging->Height[VRAM_UPLOAD_PALETTE_PAGE] ) {
+            memset(Dest,0,VRAM_TILE_SIZE * 4);
+            continue;
+        }
+        for( x = 0; x < VRAM_TILE_SIZE; x++ ) {
+            if( ColorMode == 2 ) {
+                VRAMAtlasPutColor(&Dest[x * 4],PalettePage[(PageY + y) * PageWidth + PageX + x]);
+                continue;
+            }
+            Index = CLUTDestX + IndexPage[(PageY + y) * PageWidth + PageX + x];
+            VRAMAtlasPutColor(&Dest[x * 4],CLUT && Index < PageWidth ? CLUT[Index] : 0);
+        }
+    }
+}
+
+/*
+ * Decodes every tile from the image list and uploads the atlas texture.
+ */
+static int VRAMAtlasUpload(VRAM_t *VRAM)
+{
+    VRAMUploadContext_t Staging;
+    VRAMAtlasContext_t Context;
+    VRAMAtlas_t *Atlas;
+    GLint MaxTextureSize;
+    int Height;
+    
+    Atlas = VRAM->Atlas;
+    Context.Width = MIN(Atlas->NumTiles,VRAM_ATLAS_TILES_PER_ROW) * VRAM_TILE_SIZE;
+    Height = ((Atlas->NumTiles + VRAM_ATLAS_TILES_PER_ROW - 1) / VRAM_ATLAS_TILES_PER_ROW) * VRAM_TILE_SIZE;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE,&MaxTextureSize);
+    if( !Atlas->NumTiles || Height > MaxTextureSize ) {
+        DPrintf("VRAMAtlasUpload:Cannot store %i tiles inside a texture (Max size is %i)\n",Atlas->NumTiles,MaxTextureSize);
+        return 0;
+    }
+    Context.Data = malloc(Context.Width * Height * 4);
+    if( !Context.Data ) {
+        DPrintf("VRAMAtlasUpload:Failed to allocate memory for %i tiles\n",Atlas->NumTiles);
+        return 0;
+    }
+    if( !VRAMBuildStagingPages(&Staging,VRAM,VRAM->ImageList,false) ) {
+        DPrintf("VRAMAtlasUpload:Failed to build the expanded pages\n");
+        VRAMFreeStagingPages(&Staging);
+        free(Context.Data);
+        return 0;
+    }
+    Context.Atlas = Atlas;
+    Context.Staging = &Staging;
+    ThreadPoolParallelFor(Atlas->NumTiles,VRAMAtlasDecodeTile,&Context);
+    VRAMFreeStagingPages(&Staging);
+    
+    VRAMCreatePage(&Atlas->Page,Context.Width,Height,GL_RGBA8,GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+    glBindTexture(GL_TEXTURE_2D,Atlas->Page.TextureId);
+    glTexSubImage2D(GL_TEXTURE_2D,0,0,0,Context.Width,Height,GL_RGBA,GL_UNSIGNED_BYTE,Context.Data);
+    glBindTexture(GL_TEXTURE_2D,0);
+    free(Context.Data);
+    return 1;
+}
+
+/*
+ * Decodes every registered texture page and CLUT pair into an RGBA tile so that faces can be drawn with a
+ * single texture fetch.
+ * Returns 1 on success,0 otherwise and in that case the atlas is released and the expanded pages are used.
+ */
+int VRAMAtlasBuild(VRAM_t *VRAM)
+{
+    VRAMAtlas_t *Atlas;
+    double StartTime;
+    int i;
+    
+    if( !VRAM || !VRAM->Atlas ) {
+        return 0;
+    }
+    StartTime = SysPreciseMilliseconds();
+    Atlas = VRAM->Atlas;
+    qsort(Atlas->KeyList,Atlas->NumKeys,sizeof(unsigned int),VRAMAtlasCompareKey);
+    Atlas->NumTiles = 0;
+    for( i = 0; i < Atlas->NumKeys; i++ ) {
+        if( Atlas->NumTiles == 0 || Atlas->KeyList[Atlas->NumTiles - 1] != Atlas->KeyList[i] ) {
+            Atlas->KeyList[Atlas->NumTiles++] = Atlas->KeyList[i];
         }
     }
+    Atlas->NumKeys = Atlas->NumTiles;
+    if( !VRAMAtlasUpload(VRAM) ) {
+        free(Atlas->KeyList);
+        free(Atlas);
+        VRAM->Atlas = NULL;
+        return 0;
+    }
+    VRAMAtlasStats.NumTiles = Atlas->NumTiles;
+    VRAMAtlasStats.AtlasSize = Atlas->Page.Width * Atlas->Page.Height * 4;
+    VRAMAtlasStats.PagesSize = VRAM->NativeLayout ? VRAM_NATIVE_WIDTH * VRAM_NATIVE_HEIGHT * sizeof(unsigned short) :
+                                                    VRAM->Page.Width * VRAM->Page.Height * (sizeof(Byte) + sizeof(unsigned short));
+    VRAMAtlasStats.BuildTime = SysPreciseMilliseconds() - StartTime;
+    DPrintf("VRAMAtlasBuild:Built %i tiles (%i KB,pages use %i KB) in %f ms\n",VRAMAtlasStats.NumTiles,
+            VRAMAtlasStats.AtlasSize / 1024,VRAMAtlasStats.PagesSize / 1024,VRAMAtlasStats.BuildTime);
+    return 1;
+}
+
+/*
+ * Finds the tile that contains the given texture page decoded using the CLUT,face UVs are relative to it.
+ * Returns 1 if the pair was registered before building the atlas,0 otherwise.
+ */
+int VRAMAtlasGetTile(const VRAMAtlas_t *Atlas,int VRAMPage,int ColorMode,int CBA,int *TileX,int *TileY)
+{
+    const unsigned int *Result;
+    unsigned int Key;
+    int Index;
+    
+    Key = VRAMAtlasGetKey(VRAMPage,ColorMode,CBA);
+    Result = bsearch(&Key,Atlas->KeyList,Atlas->NumTiles,sizeof(unsigned int),VRAMAtlasCompareKey);
+    if( !Result ) {
+        *TileX = 0;
+        *TileY = 0;
+        return 0;
+    }
+    Index = Result - Atlas->KeyList;
+    *TileX = (Index % VRAM_ATLAS_TILES_PER_ROW) * VRAM_TILE_SIZE;
+    *TileY = (Index / VRAM_ATLAS_TILES_PER_ROW) * VRAM_TILE_SIZE;
+    return 1;
+}
+
+const VRAMAtlasStats_t *VRAMGetAtlasStats()
+{
+    return &VRAMAtlasStats;
+}
+
+/*
+ * Binds the VRAM textures used by the render object shader,the index (or native) page goes into the first unit
+ * and the palette page into the second one while the atlas,when built,goes into the third one.
+ */
+void VRAMBindTextures(VRAM_t *VRAM)
+{
+    glActiveTexture(GL_TEXTURE0 + 0);
+    glBindTexture(GL_TEXTURE_2D, VRAM->NativeLayout ? VRAM->NativePage.TextureId : VRAM->TextureIndexPage.TextureId);
+    glActiveTexture(GL_TEXTURE0 + 1);
+    glBindTexture(GL_TEXTURE_2D, VRAM->NativeLayout ? 0 : VRAM->PalettePage.TextureId);
+    glActiveTexture(GL_TEXTURE0 + 2);
+    glBindTexture(GL_TEXTURE_2D, VRAM->Atlas ? VRAM->Atlas->Page.TextureId : 0);
+    glActiveTexture(GL_TEXTURE0 + 0);
+}
+
+/*
+ * Returns the amount of GPU memory (in bytes) used by the VRAM textures,0 if they were evicted.
+ */
+int VRAMGetSize(VRAM_t *VRAM)
+{
+    int Size;
+    
+    if( !VRAM || !VRAM->Resident ) {
+        return 0;
+    }
+    if( VRAM->NativeLayout ) {
+        Size = VRAM->NativePage.Width * VRAM->NativePage.Height * sizeof(unsigned short);
+    } else {
+        Size = VRAM->TextureIndexPage.Width * VRAM->TextureIndexPage.Height * sizeof(Byte) +
+                VRAM->PalettePage.Width * VRAM->PalettePage.Height * sizeof(unsigned short);
+    }
+    if( VRAM->Atlas ) {
+        Size += VRAM->Atlas->Page.Width * VRAM->Atlas->Page.Height * 4;
+    }
+    return Size;
+}
+
+static void VRAMCreateTextures(VRAM_t *VRAM)
+{
+    if( VRAM->NativeLayout ) {
+        VRAMCreatePage(&VRAM->NativePage,VRAM_NATIVE_WIDTH,VRAM_NATIVE_HEIGHT,GL_R16UI,GL_NEAREST);
+    } else {
+        VRAMCreatePage(&VRAM->PalettePage,VRAM->Page.Width,VRAM->Page.Height,GL_RGB5_A1,GL_LINEAR);
+        VRAMCreatePage(&VRAM->TextureIndexPage,VRAM->Page.Width,VRAM->Page.Height,GL_R8UI,GL_NEAREST);
+    }
+    VRAMUploadImageList(VRAM,VRAM->ImageList);
+    VRAM->Resident = true;
+}
+
+/*
+ * Releases the VRAM textures while keeping the image list and the atlas layout so that they can be
+ * recreated by VRAMRestore.
+ */
+void VRAMEvict(VRAM_t *VRAM)
+{
+    if( !VRAM || !VRAM->Resident ) {
+        return;
+    }
+    glDeleteTextures(1,&VRAM->NativePage.TextureId);
+    glDeleteTextures(1,&VRAM->TextureIndexPage.TextureId);
+    glDeleteTextures(1,&VRAM->PalettePage.TextureId);
+    VRAM->NativePage.TextureId = 0;
+    VRAM->TextureIndexPage.TextureId = 0;
+    VRAM->PalettePage.TextureId = 0;
+    if( VRAM->Atlas ) {
+        glDeleteTextures(1,&VRAM->Atlas->Page.TextureId);
+        VRAM->Atlas->Page.TextureId = 0;
+    }
+    VRAM->Resident = false;
+}
+
+/*
+ * Recreates the textures of an evicted VRAM from its image list,faces keep pointing to the same atlas tiles
+ * since the atlas layout does not change.
+ */
+void VRAMRestore(VRAM_t *VRAM)
+{
+    if( !VRAM || VRAM->Resident ) {
+        return;
+    }
+    VRAMCreateTextures(VRAM);
+    if( VRAM->Atlas && !VRAMAtlasUpload(VRAM) ) {
+        DPrintf("VRAMRestore:Failed to restore the atlas\n");
+    }
+}
+
+/*
+ Creates the textures used to draw the images.
+ By default indices are expanded to one byte per pixel inside the index page while CLUTs and 16-BPP images
+ are stored inside the palette page,both pages are 4096x1024.
+ When NativeLayout is set the data is stored unchanged inside a 1024x512 16-bit page that mirrors the PSX VRAM
+ and the shader decodes it.
+ */
+VRAM_t *VRAMInit(TIMImage_t *ImageList,bool NativeLayout)
+{
+    VRAM_t *VRAM;
+    
+    VRAM = malloc(sizeof(VRAM_t));
+    
+    if( !VRAM ) {
+        DPrintf("VRAMInit:Failed to allocate memory for struct\n");
+        return NULL;
+    }
+    memset(VRAM,0,sizeof(VRAM_t));
+    VRAM->ImageList = ImageList;
+    VRAM->NativeLayout = NativeLayout;
+    VRAM->Page.Width = 4096.f;
+    VRAM->Page.Height = 1024.f;
+    VRAMCreateTextures(VRAM);
 #ifdef _DEBUG
     VRAMDump(VRAM);
 #endif
-    glGenTextures(1,&VRAM->Page.TextureId);
-    glBindTexture(GL_TEXTURE_2D,VRAM->Page.TextureId);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, VRAM->Page.Width, VRAM->Page.Height, 0, GL_RGBA,GL_UNSIGNED_BYTE, VRAM->Page.Surface->pixels);
-    glBindTexture(GL_TEXTURE_2D,0);
     return VRAM;
 }
-
@@ -22,6 +22,18 @@
 #include "Common.h"
 #include "TIM.h"
 
+//NOTE(Adriano):Texture pages are 256x256 pixels inside the expanded VRAM,4bpp pages use the top half
+//              while 8bpp pages use the bottom one.
+#define VRAM_TILE_SIZE 256
+#define VRAM_NUM_TILES_X 16
+#define VRAM_NUM_TILES_Y 4
+#define VRAM_NUM_TILES (VRAM_NUM_TILES_X * VRAM_NUM_TILES_Y)
+//NOTE(Adriano):Size of the PSX VRAM in 16-bit words.
+#define VRAM_NATIVE_WIDTH 1024
+#define VRAM_NATIVE_HEIGHT 512
+//NOTE(Adriano):Atlas tiles have the same size of a texture page.
+#define VRAM_ATLAS_TILES_PER_ROW 16
+
 typedef struct VRamPage_s {
     unsigned int TextureId;
     SDL_Surface *Surface;
@@ -30,14 +42,42 @@ typedef struct VRamPage_s {
     float Height;
 } VRAMPage_t;
 
+//NOTE(Adriano):Each texture page is decoded once for every CLUT that is used together with it by a face.
+//              Keys are sorted when the atlas is built and the position of a key is the index of its tile.
+typedef struct VRAMAtlas_s {
+    unsigned int    *KeyList;
+    int             NumKeys;
+    int             KeyListSize;
+    int             NumTiles;
+    VRAMPage_t      Page;
+} VRAMAtlas_t;
+
+typedef struct VRAMAtlasStats_s {
+    int     NumTiles;
+    int     NumIndexedFaces;
+    int     NumDirectFaces;
+    int     AtlasSize;
+    int     PagesSize;
+    double  BuildTime;
+} VRAMAtlasStats_t;
+
 typedef struct VRam_s {
+    TIMImage_t *ImageList; //Not owned,used to build the RGBA page when it is needed.
+    bool NativeLayout;
+    bool Resident; //False when the textures were evicted.
     VRAMPage_t Page;
     VRAMPage_t PalettePage;
     VRAMPage_t TextureIndexPage;
+    VRAMPage_t NativePage;
+    VRAMAtlas_t *Atlas;
 } VRAM_t;
 
-VRAM_t      *VRAMInit(TIMImage_t *ImageList);
+VRAM_t      *VRAMInit(TIMImage_t *ImageList,bool NativeLayout);
+void        VRAMBindTextures(VRAM_t *VRAM);
 void        VRAMFree(VRAM_t *VRAM);
+int         VRAMGetSize(VRAM_t *VRAM);
+void        VRAMEvict(VRAM_t *VRAM);
+void        VRAMRestore(VRAM_t *VRAM);
 int         VRAMGetTexturePageX(int VRAMPage);
 int         VRAMGetTexturePageY(int VRAMPage,int ColorMode);
 int         VRAMGetCLUTPage(int CLUTPosX,int CLUTPosY);
@@ -45,5 +85,13 @@ int         VRAMGetCLUTPositionX(int CLUTX,int CLUTY,int CLUTPage);
 int         VRAMGetCLUTOffsetY(int ColorMode);
 void        VRAMGetTIMImageCoordinates(TIMImage_t *Image,int *DestX,int *DestY);
 void        VRAMDumpDataToFile(VRAM_t *VRam,const char *OutBaseDir);
-void        VRAMSave(VRAM_t *VRAM,const char *File);
+SDL_Surface *VRAMGetPageSurface(VRAM_t *VRAM);
+int         VRAMSave(VRAM_t *VRAM,const char *File);
+int         VRAMSaveImageList(TIMImage_t *ImageList,const char *File);
+int         VRAMGetTile(int VRAMPage,int ColorMode);
+void        VRAMSaveTiles(VRAM_t *VRAM,const char *File,const int *TileList,int NumTiles,int NumColumns);
+void        VRAMAtlasAddTexture(VRAM_t *VRAM,int VRAMPage,int ColorMode,int CBA);
+int         VRAMAtlasBuild(VRAM_t *VRAM);
+int         VRAMAtlasGetTile(const VRAMAtlas_t *Atlas,int VRAMPage,int ColorMode,int CBA,int *TileX,int *TileY);
+const VRAMAtlasStats_t *VRAMGetAtlasStats();
 #endif //__VRAM_H_
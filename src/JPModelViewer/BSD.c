@@ -20,8 +20,11 @@
 */
 #include "BSD.h"
 #include "TSP.h"
+#include "Pick.h"
+#include "MeshOptimizer.h"
 #include "JPModelViewer.h" 
 #include "../Common/ShaderManager.h"
+#include "../Common/Intern.h"
 
 void BSDRecusivelyFreeHierarchyBone(BSDHierarchyBone_t *Bone)
 {
@@ -32,6 +35,31 @@ void BSDRecusivelyFreeHierarchyBone(BSDHierarchyBone_t *Bone)
     BSDRecusivelyFreeHierarchyBone(Bone->Child1);
     free(Bone);
 }
+void BSDFreeAnimatedLightTable(BSDAnimatedLightTable_t *AnimatedLightTable)
+{
+    int i;
+    
+    if( !AnimatedLightTable ) {
+        return;
+    }
+    for( i = 0; i < BSD_ANIMATED_LIGHTS_TABLE_SIZE; i++ ) {
+        if( AnimatedLightTable->AnimatedLightsList[i].ColorList ) {
+            free(AnimatedLightTable->AnimatedLightsList[i].ColorList);
+        }
+    }
+    free(AnimatedLightTable);
+}
+/*
+ * Frees one of the vertex or face arrays of the render object,that can be owned by the intern table.
+ */
+static void BSDFreeArray(BSDRenderObject_t *RenderObject,void *Array)
+{
+    if( RenderObject->Interned ) {
+        InternRelease(Array);
+    } else {
+        free(Array);
+    }
+}
 void BSDFreeRenderObject(BSDRenderObject_t *RenderObject)
 {
     int i;
@@ -42,7 +70,7 @@ void BSDFreeRenderObject(BSDRenderObject_t *RenderObject)
     if( RenderObject->VertexTable ) {
         for( i = 0; i < RenderObject->NumVertexTables; i++ ) {
             if( RenderObject->VertexTable[i].VertexList ) {
-                free(RenderObject->VertexTable[i].VertexList);
+                BSDFreeArray(RenderObject,RenderObject->VertexTable[i].VertexList);
             }
             if( RenderObject->CurrentVertexTable[i].VertexList ) {
                 free(RenderObject->CurrentVertexTable[i].VertexList);
@@ -52,19 +80,19 @@ void BSDFreeRenderObject(BSDRenderObject_t *RenderObject)
         free(RenderObject->CurrentVertexTable);
     }
     if( RenderObject->Vertex ) {
-        free(RenderObject->Vertex);
+        BSDFreeArray(RenderObject,RenderObject->Vertex);
     }
     if( RenderObject->Color ) {
         free(RenderObject->Color);
     }
     if( RenderObject->TexturedFaceList ) {
-        free(RenderObject->TexturedFaceList);
+        BSDFreeArray(RenderObject,RenderObject->TexturedFaceList);
     }
     if( RenderObject->UntexturedFaceList ) {
-        free(RenderObject->UntexturedFaceList);
+        BSDFreeArray(RenderObject,RenderObject->UntexturedFaceList);
     }
     if( RenderObject->FaceList ) {
-        free(RenderObject->FaceList);
+        BSDFreeArray(RenderObject,RenderObject->FaceList);
     }
     if( RenderObject->HierarchyDataRoot ) {
         BSDRecusivelyFreeHierarchyBone(RenderObject->HierarchyDataRoot);
@@ -72,6 +100,7 @@ void BSDFreeRenderObject(BSDRenderObject_t *RenderObject)
     if( RenderObject->TSP ) {
         TSPFree(RenderObject->TSP);
     }
+    BSDFreeAnimatedLightTable(RenderObject->AnimatedLightTable);
     if( RenderObject->RenderObjectShader ) {
         free(RenderObject->RenderObjectShader);
     }
@@ -93,6 +122,7 @@ void BSDFreeRenderObject(BSDRenderObject_t *RenderObject)
         free(RenderObject->AnimationList);
     }
     VAOFree(RenderObject->VAO);
+    PickFree(RenderObject->PickData);
     free(RenderObject->FileName);
     free(RenderObject);
 }
@@ -114,6 +144,7 @@ void BSDFree(BSD_t *BSD)
     if( BSD->RenderObjectTable.RenderObject ) {
         free(BSD->RenderObjectTable.RenderObject);
     }
+    BSDFreeAnimatedLightTable(BSD->AnimatedLightTable);
     free(BSD);
 }
 
@@ -332,6 +363,8 @@ void BSDRenderObjectGenerateVAO(BSDRenderObject_t *RenderObject)
     int V1;
     int U2;
     int V2;
+    int PageX;
+    int PageY;
     int i;
     
     if( !RenderObject ) {
@@ -363,12 +396,18 @@ void BSDRenderObjectGenerateVAO(BSDRenderObject_t *RenderObject)
         CLUTDestY = CLUTPosY + VRAMGetCLUTOffsetY(ColorMode);
         CLUTDestX += VRAMGetTexturePageX(CLUTPage);
  
-        U0 = CurrentFace->UV0.u + VRAMGetTexturePageX(VRAMPage);
-        V0 = CurrentFace->UV0.v + VRAMGetTexturePageY(VRAMPage,ColorMode);
-        U1 = CurrentFace->UV1.u + VRAMGetTexturePageX(VRAMPage);
-        V1 = CurrentFace->UV1.v + VRAMGetTexturePageY(VRAMPage,ColorMode);
-        U2 = CurrentFace->UV2.u + VRAMGetTexturePageX(VRAMPage);
-        V2 = CurrentFace->UV2.v + VRAMGetTexturePageY(VRAMPage,ColorMode);
+        if( RenderObject->Atlas ) {
+            VRAMAtlasGetTile(RenderObject->Atlas,VRAMPage,ColorMode,CurrentFace->CLUT,&PageX,&PageY);
+        } else {
+            PageX = VRAMGetTexturePageX(VRAMPage);
+            PageY = VRAMGetTexturePageY(VRAMPage,ColorMode);
+        }
+        U0 = CurrentFace->UV0.u + PageX;
+        V0 = CurrentFace->UV0.v + PageY;
+        U1 = CurrentFace->UV1.u + PageX;
+        V1 = CurrentFace->UV1.v + PageY;
+        U2 = CurrentFace->UV2.u + PageX;
+        V2 = CurrentFace->UV2.v + PageY;
 
         
         BSDFillFaceVertexBuffer(VertexData,&VertexPointer,
@@ -388,6 +427,38 @@ void BSDRenderObjectGenerateVAO(BSDRenderObject_t *RenderObject)
                                         ColorOffset,CLUTOffset,ColorModeOffset,TexturedOffset,RenderObject->NumFaces * 3);
     free(VertexData);
 }
+/*
+ * Static models are never updated after being created so they can be drawn using an optimized indexed mesh.
+ * Models are small enough to build their detail levels every time without using the LOD cache.
+ */
+VAO_t *BSDRenderObjectCreateStaticVAO(int *VertexData,int VertexSize,int Stride,int VertexOffset,int TextureOffset,int ColorOffset,
+                                      int CLUTOffset,int ColorModeOffset,int TexturedOffset,int Count,LODMesh_t *LOD)
+{
+    MeshOptimizerMesh_t Mesh;
+    LODVertexFormat_t LODVertexFormat;
+    VAO_t *VAO;
+    int NumIndices;
+    
+    memset(LOD,0,sizeof(LODMesh_t));
+    if( !EnableMeshOptimization->IValue || !MeshOptimizerOptimize(VertexData,Count,Stride,&Mesh) ) {
+        return VAOInitXYZUVRGBCLUTColorModeTexturedInteger(VertexData,VertexSize,Stride,VertexOffset,TextureOffset,ColorOffset,CLUTOffset,
+                                                           ColorModeOffset,TexturedOffset,Count);
+    }
+    NumIndices = Mesh.NumIndices;
+    if( EnableLOD->IValue ) {
+        LODVertexFormat.Stride = Stride;
+        LODVertexFormat.UVOffset = TextureOffset;
+        LODVertexFormat.ColorOffset = ColorOffset;
+        LODBuildMesh(NULL,Mesh.VertexData,Mesh.NumVertices,&LODVertexFormat,&Mesh.IndexList,&Mesh.NumIndices,LOD);
+    }
+    VAO = VAOInitXYZUVRGBCLUTColorModeTexturedInteger(Mesh.VertexData,Mesh.NumVertices * Stride,Stride,VertexOffset,TextureOffset,
+                                                      ColorOffset,CLUTOffset,ColorModeOffset,TexturedOffset,Mesh.NumVertices);
+    if( VAO ) {
+        VAOAttachIndexBuffer(VAO,Mesh.IndexList,Mesh.NumIndices * sizeof(unsigned int),NumIndices);
+    }
+    MeshOptimizerFreeMesh(&Mesh);
+    return VAO;
+}
 void BSDRenderObjectGenerateStaticTexturedVAO(BSDRenderObject_t *RenderObject)
 {
     VAO_t *VAO;
@@ -410,6 +481,8 @@ void BSDRenderObjectGenerateStaticTexturedVAO(BSDRenderObject_t *RenderObject)
     int V1;
     int U2;
     int V2;
+    int PageX;
+    int PageY;
     int VRAMPage;
     int ColorMode;
     int CLUTPosX;
@@ -442,12 +515,18 @@ void BSDRenderObjectGenerateStaticTexturedVAO(BSDRenderObject_t *RenderObject)
 
         VRAMPage = RenderObject->TexturedFaceList[i].TexInfo & 0x1F;
         ColorMode = (RenderObject->TexturedFaceList[i].TexInfo & 0xC0) >> 7;
-        U0 = RenderObject->TexturedFaceList[i].UV0.u + VRAMGetTexturePageX(VRAMPage);
-        V0 = RenderObject->TexturedFaceList[i].UV0.v + VRAMGetTexturePageY(VRAMPage,ColorMode);
-        U1 = RenderObject->TexturedFaceList[i].UV1.u + VRAMGetTexturePageX(VRAMPage);
-        V1 = RenderObject->TexturedFaceList[i].UV1.v + VRAMGetTexturePageY(VRAMPage,ColorMode);
-        U2 = RenderObject->TexturedFaceList[i].UV2.u + VRAMGetTexturePageX(VRAMPage);
-        V2 = RenderObject->TexturedFaceList[i].UV2.v + VRAMGetTexturePageY(VRAMPage,ColorMode);
+        if( RenderObject->Atlas ) {
+            VRAMAtlasGetTile(RenderObject->Atlas,VRAMPage,ColorMode,RenderObject->TexturedFaceList[i].CBA,&PageX,&PageY);
+        } else {
+            PageX = VRAMGetTexturePageX(VRAMPage);
+            PageY = VRAMGetTexturePageY(VRAMPage,ColorMode);
+        }
+        U0 = RenderObject->TexturedFaceList[i].UV0.u + PageX;
+        V0 = RenderObject->TexturedFaceList[i].UV0.v + PageY;
+        U1 = RenderObject->TexturedFaceList[i].UV1.u + PageX;
+        V1 = RenderObject->TexturedFaceList[i].UV1.v + PageY;
+        U2 = RenderObject->TexturedFaceList[i].UV2.u + PageX;
+        V2 = RenderObject->TexturedFaceList[i].UV2.v + PageY;
         CLUTPosX = (RenderObject->TexturedFaceList[i].CBA << 4) & 0x3F0;
         CLUTPosY = (RenderObject->TexturedFaceList[i].CBA >> 6) & 0x1ff;
         CLUTPage = VRAMGetCLUTPage(CLUTPosX,CLUTPosY);
@@ -466,8 +545,9 @@ void BSDRenderObjectGenerateStaticTexturedVAO(BSDRenderObject_t *RenderObject)
                                 U2,V2,RenderObject->TexturedFaceList[i].RGB2,CLUTDestX,CLUTDestY,ColorMode,true);
     }
     VAO = 
-        VAOInitXYZUVRGBCLUTColorModeTexturedInteger(VertexData,VertexSize,Stride,VertexOffset,TextureOffset,ColorOffset,CLUTOffset,ColorModeOffset,
-                                              TexturedOffset,RenderObject->NumTexturedFaces * 3);
+        BSDRenderObjectCreateStaticVAO(VertexData,VertexSize,Stride,VertexOffset,TextureOffset,ColorOffset,CLUTOffset,ColorModeOffset,
+                                       TexturedOffset,RenderObject->NumTexturedFaces * 3,&RenderObject->TexturedLOD);
+    RenderObject->TexturedVAO = VAO;
     VAO->Next = RenderObject->VAO;
     RenderObject->VAO = VAO;
     free(VertexData);
@@ -523,8 +603,9 @@ void BSDRenderObjectGenerateStaticUntexturedVAO(BSDRenderObject_t *RenderObject)
 
     }
     VAO = 
-        VAOInitXYZUVRGBCLUTColorModeTexturedInteger(VertexData,VertexSize,Stride,VertexOffset,TextureOffset,ColorOffset,CLUTOffset,ColorModeOffset,
-                                              TexturedOffset,RenderObject->NumUntexturedFaces * 3);
+        BSDRenderObjectCreateStaticVAO(VertexData,VertexSize,Stride,VertexOffset,TextureOffset,ColorOffset,CLUTOffset,ColorModeOffset,
+                                       TexturedOffset,RenderObject->NumUntexturedFaces * 3,&RenderObject->UntexturedLOD);
+    RenderObject->UntexturedVAO = VAO;
     VAO->Next = RenderObject->VAO;
     RenderObject->VAO = VAO;
     free(VertexData);
@@ -798,9 +879,18 @@ int BSDCreateRenderObjectShader(BSDRenderObject_t *RenderObject)
     RenderObject->RenderObjectShader->EnableLightingId = glGetUniformLocation(Shader->ProgramId,"enableLighting");
     RenderObject->RenderObjectShader->TextureIndexId = glGetUniformLocation(Shader->ProgramId,"indexTexture");
     RenderObject->RenderObjectShader->PaletteTextureId = glGetUniformLocation(Shader->ProgramId,"paletteTexture");
+    RenderObject->RenderObjectShader->EnableAnimatedLightsId = glGetUniformLocation(Shader->ProgramId,"enableAnimatedLights");
+    RenderObject->RenderObjectShader->AnimatedLightColorsId = glGetUniformLocation(Shader->ProgramId,"animatedLightColors");
+    RenderObject->RenderObjectShader->NativeVRAMId = glGetUniformLocation(Shader->ProgramId,"nativeVRAM");
+    RenderObject->RenderObjectShader->AtlasTextureId = glGetUniformLocation(Shader->ProgramId,"atlasTexture");
+    RenderObject->RenderObjectShader->AtlasModeId = glGetUniformLocation(Shader->ProgramId,"atlasMode");
     glUniform1i(RenderObject->RenderObjectShader->TextureIndexId, 0);
     glUniform1i(RenderObject->RenderObjectShader->PaletteTextureId,  1);
     glUniform1i(RenderObject->RenderObjectShader->EnableLightingId, 1);
+    glUniform1i(RenderObject->RenderObjectShader->EnableAnimatedLightsId, 0);
+    glUniform1i(RenderObject->RenderObjectShader->NativeVRAMId, 0);
+    glUniform1i(RenderObject->RenderObjectShader->AtlasTextureId, 2);
+    glUniform1i(RenderObject->RenderObjectShader->AtlasModeId, 0);
     glUseProgram(0);
     return 1;
 }
@@ -810,13 +900,57 @@ void BSDRenderObjectGenerateVAOs(BSDRenderObject_t *RenderObject)
     BSDRenderObjectGenerateStaticUntexturedVAO(RenderObject);
 
 }
-void BSDDrawRenderObject(BSDRenderObject_t *RenderObject,VRAM_t *VRAM,Camera_t *Camera,mat4 ProjectionMatrix)
+/*
+ * Computes the matrix used to draw the render object,levels are drawn without any model transformation.
+ */
+void BSDGetRenderObjectMVPMatrix(BSDRenderObject_t *RenderObject,Camera_t *Camera,mat4 ProjectionMatrix,mat4 MVPMatrix)
 {
     vec3 Temp;
     mat4 ModelMatrix;
     mat4 ModelViewMatrix;
+    
+    if( RenderObject->TSP ) {
+        glm_mat4_mul(ProjectionMatrix,Camera->ViewMatrix,MVPMatrix);
+        glm_rotate_x(MVPMatrix,glm_rad(180.f), MVPMatrix);
+        return;
+    }
+    glm_mat4_identity(ModelMatrix);
+    glm_mat4_identity(ModelViewMatrix);
+    Temp[0] = -RenderObject->Center[0];
+    Temp[1] = -RenderObject->Center[1];
+    Temp[2] = -RenderObject->Center[2];
+    glm_vec3_rotate(Temp, DEGTORAD(180.f), GLM_XUP);    
+    glm_translate(ModelMatrix,Temp);
+    Temp[0] = 0;
+    Temp[1] = 1;
+    Temp[2] = 0;
+    glm_rotate(ModelMatrix,glm_rad(-90), Temp);
+    glm_scale(ModelMatrix,RenderObject->Scale);
+    glm_mat4_mul(Camera->ViewMatrix,ModelMatrix,ModelViewMatrix);
+    glm_mat4_mul(ProjectionMatrix,ModelViewMatrix,MVPMatrix);
+    //Emulate PSX Coordinate system...
+    glm_rotate_x(MVPMatrix,glm_rad(180.f), MVPMatrix);
+}
+
+/*
+ * Returns the detail levels of one of the VAOs of the render object or NULL if it has none.
+ */
+LODMesh_t *BSDRenderObjectGetLOD(BSDRenderObject_t *RenderObject,VAO_t *VAO)
+{
+    if( VAO == RenderObject->TexturedVAO ) {
+        return &RenderObject->TexturedLOD;
+    }
+    if( VAO == RenderObject->UntexturedVAO ) {
+        return &RenderObject->UntexturedLOD;
+    }
+    return NULL;
+}
+
+void BSDDrawRenderObject(BSDRenderObject_t *RenderObject,VRAM_t *VRAM,Camera_t *Camera,mat4 ProjectionMatrix)
+{
     mat4 MVPMatrix;
     VAO_t *Iterator;
+    LODMesh_t *LOD;
     
     if( !RenderObject ) {
         return;
@@ -827,7 +961,8 @@ void BSDDrawRenderObject(BSDRenderObject_t *RenderObject,VRAM_t *VRAM,Camera_t *
     }
     
     if( RenderObject->TSP ) {
-        TSPDrawList(RenderObject->TSP,VRAM,Camera,RenderObject->RenderObjectShader,ProjectionMatrix);
+        BSDUpdateAnimatedLights(RenderObject->AnimatedLightTable);
+        TSPDrawList(RenderObject->TSP,VRAM,Camera,RenderObject->RenderObjectShader,RenderObject->AnimatedLightTable,ProjectionMatrix);
         return;
     }
     if( !RenderObject->VAO ) {
@@ -840,36 +975,29 @@ void BSDDrawRenderObject(BSDRenderObject_t *RenderObject,VRAM_t *VRAM,Camera_t *
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
     
-    glm_mat4_identity(ModelMatrix);
-    glm_mat4_identity(ModelViewMatrix);
-    Temp[0] = -RenderObject->Center[0];
-    Temp[1] = -RenderObject->Center[1];
-    Temp[2] = -RenderObject->Center[2];
-    glm_vec3_rotate(Temp, DEGTORAD(180.f), GLM_XUP);    
-    glm_translate(ModelMatrix,Temp);
-    Temp[0] = 0;
-    Temp[1] = 1;
-    Temp[2] = 0;
-    glm_rotate(ModelMatrix,glm_rad(-90), Temp);
-    glm_scale(ModelMatrix,RenderObject->Scale);
-    glm_mat4_mul(Camera->ViewMatrix,ModelMatrix,ModelViewMatrix);
-    glm_mat4_mul(ProjectionMatrix,ModelViewMatrix,MVPMatrix);
-    //Emulate PSX Coordinate system...
-    glm_rotate_x(MVPMatrix,glm_rad(180.f), MVPMatrix);
+    BSDGetRenderObjectMVPMatrix(RenderObject,Camera,ProjectionMatrix,MVPMatrix);
         
     glUseProgram(RenderObject->RenderObjectShader->Shader->ProgramId);
     glUniform1i(RenderObject->RenderObjectShader->EnableLightingId, EnableAmbientLight->IValue);
+    glUniform1i(RenderObject->RenderObjectShader->EnableAnimatedLightsId, 0);
     glUniformMatrix4fv(RenderObject->RenderObjectShader->MVPMatrixId,1,false,&MVPMatrix[0][0]);
+    glUniform1i(RenderObject->RenderObjectShader->NativeVRAMId, VRAM->NativeLayout);
+    glUniform1i(RenderObject->RenderObjectShader->AtlasModeId, RenderObject->Atlas != NULL);
     
-    glActiveTexture(GL_TEXTURE0 + 0);
-    glBindTexture(GL_TEXTURE_2D, VRAM->TextureIndexPage.TextureId);
-    glActiveTexture(GL_TEXTURE0 + 1);
-    glBindTexture(GL_TEXTURE_2D, VRAM->PalettePage.TextureId);
+    VRAMBindTextures(VRAM);
 
     glDisable(GL_BLEND);
     for( Iterator = RenderObject->VAO; Iterator; Iterator = Iterator->Next ) {
         glBindVertexArray(Iterator->VAOId[0]);
-        glDrawArrays(GL_TRIANGLES, 0, Iterator->Count);
+        LOD = BSDRenderObjectGetLOD(RenderObject,Iterator);
+        if( Iterator->IBOId[0] && LOD ) {
+            LODUpdateLevel(LOD,MVPMatrix,ProjectionMatrix[1][1] * RenderObject->Scale[1]);
+            LODDrawElements(Iterator,LOD);
+        } else if( Iterator->IBOId[0] ) {
+            glDrawElements(GL_TRIANGLES, Iterator->Count, GL_UNSIGNED_INT, 0);
+        } else {
+            glDrawArrays(GL_TRIANGLES, 0, Iterator->Count);
+        }
         glBindVertexArray(0);
     }
     glActiveTexture(GL_TEXTURE0 + 0);
@@ -931,6 +1059,142 @@ int BSDReadEntryTableChunk(BSD_t *BSD,FILE *BSDFile)
             BSD->EntryTable.AnimationVertexDataOffset + BSD_HEADER_SIZE,BSD->EntryTable.NumAnimationVertex);
     return 1;
 }
+/*
+ * Reads the animated light table.
+ * The table starts with the number of lights followed by one entry (NumColors,StartingColorOffset,ColorIndex,CurrentColor,Delay)
+ * for each light,the colors of each light are stored at StartingColorOffset.
+ * NOTE that the table must end before the RenderObject chunk,entries that don't fit or that point outside the file
+ * are rejected and the corresponding faces will keep their static color.
+ */
+int BSDReadAnimatedLightChunk(BSD_t *BSD,FILE *BSDFile)
+{
+    BSDAnimatedLightTable_t *AnimatedLightTable;
+    BSDAnimatedLight_t *AnimatedLight;
+    int MaxAnimatedLights;
+    int FileLength;
+    int Entry[5];
+    int i;
+    
+    if( !BSD || !BSDFile ) {
+        bool InvalidFile = (BSDFile == NULL ? true : false);
+        printf("BSDReadAnimatedLightChunk: Invalid %s\n",InvalidFile ? "file" : "BSD struct");
+        return 0;
+    }
+    AnimatedLightTable = malloc(sizeof(BSDAnimatedLightTable_t));
+    if( !AnimatedLightTable ) {
+        DPrintf("BSDReadAnimatedLightChunk:Failed to allocate memory for animated light table\n");
+        return 0;
+    }
+    for( i = 0; i < BSD_ANIMATED_LIGHTS_TABLE_SIZE; i++ ) {
+        AnimatedLightTable->AnimatedLightsList[i].NumColors = 0;
+        AnimatedLightTable->AnimatedLightsList[i].ColorList = NULL;
+        AnimatedLightTable->ColorList[i * 3] = -1;
+        AnimatedLightTable->ColorList[i * 3 + 1] = -1;
+        AnimatedLightTable->ColorList[i * 3 + 2] = -1;
+    }
+    FileLength = GetFileLength(BSDFile);
+    MaxAnimatedLights = (BSD_RENDER_OBJECT_STARTING_OFFSET - BSD_ANIMATED_LIGHTS_FILE_POSITION - sizeof(int)) / BSD_ANIMATED_LIGHT_ENTRY_SIZE;
+    fseek(BSDFile,BSD_ANIMATED_LIGHTS_FILE_POSITION + BSD_HEADER_SIZE,SEEK_SET);
+    if( fread(&AnimatedLightTable->NumAnimatedLights,sizeof(AnimatedLightTable->NumAnimatedLights),1,BSDFile) != 1 ) {
+        DPrintf("BSDReadAnimatedLightChunk:Failed to read the number of animated lights\n");
+        goto Failure;
+    }
+    DPrintf("BSDReadAnimatedLightChunk:Reading %i animated lights\n",AnimatedLightTable->NumAnimatedLights);
+    if( AnimatedLightTable->NumAnimatedLights <= 0 || AnimatedLightTable->NumAnimatedLights > MaxAnimatedLights ) {
+        DPrintf("BSDReadAnimatedLightChunk:Invalid number of animated lights %i\n",AnimatedLightTable->NumAnimatedLights);
+        goto Failure;
+    }
+    for( i = 0; i < AnimatedLightTable->NumAnimatedLights; i++ ) {
+        assert(sizeof(Entry) == BSD_ANIMATED_LIGHT_ENTRY_SIZE);
+        if( fread(Entry,sizeof(Entry),1,BSDFile) != 1 ) {
+            DPrintf("BSDReadAnimatedLightChunk:Failed to read light %i\n",i);
+            goto Failure;
+        }
+        AnimatedLight = &AnimatedLightTable->AnimatedLightsList[i];
+        if( Entry[0] <= 0 || Entry[0] > BSD_ANIMATED_LIGHT_MAX_COLORS || Entry[1] < 0 ||
+            Entry[1] + BSD_HEADER_SIZE + Entry[0] * (int) sizeof(Color1i_t) > FileLength ) {
+            DPrintf("BSDReadAnimatedLightChunk:Skipping light %i (NumColors:%i Offset:%i)\n",i,Entry[0],Entry[1]);
+            continue;
+        }
+        AnimatedLight->NumColors = Entry[0];
+        AnimatedLight->StartingColorOffset = Entry[1];
+        AnimatedLight->ColorIndex = Entry[2];
+        AnimatedLight->CurrentColor = Entry[3];
+        AnimatedLight->Delay = Entry[4];
+        AnimatedLight->LastUpdateTime = 0;
+        if( AnimatedLight->ColorIndex < 0 || AnimatedLight->ColorIndex >= AnimatedLight->NumColors ) {
+            AnimatedLight->ColorIndex = 0;
+        }
+    }
+    for( i = 0; i < AnimatedLightTable->NumAnimatedLights; i++ ) {
+        AnimatedLight = &AnimatedLightTable->AnimatedLightsList[i];
+        if( !AnimatedLight->NumColors ) {
+            continue;
+        }
+        AnimatedLight->ColorList = malloc(AnimatedLight->NumColors * sizeof(Color1i_t));
+        if( !AnimatedLight->ColorList ) {
+            DPrintf("BSDReadAnimatedLightChunk:Failed to allocate memory for light %i colors\n",i);
+            goto Failure;
+        }
+        fseek(BSDFile,AnimatedLight->StartingColorOffset + BSD_HEADER_SIZE,SEEK_SET);
+        if( fread(AnimatedLight->ColorList,sizeof(Color1i_t),AnimatedLight->NumColors,BSDFile) != AnimatedLight->NumColors ) {
+            DPrintf("BSDReadAnimatedLightChunk:Failed to read light %i colors\n",i);
+            goto Failure;
+        }
+        AnimatedLight->CurrentColor = AnimatedLight->ColorList[AnimatedLight->ColorIndex].c;
+    }
+    BSD->AnimatedLightTable = AnimatedLightTable;
+    return 1;
+Failure:
+    BSDFreeAnimatedLightTable(AnimatedLightTable);
+    return 0;
+}
+/*
+ * Advances all the animated lights and stores their current color inside the table ColorList.
+ * Lights are stepped at a fixed rate (BSD_ANIMATED_LIGHTS_FRAME_TIME) and move to the next color
+ * once their delay runs out,the delay of each color is stored in its alpha component.
+ */
+void BSDUpdateAnimatedLights(BSDAnimatedLightTable_t *AnimatedLightTable)
+{
+    BSDAnimatedLight_t *AnimatedLight;
+    Color1i_t CurrentColor;
+    int Now;
+    int NumSteps;
+    int i;
+    
+    if( !AnimatedLightTable ) {
+        return;
+    }
+    Now = SysMilliseconds();
+    for( i = 0; i < AnimatedLightTable->NumAnimatedLights; i++ ) {
+        AnimatedLight = &AnimatedLightTable->AnimatedLightsList[i];
+        if( !AnimatedLight->NumColors ) {
+            continue;
+        }
+        if( !AnimatedLight->LastUpdateTime ) {
+            AnimatedLight->LastUpdateTime = Now;
+        }
+        NumSteps = (Now - AnimatedLight->LastUpdateTime) / BSD_ANIMATED_LIGHTS_FRAME_TIME;
+        AnimatedLight->LastUpdateTime += NumSteps * BSD_ANIMATED_LIGHTS_FRAME_TIME;
+        //NOTE(Adriano):Don't try to catch up after a long pause (e.g:window being dragged).
+        if( NumSteps > 1000 / BSD_ANIMATED_LIGHTS_FRAME_TIME ) {
+            NumSteps = 1000 / BSD_ANIMATED_LIGHTS_FRAME_TIME;
+        }
+        while( NumSteps-- > 0 ) {
+            AnimatedLight->Delay--;
+            if( AnimatedLight->Delay > 0 ) {
+                continue;
+            }
+            AnimatedLight->ColorIndex = (AnimatedLight->ColorIndex + 1) % AnimatedLight->NumColors;
+            AnimatedLight->CurrentColor = AnimatedLight->ColorList[AnimatedLight->ColorIndex].c;
+            AnimatedLight->Delay = AnimatedLight->ColorList[AnimatedLight->ColorIndex].rgba[3];
+        }
+        CurrentColor.c = AnimatedLight->CurrentColor;
+        AnimatedLightTable->ColorList[i * 3] = CurrentColor.rgba[0];
+        AnimatedLightTable->ColorList[i * 3 + 1] = CurrentColor.rgba[1];
+        AnimatedLightTable->ColorList[i * 3 + 2] = CurrentColor.rgba[2];
+    }
+}
 BSDRenderObjectElement_t *BSDGetRenderObjectById(const BSD_t *BSD,unsigned int RenderObjectId)
 {
     int i;
@@ -1787,11 +2051,19 @@ BSDRenderObject_t *BSDLoadStaticRenderObject(BSDRenderObjectElement_t RenderObje
     RenderObject->HierarchyDataRoot = NULL;
     RenderObject->AnimationList = NULL;
     RenderObject->VAO = NULL;
+    RenderObject->TexturedVAO = NULL;
+    RenderObject->UntexturedVAO = NULL;
+    memset(&RenderObject->TexturedLOD,0,sizeof(LODMesh_t));
+    memset(&RenderObject->UntexturedLOD,0,sizeof(LODMesh_t));
     RenderObject->CurrentAnimationIndex = -1;
     RenderObject->CurrentFrameIndex = -1;
     RenderObject->Next = NULL;
     RenderObject->TSP = NULL;
+    RenderObject->AnimatedLightTable = NULL;
     RenderObject->RenderObjectShader = NULL;
+    RenderObject->PickData = NULL;
+    RenderObject->Atlas = NULL;
+    RenderObject->Interned = false;
 
     RenderObject->Scale[0] = (float) (RenderObjectElement.ScaleX  / 16) / 4096.f;
     RenderObject->Scale[1] = (float) (RenderObjectElement.ScaleY  / 16) / 4096.f;
@@ -1829,15 +2101,101 @@ BSD_t *BSDLoad(FILE *BSDFile)
     BSD = NULL;
     
     BSD = malloc(sizeof(BSD_t));
+    if( !BSD ) {
+        DPrintf("BSDLoad:Failed to allocate memory for BSD\n");
+        goto Failure;
+    }
+    BSD->RenderObjectTable.RenderObject = NULL;
+    BSD->AnimatedLightTable = NULL;
     if( !BSDReadRenderObjectChunk(BSD,BSDFile) ) {
         goto Failure;
     }
+    //NOTE(Adriano):Animated lights are optional,if the table cannot be read the level keeps its static colors.
+    BSDReadAnimatedLightChunk(BSD,BSDFile);
     return BSD;
 Failure:
     BSDFree(BSD);
     return NULL;
 }
 
+/*
+ * Moves the vertex and face arrays of the render object inside the intern table,models that are contained
+ * inside more than one BSD file are stored only once.
+ * Levels are skipped since their data is stored inside the TSP files.
+ * Returns 1 on success,0 if the arrays could not be moved,in that case the render object is left untouched.
+ */
+static int BSDInternRenderObject(BSDRenderObject_t *RenderObject)
+{
+    void ***SlotList;
+    void **SharedList;
+    int *SizeList;
+    int NumSlots;
+    int i;
+    
+    if( RenderObject->Interned || RenderObject->TSP ) {
+        return 0;
+    }
+    NumSlots = 4 + (RenderObject->VertexTable ? RenderObject->NumVertexTables : 0);
+    SlotList = malloc(NumSlots * sizeof(void **));
+    SharedList = calloc(NumSlots,sizeof(void *));
+    SizeList = malloc(NumSlots * sizeof(int));
+    if( !SlotList || !SharedList || !SizeList ) {
+        DPrintf("BSDInternRenderObject:Failed to allocate memory for %i arrays\n",NumSlots);
+        free(SlotList);
+        free(SharedList);
+        free(SizeList);
+        return 0;
+    }
+    SlotList[0] = (void **) &RenderObject->Vertex;
+    SizeList[0] = RenderObject->NumVertex * sizeof(BSDVertex_t);
+    SlotList[1] = (void **) &RenderObject->TexturedFaceList;
+    SizeList[1] = RenderObject->NumTexturedFaces * sizeof(BSDFace_t);
+    SlotList[2] = (void **) &RenderObject->UntexturedFaceList;
+    SizeList[2] = RenderObject->NumUntexturedFaces * sizeof(BSDFace_t);
+    SlotList[3] = (void **) &RenderObject->FaceList;
+    SizeList[3] = RenderObject->NumFaces * sizeof(BSDAnimatedModelFace_t);
+    for( i = 4; i < NumSlots; i++ ) {
+        SlotList[i] = (void **) &RenderObject->VertexTable[i - 4].VertexList;
+        SizeList[i] = RenderObject->VertexTable[i - 4].NumVertex * sizeof(BSDVertex_t);
+    }
+    for( i = 0; i < NumSlots; i++ ) {
+        if( !*SlotList[i] ) {
+            continue;
+        }
+        SharedList[i] = InternAcquire(INTERN_TYPE_GEOMETRY,*SlotList[i],SizeList[i]);
+        if( !SharedList[i] ) {
+            DPrintf("BSDInternRenderObject:Failed to intern RenderObject %i\n",RenderObject->Id);
+            for( i = 0; i < NumSlots; i++ ) {
+                InternRelease(SharedList[i]);
+            }
+            free(SlotList);
+            free(SharedList);
+            free(SizeList);
+            return 0;
+        }
+    }
+    for( i = 0; i < NumSlots; i++ ) {
+        if( *SlotList[i] ) {
+            free(*SlotList[i]);
+            *SlotList[i] = SharedList[i];
+        }
+    }
+    RenderObject->Interned = true;
+    free(SlotList);
+    free(SharedList);
+    free(SizeList);
+    return 1;
+}
+
+void BSDInternRenderObjectList(BSDRenderObject_t *RenderObjectList)
+{
+    BSDRenderObject_t *Iterator;
+    
+    for( Iterator = RenderObjectList; Iterator; Iterator = Iterator->Next ) {
+        BSDInternRenderObject(Iterator);
+    }
+}
+
 BSDRenderObject_t *BSDLoadAllRenderObjects(const char *FName)
 {
     FILE *BSDFile;
@@ -1867,6 +2225,11 @@ BSDRenderObject_t *BSDLoadAllRenderObjects(const char *FName)
             DPrintf("BSDLoadAllAnimatedRenderObjects:Failed to load animated RenderObject.\n");
             continue;
         }
+        //NOTE(Adriano):The animated lights are used by the level,move them into the render object that holds the TSP.
+        if( RenderObject->TSP && BSD->AnimatedLightTable ) {
+            RenderObject->AnimatedLightTable = BSD->AnimatedLightTable;
+            BSD->AnimatedLightTable = NULL;
+        }
         BSDAppendRenderObjectToList(&RenderObjectList,RenderObject);
     }
     BSDFree(BSD);
@@ -24,9 +24,13 @@
 #include "../Common/VAO.h"
 #include "../Common/ShaderManager.h"
 #include "../Common/VRAM.h"
+#include "LOD.h"
 
 #define BSD_HEADER_SIZE 2048
 #define BSD_ANIMATED_LIGHTS_TABLE_SIZE 40
+#define BSD_ANIMATED_LIGHT_ENTRY_SIZE 20
+#define BSD_ANIMATED_LIGHT_MAX_COLORS 256
+#define BSD_ANIMATED_LIGHTS_FRAME_TIME 33
 #define JP_RENDER_OBJECT_SIZE 2124
 #define BSD_ANIMATION_FRAME_DATA_SIZE 20
 #define BSD_ANIMATED_LIGHTS_FILE_POSITION 0xD8
@@ -68,6 +72,11 @@ typedef struct RenderObjectShader_s {
     int             EnableLightingId;
     int             PaletteTextureId;
     int             TextureIndexId;
+    int             EnableAnimatedLightsId;
+    int             AnimatedLightColorsId;
+    int             NativeVRAMId;
+    int             AtlasTextureId;
+    int             AtlasModeId;
     Shader_t        *Shader;
 } RenderObjectShader_t;
 
@@ -273,6 +282,24 @@ typedef struct BSDFace_s {
 
 } BSDFace_t;
 
+typedef struct BSDAnimatedLight_s {
+    int         NumColors;
+    int         StartingColorOffset;
+    int         ColorIndex;
+    int         CurrentColor;
+    int         Delay;
+    Color1i_t   *ColorList;
+    int         LastUpdateTime;
+} BSDAnimatedLight_t;
+
+//NOTE(Adriano):ColorList contains the current color of each light (RGB triplets) and is uploaded to the shader every frame,
+//              lights that are not animated are stored as -1.
+typedef struct BSDAnimatedLightTable_s {
+    int                 NumAnimatedLights;
+    BSDAnimatedLight_t  AnimatedLightsList[BSD_ANIMATED_LIGHTS_TABLE_SIZE];
+    int                 ColorList[BSD_ANIMATED_LIGHTS_TABLE_SIZE * 3];
+} BSDAnimatedLightTable_t;
+
 typedef struct TSP_s TSP_t;
 typedef struct BSDRenderObject_s {
     int                         Id;
@@ -301,9 +328,22 @@ typedef struct BSDRenderObject_s {
     vec3                        Scale;
     vec3                        Center;
     VAO_t                       *VAO;
+    //NOTE(Adriano):Detail levels of the static VAOs,both are stored inside the VAO list.
+    VAO_t                       *TexturedVAO;
+    VAO_t                       *UntexturedVAO;
+    LODMesh_t                   TexturedLOD;
+    LODMesh_t                   UntexturedLOD;
     
     TSP_t                       *TSP;
+    BSDAnimatedLightTable_t     *AnimatedLightTable;
     RenderObjectShader_t        *RenderObjectShader;
+    //NOTE(Adriano):Not owned,when set face UVs point inside the atlas instead of the expanded VRAM.
+    VRAMAtlas_t                 *Atlas;
+    //NOTE(Adriano):Built on the first pick request.
+    struct PickData_s           *PickData;
+    //NOTE(Adriano):When set vertex and face arrays point inside the intern table and are shared with identical
+    //              render objects loaded from other packs.
+    bool                        Interned;
 
     struct BSDRenderObject_s *Next;
 } BSDRenderObject_t;
@@ -311,21 +351,26 @@ typedef struct BSDRenderObject_s {
 typedef struct BSD_s {
     BSDEntryTable_t         EntryTable;
     BSDRenderObjectBlock_t  RenderObjectTable;
+    BSDAnimatedLightTable_t *AnimatedLightTable;
 } BSD_t;
 
 typedef struct Camera_s Camera_t;
 
 BSDRenderObject_t           *BSDLoadAllRenderObjects(const char *FName);
+void                        BSDInternRenderObjectList(BSDRenderObject_t *RenderObjectList);
 char                        *BSDGetRenderObjectFileName(BSDRenderObject_t *RenderObject);
 
 void                        BSDDrawRenderObjectList(BSDRenderObject_t *RenderObjectList,VRAM_t *VRAM,Camera_t *Camera,mat4 ProjectionMatrix);
 void                        BSDDrawRenderObject(BSDRenderObject_t *RenderObject,VRAM_t *VRAM,Camera_t *Camera,mat4 ProjectionMatrix);
+void                        BSDGetRenderObjectMVPMatrix(BSDRenderObject_t *RenderObject,Camera_t *Camera,mat4 ProjectionMatrix,mat4 MVPMatrix);
+LODMesh_t                   *BSDRenderObjectGetLOD(BSDRenderObject_t *RenderObject,VAO_t *VAO);
 void                        BSDRecursivelyApplyHierachyData(const BSDHierarchyBone_t *Bone,const BSDQuaternion_t *QuaternionList,
                                                     BSDVertexTable_t *VertexTable,mat4 TransformMatrix);
 int                         BSDRenderObjectSetAnimationPose(BSDRenderObject_t *RenderObject,int AnimationIndex,int FrameIndex,int Override);
 BSDAnimationFrame_t         *BSDRenderObjectGetCurrentFrame(BSDRenderObject_t *RenderObject);
 void                        BSDRenderObjectResetFrameQuaternionList(BSDAnimationFrame_t *Frame);
 
+void                        BSDUpdateAnimatedLights(BSDAnimatedLightTable_t *AnimatedLightTable);
 void                        BSDRenderObjectGenerateVAO(BSDRenderObject_t *RenderObject);
 void                        BSDRenderObjectExportToPly(BSDRenderObject_t *RenderObject,VRAM_t *VRAM,const char *Directory,char *BSDFileName);
 void                        BSDFree(BSD_t *BSD);
@@ -0,0 +1,840 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#include "BVH.h"
+#include "../Common/ThreadPool.h"
+#include <float.h>
+
+#define BVH_MIN_TRIANGLES_PER_BOUNDS_TASK   4096
+#define BVH_STACK_SIZE                      (BVH_MAX_DEPTH * 2)
+
+typedef struct BVHNodeArray_s {
+    BVHNode_t   *List;
+    int         NumNodes;
+    int         Capacity;
+    bool        Failed;
+} BVHNodeArray_t;
+
+typedef struct BVHBin_s {
+    vec3    Min;
+    vec3    Max;
+    int     NumTriangles;
+} BVHBin_t;
+
+typedef struct BVHSplit_s {
+    int     Axis;
+    int     Bin;
+    float   CentroidMin;
+    float   Scale;
+} BVHSplit_t;
+
+typedef struct BVHBuildContext_s {
+    BVH_t           *BVH;
+    vec3            *CentroidList;
+    vec3            *BoundMinList;
+    vec3            *BoundMaxList;
+    int             NumBoundsTasks;
+    int             *RootList;
+    int             *RootDepthList;
+    BVHNodeArray_t  *SubtreeList;
+} BVHBuildContext_t;
+
+static int BVHAllocNodes(BVHNodeArray_t *Array,int Count)
+{
+    BVHNode_t *NewList;
+    int NewCapacity;
+    int Index;
+    
+    if( Array->NumNodes + Count > Array->Capacity ) {
+        NewCapacity = Array->Capacity * 2;
+        if( NewCapacity < Array->NumNodes + Count ) {
+            NewCapacity = Array->NumNodes + Count;
+        }
+        if( NewCapacity < 64 ) {
+            NewCapacity = 64;
+        }
+        NewList = realloc(Array->List,NewCapacity * sizeof(BVHNode_t));
+        if( !NewList ) {
+            DPrintf("BVHAllocNodes:Failed to allocate memory for %i nodes\n",NewCapacity);
+            Array->Failed = true;
+            return -1;
+        }
+        Array->List = NewList;
+        Array->Capacity = NewCapacity;
+    }
+    Index = Array->NumNodes;
+    Array->NumNodes += Count;
+    return Index;
+}
+
+static void BVHComputeTriangleBounds(void *UserData,int TaskIndex)
+{
+    BVHBuildContext_t *Context;
+    vec3 *Vertex;
+    int Start;
+    int End;
+    int i;
+    
+    Context = (BVHBuildContext_t *) UserData;
+    Start = (int) (((long long) Context->BVH->NumTriangles * TaskIndex) / Context->NumBoundsTasks);
+    End = (int) (((long long) Context->BVH->NumTriangles * (TaskIndex + 1)) / Context->NumBoundsTasks);
+    for( i = Start; i < End; i++ ) {
+        Vertex = &Context->BVH->VertexList[i * 3];
+        glm_vec3_minv(Vertex[0],Vertex[1],Context->BoundMinList[i]);
+        glm_vec3_minv(Context->BoundMinList[i],Vertex[2],Context->BoundMinList[i]);
+        glm_vec3_maxv(Vertex[0],Vertex[1],Context->BoundMaxList[i]);
+        glm_vec3_maxv(Context->BoundMaxList[i],Vertex[2],Context->BoundMaxList[i]);
+        glm_vec3_lerp(Context->BoundMinList[i],Context->BoundMaxList[i],0.5f,Context->CentroidList[i]);
+    }
+}
+
+static void BVHClearBounds(vec3 Min,vec3 Max)
+{
+    Min[0] = Min[1] = Min[2] = FLT_MAX;
+    Max[0] = Max[1] = Max[2] = -FLT_MAX;
+}
+
+static float BVHGetHalfSurfaceArea(vec3 Min,vec3 Max)
+{
+    vec3 Extent;
+    
+    glm_vec3_sub(Max,Min,Extent);
+    return Extent[0] * Extent[1] + Extent[1] * Extent[2] + Extent[2] * Extent[0];
+}
+
+static void BVHUpdateNodeBounds(BVHBuildContext_t *Context,BVHNode_t *Node)
+{
+    int Triangle;
+    int i;
+    
+    BVHClearBounds(Node->Min,Node->Max);
+    for( i = 0; i < Node->NumTriangles; i++ ) {
+        Triangle = Context->BVH->TriangleIndexList[Node->LeftFirst + i];
+        glm_vec3_minv(Node->Min,Context->BoundMinList[Triangle],Node->Min);
+        glm_vec3_maxv(Node->Max,Context->BoundMaxList[Triangle],Node->Max);
+    }
+}
+
+static int BVHGetBin(const BVHSplit_t *Split,const vec3 Centroid)
+{
+    int Bin;
+    
+    Bin = (int) ((Centroid[Split->Axis] - Split->CentroidMin) * Split->Scale);
+    return Bin < BVH_NUM_BINS - 1 ? Bin : BVH_NUM_BINS - 1;
+}
+
+/*
+ * Evaluates the surface area heuristic for BVH_NUM_BINS evenly spaced planes on each axis.
+ * Returns 0 when keeping the node as a leaf is cheaper than the best split.
+ */
+static int BVHFindSplit(BVHBuildContext_t *Context,BVHNode_t *Node,BVHSplit_t *BestSplit)
+{
+    BVHBin_t BinList[BVH_NUM_BINS];
+    BVHSplit_t Split;
+    vec3 CentroidMin;
+    vec3 CentroidMax;
+    vec3 Min;
+    vec3 Max;
+    float LeftArea[BVH_NUM_BINS];
+    int LeftCount[BVH_NUM_BINS];
+    float Extent;
+    float Cost;
+    float BestCost;
+    float NodeArea;
+    int Count;
+    int Triangle;
+    int Bin;
+    int i;
+    
+    BVHClearBounds(CentroidMin,CentroidMax);
+    for( i = 0; i < Node->NumTriangles; i++ ) {
+        Triangle = Context->BVH->TriangleIndexList[Node->LeftFirst + i];
+        glm_vec3_minv(CentroidMin,Context->CentroidList[Triangle],CentroidMin);
+        glm_vec3_maxv(CentroidMax,Context->CentroidList[Triangle],CentroidMax);
+    }
+    BestCost = FLT_MAX;
+    for( Split.Axis = 0; Split.Axis < 3; Split.Axis++ ) {
+        Extent = CentroidMax[Split.Axis] - CentroidMin[Split.Axis];
+        if( Extent <= 0.f ) {
+            continue;
+        }
+        Split.CentroidMin = CentroidMin[Split.Axis];
+        Split.Scale = BVH_NUM_BINS / Extent;
+        for( Bin = 0; Bin < BVH_NUM_BINS; Bin++ ) {
+            BVHClearBounds(BinList[Bin].Min,BinList[Bin].Max);
+            BinList[Bin].NumTriangles = 0;
+        }
+        for( i = 0; i < Node->NumTriangles; i++ ) {
+            Triangle = Context->BVH->TriangleIndexList[Node->LeftFirst + i];
+            Bin = BVHGetBin(&Split,Context->CentroidList[Triangle]);
+            BinList[Bin].NumTriangles++;
+            glm_vec3_minv(BinList[Bin].Min,Context->BoundMinList[Triangle],BinList[Bin].Min);
+            glm_vec3_maxv(BinList[Bin].Max,Context->BoundMaxList[Triangle],BinList[Bin].Max);
+        }
+        //NOTE(Adriano):Split planes are placed after each bin,sweep from the left and then from the right.
+        BVHClearBounds(Min,Max);
+        Count = 0;
+        for( Bin = 0; Bin < BVH_NUM_BINS - 1; Bin++ ) {
+            Count += BinList[Bin].NumTriangles;
+            glm_vec3_minv(Min,BinList[Bin].Min,Min);
+            glm_vec3_maxv(Max,BinList[Bin].Max,Max);
+            LeftCount[Bin] = Count;
+            LeftArea[Bin] = Count ? BVHGetHalfSurfaceArea(Min,Max) : 0.f;
+        }
+        BVHClearBounds(Min,Max);
+        Count = 0;
+        for( Bin = BVH_NUM_BINS - 1; Bin > 0; Bin-- ) {
+            Count += BinList[Bin].NumTriangles;
+            glm_vec3_minv(Min,BinList[Bin].Min,Min);
+            glm_vec3_maxv(Max,BinList[Bin].Max,Max);
+            if( !Count || !LeftCount[Bin - 1] ) {
+                continue;
+            }
+            Cost = LeftArea[Bin - 1] * LeftCount[Bin - 1] + BVHGetHalfSurfaceArea(Min,Max) * Count;
+            if( Cost < BestCost ) {
+                BestCost = Cost;
+                Split.Bin = Bin;
+                *BestSplit = Split;
+            }
+        }
+    }
+    if( BestCost == FLT_MAX ) {
+        return 0;
+    }
+    NodeArea = BVHGetHalfSurfaceArea(Node->Min,Node->Max);
+    if( Node->NumTriangles > BVH_MAX_LEAF_TRIANGLES ) {
+        return 1;
+    }
+    if( NodeArea <= 0.f ) {
+        return 0;
+    }
+    return BVH_TRAVERSAL_COST + BVH_INTERSECTION_COST * BestCost / NodeArea < BVH_INTERSECTION_COST * Node->NumTriangles;
+}
+
+/*
+ * Splits a leaf in two children,returns 0 if the node has to stay a leaf.
+ */
+static int BVHSplitNode(BVHBuildContext_t *Context,BVHNodeArray_t *Array,int NodeIndex)
+{
+    BVHNode_t *Node;
+    BVHNode_t *Left;
+    BVHNode_t *Right;
+    BVHSplit_t Split;
+    int *TriangleIndexList;
+    int First;
+    int NumTriangles;
+    int LeftIndex;
+    int Temp;
+    int i;
+    int j;
+    
+    Node = &Array->List[NodeIndex];
+    if( Node->NumTriangles <= 1 || !BVHFindSplit(Context,Node,&Split) ) {
+        return 0;
+    }
+    TriangleIndexList = Context->BVH->TriangleIndexList;
+    First = Node->LeftFirst;
+    NumTriangles = Node->NumTriangles;
+    i = First;
+    j = First + NumTriangles - 1;
+    while( i <= j ) {
+        if( BVHGetBin(&Split,Context->CentroidList[TriangleIndexList[i]]) < Split.Bin ) {
+            i++;
+        } else {
+            Temp = TriangleIndexList[i];
+            TriangleIndexList[i] = TriangleIndexList[j];
+            TriangleIndexList[j--] = Temp;
+        }
+    }
+    if( i == First || i == First + NumTriangles ) {
+        return 0;
+    }
+    LeftIndex = BVHAllocNodes(Array,2);
+    if( LeftIndex == -1 ) {
+        return 0;
+    }
+    Node = &Array->List[NodeIndex];
+    Left = &Array->List[LeftIndex];
+    Right = &Array->List[LeftIndex + 1];
+    Left->LeftFirst = First;
+    Left->NumTriangles = i - First;
+    Right->LeftFirst = i;
+    Right->NumTriangles = NumTriangles - Left->NumTriangles;
+    BVHUpdateNodeBounds(Context,Left);
+    BVHUpdateNodeBounds(Context,Right);
+    Node->LeftFirst = LeftIndex;
+    Node->NumTriangles = 0;
+    return 1;
+}
+
+static void BVHBuildSubtree(BVHBuildContext_t *Context,BVHNodeArray_t *Array,int RootIndex,int RootDepth)
+{
+    int Stack[BVH_STACK_SIZE];
+    int DepthStack[BVH_STACK_SIZE];
+    int StackSize;
+    int NodeIndex;
+    int Depth;
+    int LeftIndex;
+    
+    Stack[0] = RootIndex;
+    DepthStack[0] = RootDepth;
+    StackSize = 1;
+    while( StackSize > 0 ) {
+        StackSize--;
+        NodeIndex = Stack[StackSize];
+        Depth = DepthStack[StackSize];
+        if( Depth >= BVH_MAX_DEPTH - 1 || !BVHSplitNode(Context,Array,NodeIndex) ) {
+            continue;
+        }
+        LeftIndex = Array->List[NodeIndex].LeftFirst;
+        Stack[StackSize] = LeftIndex + 1;
+        DepthStack[StackSize++] = Depth + 1;
+        Stack[StackSize] = LeftIndex;
+        DepthStack[StackSize++] = Depth + 1;
+    }
+}
+
+static void BVHBuildSubtreeTask(void *UserData,int TaskIndex)
+{
+    BVHBuildContext_t *Context;
+    BVHNodeArray_t *Array;
+    
+    Context = (BVHBuildContext_t *) UserData;
+    Array = &Context->SubtreeList[TaskIndex];
+    if( BVHAllocNodes(Array,1) == -1 ) {
+        return;
+    }
+    Array->List[0] = Context->BVH->NodeList[Context->RootList[TaskIndex]];
+    BVHBuildSubtree(Context,Array,0,Context->RootDepthList[TaskIndex]);
+}
+
+/*
+ * Moves the nodes of a subtree built by a task at the end of the tree.
+ * Node 0 of the subtree replaces its root while the others are appended.
+ */
+static int BVHMergeSubtree(BVHNodeArray_t *Tree,BVHNodeArray_t *Subtree,int RootIndex)
+{
+    BVHNode_t *Node;
+    int Base;
+    int i;
+    
+    Base = Tree->NumNodes;
+    if( Subtree->NumNodes > 1 && BVHAllocNodes(Tree,Subtree->NumNodes - 1) == -1 ) {
+        return 0;
+    }
+    for( i = 0; i < Subtree->NumNodes; i++ ) {
+        Node = &Subtree->List[i];
+        if( !Node->NumTriangles ) {
+            Node->LeftFirst = Base + Node->LeftFirst - 1;
+        }
+        if( i == 0 ) {
+            Tree->List[RootIndex] = *Node;
+        } else {
+            Tree->List[Base + i - 1] = *Node;
+        }
+    }
+    return 1;
+}
+
+void BVHFree(BVH_t *BVH)
+{
+    if( !BVH ) {
+        return;
+    }
+    if( BVH->NodeList ) {
+        free(BVH->NodeList);
+    }
+    if( BVH->VertexList ) {
+        free(BVH->VertexList);
+    }
+    if( BVH->TriangleIndexList ) {
+        free(BVH->TriangleIndexList);
+    }
+    free(BVH);
+}
+
+/*
+ * Builds a bounding volume hierarchy over a triangle soup (3 vertices for each triangle) using
+ * the surface area heuristic.
+ * The upper levels are split on the calling thread until there are enough subtrees to keep the thread
+ * pool busy,then each subtree is built by a separate task.
+ * The BVH takes ownership of VertexList which is freed even if the build fails.
+ */
+BVH_t *BVHBuild(vec3 *VertexList,int NumTriangles)
+{
+    BVHBuildContext_t Context;
+    BVHNodeArray_t Tree;
+    BVH_t *BVH;
+    vec3 *SortedVertexList;
+    int *PendingList;
+    int *PendingDepthList;
+    int NumPending;
+    int NumRoots;
+    int MaxRoots;
+    int Largest;
+    int NodeIndex;
+    int Depth;
+    int LeftIndex;
+    int i;
+    
+    if( !VertexList || NumTriangles <= 0 ) {
+        DPrintf("BVHBuild:No triangles to build from\n");
+        if( VertexList ) {
+            free(VertexList);
+        }
+        return NULL;
+    }
+    memset(&Context,0,sizeof(Context));
+    memset(&Tree,0,sizeof(Tree));
+    PendingList = NULL;
+    PendingDepthList = NULL;
+    NumRoots = 0;
+    BVH = malloc(sizeof(BVH_t));
+    if( !BVH ) {
+        DPrintf("BVHBuild:Failed to allocate memory for BVH\n");
+        free(VertexList);
+        return NULL;
+    }
+    BVH->NodeList = NULL;
+    BVH->NumNodes = 0;
+    BVH->VertexList = VertexList;
+    BVH->NumTriangles = NumTriangles;
+    BVH->TriangleIndexList = malloc(NumTriangles * sizeof(int));
+    Context.BVH = BVH;
+    Context.CentroidList = malloc(NumTriangles * sizeof(vec3));
+    Context.BoundMinList = malloc(NumTriangles * sizeof(vec3));
+    Context.BoundMaxList = malloc(NumTriangles * sizeof(vec3));
+    MaxRoots = ThreadPoolGetNumThreads() * 4;
+    PendingList = malloc((MaxRoots + 2) * sizeof(int));
+    PendingDepthList = malloc((MaxRoots + 2) * sizeof(int));
+    Context.RootList = malloc((MaxRoots + 2) * sizeof(int));
+    Context.RootDepthList = malloc((MaxRoots + 2) * sizeof(int));
+    if( !BVH->TriangleIndexList || !Context.CentroidList || !Context.BoundMinList || !Context.BoundMaxList ||
+        !PendingList || !PendingDepthList || !Context.RootList || !Context.RootDepthList ) {
+        DPrintf("BVHBuild:Failed to allocate memory for %i triangles\n",NumTriangles);
+        goto Failure;
+    }
+    for( i = 0; i < NumTriangles; i++ ) {
+        BVH->TriangleIndexList[i] = i;
+    }
+    Context.NumBoundsTasks = NumTriangles / BVH_MIN_TRIANGLES_PER_BOUNDS_TASK;
+    if( Context.NumBoundsTasks > MaxRoots ) {
+        Context.NumBoundsTasks = MaxRoots;
+    }
+    if( Context.NumBoundsTasks < 1 ) {
+        Context.NumBoundsTasks = 1;
+    }
+    ThreadPoolParallelFor(Context.NumBoundsTasks,BVHComputeTriangleBounds,&Context);
+    
+    if( BVHAllocNodes(&Tree,1) == -1 ) {
+        goto Failure;
+    }
+    Tree.List[0].LeftFirst = 0;
+    Tree.List[0].NumTriangles = NumTriangles;
+    BVHUpdateNodeBounds(&Context,&Tree.List[0]);
+    PendingList[0] = 0;
+    PendingDepthList[0] = 0;
+    NumPending = 1;
+    while( NumPending > 0 && NumPending + NumRoots < MaxRoots ) {
+        Largest = 0;
+        for( i = 1; i < NumPending; i++ ) {
+            if( Tree.List[PendingList[i]].NumTriangles > Tree.List[PendingList[Largest]].NumTriangles ) {
+                Largest = i;
+            }
+        }
+        NodeIndex = PendingList[Largest];
+        Depth = PendingDepthList[Largest];
+        NumPending--;
+        PendingList[Largest] = PendingList[NumPending];
+        PendingDepthList[Largest] = PendingDepthList[NumPending];
+        if( Tree.List[NodeIndex].NumTriangles < BVH_MIN_TRIANGLES_PER_TASK ) {
+            Context.RootList[NumRoots] = NodeIndex;
+            Context.RootDepthList[NumRoots++] = Depth;
+            break;
+        }
+        if( Depth >= BVH_MAX_DEPTH - 1 || !BVHSplitNode(&Context,&Tree,NodeIndex) ) {
+            continue;
+        }
+        LeftIndex = Tree.List[NodeIndex].LeftFirst;
+        PendingList[NumPending] = LeftIndex;
+        PendingDepthList[NumPending++] = Depth + 1;
+        PendingList[NumPending] = LeftIndex + 1;
+        PendingDepthList[NumPending++] = Depth + 1;
+    }
+    for( i = 0; i < NumPending; i++ ) {
+        Context.RootList[NumRoots] = PendingList[i];
+        Context.RootDepthList[NumRoots++] = PendingDepthList[i];
+    }
+    if( Tree.Failed ) {
+        goto Failure;
+    }
+    Context.SubtreeList = calloc(NumRoots,sizeof(BVHNodeArray_t));
+    if( !Context.SubtreeList ) {
+        DPrintf("BVHBuild:Failed to allocate memory for %i subtrees\n",NumRoots);
+        goto Failure;
+    }
+    BVH->NodeList = Tree.List;
+    ThreadPoolParallelFor(NumRoots,BVHBuildSubtreeTask,&Context);
+    for( i = 0; i < NumRoots; i++ ) {
+        if( Context.SubtreeList[i].Failed || !Context.SubtreeList[i].NumNodes || 
+            !BVHMergeSubtree(&Tree,&Context.SubtreeList[i],Context.RootList[i]) ) {
+            BVH->NodeList = NULL;
+            goto Failure;
+        }
+    }
+    BVH->NodeList = Tree.List;
+    BVH->NumNodes = Tree.NumNodes;
+    Tree.List = NULL;
+    //NOTE(Adriano):Store the vertices in leaf order so that each leaf reads a contiguous block.
+    SortedVertexList = malloc(NumTriangles * 3 * sizeof(vec3));
+    if( !SortedVertexList ) {
+        DPrintf("BVHBuild:Failed to allocate memory for sorted vertices\n");
+        goto Failure;
+    }
+    for( i = 0; i < NumTriangles; i++ ) {
+        memcpy(&SortedVertexList[i * 3],&BVH->VertexList[BVH->TriangleIndexList[i] * 3],3 * sizeof(vec3));
+    }
+    free(BVH->VertexList);
+    BVH->VertexList = SortedVertexList;
+    goto Cleanup;
+Failure:
+    BVHFree(BVH);
+    BVH = NULL;
+Cleanup:
+    if( Tree.List ) {
+        free(Tree.List);
+    }
+    if( Context.SubtreeList ) {
+        for( i = 0; i < NumRoots; i++ ) {
+            if( Context.SubtreeList[i].List ) {
+                free(Context.SubtreeList[i].List);
+            }
+        }
+        free(Context.SubtreeList);
+    }
+    if( Context.CentroidList ) {
+        free(Context.CentroidList);
+    }
+    if( Context.BoundMinList ) {
+        free(Context.BoundMinList);
+    }
+    if( Context.BoundMaxList ) {
+        free(Context.BoundMaxList);
+    }
+    if( Context.RootList ) {
+        free(Context.RootList);
+    }
+    if( Context.RootDepthList ) {
+        free(Context.RootDepthList);
+    }
+    if( PendingList ) {
+        free(PendingList);
+    }
+    if( PendingDepthList ) {
+        free(PendingDepthList);
+    }
+    return BVH;
+}
+
+static void BVHGetInverseDirection(vec3 Direction,vec3 InverseDirection)
+{
+    int i;
+    
+    for( i = 0; i < 3; i++ ) {
+        if( fabsf(Direction[i]) < 1e-8f ) {
+            InverseDirection[i] = Direction[i] < 0.f ? -1e8f : 1e8f;
+        } else {
+            InverseDirection[i] = 1.f / Direction[i];
+        }
+    }
+}
+
+/*
+ * Slab test,returns the entry distance or FLT_MAX if the ray misses the box or enters it after MaxDistance.
+ */
+static float BVHIntersectBox(const BVHNode_t *Node,vec3 Origin,vec3 InverseDirection,float MaxDistance)
+{
+    float Near;
+    float Far;
+    float T0;
+    float T1;
+    int i;
+    
+    Near = -FLT_MAX;
+    Far = FLT_MAX;
+    for( i = 0; i < 3; i++ ) {
+        T0 = (Node->Min[i] - Origin[i]) * InverseDirection[i];
+        T1 = (Node->Max[i] - Origin[i]) * InverseDirection[i];
+        Near = fmaxf(Near,fminf(T0,T1));
+        Far = fminf(Far,fmaxf(T0,T1));
+    }
+    if( Far < Near || Far < 0.f || Near >= MaxDistance ) {
+        return FLT_MAX;
+    }
+    return Near;
+}
+
+/*
+ * Moller-Trumbore ray/triangle intersection,both sides of the triangle are considered.
+ */
+static int BVHIntersectTriangle(vec3 *Vertex,vec3 Origin,vec3 Direction,float *Distance,float *U,float *V)
+{
+    vec3 Edge1;
+    vec3 Edge2;
+    vec3 P;
+    vec3 Q;
+    vec3 T;
+    float Determinant;
+    float InverseDeterminant;
+    
+    glm_vec3_sub(Vertex[1],Vertex[0],Edge1);
+    glm_vec3_sub(Vertex[2],Vertex[0],Edge2);
+    glm_vec3_cross(Direction,Edge2,P);
+    Determinant = glm_vec3_dot(Edge1,P);
+    if( fabsf(Determinant) < 1e-8f ) {
+        return 0;
+    }
+    InverseDeterminant = 1.f / Determinant;
+    glm_vec3_sub(Origin,Vertex[0],T);
+    *U = glm_vec3_dot(T,P) * InverseDeterminant;
+    if( *U < 0.f || *U > 1.f ) {
+        return 0;
+    }
+    glm_vec3_cross(T,Edge1,Q);
+    *V = glm_vec3_dot(Direction,Q) * InverseDeterminant;
+    if( *V < 0.f || *U + *V > 1.f ) {
+        return 0;
+    }
+    *Distance = glm_vec3_dot(Edge2,Q) * InverseDeterminant;
+    return *Distance >= 0.f;
+}
+
+static void BVHIntersectLeaf(BVH_t *BVH,const BVHNode_t *Node,vec3 Origin,vec3 Direction,BVHHit_t *Hit)
+{
+    float Distance;
+    float U;
+    float V;
+    int i;
+    
+    for( i = Node->LeftFirst; i < Node->LeftFirst + Node->NumTriangles; i++ ) {
+        if( BVHIntersectTriangle(&BVH->VertexList[i * 3],Origin,Direction,&Distance,&U,&V) && Distance < Hit->Distance ) {
+            Hit->Distance = Distance;
+            Hit->TriangleIndex = BVH->TriangleIndexList[i];
+            Hit->U = U;
+            Hit->V = V;
+        }
+    }
+}
+
+/*
+ * Finds the closest triangle hit by the ray within MaxDistance.
+ * Children are visited front to back and nodes farther than the closest hit are skipped.
+ * Returns 1 if a triangle was hit.
+ */
+int BVHIntersectRay(BVH_t *BVH,vec3 Origin,vec3 Direction,float MaxDistance,BVHHit_t *Hit)
+{
+    const BVHNode_t *Node;
+    const BVHNode_t *Near;
+    const BVHNode_t *Far;
+    const BVHNode_t *TempNode;
+    vec3 InverseDirection;
+    int Stack[BVH_STACK_SIZE];
+    float DistanceStack[BVH_STACK_SIZE];
+    float NearDistance;
+    float FarDistance;
+    float TempDistance;
+    int StackSize;
+    
+    if( !BVH || !Hit || !BVH->NumNodes ) {
+        return 0;
+    }
+    Hit->Distance = MaxDistance;
+    Hit->TriangleIndex = -1;
+    BVHGetInverseDirection(Direction,InverseDirection);
+    if( BVHIntersectBox(&BVH->NodeList[0],Origin,InverseDirection,MaxDistance) == FLT_MAX ) {
+        return 0;
+    }
+    Node = &BVH->NodeList[0];
+    StackSize = 0;
+    while( 1 ) {
+        if( Node->NumTriangles ) {
+            BVHIntersectLeaf(BVH,Node,Origin,Direction,Hit);
+            Node = NULL;
+        } else {
+            Near = &BVH->NodeList[Node->LeftFirst];
+            Far = Near + 1;
+            NearDistance = BVHIntersectBox(Near,Origin,InverseDirection,Hit->Distance);
+            FarDistance = BVHIntersectBox(Far,Origin,InverseDirection,Hit->Distance);
+            if( FarDistance < NearDistance ) {
+                TempNode = Near;
+                Near = Far;
+                Far = TempNode;
+                TempDistance = NearDistance;
+                NearDistance = FarDistance;
+                FarDistance = TempDistance;
+            }
+            if( FarDistance != FLT_MAX ) {
+                Stack[StackSize] = Far - BVH->NodeList;
+                DistanceStack[StackSize++] = FarDistance;
+            }
+            Node = NearDistance != FLT_MAX ? Near : NULL;
+        }
+        while( !Node && StackSize > 0 ) {
+            StackSize--;
+            if( DistanceStack[StackSize] < Hit->Distance ) {
+                Node = &BVH->NodeList[Stack[StackSize]];
+            }
+        }
+        if( !Node ) {
+            break;
+        }
+    }
+    return Hit->TriangleIndex != -1;
+}
+
+/*
+ * Traverses the tree once for a group of up to BVH_PACKET_SIZE rays,a node is visited when at least one
+ * ray of the packet hits it.
+ * Works best with coherent rays (E.G:adjacent pixels).
+ */
+static int BVHIntersectPacket(BVH_t *BVH,vec3 *OriginList,vec3 *DirectionList,int NumRays,float MaxDistance,BVHHit_t *HitList)
+{
+    const BVHNode_t *Node;
+    const BVHNode_t *Left;
+    vec3 InverseDirectionList[BVH_PACKET_SIZE];
+    int Stack[BVH_STACK_SIZE];
+    float LeftDistance;
+    float RightDistance;
+    int StackSize;
+    int FirstActive;
+    int NumHits;
+    int i;
+    
+    for( i = 0; i < NumRays; i++ ) {
+        BVHGetInverseDirection(DirectionList[i],InverseDirectionList[i]);
+        HitList[i].Distance = MaxDistance;
+        HitList[i].TriangleIndex = -1;
+    }
+    Stack[0] = 0;
+    StackSize = 1;
+    while( StackSize > 0 ) {
+        Node = &BVH->NodeList[Stack[--StackSize]];
+        FirstActive = -1;
+        for( i = 0; i < NumRays; i++ ) {
+            if( BVHIntersectBox(Node,OriginList[i],InverseDirectionList[i],HitList[i].Distance) != FLT_MAX ) {
+                FirstActive = i;
+                break;
+            }
+        }
+        if( FirstActive == -1 ) {
+            continue;
+        }
+        if( Node->NumTriangles ) {
+            for( i = FirstActive; i < NumRays; i++ ) {
+                BVHIntersectLeaf(BVH,Node,OriginList[i],DirectionList[i],&HitList[i]);
+            }
+            continue;
+        }
+        //NOTE(Adriano):Children are ordered using the first ray that hits the node.
+        Left = &BVH->NodeList[Node->LeftFirst];
+        LeftDistance = BVHIntersectBox(Left,OriginList[FirstActive],InverseDirectionList[FirstActive],FLT_MAX);
+        RightDistance = BVHIntersectBox(Left + 1,OriginList[FirstActive],InverseDirectionList[FirstActive],FLT_MAX);
+        if( LeftDistance <= RightDistance ) {
+            Stack[StackSize++] = Node->LeftFirst + 1;
+            Stack[StackSize++] = Node->LeftFirst;
+        } else {
+            Stack[StackSize++] = Node->LeftFirst;
+            Stack[StackSize++] = Node->LeftFirst + 1;
+        }
+    }
+    NumHits = 0;
+    for( i = 0; i < NumRays; i++ ) {
+        if( HitList[i].TriangleIndex != -1 ) {
+            NumHits++;
+        }
+    }
+    return NumHits;
+}
+
+/*
+ * Intersects a list of rays,processing them in packets of BVH_PACKET_SIZE.
+ * Returns the number of rays that hit a triangle.
+ */
+int BVHIntersectRayList(BVH_t *BVH,vec3 *OriginList,vec3 *DirectionList,int NumRays,float MaxDistance,BVHHit_t *HitList)
+{
+    int NumHits;
+    int Count;
+    int i;
+    
+    if( !BVH || !BVH->NumNodes || !OriginList || !DirectionList || !HitList ) {
+        return 0;
+    }
+    NumHits = 0;
+    for( i = 0; i < NumRays; i += BVH_PACKET_SIZE ) {
+        Count = NumRays - i < BVH_PACKET_SIZE ? NumRays - i : BVH_PACKET_SIZE;
+        NumHits += BVHIntersectPacket(BVH,&OriginList[i],&DirectionList[i],Count,MaxDistance,&HitList[i]);
+    }
+    return NumHits;
+}
+
+static bool BVHOverlapBox(const BVHNode_t *Node,vec3 Min,vec3 Max)
+{
+    return Node->Min[0] <= Max[0] && Node->Max[0] >= Min[0] &&
+           Node->Min[1] <= Max[1] && Node->Max[1] >= Min[1] &&
+           Node->Min[2] <= Max[2] && Node->Max[2] >= Min[2];
+}
+/*
+ * Collects the triangles whose leaf overlaps the given box.
+ * The returned indices refer to the leaf ordered VertexList (three vertices for each triangle),at most
+ * MaxTriangles are stored.
+ * Returns the number of triangles found,which is greater than MaxTriangles when the list was too small.
+ */
+int BVHQueryBox(BVH_t *BVH,vec3 Min,vec3 Max,int *TriangleList,int MaxTriangles)
+{
+    const BVHNode_t *Node;
+    int Stack[BVH_STACK_SIZE];
+    int StackSize;
+    int NumTriangles;
+    int i;
+    
+    if( !BVH || !BVH->NumNodes || !TriangleList ) {
+        return 0;
+    }
+    NumTriangles = 0;
+    StackSize = 0;
+    Stack[StackSize++] = 0;
+    while( StackSize > 0 ) {
+        Node = &BVH->NodeList[Stack[--StackSize]];
+        if( !BVHOverlapBox(Node,Min,Max) ) {
+            continue;
+        }
+        if( Node->NumTriangles ) {
+            for( i = 0; i < Node->NumTriangles; i++, NumTriangles++ ) {
+                if( NumTriangles < MaxTriangles ) {
+                    TriangleList[NumTriangles] = Node->LeftFirst + i;
+                }
+            }
+        } else {
+            Stack[StackSize++] = Node->LeftFirst;
+            Stack[StackSize++] = Node->LeftFirst + 1;
+        }
+    }
+    return NumTriangles;
+}
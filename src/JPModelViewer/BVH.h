@@ -0,0 +1,65 @@
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#ifndef __BVH_H_
+#define __BVH_H_
+
+#include "../Common/Common.h"
+
+#define BVH_NUM_BINS                    16
+#define BVH_MAX_LEAF_TRIANGLES          8
+#define BVH_MAX_DEPTH                   64
+#define BVH_PACKET_SIZE                 8
+//NOTE(Adriano):Nodes with less triangles than this are not split any further on the calling thread
+//              and are built as a single task.
+#define BVH_MIN_TRIANGLES_PER_TASK      1024
+#define BVH_TRAVERSAL_COST              1.f
+#define BVH_INTERSECTION_COST           1.f
+
+//NOTE(Adriano):Leaves have NumTriangles != 0 and LeftFirst is the index of the first triangle,
+//              inner nodes store the index of the left child and the right one follows it.
+typedef struct BVHNode_s {
+    vec3    Min;
+    vec3    Max;
+    int     LeftFirst;
+    int     NumTriangles;
+} BVHNode_t;
+
+typedef struct BVH_s {
+    BVHNode_t   *NodeList;
+    int         NumNodes;
+    //NOTE(Adriano):Three vertices for each triangle stored in leaf order,TriangleIndexList maps them
+    //              back to the index used when building the tree.
+    vec3        *VertexList;
+    int         *TriangleIndexList;
+    int         NumTriangles;
+} BVH_t;
+
+typedef struct BVHHit_s {
+    float   Distance;
+    int     TriangleIndex;
+    float   U;
+    float   V;
+} BVHHit_t;
+
+BVH_t   *BVHBuild(vec3 *VertexList,int NumTriangles);
+int     BVHIntersectRay(BVH_t *BVH,vec3 Origin,vec3 Direction,float MaxDistance,BVHHit_t *Hit);
+int     BVHIntersectRayList(BVH_t *BVH,vec3 *OriginList,vec3 *DirectionList,int NumRays,float MaxDistance,BVHHit_t *HitList);
+int     BVHQueryBox(BVH_t *BVH,vec3 Min,vec3 Max,int *TriangleList,int MaxTriangles);
+void    BVHFree(BVH_t *BVH);
+#endif//__BVH_H_
@@ -20,9 +20,12 @@
 */
 #include "Camera.h" 
 #include "JPModelViewer.h"
+#include "Collision.h"
+#include "Heightfield.h"
 
 Config_t *CameraMouseSensitivity;
 Config_t *CameraSpeed;
+Config_t *CameraMode;
 
 void CameraCleanUp(Camera_t *Camera)
 {
@@ -45,6 +48,9 @@ void CameraOnAngleUpdate(Camera_t *Camera)
 }
 void CameraZoom(Camera_t *Camera,float Distance)
 {
+    if( CameraMode->IValue != CAMERA_MODE_ORBIT ) {
+        return;
+    }
     Camera->Position.Radius += Distance * CameraMouseSensitivity->FValue * 10.f;
 }
 void CameraOnMouseEvent(Camera_t *Camera,int Dx,int Dy)
@@ -56,9 +62,13 @@ void CameraOnMouseEvent(Camera_t *Camera,int Dx,int Dy)
 }
 void CameraUpdateEyeVector(Camera_t *Camera)
 {
-    Camera->Eye[0] = Camera->ViewPoint[0] + Camera->Position.Radius * cos(Camera->Position.Theta) * cos(Camera->Position.Phi);
-    Camera->Eye[1] = Camera->ViewPoint[1] + Camera->Position.Radius * sin(Camera->Position.Theta);
-    Camera->Eye[2] = Camera->ViewPoint[2] + Camera->Position.Radius * cos(Camera->Position.Theta) * sin(Camera->Position.Phi);
+    float Radius;
+    
+    //NOTE(Adriano):Fly and walk modes look around from the view point.
+    Radius = CameraMode->IValue == CAMERA_MODE_ORBIT ? Camera->Position.Radius : CAMERA_FIRST_PERSON_RADIUS;
+    Camera->Eye[0] = Camera->ViewPoint[0] + Radius * cos(Camera->Position.Theta) * cos(Camera->Position.Phi);
+    Camera->Eye[1] = Camera->ViewPoint[1] + Radius * sin(Camera->Position.Theta);
+    Camera->Eye[2] = Camera->ViewPoint[2] + Radius * cos(Camera->Position.Theta) * sin(Camera->Position.Phi);
 }
 void CameraGetNormalizedDirection(Camera_t *Camera,vec3 Direction)
 {
@@ -79,13 +89,122 @@ void CameraUpdateViewMatrix(Camera_t *Camera)
     CameraGetForwardVector(Camera,Forward);
     glm_lookat(Camera->Eye,Forward,GLM_YUP,Camera->ViewMatrix);
 }
+/*
+ Fly and walk modes don't move the view point directly,the movement is accumulated and then applied
+ by CameraApplyMovement after testing it against the level.
+ */
+void CameraUpdateMoveDirection(Camera_t *Camera,int Orientation,float Delta)
+{
+    float CamSpeed;
+    vec3 Direction;
+    vec3 Right;
+    
+    CamSpeed = CameraSpeed->FValue * Delta * 128.f;
+    CameraGetNormalizedDirection(Camera,Direction);
+    glm_vec3_cross(GLM_YUP,Direction,Right);    
+    glm_vec3_normalize(Right);
+    if( CameraMode->IValue == CAMERA_MODE_WALK ) {
+        Direction[1] = 0.f;
+        glm_vec3_normalize(Direction);
+    }
+    switch( Orientation ) {
+        case CAMERA_DIRECTION_FORWARD:
+            glm_vec3_muladds(Direction,CamSpeed,Camera->MoveDirection);
+            break;
+        case CAMERA_DIRECTION_BACKWARD:
+            glm_vec3_muladds(Direction,-CamSpeed,Camera->MoveDirection);
+            break;
+        case CAMERA_DIRECTION_LEFTWARD:
+            glm_vec3_muladds(Right,CamSpeed,Camera->MoveDirection);
+            break;
+        case CAMERA_DIRECTION_RIGHTWARD:
+            glm_vec3_muladds(Right,-CamSpeed,Camera->MoveDirection);
+            break;
+        case CAMERA_DIRECTION_UPWARD:
+            if( CameraMode->IValue == CAMERA_MODE_WALK ) {
+                if( Camera->OnGround ) {
+                    Camera->VerticalVelocity = CAMERA_JUMP_SPEED;
+                    Camera->OnGround = false;
+                }
+            } else {
+                Camera->MoveDirection[1] += CamSpeed;
+            }
+            break;
+        case CAMERA_DIRECTION_DOWNWARD:
+            if( CameraMode->IValue != CAMERA_MODE_WALK ) {
+                Camera->MoveDirection[1] -= CamSpeed;
+            }
+            break;
+    }
+}
+/*
+ Applies the movement accumulated during this frame,when a level is available the camera is moved as a sphere
+ sliding along its surfaces.
+ Walk mode also applies gravity and lets the camera climb steps.
+ */
+void CameraApplyMovement(Camera_t *Camera,struct TSP_s *TSPList,float Delta)
+{
+    vec3 Position;
+    vec3 Displacement;
+    vec3 OutPosition;
+    bool OnGround;
+    int FloorY;
+    float Penetration;
+    
+    if( !Camera || CameraMode->IValue == CAMERA_MODE_ORBIT ) {
+        return;
+    }
+    if( CameraMode->IValue == CAMERA_MODE_WALK && TSPList ) {
+        Camera->VerticalVelocity -= CAMERA_GRAVITY * Delta;
+        Camera->MoveDirection[1] += Camera->VerticalVelocity * Delta;
+    } else {
+        Camera->VerticalVelocity = 0.f;
+    }
+    if( !TSPList ) {
+        glm_vec3_add(Camera->ViewPoint,Camera->MoveDirection,Camera->ViewPoint);
+        glm_vec3_zero(Camera->MoveDirection);
+        Camera->OnGround = false;
+        return;
+    }
+    //NOTE(Adriano):Levels are drawn rotated by 180 degrees around the X axis.
+    Position[0] = Camera->ViewPoint[0];
+    Position[1] = -Camera->ViewPoint[1];
+    Position[2] = -Camera->ViewPoint[2];
+    Displacement[0] = Camera->MoveDirection[0];
+    Displacement[1] = -Camera->MoveDirection[1];
+    Displacement[2] = -Camera->MoveDirection[2];
+    CollisionMoveSphere(TSPList,Position,CAMERA_COLLISION_RADIUS,Displacement,
+                        CameraMode->IValue == CAMERA_MODE_WALK ? CAMERA_STEP_HEIGHT : 0.f,OutPosition,&OnGround);
+    //NOTE(Adriano):The sweep only tests the triangles around the sphere and can let it sink into the floor,
+    //              the heightfield (loaded or baked when the level VAOs are created) is used to put it back on top
+    //              of the surface below.
+    if( CameraMode->IValue == CAMERA_MODE_WALK && TSPList->Heightfield &&
+        HeightfieldGetY(TSPList->Heightfield,TSPList,OutPosition,&FloorY,NULL,NULL) ) {
+        Penetration = OutPosition[1] + CAMERA_COLLISION_RADIUS - FloorY;
+        if( Penetration > 0.f && Penetration <= CAMERA_STEP_HEIGHT ) {
+            OutPosition[1] -= Penetration;
+            OnGround = true;
+        }
+    }
+    Camera->ViewPoint[0] = OutPosition[0];
+    Camera->ViewPoint[1] = -OutPosition[1];
+    Camera->ViewPoint[2] = -OutPosition[2];
+    Camera->OnGround = OnGround;
+    if( OnGround && Camera->VerticalVelocity < 0.f ) {
+        Camera->VerticalVelocity = 0.f;
+    }
+    glm_vec3_zero(Camera->MoveDirection);
+}
 void CameraUpdate(Camera_t *Camera,int Orientation, float Delta)
 {
     float CamSpeed;
     vec3 Direction;
     vec3 Right;
 
-    
+    if( CameraMode->IValue != CAMERA_MODE_ORBIT ) {
+        CameraUpdateMoveDirection(Camera,Orientation,Delta);
+        return;
+    }
     CamSpeed = CameraSpeed->FValue * Delta * 128.f;
     CameraGetNormalizedDirection(Camera,Direction);
     glm_vec3_cross(GLM_YUP,Direction,Right);    
@@ -108,6 +227,12 @@ void CameraUpdate(Camera_t *Camera,int Orientation, float Delta)
 }
 void CameraCheckKeyEvents(Camera_t *Camera,const Byte *KeyState,float Delta)
 {
+    if( KeyState[SDL_SCANCODE_W] ) {
+        CameraUpdate(Camera,CAMERA_DIRECTION_FORWARD,Delta);
+    }
+    if( KeyState[SDL_SCANCODE_S] ) {
+        CameraUpdate(Camera,CAMERA_DIRECTION_BACKWARD,Delta);
+    }
     if( KeyState[SDL_SCANCODE_A] ) {
         CameraUpdate(Camera,CAMERA_DIRECTION_LEFTWARD,Delta);
     }
@@ -137,6 +262,9 @@ void CameraReset(Camera_t *Camera)
     Camera->Position.Radius = 350.f;
     Camera->Position.Theta = 0.f;
     Camera->Position.Phi = 0.f;
+    glm_vec3_zero(Camera->MoveDirection);
+    Camera->VerticalVelocity = 0.f;
+    Camera->OnGround = false;
     CameraOnAngleUpdate(Camera);
 }
 Camera_t *CameraInit()
@@ -148,8 +276,9 @@ Camera_t *CameraInit()
         printf("CameraInit:Failed to allocate memory for struct\n");
         return NULL;
     }
-    CameraReset(Camera);
     CameraSpeed = ConfigGet("CameraSpeed");
     CameraMouseSensitivity = ConfigGet("CameraMouseSensitivity");
+    CameraMode = ConfigGet("CameraMode");
+    CameraReset(Camera);
     return Camera;
 }
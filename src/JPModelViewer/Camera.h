@@ -39,6 +39,19 @@ typedef enum {
     CAMERA_DIRECTION_RIGHTWARD
 } CameraDirection_t;
 
+typedef enum {
+    CAMERA_MODE_ORBIT,
+    CAMERA_MODE_FLY,
+    CAMERA_MODE_WALK
+} CameraMode_t;
+
+//NOTE(Adriano):Fly and walk modes move a sphere through the level,values are in level units.
+#define CAMERA_COLLISION_RADIUS     32.f
+#define CAMERA_STEP_HEIGHT          48.f
+#define CAMERA_GRAVITY              4096.f
+#define CAMERA_JUMP_SPEED           1024.f
+#define CAMERA_FIRST_PERSON_RADIUS  1.f
+
 typedef struct PolarCoordinate_s {
     float Radius;
     float Theta;
@@ -50,11 +63,17 @@ typedef struct Camera_s {
     vec3                ViewPoint;
     vec3                Eye;
     mat4                ViewMatrix;
-    
+    //NOTE(Adriano):Movement requested during the current frame,applied by CameraApplyMovement.
+    vec3                MoveDirection;
+    float               VerticalVelocity;
+    bool                OnGround;
 } Camera_t;
 
+struct TSP_s;
+
 extern Config_t *CameraSpeed;
 extern Config_t *CameraMouseSensitivity;
+extern Config_t *CameraMode;
 
 Camera_t    *CameraInit();
 void        CameraBeginFrame(Camera_t *Camera);
@@ -62,5 +81,6 @@ void        CameraReset(Camera_t *Camera);
 void        CameraOnMouseEvent(Camera_t *Camera,int Dx,int Dy);
 void        CameraCheckKeyEvents(Camera_t *Camera,const Byte *KeyState,float Delta);
 void        CameraZoom(Camera_t *Camera,float Distance);
+void        CameraApplyMovement(Camera_t *Camera,struct TSP_s *TSPList,float Delta);
 void        CameraCleanUp(Camera_t *Camera);
 #endif//__CAMERA_H_
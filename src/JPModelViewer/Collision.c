@@ -0,0 +1,1128 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#include "Collision.h"
+#include "../Common/ThreadPool.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//NOTE(Adriano):Faces of a KD tree leaf stored four at a time as structure of arrays.
+//              Each edge is stored as its end point (X,Z) and its delta so that the edge test
+//              matches the one used by TSPPointInTriangle.
+typedef struct CollisionFaceGroup_s {
+    float   EndX[3][4];
+    float   EndZ[3][4];
+    float   DeltaX[3][4];
+    float   DeltaZ[3][4];
+    int     FaceIndex[4];
+    int     NumFaces;
+} CollisionFaceGroup_t;
+
+typedef struct CollisionLeafCache_s {
+    TSPCollision_t          *CollisionData;
+    int                     StartingFaceListIndex;
+    CollisionFaceGroup_t    *GroupList;
+    int                     NumGroups;
+    int                     Capacity;
+} CollisionLeafCache_t;
+
+typedef struct CollisionQuery_s {
+    unsigned int    Key;
+    int             Index;
+    int             TSPIndex;
+} CollisionQuery_t;
+
+typedef struct CollisionSweep_s {
+    BVH_t   *BVH;
+    int     *TriangleList;
+    int     NumTriangles;
+    float   Radius;
+} CollisionSweep_t;
+
+static CollisionMoveStats_t CollisionMoveStats;
+
+typedef struct CollisionBatch_s {
+    CollisionGrid_t     *Grid;
+    CollisionQuery_t    *QueryList;
+    vec3                *PointList;
+    int                 *OutYList;
+    int                 *OutFaceList;
+    int                 *OutNumLayersList;
+    int                 *OutTSPNumberList;
+    int                 MaxLayers;
+    int                 NumQueries;
+    int                 NumTasks;
+    int                 NumHits[256];
+} CollisionBatch_t;
+
+CollisionGrid_t *CollisionCreateGrid(TSP_t *TSPList)
+{
+    CollisionGrid_t *Grid;
+    TSPCollisionHeader_t *Header;
+    TSP_t *Iterator;
+    int MaxX;
+    int MaxZ;
+    int NumCells;
+    int MinCellX;
+    int MinCellZ;
+    int MaxCellX;
+    int MaxCellZ;
+    int Pass;
+    int x;
+    int z;
+    int i;
+    
+    Grid = malloc(sizeof(CollisionGrid_t));
+    if( !Grid ) {
+        DPrintf("CollisionCreateGrid:Failed to allocate memory for grid\n");
+        return NULL;
+    }
+    Grid->CellStart = NULL;
+    Grid->CellTSPList = NULL;
+    Grid->TSPList = NULL;
+    Grid->NumTSP = 0;
+    Grid->MinX = Grid->MinZ = 0;
+    Grid->NumCellsX = Grid->NumCellsZ = 0;
+    Grid->CellSizeX = Grid->CellSizeZ = 1;
+    MaxX = MaxZ = 0;
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        if( !Iterator->CollisionData ) {
+            continue;
+        }
+        Header = &Iterator->CollisionData->Header;
+        if( !Grid->NumTSP ) {
+            Grid->MinX = Header->CollisionBoundMinX;
+            Grid->MinZ = Header->CollisionBoundMinZ;
+            MaxX = Header->CollisionBoundMaxX;
+            MaxZ = Header->CollisionBoundMaxZ;
+        } else {
+            Grid->MinX = Header->CollisionBoundMinX < Grid->MinX ? Header->CollisionBoundMinX : Grid->MinX;
+            Grid->MinZ = Header->CollisionBoundMinZ < Grid->MinZ ? Header->CollisionBoundMinZ : Grid->MinZ;
+            MaxX = Header->CollisionBoundMaxX > MaxX ? Header->CollisionBoundMaxX : MaxX;
+            MaxZ = Header->CollisionBoundMaxZ > MaxZ ? Header->CollisionBoundMaxZ : MaxZ;
+        }
+        Grid->NumTSP++;
+    }
+    if( !Grid->NumTSP ) {
+        return Grid;
+    }
+    Grid->TSPList = malloc(Grid->NumTSP * sizeof(TSP_t *));
+    if( !Grid->TSPList ) {
+        DPrintf("CollisionCreateGrid:Failed to allocate memory for TSP list\n");
+        goto Failure;
+    }
+    i = 0;
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        if( Iterator->CollisionData ) {
+            Grid->TSPList[i++] = Iterator;
+        }
+    }
+    Grid->NumCellsX = Grid->NumTSP == 1 ? 1 : COLLISION_GRID_MAX_CELLS_PER_AXIS;
+    Grid->NumCellsZ = Grid->NumCellsX;
+    Grid->CellSizeX = (MaxX - Grid->MinX) / Grid->NumCellsX + 1;
+    Grid->CellSizeZ = (MaxZ - Grid->MinZ) / Grid->NumCellsZ + 1;
+    NumCells = Grid->NumCellsX * Grid->NumCellsZ;
+    Grid->CellStart = malloc((NumCells + 1) * sizeof(int));
+    if( !Grid->CellStart ) {
+        DPrintf("CollisionCreateGrid:Failed to allocate memory for %i cells\n",NumCells);
+        goto Failure;
+    }
+    memset(Grid->CellStart,0,(NumCells + 1) * sizeof(int));
+    //NOTE(Adriano):First pass counts the entries of each cell,second one fills them using CellStart as cursor.
+    for( Pass = 0; Pass < 2; Pass++ ) {
+        for( i = 0; i < Grid->NumTSP; i++ ) {
+            Header = &Grid->TSPList[i]->CollisionData->Header;
+            MinCellX = (Header->CollisionBoundMinX - Grid->MinX) / Grid->CellSizeX;
+            MinCellZ = (Header->CollisionBoundMinZ - Grid->MinZ) / Grid->CellSizeZ;
+            MaxCellX = (Header->CollisionBoundMaxX - Grid->MinX) / Grid->CellSizeX;
+            MaxCellZ = (Header->CollisionBoundMaxZ - Grid->MinZ) / Grid->CellSizeZ;
+            for( z = MinCellZ; z <= MaxCellZ; z++ ) {
+                for( x = MinCellX; x <= MaxCellX; x++ ) {
+                    if( Pass == 0 ) {
+                        Grid->CellStart[z * Grid->NumCellsX + x + 1]++;
+                    } else {
+                        Grid->CellTSPList[Grid->CellStart[z * Grid->NumCellsX + x]++] = i;
+                    }
+                }
+            }
+        }
+        if( Pass == 0 ) {
+            for( i = 1; i <= NumCells; i++ ) {
+                Grid->CellStart[i] += Grid->CellStart[i - 1];
+            }
+            Grid->CellTSPList = malloc(Grid->CellStart[NumCells] * sizeof(int));
+            if( !Grid->CellTSPList ) {
+                DPrintf("CollisionCreateGrid:Failed to allocate memory for cell list\n");
+                goto Failure;
+            }
+        }
+    }
+    //NOTE(Adriano):The fill pass moved each cursor to the start of the next cell,shift them back.
+    memmove(&Grid->CellStart[1],&Grid->CellStart[0],NumCells * sizeof(int));
+    Grid->CellStart[0] = 0;
+    return Grid;
+Failure:
+    CollisionFreeGrid(Grid);
+    return NULL;
+}
+
+static int CollisionGetTSPIndexFromPoint(CollisionGrid_t *Grid,int X,int Z)
+{
+    TSPCollisionHeader_t *Header;
+    int CellX;
+    int CellZ;
+    int Cell;
+    int i;
+    
+    if( !Grid || !Grid->NumTSP || X < Grid->MinX || Z < Grid->MinZ ) {
+        return -1;
+    }
+    CellX = (X - Grid->MinX) / Grid->CellSizeX;
+    CellZ = (Z - Grid->MinZ) / Grid->CellSizeZ;
+    if( CellX >= Grid->NumCellsX || CellZ >= Grid->NumCellsZ ) {
+        return -1;
+    }
+    Cell = CellZ * Grid->NumCellsX + CellX;
+    for( i = Grid->CellStart[Cell]; i < Grid->CellStart[Cell + 1]; i++ ) {
+        Header = &Grid->TSPList[Grid->CellTSPList[i]]->CollisionData->Header;
+        if( X >= Header->CollisionBoundMinX && X <= Header->CollisionBoundMaxX &&
+            Z >= Header->CollisionBoundMinZ && Z <= Header->CollisionBoundMaxZ ) {
+            return Grid->CellTSPList[i];
+        }
+    }
+    return -1;
+}
+
+TSP_t *CollisionGetTSPFromPoint(CollisionGrid_t *Grid,int X,int Z)
+{
+    int TSPIndex;
+    
+    TSPIndex = CollisionGetTSPIndexFromPoint(Grid,X,Z);
+    return TSPIndex == -1 ? NULL : Grid->TSPList[TSPIndex];
+}
+
+static unsigned int CollisionSpreadBits(unsigned int Value)
+{
+    Value &= 0xFFFF;
+    Value = (Value | (Value << 8)) & 0x00FF00FF;
+    Value = (Value | (Value << 4)) & 0x0F0F0F0F;
+    Value = (Value | (Value << 2)) & 0x33333333;
+    Value = (Value | (Value << 1)) & 0x55555555;
+    return Value;
+}
+
+static int CollisionCompareQueries(const void *a,const void *b)
+{
+    const CollisionQuery_t *QueryA;
+    const CollisionQuery_t *QueryB;
+    
+    QueryA = (const CollisionQuery_t *) a;
+    QueryB = (const CollisionQuery_t *) b;
+    if( QueryA->Key != QueryB->Key ) {
+        return QueryA->Key < QueryB->Key ? -1 : 1;
+    }
+    return QueryA->Index - QueryB->Index;
+}
+
+/*
+ * Walks the KD tree down to the leaf that contains the given point.
+ * Same traversal as TSPGetPointYComponentFromKDTree.
+ */
+static int CollisionGetLeaf(TSPCollision_t *CollisionData,TSPVec3_t Position,int *StartingFaceListIndex,int *NumFaces)
+{
+    TSPCollisionKDTreeNode_t *Node;
+    int WorldBoundMinX;
+    int WorldBoundMinZ;
+    int MinValue;
+    int CurrentNode;
+    int i;
+    
+    WorldBoundMinX = CollisionData->Header.CollisionBoundMinX;
+    WorldBoundMinZ = CollisionData->Header.CollisionBoundMinZ;
+    CurrentNode = 0;
+    //NOTE(Adriano):A valid tree can't be deeper than its number of nodes.
+    for( i = 0; i < CollisionData->Header.NumCollisionKDTreeNodes; i++ ) {
+        if( CurrentNode < 0 || CurrentNode >= CollisionData->Header.NumCollisionKDTreeNodes ) {
+            return 0;
+        }
+        Node = &CollisionData->KDTree[CurrentNode];
+        if( Node->Child0 < 0 ) {
+            *StartingFaceListIndex = Node->Child1;
+            *NumFaces = ~Node->Child0;
+            return 1;
+        }
+        if( Node->Child1 < 0 ) {
+            MinValue = WorldBoundMinZ + Node->SplitValue;
+            if (Position.z < MinValue) {
+                CurrentNode = Node->Child0;
+            } else {
+                CurrentNode = ~Node->Child1;
+                WorldBoundMinZ = MinValue;
+            }
+        } else {
+            MinValue = WorldBoundMinX + Node->SplitValue;
+            if( Position.x < MinValue ) {
+                CurrentNode = Node->Child0;
+            } else {
+                CurrentNode = Node->Child1;
+                WorldBoundMinX = MinValue;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Converts the faces of a leaf into groups of four,faces that point downwards are skipped
+ * since they can never be stood upon (see TSPPointInTriangle).
+ * Consecutive queries are sorted so that they usually land in the same leaf and reuse the cache.
+ */
+static int CollisionCacheLeaf(CollisionLeafCache_t *Cache,TSPCollision_t *CollisionData,int StartingFaceListIndex,int NumFaces)
+{
+    CollisionFaceGroup_t *Group;
+    CollisionFaceGroup_t *NewGroupList;
+    TSPCollisionFace_t *Face;
+    TSPVec3_t Vertex[3];
+    int NumGroups;
+    int FaceIndex;
+    int Lane;
+    int Next;
+    int i;
+    int j;
+    
+    if( Cache->CollisionData == CollisionData && Cache->StartingFaceListIndex == StartingFaceListIndex ) {
+        return 1;
+    }
+    Cache->CollisionData = NULL;
+    if( StartingFaceListIndex < 0 || NumFaces < 0 ||
+        StartingFaceListIndex + NumFaces > CollisionData->Header.NumCollisionFaceIndex ) {
+        return 0;
+    }
+    NumGroups = (NumFaces + 3) / 4;
+    if( NumGroups > Cache->Capacity ) {
+        NewGroupList = realloc(Cache->GroupList,NumGroups * sizeof(CollisionFaceGroup_t));
+        if( !NewGroupList ) {
+            DPrintf("CollisionCacheLeaf:Failed to allocate memory for %i groups\n",NumGroups);
+            return 0;
+        }
+        Cache->GroupList = NewGroupList;
+        Cache->Capacity = NumGroups;
+    }
+    Cache->NumGroups = 0;
+    Group = NULL;
+    for( i = 0; i < NumFaces; i++ ) {
+        FaceIndex = CollisionData->FaceIndexList[StartingFaceListIndex + i];
+        if( FaceIndex < 0 || FaceIndex >= CollisionData->Header.NumFaces ) {
+            continue;
+        }
+        Face = &CollisionData->Face[FaceIndex];
+        if( CollisionData->Normal[Face->NormalIndex].Position.y > 0 ) {
+            continue;
+        }
+        if( !Group || Group->NumFaces == 4 ) {
+            Group = &Cache->GroupList[Cache->NumGroups++];
+            memset(Group,0,sizeof(CollisionFaceGroup_t));
+        }
+        Lane = Group->NumFaces;
+        Vertex[0] = CollisionData->Vertex[Face->V0].Position;
+        Vertex[1] = CollisionData->Vertex[Face->V1].Position;
+        Vertex[2] = CollisionData->Vertex[Face->V2].Position;
+        for( j = 0; j < 3; j++ ) {
+            Next = (j + 1) % 3;
+            Group->EndX[j][Lane] = Vertex[Next].x;
+            Group->EndZ[j][Lane] = Vertex[Next].z;
+            Group->DeltaX[j][Lane] = Vertex[j].x - Vertex[Next].x;
+            Group->DeltaZ[j][Lane] = Vertex[j].z - Vertex[Next].z;
+        }
+        Group->FaceIndex[Lane] = FaceIndex;
+        Group->NumFaces++;
+    }
+    Cache->CollisionData = CollisionData;
+    Cache->StartingFaceListIndex = StartingFaceListIndex;
+    return 1;
+}
+
+/*
+ * Returns a mask with one bit set for each face of the group that contains the point on the XZ plane.
+ * A point is inside when the three edge functions don't have opposite signs.
+ */
+static int CollisionTestGroup(const CollisionFaceGroup_t *Group,float PointX,float PointZ)
+{
+    int Mask;
+    int i;
+#if defined(__SSE2__)
+    __m128 X;
+    __m128 Z;
+    __m128 Edge;
+    __m128 Zero;
+    __m128 Negative;
+    __m128 Positive;
+    
+    X = _mm_set1_ps(PointX);
+    Z = _mm_set1_ps(PointZ);
+    Zero = _mm_setzero_ps();
+    Negative = Zero;
+    Positive = Zero;
+    for( i = 0; i < 3; i++ ) {
+        Edge = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(X,_mm_loadu_ps(Group->EndX[i])),_mm_loadu_ps(Group->DeltaZ[i])),
+                          _mm_mul_ps(_mm_loadu_ps(Group->DeltaX[i]),_mm_sub_ps(Z,_mm_loadu_ps(Group->EndZ[i]))));
+        Negative = _mm_or_ps(Negative,_mm_cmplt_ps(Edge,Zero));
+        Positive = _mm_or_ps(Positive,_mm_cmpgt_ps(Edge,Zero));
+    }
+    Mask = ~_mm_movemask_ps(_mm_and_ps(Negative,Positive));
+#else
+    float Edge;
+    int Negative;
+    int Positive;
+    int Lane;
+    
+    Mask = 0;
+    for( Lane = 0; Lane < Group->NumFaces; Lane++ ) {
+        Negative = 0;
+        Positive = 0;
+        for( i = 0; i < 3; i++ ) {
+            Edge = (PointX - Group->EndX[i][Lane]) * Group->DeltaZ[i][Lane] - Group->DeltaX[i][Lane] * (PointZ - Group->EndZ[i][Lane]);
+            Negative |= Edge < 0.f;
+            Positive |= Edge > 0.f;
+        }
+        if( !(Negative && Positive) ) {
+            Mask |= 1 << Lane;
+        }
+    }
+#endif
+    return Mask & ((1 << Group->NumFaces) - 1);
+}
+
+/*
+ * Same as TSPGetYFromCollisionFace without the debug output.
+ */
+static int CollisionGetFaceY(TSPCollision_t *CollisionData,TSPCollisionFace_t *Face,float PointX,float PointZ)
+{
+    TSPVec3_t Normal;
+    float NormalX;
+    float NormalY;
+    float NormalZ;
+    
+    Normal = CollisionData->Normal[Face->NormalIndex].Position;
+    if( abs(Normal.y) < 257 ) {
+        return (int) ((float) CollisionData->Vertex[Face->V0].Position.y / (float) (1 << 15));
+    }
+    NormalX = (float) Normal.x / (float) (1 << 15);
+    NormalY = (float) Normal.y / (float) (1 << 15);
+    NormalZ = (float) Normal.z / (float) (1 << 15);
+    return (int) (-(NormalX * PointX + NormalZ * PointZ + Face->PlaneDistance) / NormalY);
+}
+
+/*
+ * Inserts a height inside the sorted layer list of a point,keeping only the MaxLayers smallest ones.
+ * Faces sharing an edge report the same height and are stored once.
+ */
+static void CollisionInsertLayer(int *YList,int *FaceList,int *NumLayers,int MaxLayers,int Y,int FaceIndex)
+{
+    int i;
+    int j;
+    
+    for( i = 0; i < *NumLayers; i++ ) {
+        if( YList[i] == Y ) {
+            return;
+        }
+        if( Y < YList[i] ) {
+            break;
+        }
+    }
+    if( i >= MaxLayers ) {
+        return;
+    }
+    j = *NumLayers < MaxLayers ? *NumLayers : MaxLayers - 1;
+    for( ; j > i; j-- ) {
+        YList[j] = YList[j - 1];
+        FaceList[j] = FaceList[j - 1];
+    }
+    YList[i] = Y;
+    FaceList[i] = FaceIndex;
+    if( *NumLayers < MaxLayers ) {
+        (*NumLayers)++;
+    }
+}
+
+/*
+ * Thread pool task: each task resolves a contiguous range of the sorted queries with its own leaf cache.
+ */
+static void CollisionProcessQueries(void *UserData,int TaskIndex)
+{
+    CollisionBatch_t *Batch;
+    CollisionQuery_t *Query;
+    CollisionLeafCache_t Cache;
+    TSPCollision_t *CollisionData;
+    TSPCollisionFace_t *Face;
+    CollisionFaceGroup_t *Group;
+    TSPVec3_t Position;
+    float PointX;
+    float PointZ;
+    int StartingFaceListIndex;
+    int NumFaces;
+    int Start;
+    int End;
+    int Mask;
+    int *YList;
+    int *FaceList;
+    int NumLayers;
+    int NumHits;
+    int Lane;
+    int i;
+    int j;
+    
+    Batch = (CollisionBatch_t *) UserData;
+    Start = (int) (((long long) Batch->NumQueries * TaskIndex) / Batch->NumTasks);
+    End = (int) (((long long) Batch->NumQueries * (TaskIndex + 1)) / Batch->NumTasks);
+    Cache.CollisionData = NULL;
+    Cache.StartingFaceListIndex = -1;
+    Cache.GroupList = NULL;
+    Cache.NumGroups = 0;
+    Cache.Capacity = 0;
+    NumHits = 0;
+    for( i = Start; i < End; i++ ) {
+        Query = &Batch->QueryList[i];
+        YList = &Batch->OutYList[Query->Index * Batch->MaxLayers];
+        FaceList = &Batch->OutFaceList[Query->Index * Batch->MaxLayers];
+        for( j = 0; j < Batch->MaxLayers; j++ ) {
+            YList[j] = 0;
+            FaceList[j] = -1;
+        }
+        NumLayers = 0;
+        if( Batch->OutNumLayersList ) {
+            Batch->OutNumLayersList[Query->Index] = 0;
+        }
+        if( Batch->OutTSPNumberList ) {
+            Batch->OutTSPNumberList[Query->Index] = -1;
+        }
+        if( Query->TSPIndex == -1 ) {
+            continue;
+        }
+        CollisionData = Batch->Grid->TSPList[Query->TSPIndex]->CollisionData;
+        Position = TSPGLMVec3ToTSPVec3(Batch->PointList[Query->Index]);
+        if( !CollisionGetLeaf(CollisionData,Position,&StartingFaceListIndex,&NumFaces) ) {
+            continue;
+        }
+        if( !CollisionCacheLeaf(&Cache,CollisionData,StartingFaceListIndex,NumFaces) ) {
+            continue;
+        }
+        PointX = Position.x;
+        PointZ = Position.z;
+        for( j = 0; j < Cache.NumGroups; j++ ) {
+            Group = &Cache.GroupList[j];
+            Mask = CollisionTestGroup(Group,PointX,PointZ);
+            for( Lane = 0; Mask != 0; Lane++, Mask >>= 1 ) {
+                if( !(Mask & 1) ) {
+                    continue;
+                }
+                Face = &CollisionData->Face[Group->FaceIndex[Lane]];
+                CollisionInsertLayer(YList,FaceList,&NumLayers,Batch->MaxLayers,
+                                     CollisionGetFaceY(CollisionData,Face,PointX,PointZ),Group->FaceIndex[Lane]);
+            }
+        }
+        if( NumLayers != 0 ) {
+            NumHits++;
+        }
+        if( Batch->OutNumLayersList ) {
+            Batch->OutNumLayersList[Query->Index] = NumLayers;
+        }
+        if( Batch->OutTSPNumberList && NumLayers != 0 ) {
+            Batch->OutTSPNumberList[Query->Index] = Batch->Grid->TSPList[Query->TSPIndex]->Number;
+        }
+    }
+    if( Cache.GroupList ) {
+        free(Cache.GroupList);
+    }
+    Batch->NumHits[TaskIndex] = NumHits;
+}
+
+/*
+ * Finds up to MaxLayers surfaces below each point of PointList,sorted by height (smallest Y first)
+ * so that the first layer matches the result of TSPGetPointYComponentFromKDTree.
+ * OutYList and OutFaceList must hold NumPoints * MaxLayers entries,unused layers have a face index of -1.
+ * OutNumLayersList is optional and receives the number of surfaces found for each point.
+ * OutTSPNumberList is optional and receives the number of the TSP that owns the faces of each point,or -1 when
+ * no face was found.Every layer of a point comes from the same TSP.
+ * Queries are sorted by TSP and by their position along a Z-order curve so that nearby points walk
+ * the same KD tree path and test the same leaf,which is converted only once.
+ * Returns the number of points that hit at least one face.
+ */
+int CollisionGetHeightLayerList(TSP_t *TSPList,vec3 *PointList,int NumPoints,int MaxLayers,
+                                int *OutYList,int *OutFaceList,int *OutNumLayersList,int *OutTSPNumberList)
+{
+    CollisionBatch_t Batch;
+    CollisionQuery_t *Query;
+    TSPVec3_t Position;
+    int MaxTasks;
+    int GridWidth;
+    int GridDepth;
+    unsigned int QuantizedX;
+    unsigned int QuantizedZ;
+    unsigned int TSPKey;
+    int NumHits;
+    int i;
+    
+    if( !TSPList || !PointList || !OutYList || !OutFaceList || NumPoints <= 0 || MaxLayers <= 0 ) {
+        return 0;
+    }
+    if( !TSPList->CollisionGrid ) {
+        TSPList->CollisionGrid = CollisionCreateGrid(TSPList);
+        if( !TSPList->CollisionGrid ) {
+            return 0;
+        }
+    }
+    Batch.Grid = TSPList->CollisionGrid;
+    Batch.PointList = PointList;
+    Batch.OutYList = OutYList;
+    Batch.OutFaceList = OutFaceList;
+    Batch.OutNumLayersList = OutNumLayersList;
+    Batch.OutTSPNumberList = OutTSPNumberList;
+    Batch.MaxLayers = MaxLayers;
+    Batch.NumQueries = NumPoints;
+    Batch.QueryList = malloc(NumPoints * sizeof(CollisionQuery_t));
+    if( !Batch.QueryList ) {
+        DPrintf("CollisionGetHeightLayerList:Failed to allocate memory for %i queries\n",NumPoints);
+        return 0;
+    }
+    GridWidth = Batch.Grid->CellSizeX * Batch.Grid->NumCellsX;
+    GridDepth = Batch.Grid->CellSizeZ * Batch.Grid->NumCellsZ;
+    for( i = 0; i < NumPoints; i++ ) {
+        Query = &Batch.QueryList[i];
+        Position = TSPGLMVec3ToTSPVec3(PointList[i]);
+        Query->Index = i;
+        Query->TSPIndex = CollisionGetTSPIndexFromPoint(Batch.Grid,Position.x,Position.z);
+        if( Query->TSPIndex == -1 ) {
+            //NOTE(Adriano):Misses don't touch any data,move them at the end.
+            Query->Key = 0xFFFFFFFF;
+            continue;
+        }
+        QuantizedX = ((Position.x - Batch.Grid->MinX) * 4096) / GridWidth;
+        QuantizedZ = ((Position.z - Batch.Grid->MinZ) * 4096) / GridDepth;
+        TSPKey = Query->TSPIndex < 254 ? Query->TSPIndex : 254;
+        Query->Key = (TSPKey << 24) | CollisionSpreadBits(QuantizedX) | (CollisionSpreadBits(QuantizedZ) << 1);
+    }
+    qsort(Batch.QueryList,NumPoints,sizeof(CollisionQuery_t),CollisionCompareQueries);
+    
+    MaxTasks = ThreadPoolGetNumThreads() * 4;
+    if( MaxTasks < 1 ) {
+        MaxTasks = 1;
+    }
+    if( MaxTasks > 256 ) {
+        MaxTasks = 256;
+    }
+    Batch.NumTasks = NumPoints / COLLISION_MIN_QUERIES_PER_TASK;
+    if( Batch.NumTasks > MaxTasks ) {
+        Batch.NumTasks = MaxTasks;
+    }
+    if( Batch.NumTasks < 1 ) {
+        Batch.NumTasks = 1;
+    }
+    ThreadPoolParallelFor(Batch.NumTasks,CollisionProcessQueries,&Batch);
+    NumHits = 0;
+    for( i = 0; i < Batch.NumTasks; i++ ) {
+        NumHits += Batch.NumHits[i];
+    }
+    free(Batch.QueryList);
+    return NumHits;
+}
+
+/*
+ * Builds the tree used by the swept sphere queries.
+ * Uses the collision faces when the level has them,otherwise the opaque rendering faces are used in their place.
+ */
+static BVH_t *CollisionBuildBVH(TSP_t *TSPList)
+{
+    TSP_t *Iterator;
+    TSPCollision_t *CollisionData;
+    TSPFace_t *Face;
+    vec3 *VertexList;
+    bool UseCollisionData;
+    int MaxTriangles;
+    int NumTriangles;
+    int i;
+    int j;
+    
+    UseCollisionData = false;
+    MaxTriangles = 0;
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        if( Iterator->CollisionData && Iterator->CollisionData->Header.NumFaces ) {
+            UseCollisionData = true;
+            break;
+        }
+    }
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        if( UseCollisionData ) {
+            MaxTriangles += Iterator->CollisionData ? Iterator->CollisionData->Header.NumFaces : 0;
+        } else {
+            MaxTriangles += Iterator->Header.NumFaces;
+        }
+    }
+    if( !MaxTriangles ) {
+        DPrintf("CollisionBuildBVH:No faces available\n");
+        return NULL;
+    }
+    VertexList = malloc(MaxTriangles * 3 * sizeof(vec3));
+    if( !VertexList ) {
+        DPrintf("CollisionBuildBVH:Failed to allocate memory for %i triangles\n",MaxTriangles);
+        return NULL;
+    }
+    NumTriangles = 0;
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        if( UseCollisionData ) {
+            CollisionData = Iterator->CollisionData;
+            if( !CollisionData ) {
+                continue;
+            }
+            for( i = 0; i < CollisionData->Header.NumFaces; i++ ) {
+                TSPVec3ToGLMVec3(CollisionData->Vertex[CollisionData->Face[i].V0].Position,VertexList[NumTriangles * 3]);
+                TSPVec3ToGLMVec3(CollisionData->Vertex[CollisionData->Face[i].V1].Position,VertexList[NumTriangles * 3 + 1]);
+                TSPVec3ToGLMVec3(CollisionData->Vertex[CollisionData->Face[i].V2].Position,VertexList[NumTriangles * 3 + 2]);
+                NumTriangles++;
+            }
+            continue;
+        }
+        for( i = 0; i < Iterator->Header.NumNodes; i++ ) {
+            if( !Iterator->Node[i].FaceList ) {
+                continue;
+            }
+            for( j = 0; j < Iterator->Node[i].NumFaces && NumTriangles < MaxTriangles; j++ ) {
+                Face = &Iterator->Node[i].FaceList[j];
+                //NOTE(Adriano):Skip semi-transparent faces (water,glass...).
+                if( (Face->TSB & 0x4000) != 0 ) {
+                    continue;
+                }
+                TSPVec3ToGLMVec3(Iterator->Vertex[Face->V0].Position,VertexList[NumTriangles * 3]);
+                TSPVec3ToGLMVec3(Iterator->Vertex[Face->V1].Position,VertexList[NumTriangles * 3 + 1]);
+                TSPVec3ToGLMVec3(Iterator->Vertex[Face->V2].Position,VertexList[NumTriangles * 3 + 2]);
+                NumTriangles++;
+            }
+        }
+    }
+    DPrintf("CollisionBuildBVH:Building tree from %i %s faces\n",NumTriangles,UseCollisionData ? "collision" : "rendering");
+    return BVHBuild(VertexList,NumTriangles);
+}
+
+BVH_t *CollisionGetBVH(TSP_t *TSPList)
+{
+    if( !TSPList ) {
+        return NULL;
+    }
+    if( !TSPList->CollisionBVH ) {
+        TSPList->CollisionBVH = CollisionBuildBVH(TSPList);
+    }
+    return TSPList->CollisionBVH;
+}
+
+/*
+ * Returns the lowest root of A*t^2 + B*t + C = 0 that lies inside [0,MaxRoot].
+ */
+static bool CollisionGetLowestRoot(float A,float B,float C,float MaxRoot,float *Root)
+{
+    float Determinant;
+    float SquareRoot;
+    float Root0;
+    float Root1;
+    float Temp;
+    
+    Determinant = B * B - 4.f * A * C;
+    if( Determinant < 0.f || fabsf(A) < 1e-8f ) {
+        return false;
+    }
+    SquareRoot = sqrtf(Determinant);
+    Root0 = (-B - SquareRoot) / (2.f * A);
+    Root1 = (-B + SquareRoot) / (2.f * A);
+    if( Root0 > Root1 ) {
+        Temp = Root1;
+        Root1 = Root0;
+        Root0 = Temp;
+    }
+    if( Root0 > 0.f && Root0 < MaxRoot ) {
+        *Root = Root0;
+        return true;
+    }
+    if( Root1 > 0.f && Root1 < MaxRoot ) {
+        *Root = Root1;
+        return true;
+    }
+    return false;
+}
+
+static bool CollisionPointInTriangle(vec3 Point,vec3 V0,vec3 V1,vec3 V2,vec3 Normal)
+{
+    vec3 Edge;
+    vec3 ToPoint;
+    vec3 Cross;
+    
+    glm_vec3_sub(V1,V0,Edge);
+    glm_vec3_sub(Point,V0,ToPoint);
+    glm_vec3_cross(Edge,ToPoint,Cross);
+    if( glm_vec3_dot(Cross,Normal) < 0.f ) {
+        return false;
+    }
+    glm_vec3_sub(V2,V1,Edge);
+    glm_vec3_sub(Point,V1,ToPoint);
+    glm_vec3_cross(Edge,ToPoint,Cross);
+    if( glm_vec3_dot(Cross,Normal) < 0.f ) {
+        return false;
+    }
+    glm_vec3_sub(V0,V2,Edge);
+    glm_vec3_sub(Point,V2,ToPoint);
+    glm_vec3_cross(Edge,ToPoint,Cross);
+    return glm_vec3_dot(Cross,Normal) >= 0.f;
+}
+
+/*
+ * Sweeps a sphere from Center along Displacement against a two-sided triangle.
+ * If the sphere hits the triangle before *HitTime (a fraction of Displacement) it is updated together
+ * with the normal of the contact.
+ */
+static bool CollisionSweepTriangle(vec3 Center,float Radius,vec3 Displacement,vec3 *Vertex,float *HitTime,vec3 HitNormal)
+{
+    vec3 FaceNormal;
+    vec3 Normal;
+    vec3 Edge0;
+    vec3 Edge1;
+    vec3 Temp;
+    vec3 Contact;
+    vec3 BestContact;
+    vec3 Projected;
+    float SignedDistance;
+    float NormalDotDisplacement;
+    float T0;
+    float T1;
+    float T;
+    float BestTime;
+    float DisplacementSquared;
+    float EdgeSquared;
+    float EdgeDotDisplacement;
+    float EdgeDotBase;
+    float A;
+    float B;
+    float C;
+    float F;
+    bool Embedded;
+    bool TestPlane;
+    bool Found;
+    int i;
+    
+    glm_vec3_sub(Vertex[1],Vertex[0],Edge0);
+    glm_vec3_sub(Vertex[2],Vertex[0],Edge1);
+    glm_vec3_cross(Edge0,Edge1,FaceNormal);
+    if( glm_vec3_norm2(FaceNormal) < 1e-8f ) {
+        return false;
+    }
+    glm_vec3_normalize(FaceNormal);
+    //NOTE(Adriano):Faces are two-sided,the normal used for the response always points towards the sphere.
+    glm_vec3_copy(FaceNormal,Normal);
+    glm_vec3_sub(Center,Vertex[0],Temp);
+    SignedDistance = glm_vec3_dot(Temp,Normal);
+    if( SignedDistance < 0.f ) {
+        glm_vec3_negate(Normal);
+        SignedDistance = -SignedDistance;
+    }
+    NormalDotDisplacement = glm_vec3_dot(Normal,Displacement);
+    if( NormalDotDisplacement >= 0.f && SignedDistance >= Radius ) {
+        return false;
+    }
+    Embedded = false;
+    TestPlane = true;
+    if( fabsf(NormalDotDisplacement) < 1e-6f ) {
+        //NOTE(Adriano):Moving parallel to the plane,the sphere can only touch the inside of the face if it
+        //              already intersects the plane.
+        if( fabsf(SignedDistance) < Radius ) {
+            Embedded = true;
+        } else {
+            TestPlane = false;
+        }
+        T0 = 0.f;
+        T1 = 1.f;
+    } else if( NormalDotDisplacement < 0.f ) {
+        T0 = (SignedDistance - Radius) / -NormalDotDisplacement;
+        T1 = (SignedDistance + Radius) / -NormalDotDisplacement;
+        if( T0 < 0.f ) {
+            Embedded = true;
+            T0 = 0.f;
+        }
+    } else {
+        Embedded = true;
+        T0 = 0.f;
+        T1 = (Radius - SignedDistance) / NormalDotDisplacement;
+    }
+    if( T0 > 1.f || T1 < 0.f || T0 >= *HitTime ) {
+        return false;
+    }
+    if( TestPlane && (!Embedded || NormalDotDisplacement < 0.f) ) {
+        //NOTE(Adriano):Contact inside the face,when the sphere is already touching the plane and moving
+        //              towards it we test the projection of its center.
+        glm_vec3_scale(Normal,Embedded ? SignedDistance : Radius,Temp);
+        glm_vec3_sub(Center,Temp,Projected);
+        glm_vec3_muladds(Displacement,T0,Projected);
+        if( CollisionPointInTriangle(Projected,Vertex[0],Vertex[1],Vertex[2],FaceNormal) ) {
+            *HitTime = T0;
+            glm_vec3_copy(Normal,HitNormal);
+            return true;
+        }
+    }
+    //NOTE(Adriano):Contact with one of the vertices or edges.
+    Found = false;
+    BestTime = *HitTime;
+    DisplacementSquared = glm_vec3_norm2(Displacement);
+    for( i = 0; i < 3; i++ ) {
+        glm_vec3_sub(Center,Vertex[i],Temp);
+        A = DisplacementSquared;
+        B = 2.f * glm_vec3_dot(Displacement,Temp);
+        C = glm_vec3_norm2(Temp) - Radius * Radius;
+        if( CollisionGetLowestRoot(A,B,C,BestTime,&T) ) {
+            BestTime = T;
+            glm_vec3_copy(Vertex[i],BestContact);
+            Found = true;
+        }
+    }
+    for( i = 0; i < 3; i++ ) {
+        glm_vec3_sub(Vertex[(i + 1) % 3],Vertex[i],Edge0);
+        glm_vec3_sub(Vertex[i],Center,Temp);
+        EdgeSquared = glm_vec3_norm2(Edge0);
+        EdgeDotDisplacement = glm_vec3_dot(Edge0,Displacement);
+        EdgeDotBase = glm_vec3_dot(Edge0,Temp);
+        A = EdgeSquared * -DisplacementSquared + EdgeDotDisplacement * EdgeDotDisplacement;
+        B = EdgeSquared * (2.f * glm_vec3_dot(Displacement,Temp)) - 2.f * EdgeDotDisplacement * EdgeDotBase;
+        C = EdgeSquared * (Radius * Radius - glm_vec3_norm2(Temp)) + EdgeDotBase * EdgeDotBase;
+        if( CollisionGetLowestRoot(A,B,C,BestTime,&T) ) {
+            F = (EdgeDotDisplacement * T - EdgeDotBase) / EdgeSquared;
+            if( F >= 0.f && F <= 1.f ) {
+                BestTime = T;
+                glm_vec3_scale(Edge0,F,Contact);
+                glm_vec3_add(Vertex[i],Contact,BestContact);
+                Found = true;
+            }
+        }
+    }
+    if( !Found ) {
+        return false;
+    }
+    *HitTime = BestTime;
+    glm_vec3_copy(Center,Temp);
+    glm_vec3_muladds(Displacement,BestTime,Temp);
+    glm_vec3_sub(Temp,BestContact,HitNormal);
+    glm_vec3_normalize(HitNormal);
+    return true;
+}
+
+/*
+ * Moves the sphere along Displacement sliding along the surfaces that it touches.
+ * MaxIterations set to 1 stops the sphere at the first contact.
+ * Returns true if the sphere touched a walkable surface.
+ */
+static bool CollisionSlideSphere(CollisionSweep_t *Sweep,vec3 Position,vec3 Displacement,int MaxIterations,vec3 OutPosition)
+{
+    vec3 Remaining;
+    vec3 HitNormal;
+    vec3 BestNormal;
+    vec3 Direction;
+    float HitTime;
+    float Length;
+    float Distance;
+    bool TouchedGround;
+    int Iteration;
+    int i;
+    
+    TouchedGround = false;
+    glm_vec3_copy(Position,OutPosition);
+    glm_vec3_copy(Displacement,Remaining);
+    for( Iteration = 0; Iteration < MaxIterations; Iteration++ ) {
+        Length = glm_vec3_norm(Remaining);
+        if( Length < COLLISION_MIN_MOVE_DISTANCE ) {
+            break;
+        }
+        CollisionMoveStats.NumIterations++;
+        HitTime = 1.f;
+        for( i = 0; i < Sweep->NumTriangles; i++ ) {
+            if( CollisionSweepTriangle(OutPosition,Sweep->Radius,Remaining,&Sweep->BVH->VertexList[Sweep->TriangleList[i] * 3],
+                &HitTime,HitNormal) ) {
+                glm_vec3_copy(HitNormal,BestNormal);
+            }
+        }
+        CollisionMoveStats.NumSweepTests += Sweep->NumTriangles;
+        if( HitTime >= 1.f ) {
+            glm_vec3_add(OutPosition,Remaining,OutPosition);
+            break;
+        }
+        //NOTE(Adriano):Stop slightly before the contact to avoid starting the next sweep inside the surface.
+        Distance = Length * HitTime - COLLISION_SKIN_WIDTH;
+        if( Distance > 0.f ) {
+            glm_vec3_scale(Remaining,1.f / Length,Direction);
+            glm_vec3_muladds(Direction,Distance,OutPosition);
+        }
+        //NOTE(Adriano):Up is -Y in level space.
+        if( -BestNormal[1] >= COLLISION_WALKABLE_NORMAL_Y ) {
+            TouchedGround = true;
+        }
+        glm_vec3_scale(Remaining,1.f - HitTime,Remaining);
+        glm_vec3_muladds(BestNormal,-glm_vec3_dot(Remaining,BestNormal),Remaining);
+    }
+    return TouchedGround;
+}
+
+static float CollisionGetHorizontalDistance(vec3 From,vec3 To)
+{
+    float DeltaX;
+    float DeltaZ;
+    
+    DeltaX = To[0] - From[0];
+    DeltaZ = To[2] - From[2];
+    return DeltaX * DeltaX + DeltaZ * DeltaZ;
+}
+
+/*
+ * Moves a sphere of the given radius through the level,Position and Displacement are in level space (Y pointing down).
+ * When StepHeight is zero the sphere slides freely along every direction (fly mode),otherwise the horizontal movement
+ * can climb steps up to StepHeight and the vertical one stops on the first surface (walk mode).
+ * OnGround is set when the sphere is standing on a walkable surface.
+ * Returns 0 if the level has no collision geometry,in which case the sphere is moved without any test.
+ */
+int CollisionMoveSphere(TSP_t *TSPList,vec3 Position,float Radius,vec3 Displacement,float StepHeight,vec3 OutPosition,
+                        bool *OnGround)
+{
+    CollisionSweep_t Sweep;
+    int TriangleList[COLLISION_MAX_SWEEP_TRIANGLES];
+    int *LargeTriangleList;
+    vec3 Min;
+    vec3 Max;
+    vec3 Horizontal;
+    vec3 Vertical;
+    vec3 Direct;
+    vec3 Stepped;
+    vec3 Temp;
+    vec3 Up;
+    double StartTime;
+    double BroadphaseStartTime;
+    float Climbed;
+    bool Grounded;
+    int i;
+    
+    StartTime = SysPreciseMilliseconds();
+    memset(&CollisionMoveStats,0,sizeof(CollisionMoveStats));
+    if( OnGround ) {
+        *OnGround = false;
+    }
+    Sweep.BVH = CollisionGetBVH(TSPList);
+    if( !Sweep.BVH ) {
+        glm_vec3_add(Position,Displacement,OutPosition);
+        return 0;
+    }
+    //NOTE(Adriano):Single broadphase query covering every sweep done during this move.
+    BroadphaseStartTime = SysPreciseMilliseconds();
+    for( i = 0; i < 3; i++ ) {
+        Min[i] = Position[i] + (Displacement[i] < 0.f ? Displacement[i] : 0.f) - Radius - COLLISION_SKIN_WIDTH;
+        Max[i] = Position[i] + (Displacement[i] > 0.f ? Displacement[i] : 0.f) + Radius + COLLISION_SKIN_WIDTH;
+    }
+    Min[1] -= StepHeight;
+    Max[1] += StepHeight;
+    Sweep.TriangleList = TriangleList;
+    Sweep.NumTriangles = BVHQueryBox(Sweep.BVH,Min,Max,TriangleList,COLLISION_MAX_SWEEP_TRIANGLES);
+    LargeTriangleList = NULL;
+    if( Sweep.NumTriangles > COLLISION_MAX_SWEEP_TRIANGLES ) {
+        LargeTriangleList = malloc(Sweep.NumTriangles * sizeof(int));
+        if( LargeTriangleList ) {
+            Sweep.TriangleList = LargeTriangleList;
+            Sweep.NumTriangles = BVHQueryBox(Sweep.BVH,Min,Max,LargeTriangleList,Sweep.NumTriangles);
+        } else {
+            DPrintf("CollisionMoveSphere:Failed to allocate memory for %i candidate triangles,only testing the first %i\n",
+                    Sweep.NumTriangles,COLLISION_MAX_SWEEP_TRIANGLES);
+            Sweep.NumTriangles = COLLISION_MAX_SWEEP_TRIANGLES;
+        }
+    }
+    Sweep.Radius = Radius;
+    CollisionMoveStats.NumCandidateTriangles = Sweep.NumTriangles;
+    CollisionMoveStats.BroadphaseTime = SysPreciseMilliseconds() - BroadphaseStartTime;
+    
+    Grounded = false;
+    if( StepHeight <= 0.f ) {
+        Grounded = CollisionSlideSphere(&Sweep,Position,Displacement,COLLISION_MAX_SLIDE_ITERATIONS,OutPosition);
+    } else {
+        glm_vec3_copy(Displacement,Horizontal);
+        Horizontal[1] = 0.f;
+        glm_vec3_zero(Vertical);
+        Vertical[1] = Displacement[1];
+        CollisionSlideSphere(&Sweep,Position,Horizontal,COLLISION_MAX_SLIDE_ITERATIONS,Direct);
+        glm_vec3_copy(Direct,OutPosition);
+        if( CollisionGetHorizontalDistance(Position,Direct) < glm_vec3_norm2(Horizontal) ) {
+            //NOTE(Adriano):Blocked,try to climb: move up,forward and then back down by the same amount.
+            glm_vec3_zero(Up);
+            Up[1] = -StepHeight;
+            CollisionSlideSphere(&Sweep,Position,Up,1,Temp);
+            Climbed = Position[1] - Temp[1];
+            CollisionSlideSphere(&Sweep,Temp,Horizontal,COLLISION_MAX_SLIDE_ITERATIONS,Stepped);
+            glm_vec3_zero(Up);
+            Up[1] = Climbed;
+            CollisionSlideSphere(&Sweep,Stepped,Up,1,Temp);
+            if( CollisionGetHorizontalDistance(Position,Temp) > CollisionGetHorizontalDistance(Position,Direct) + 1.f ) {
+                glm_vec3_copy(Temp,OutPosition);
+            }
+        }
+        glm_vec3_copy(OutPosition,Temp);
+        Grounded = CollisionSlideSphere(&Sweep,Temp,Vertical,1,OutPosition) && Vertical[1] > 0.f;
+    }
+    CollisionMoveStats.OnGround = Grounded;
+    if( OnGround ) {
+        *OnGround = Grounded;
+    }
+    if( LargeTriangleList ) {
+        free(LargeTriangleList);
+    }
+    CollisionMoveStats.QueryTime = SysPreciseMilliseconds() - StartTime;
+    return 1;
+}
+
+const CollisionMoveStats_t *CollisionGetMoveStats()
+{
+    return &CollisionMoveStats;
+}
+
+/*
+ * Finds the floor height below each point of PointList.
+ * For each point OutYList receives the height and OutFaceList the collision face index,or -1 when
+ * the point is not above any face.
+ * Returns the number of points that hit a face.
+ */
+int CollisionGetHeightList(TSP_t *TSPList,vec3 *PointList,int NumPoints,int *OutYList,int *OutFaceList)
+{
+    return CollisionGetHeightLayerList(TSPList,PointList,NumPoints,1,OutYList,OutFaceList,NULL,NULL);
+}
+
+void CollisionFreeGrid(CollisionGrid_t *Grid)
+{
+    if( !Grid ) {
+        return;
+    }
+    if( Grid->CellStart ) {
+        free(Grid->CellStart);
+    }
+    if( Grid->CellTSPList ) {
+        free(Grid->CellTSPList);
+    }
+    if( Grid->TSPList ) {
+        free(Grid->TSPList);
+    }
+    free(Grid);
+}
@@ -0,0 +1,70 @@
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#ifndef __COLLISION_H_
+#define __COLLISION_H_
+
+#include "../Common/Common.h"
+#include "TSP.h"
+#include "BVH.h"
+
+#define COLLISION_GRID_MAX_CELLS_PER_AXIS   64
+#define COLLISION_MIN_QUERIES_PER_TASK      256
+
+//NOTE(Adriano):Size of the candidate list kept on the stack,bigger queries allocate a list that fits.
+#define COLLISION_MAX_SWEEP_TRIANGLES       4096
+#define COLLISION_MAX_SLIDE_ITERATIONS      4
+#define COLLISION_SKIN_WIDTH                0.5f
+#define COLLISION_MIN_MOVE_DISTANCE         0.01f
+#define COLLISION_WALKABLE_NORMAL_Y         0.7f
+
+//NOTE(Adriano):Uniform grid over the XZ collision bounds of all the TSP in a level,each cell stores
+//              the index of the TSP whose bounds overlap it.
+typedef struct CollisionGrid_s {
+    int         MinX;
+    int         MinZ;
+    int         CellSizeX;
+    int         CellSizeZ;
+    int         NumCellsX;
+    int         NumCellsZ;
+    int         *CellStart;
+    int         *CellTSPList;
+    TSP_t       **TSPList;
+    int         NumTSP;
+} CollisionGrid_t;
+
+typedef struct CollisionMoveStats_s {
+    int     NumCandidateTriangles;
+    int     NumSweepTests;
+    int     NumIterations;
+    bool    OnGround;
+    double  BroadphaseTime;
+    double  QueryTime;
+} CollisionMoveStats_t;
+
+CollisionGrid_t *CollisionCreateGrid(TSP_t *TSPList);
+TSP_t           *CollisionGetTSPFromPoint(CollisionGrid_t *Grid,int X,int Z);
+int             CollisionGetHeightLayerList(TSP_t *TSPList,vec3 *PointList,int NumPoints,int MaxLayers,
+                                            int *OutYList,int *OutFaceList,int *OutNumLayersList,int *OutTSPNumberList);
+int             CollisionGetHeightList(TSP_t *TSPList,vec3 *PointList,int NumPoints,int *OutYList,int *OutFaceList);
+BVH_t           *CollisionGetBVH(TSP_t *TSPList);
+int             CollisionMoveSphere(TSP_t *TSPList,vec3 Position,float Radius,vec3 Displacement,float StepHeight,
+                                    vec3 OutPosition,bool *OnGround);
+const CollisionMoveStats_t *CollisionGetMoveStats();
+void            CollisionFreeGrid(CollisionGrid_t *Grid);
+#endif//__COLLISION_H_
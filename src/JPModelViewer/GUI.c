@@ -21,8 +21,17 @@
 
 #include "GUI.h"
 #include "../Common/VRAM.h"
+#include "../Common/PNGWriter.h"
+#include "../Common/Intern.h"
 #include "JPModelViewer.h"
 #include "TSP.h"
+#include "Occlusion.h"
+#include "PVS.h"
+#include "Pick.h"
+#include "Collision.h"
+#include "Streaming.h"
+#include "MeshOptimizer.h"
+#include "LOD.h"
 
 void GUIFree(GUI_t *GUI)
 {
@@ -55,6 +64,18 @@ void GUIDrawDebugWindow(GUI_t *GUI,Camera_t *Camera,VideoSystem_t *VideoSystem)
 {
     SDL_version LinkedVersion;
     SDL_version CompiledVersion;
+    const OcclusionStats_t *OcclusionStats;
+    const PVSStats_t *PVSStats;
+    const PickStats_t *PickStats;
+    const CollisionMoveStats_t *CollisionMoveStats;
+    const StreamingStats_t *StreamingStats;
+    const MeshOptimizerStats_t *MeshOptimizerStats;
+    const LODStats_t *LODStats;
+    const VRAMAtlasStats_t *AtlasStats;
+    const RenderObjectManagerResidencyStats_t *ResidencyStats;
+    const RenderObjectManagerDeduplicationStats_t *DeduplicationStats;
+    const InternStats_t *ImageInternStats;
+    const InternStats_t *GeometryInternStats;
     
     if( !GUI->DebugWindowHandle ) {
         return;
@@ -74,6 +95,127 @@ void GUIDrawDebugWindow(GUI_t *GUI,Camera_t *Camera,VideoSystem_t *VideoSystem)
             igText("Resolution:%ix%i",VidConfigWidth->IValue,VidConfigHeight->IValue);
             igText("Refresh Rate:%i",VidConfigRefreshRate->IValue);
         }
+        OcclusionStats = OcclusionGetStats();
+        if( OcclusionStats && igCollapsingHeader_TreeNodeFlags("Occlusion Culling",ImGuiTreeNodeFlags_None) ) {
+            igText("Occluders Rasterized:%i",OcclusionStats->NumOccluders);
+            igText("Nodes Tested:%i",OcclusionStats->NumNodesTested);
+            igText("Nodes Occluded:%i",OcclusionStats->NumNodesOccluded);
+            igText("Rasterization Time:%.3f ms",OcclusionStats->RasterizationTime);
+            igText("Test Time:%.3f ms",OcclusionStats->TestTime);
+        }
+        PVSStats = PVSGetStats();
+        if( igCollapsingHeader_TreeNodeFlags("Potentially Visible Set",ImGuiTreeNodeFlags_None) ) {
+            if( !PVSStats->Loaded ) {
+                igText("No visibility data available for the current level");
+            } else {
+                igText("Current Leaf:%i",PVSStats->CurrentLeaf);
+                igText("Visible Leaves:%i/%i",PVSStats->NumVisibleLeaves,PVSStats->NumLeaves);
+            }
+        }
+        PickStats = PickGetStats();
+        if( igCollapsingHeader_TreeNodeFlags("Face Picking",ImGuiTreeNodeFlags_None) ) {
+            igText("BVH Triangles:%i",PickStats->NumTriangles);
+            igText("BVH Nodes:%i",PickStats->NumNodes);
+            igText("Build Time:%.3f ms",PickStats->BuildTime);
+            igText("Query Time:%.3f ms",PickStats->QueryTime);
+        }
+        CollisionMoveStats = CollisionGetMoveStats();
+        if( igCollapsingHeader_TreeNodeFlags("Camera Collision",ImGuiTreeNodeFlags_None) ) {
+            igText("Candidate Triangles:%i",CollisionMoveStats->NumCandidateTriangles);
+            igText("Sweep Tests:%i",CollisionMoveStats->NumSweepTests);
+            igText("Slide Iterations:%i",CollisionMoveStats->NumIterations);
+            igText("On Ground:%s",CollisionMoveStats->OnGround ? "Yes" : "No");
+            igText("Broadphase Time:%.3f ms",CollisionMoveStats->BroadphaseTime);
+            igText("Query Time:%.3f ms",CollisionMoveStats->QueryTime);
+        }
+        StreamingStats = StreamingGetStats();
+        if( igCollapsingHeader_TreeNodeFlags("Level Streaming",ImGuiTreeNodeFlags_None) ) {
+            if( !StreamingStats->Enabled ) {
+                igText("The current level is not streamed");
+            } else {
+                igText("Resident Leaves:%i/%i",StreamingStats->NumResidentLeaves,StreamingStats->NumLeaves);
+                igText("Pending Leaves:%i",StreamingStats->NumPendingLeaves);
+                igText("Resident Memory:%.2f/%.2f MB",StreamingStats->ResidentSize / (1024.f * 1024.f),
+                       StreamingStats->Budget / (1024.f * 1024.f));
+                igText("Uploads:%i Evictions:%i",StreamingStats->NumUploads,StreamingStats->NumEvictions);
+                igText("Upload Time:%.3f ms",StreamingStats->UploadTime);
+            }
+        }
+        MeshOptimizerStats = MeshOptimizerGetStats();
+        if( igCollapsingHeader_TreeNodeFlags("Mesh Optimization",ImGuiTreeNodeFlags_None) ) {
+            if( !MeshOptimizerStats->NumMeshes ) {
+                igText("No mesh has been optimized");
+            } else {
+                igText("Meshes:%i",MeshOptimizerStats->NumMeshes);
+                igText("Triangles:%i/%i",MeshOptimizerStats->NumOutputTriangles,MeshOptimizerStats->NumInputTriangles);
+                igText("Degenerate:%i Duplicated:%i",MeshOptimizerStats->NumDegenerateTriangles,
+                       MeshOptimizerStats->NumDuplicateTriangles);
+                igText("Vertices:%i/%i",MeshOptimizerStats->NumOutputVertices,MeshOptimizerStats->NumInputVertices);
+                igText("Order Constraints:%i",MeshOptimizerStats->NumOrderConstraints);
+                igText("ACMR Before:%.3f File Order:%.3f After:%.3f",
+                       (float) MeshOptimizerStats->NumTransformedBefore / MeshOptimizerStats->NumInputTriangles,
+                       (float) MeshOptimizerStats->NumTransformedFileOrder / MeshOptimizerStats->NumInputTriangles,
+                       (float) MeshOptimizerStats->NumTransformedAfter / MeshOptimizerStats->NumOutputTriangles);
+                igText("Vertex Fetch Before:%.2f KB File Order:%.2f KB After:%.2f KB",
+                       MeshOptimizerStats->FetchedBytesBefore / 1024.f,MeshOptimizerStats->FetchedBytesFileOrder / 1024.f,
+                       MeshOptimizerStats->FetchedBytesAfter / 1024.f);
+                igText("Overfetch:%.3f",(float) MeshOptimizerStats->FetchedBytesAfter / MeshOptimizerStats->VertexBufferSize);
+                igText("Time:%.3f ms",MeshOptimizerStats->Time);
+            }
+        }
+        LODStats = LODGetStats();
+        if( igCollapsingHeader_TreeNodeFlags("Level Of Detail",ImGuiTreeNodeFlags_None) ) {
+            if( !LODStats->NumMeshes ) {
+                igText("No detail level has been built");
+            } else {
+                igText("Meshes:%i Cache Hits:%i",LODStats->NumMeshes,LODStats->NumCacheHits);
+                igText("Triangles:%i/%i/%i",LODStats->NumTriangles[0],LODStats->NumTriangles[1],LODStats->NumTriangles[2]);
+                igText("Drawn Meshes:%i/%i/%i",LODStats->NumDrawnMeshes[0],LODStats->NumDrawnMeshes[1],
+                       LODStats->NumDrawnMeshes[2]);
+                igText("Drawn Triangles:%i",LODStats->NumDrawnTriangles);
+                igText("Build Time:%.3f ms",LODStats->BuildTime);
+            }
+        }
+        ResidencyStats = RenderObjectManagerGetResidencyStats();
+        if( igCollapsingHeader_TreeNodeFlags("VRAM Residency",ImGuiTreeNodeFlags_None) ) {
+            igText("Resident Packs:%i/%i",ResidencyStats->NumResidentPacks,ResidencyStats->NumPacks);
+            igText("Resident Memory:%.2f/%.2f MB",ResidencyStats->ResidentSize / (1024.f * 1024.f),
+                   ResidencyStats->Budget / (1024.f * 1024.f));
+            igText("Evictions:%i Restores:%i",ResidencyStats->NumEvictions,ResidencyStats->NumRestores);
+            igText("Restore Time:%.3f ms",ResidencyStats->RestoreTime);
+        }
+        DeduplicationStats = RenderObjectManagerGetDeduplicationStats();
+        if( igCollapsingHeader_TreeNodeFlags("Deduplication",ImGuiTreeNodeFlags_None) ) {
+            ImageInternStats = InternGetStats(INTERN_TYPE_IMAGE);
+            GeometryInternStats = InternGetStats(INTERN_TYPE_GEOMETRY);
+            igText("Images:%i stored %i duplicated",ImageInternStats->NumEntries,
+                   ImageInternStats->NumReferences - ImageInternStats->NumEntries);
+            igText("Images Memory:%.2f MB saved:%.2f MB",ImageInternStats->StoredSize / (1024.f * 1024.f),
+                   ImageInternStats->SavedSize / (1024.f * 1024.f));
+            igText("Models:%i arrays stored %i duplicated",GeometryInternStats->NumEntries,
+                   GeometryInternStats->NumReferences - GeometryInternStats->NumEntries);
+            igText("Models Memory:%.2f MB saved:%.2f MB",GeometryInternStats->StoredSize / (1024.f * 1024.f),
+                   GeometryInternStats->SavedSize / (1024.f * 1024.f));
+            igText("VRAMs:%i shared by %i packs",DeduplicationStats->NumTextureSets,
+                   DeduplicationStats->NumTextureSets + DeduplicationStats->NumSharedTextureSets);
+            igText("VRAM Memory saved:%.2f MB",DeduplicationStats->SavedVRAMSize / (1024.f * 1024.f));
+        }
+        AtlasStats = VRAMGetAtlasStats();
+        if( igCollapsingHeader_TreeNodeFlags("Texture Atlas",ImGuiTreeNodeFlags_None) ) {
+            if( !AtlasStats->NumTiles ) {
+                igText("No atlas has been built");
+            } else {
+                igText("Tiles:%i",AtlasStats->NumTiles);
+                igText("Memory:%.2f MB (VRAM Pages:%.2f MB)",AtlasStats->AtlasSize / (1024.f * 1024.f),
+                       AtlasStats->PagesSize / (1024.f * 1024.f));
+                //NOTE(Adriano):Indexed faces need a dependent CLUT fetch when the atlas is not used.
+                igText("Faces:%i Indexed:%i Direct:%i",AtlasStats->NumIndexedFaces + AtlasStats->NumDirectFaces,
+                       AtlasStats->NumIndexedFaces,AtlasStats->NumDirectFaces);
+                igText("Fetches per Fragment:%.2f -> 1.00",
+                       1.f + (float) AtlasStats->NumIndexedFaces / (AtlasStats->NumIndexedFaces + AtlasStats->NumDirectFaces));
+                igText("Build Time:%.3f ms",AtlasStats->BuildTime);
+            }
+        }
     }
     igEnd();
 }
@@ -113,8 +255,13 @@ void GUIDrawMainWindow(GUI_t *GUI,RenderObjectManager_t *RenderObjectManager,Vid
     BSDRenderObjectPack_t *PackIterator;
     BSDRenderObject_t *RenderObjectIterator;
     BSDRenderObject_t *CurrentRenderObject;
+    TSP_t *TSPIterator;
     ImVec2 ZeroSize;
     int DisableNode;
+    int NumDynamicDataIndices;
+    int DynamicDataIndex;
+    int i;
+    int j;
     char SmallBuffer[256];
     ImGuiTreeNodeFlags TreeNodeFlags;
 
@@ -129,13 +276,25 @@ void GUIDrawMainWindow(GUI_t *GUI,RenderObjectManager_t *RenderObjectManager,Vid
     if( igCollapsingHeader_TreeNodeFlags("Help",ImGuiTreeNodeFlags_DefaultOpen) ) {
         igText("Press and Hold The Left Mouse Button to Rotate the Camera");
         igText("Scroll the Mouse Wheel to Zoom the Camera In and Out");
-        igText("Press A and S to strafe the Camera left-right,Spacebar and Z to move it up-down");
+        igText("Press A and D to strafe the Camera left-right,Spacebar and Z to move it up-down");
+        igText("In Fly and Walk mode press W and S to move the Camera forward-backward,Spacebar jumps while walking");
         igText("Press Escape to exit the program");
     }
     if( igCollapsingHeader_TreeNodeFlags("Camera",ImGuiTreeNodeFlags_DefaultOpen) ) {
         igText("Camera Spherical Position(Radius,Theta,Phi):%.3f;%.3f;%.3f",Camera->Position.Radius,Camera->Position.Theta,Camera->Position.Phi);
         igText("Camera View Point:%.3f;%.3f;%.3f",Camera->ViewPoint[0],Camera->ViewPoint[1],Camera->ViewPoint[2]);
 
+        if( igRadioButton_IntPtr("Orbit",&CameraMode->IValue,CAMERA_MODE_ORBIT) ) {
+            ConfigSetNumber("CameraMode",CameraMode->IValue);
+        }
+        igSameLine(0.f,-1.f);
+        if( igRadioButton_IntPtr("Fly",&CameraMode->IValue,CAMERA_MODE_FLY) ) {
+            ConfigSetNumber("CameraMode",CameraMode->IValue);
+        }
+        igSameLine(0.f,-1.f);
+        if( igRadioButton_IntPtr("Walk",&CameraMode->IValue,CAMERA_MODE_WALK) ) {
+            ConfigSetNumber("CameraMode",CameraMode->IValue);
+        }
         if( igButton("Reset Camera Position",ZeroSize) ) {
             CameraReset(Camera);
         }
@@ -153,6 +312,58 @@ void GUIDrawMainWindow(GUI_t *GUI,RenderObjectManager_t *RenderObjectManager,Vid
         if( GUICheckBoxWithTooltip("Ambient Light",(bool *) &EnableAmbientLight->IValue,EnableAmbientLight->Description) ) {
             ConfigSetNumber("EnableAmbientLight",EnableAmbientLight->IValue);
         }
+        if( GUICheckBoxWithTooltip("Occlusion Culling",(bool *) &EnableOcclusionCulling->IValue,EnableOcclusionCulling->Description) ) {
+            ConfigSetNumber("EnableOcclusionCulling",EnableOcclusionCulling->IValue);
+        }
+        if( GUICheckBoxWithTooltip("PVS Culling",(bool *) &EnablePVS->IValue,EnablePVS->Description) ) {
+            ConfigSetNumber("EnablePVS",EnablePVS->IValue);
+        }
+        if( GUICheckBoxWithTooltip("Level Streaming",(bool *) &EnableLevelStreaming->IValue,EnableLevelStreaming->Description) ) {
+            ConfigSetNumber("EnableLevelStreaming",EnableLevelStreaming->IValue);
+        }
+        if( igSliderInt("Streaming Memory Budget (MB)",&LevelStreamingMemoryBudget->IValue,1,1024,"%d",0) ) {
+            ConfigSetNumber("LevelStreamingMemoryBudget",LevelStreamingMemoryBudget->IValue);
+        }
+        if( igSliderInt("VRAM Memory Budget (MB)",&VRAMMemoryBudget->IValue,1,1024,"%d",0) ) {
+            ConfigSetNumber("VRAMMemoryBudget",VRAMMemoryBudget->IValue);
+        }
+        if( GUICheckBoxWithTooltip("Mesh Optimization",(bool *) &EnableMeshOptimization->IValue,EnableMeshOptimization->Description) ) {
+            ConfigSetNumber("EnableMeshOptimization",EnableMeshOptimization->IValue);
+        }
+        if( GUICheckBoxWithTooltip("Level Of Detail",(bool *) &EnableLOD->IValue,EnableLOD->Description) ) {
+            ConfigSetNumber("EnableLOD",EnableLOD->IValue);
+        }
+        if( GUICheckBoxWithTooltip("Native VRAM",(bool *) &EnableNativeVRAM->IValue,EnableNativeVRAM->Description) ) {
+            ConfigSetNumber("EnableNativeVRAM",EnableNativeVRAM->IValue);
+        }
+        if( GUICheckBoxWithTooltip("Texture Atlas",(bool *) &EnableTextureAtlas->IValue,EnableTextureAtlas->Description) ) {
+            ConfigSetNumber("EnableTextureAtlas",EnableTextureAtlas->IValue);
+        }
+        if( GUICheckBoxWithTooltip("Content Deduplication",(bool *) &EnableContentDeduplication->IValue,
+            EnableContentDeduplication->Description) ) {
+            ConfigSetNumber("EnableContentDeduplication",EnableContentDeduplication->IValue);
+        }
+        if( GUICheckBoxWithTooltip("Face Picking",(bool *) &EnableFacePicking->IValue,EnableFacePicking->Description) ) {
+            ConfigSetNumber("EnableFacePicking",EnableFacePicking->IValue);
+        }
+        igText("PNG Compression");
+        if( igRadioButton_IntPtr("Deflate",&PNGCompressionMode->IValue,PNG_WRITER_MODE_DEFLATE) ) {
+            ConfigSetNumber("PNGCompressionMode",PNGCompressionMode->IValue);
+        }
+        igSameLine(0.f,-1.f);
+        if( igRadioButton_IntPtr("RLE",&PNGCompressionMode->IValue,PNG_WRITER_MODE_RLE) ) {
+            ConfigSetNumber("PNGCompressionMode",PNGCompressionMode->IValue);
+        }
+        igSameLine(0.f,-1.f);
+        if( igRadioButton_IntPtr("Store",&PNGCompressionMode->IValue,PNG_WRITER_MODE_STORE) ) {
+            ConfigSetNumber("PNGCompressionMode",PNGCompressionMode->IValue);
+        }
+        if( igSliderInt("PNG Compression Level",&PNGCompressionLevel->IValue,0,9,"%d",0) ) {
+            ConfigSetNumber("PNGCompressionLevel",PNGCompressionLevel->IValue);
+        }
+        if( igSliderInt("PNG Filter",&PNGFilter->IValue,0,PNG_WRITER_NUM_FILTERS - 1,PNGWriterGetFilterName(PNGFilter->IValue),0) ) {
+            ConfigSetNumber("PNGFilter",PNGFilter->IValue);
+        }
         if( GUICheckBoxWithTooltip("Show FPS",(bool *) &GUIShowFPS->IValue,GUIShowFPS->Description) ) {
             ConfigSetNumber("GUIShowFPS",GUIShowFPS->IValue);
         }
@@ -211,6 +422,58 @@ void GUIDrawMainWindow(GUI_t *GUI,RenderObjectManager_t *RenderObjectManager,Vid
             if( igButton("Export to Ply",ZeroSize) ) {
                 RenderObjectManagerExportSelectedModel(RenderObjectManager,GUI,VideoSystem,RENDER_OBJECT_MANAGER_EXPORT_FORMAT_PLY,false);
             }
+            if( CurrentRenderObject->TSP ) {
+                igSeparator();
+                igText("Export a region of the level");
+                if( igRadioButton_IntPtr("Box",&ExportRegionType->IValue,RENDER_OBJECT_MANAGER_EXPORT_REGION_BOX) ) {
+                    ConfigSetNumber("ExportRegionType",ExportRegionType->IValue);
+                }
+                igSameLine(0.f,-1.f);
+                if( igRadioButton_IntPtr("Camera Frustum",&ExportRegionType->IValue,RENDER_OBJECT_MANAGER_EXPORT_REGION_FRUSTUM) ) {
+                    ConfigSetNumber("ExportRegionType",ExportRegionType->IValue);
+                }
+                if( ExportRegionType->IValue == RENDER_OBJECT_MANAGER_EXPORT_REGION_BOX &&
+                    igSliderFloat("Box Half Size",&ExportRegionSize->FValue,64.f,16384.f,"%.0f",0) ) {
+                    ConfigSetNumber("ExportRegionSize",ExportRegionSize->FValue);
+                }
+                if( GUICheckBoxWithTooltip("Clip Faces",(bool *) &ExportRegionClipFaces->IValue,ExportRegionClipFaces->Description) ) {
+                    ConfigSetNumber("ExportRegionClipFaces",ExportRegionClipFaces->IValue);
+                }
+                if( igButton("Export Region to Ply",ZeroSize) ) {
+                    RenderObjectManagerExportSelectedRegion(RenderObjectManager,GUI,VideoSystem,Camera,RENDER_OBJECT_MANAGER_EXPORT_FORMAT_PLY);
+                }
+                igSameLine(0.f,-1.f);
+                if( igButton("Export Region to Obj",ZeroSize) ) {
+                    RenderObjectManagerExportSelectedRegion(RenderObjectManager,GUI,VideoSystem,Camera,RENDER_OBJECT_MANAGER_EXPORT_FORMAT_OBJ);
+                }
+                igSeparator();
+                igText("Dynamic faces (doors and moving surfaces)");
+                NumDynamicDataIndices = 0;
+                for( TSPIterator = CurrentRenderObject->TSP; TSPIterator; TSPIterator = TSPIterator->Next ) {
+                    for( i = 0; i < TSPIterator->Header.NumDynamicDataBlock; i++ ) {
+                        DynamicDataIndex = TSPIterator->DynamicData[i].Header.DynamicDataIndex;
+                        for( j = 0; j < i; j++ ) {
+                            if( TSPIterator->DynamicData[j].Header.DynamicDataIndex == DynamicDataIndex ) {
+                                break;
+                            }
+                        }
+                        if( j != i ) {
+                            continue;
+                        }
+                        if( NumDynamicDataIndices % 8 ) {
+                            igSameLine(0.f,-1.f);
+                        }
+                        sprintf(SmallBuffer,"%i##DynamicData%i_%i",DynamicDataIndex,TSPIterator->Number,i);
+                        if( igSmallButton(SmallBuffer) ) {
+                            TSPUpdateDynamicFaces(CurrentRenderObject->TSP,Camera,DynamicDataIndex);
+                        }
+                        NumDynamicDataIndices++;
+                    }
+                }
+                if( !NumDynamicDataIndices ) {
+                    igText("The current level has no dynamic faces");
+                }
+            }
         }
     }
     igEnd();
@@ -244,6 +507,48 @@ void GUIDrawMenuBar(Application_t *Application)
     igEndMainMenuBar();
 }
 
+void GUIDrawPickTooltip()
+{
+    const PickStats_t *PickStats;
+    const PickResult_t *Result;
+    
+    if( !EnableFacePicking->IValue || !GUIIsMouseFree() ) {
+        return;
+    }
+    PickStats = PickGetStats();
+    if( !PickStats->Hit ) {
+        return;
+    }
+    Result = &PickStats->Result;
+    igBeginTooltip();
+    switch( Result->Type ) {
+        case PICK_TARGET_LEVEL_FACE:
+            igText("Level Face");
+            igText("TSP:%i Node:%i Face:%i",Result->TSPNumber,Result->NodeIndex,Result->FaceIndex);
+            break;
+        case PICK_TARGET_ANIMATED_FACE:
+            igText("Animated Model Face");
+            igText("RenderObject:%i Face:%i",Result->RenderObjectId,Result->FaceIndex);
+            break;
+        case PICK_TARGET_TEXTURED_FACE:
+        case PICK_TARGET_UNTEXTURED_FACE:
+            igText("Model Face");
+            igText("RenderObject:%i Face:%i",Result->RenderObjectId,Result->FaceIndex);
+            break;
+        default:
+            break;
+    }
+    if( Result->Textured ) {
+        igText("Texture Page:%i",Result->TexturePage);
+        igText("CLUT:%i;%i",Result->CLUTX,Result->CLUTY);
+        igText("Color Mode:%i",Result->ColorMode);
+    } else {
+        igText("Untextured");
+    }
+    igText("Distance:%.2f",Result->Distance);
+    igText("Query Time:%.3f ms",PickStats->QueryTime);
+    igEndTooltip();
+}
 void GUIDraw(Application_t *Application)
 {
     
@@ -255,6 +560,7 @@ void GUIDraw(Application_t *Application)
     GUIDrawMainWindow(Application->GUI,Application->RenderObjectManager,Application->Engine->VideoSystem,Application->Camera);
     GUIDrawDebugWindow(Application->GUI,Application->Camera,Application->Engine->VideoSystem);
     GUIDrawVideoSettingsWindow(&Application->GUI->VideoSettingsWindowHandle,Application->Engine->VideoSystem);
+    GUIDrawPickTooltip();
 //     igShowDemoWindow(NULL);
     GUIEndFrame();
 }
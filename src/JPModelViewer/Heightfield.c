@@ -0,0 +1,782 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#include "Heightfield.h"
+#include "Collision.h"
+#include "../Common/ThreadPool.h"
+
+typedef enum {
+    HEIGHTFIELD_PASS_BAKE,
+    HEIGHTFIELD_PASS_MEASURE_ERROR
+} HeightfieldPass_t;
+
+typedef struct HeightfieldBakeContext_s {
+    TSP_t           *TSPList;
+    Heightfield_t   *Heightfield;
+    int             Pass;
+    int             NumTilesX;
+    int             NumTilesZ;
+    int             *NumFailedList;
+    float           *MaxErrorList;
+    double          *ErrorSumList;
+    int             *NumErrorSamplesList;
+    int             *NumFallbackSamplesList;
+} HeightfieldBakeContext_t;
+
+/*
+ * FNV-1a hash of the collision data of every TSP in the list.
+ * Used to find the sidecar file that belongs to a level.
+ */
+static unsigned int HeightfieldComputeLevelHash(TSP_t *TSPList)
+{
+    TSPCollision_t *CollisionData;
+    TSP_t *Iterator;
+    unsigned int Hash;
+    
+    Hash = HASH_FNV1A_INITIAL_VALUE;
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        CollisionData = Iterator->CollisionData;
+        if( !CollisionData ) {
+            continue;
+        }
+        Hash = HashFNV1a(Hash,&CollisionData->Header,sizeof(CollisionData->Header));
+        Hash = HashFNV1a(Hash,CollisionData->KDTree,CollisionData->Header.NumCollisionKDTreeNodes * sizeof(TSPCollisionKDTreeNode_t));
+        Hash = HashFNV1a(Hash,CollisionData->FaceIndexList,CollisionData->Header.NumCollisionFaceIndex * sizeof(short));
+        Hash = HashFNV1a(Hash,CollisionData->Vertex,CollisionData->Header.NumVertices * sizeof(TSPVert_t));
+        Hash = HashFNV1a(Hash,CollisionData->Normal,CollisionData->Header.NumNormals * sizeof(TSPVert_t));
+        Hash = HashFNV1a(Hash,CollisionData->Face,CollisionData->Header.NumFaces * sizeof(TSPCollisionFace_t));
+    }
+    return Hash;
+}
+
+static char *HeightfieldGetFilePath(unsigned int Hash,int Resolution)
+{
+    char *ConfigPath;
+    char *Directory;
+    char *Path;
+    
+    ConfigPath = AppGetConfigPath();
+    asprintf(&Directory,"%sHeightfield",ConfigPath);
+    CreateDirIfNotExists(Directory);
+    asprintf(&Path,"%s/%08X-%i.hfd",Directory,Hash,Resolution);
+    free(Directory);
+    free(ConfigPath);
+    return Path;
+}
+
+void HeightfieldFree(Heightfield_t *Heightfield)
+{
+    if( !Heightfield ) {
+        return;
+    }
+    if( Heightfield->NumLayersList ) {
+        free(Heightfield->NumLayersList);
+    }
+    if( Heightfield->YList ) {
+        free(Heightfield->YList);
+    }
+    if( Heightfield->FaceList ) {
+        free(Heightfield->FaceList);
+    }
+    if( Heightfield->TSPNumberList ) {
+        free(Heightfield->TSPNumberList);
+    }
+    free(Heightfield);
+}
+
+static int HeightfieldAllocSamples(Heightfield_t *Heightfield)
+{
+    int NumSamples;
+    
+    NumSamples = Heightfield->NumSamplesX * Heightfield->NumSamplesZ;
+    Heightfield->NumLayersList = malloc(NumSamples * sizeof(Byte));
+    Heightfield->YList = malloc(NumSamples * HEIGHTFIELD_MAX_LAYERS * sizeof(short));
+    Heightfield->FaceList = malloc(NumSamples * HEIGHTFIELD_MAX_LAYERS * sizeof(unsigned short));
+    Heightfield->TSPNumberList = malloc(NumSamples * sizeof(short));
+    if( !Heightfield->NumLayersList || !Heightfield->YList || !Heightfield->FaceList || !Heightfield->TSPNumberList ) {
+        DPrintf("HeightfieldAllocSamples:Failed to allocate memory for %i samples\n",NumSamples);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Creates an empty heightfield that covers the collision bounds of every TSP in the list.
+ */
+static Heightfield_t *HeightfieldCreate(TSP_t *TSPList,int Resolution)
+{
+    Heightfield_t *Heightfield;
+    TSPCollisionHeader_t *Header;
+    TSP_t *Iterator;
+    int MaxX;
+    int MaxZ;
+    bool First;
+    
+    if( !TSPList || Resolution <= 0 ) {
+        DPrintf("HeightfieldCreate:Invalid %s\n",!TSPList ? "TSP list" : "resolution");
+        return NULL;
+    }
+    Heightfield = malloc(sizeof(Heightfield_t));
+    if( !Heightfield ) {
+        DPrintf("HeightfieldCreate:Failed to allocate memory for heightfield\n");
+        return NULL;
+    }
+    memset(Heightfield,0,sizeof(Heightfield_t));
+    Heightfield->Resolution = Resolution;
+    MaxX = MaxZ = 0;
+    First = true;
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        if( !Iterator->CollisionData ) {
+            continue;
+        }
+        Header = &Iterator->CollisionData->Header;
+        if( First || Header->CollisionBoundMinX < Heightfield->MinX ) {
+            Heightfield->MinX = Header->CollisionBoundMinX;
+        }
+        if( First || Header->CollisionBoundMinZ < Heightfield->MinZ ) {
+            Heightfield->MinZ = Header->CollisionBoundMinZ;
+        }
+        if( First || Header->CollisionBoundMaxX > MaxX ) {
+            MaxX = Header->CollisionBoundMaxX;
+        }
+        if( First || Header->CollisionBoundMaxZ > MaxZ ) {
+            MaxZ = Header->CollisionBoundMaxZ;
+        }
+        First = false;
+    }
+    if( First ) {
+        DPrintf("HeightfieldCreate:Level has no collision data\n");
+        HeightfieldFree(Heightfield);
+        return NULL;
+    }
+    //NOTE(Adriano):One extra sample so that the last cell reaches the maximum bound.
+    Heightfield->NumSamplesX = (MaxX - Heightfield->MinX) / Resolution + 2;
+    Heightfield->NumSamplesZ = (MaxZ - Heightfield->MinZ) / Resolution + 2;
+    Heightfield->Hash = HeightfieldComputeLevelHash(TSPList);
+    return Heightfield;
+}
+
+/*
+ * Returns the first layer at or below the given height (Y grows downwards),or the closest one
+ * when the point is below every layer.
+ */
+static int HeightfieldSelectLayer(const int *YList,int NumLayers,int Y)
+{
+    int i;
+    
+    if( NumLayers <= 0 ) {
+        return -1;
+    }
+    for( i = 0; i < NumLayers; i++ ) {
+        if( YList[i] >= Y - HEIGHTFIELD_LAYER_TOLERANCE ) {
+            return i;
+        }
+    }
+    return NumLayers - 1;
+}
+
+/*
+ * Bilinear interpolation of the four samples around the point.
+ * Returns 0 when the point is outside the heightfield or the samples don't belong to the same
+ * surface,in which case the caller has to run an exact query.
+ */
+static int HeightfieldInterpolate(Heightfield_t *Heightfield,vec3 Point,int *OutY,int *OutFace,int *OutTSPNumber)
+{
+    int CornerY[4];
+    int CornerFace[4];
+    int CornerTSPNumber[4];
+    int YList[HEIGHTFIELD_MAX_LAYERS];
+    int Sample;
+    int NumLayers;
+    int Layer;
+    int SampleX;
+    int SampleZ;
+    int MinY;
+    int MaxY;
+    int Nearest;
+    float FractionX;
+    float FractionZ;
+    float Top;
+    float Bottom;
+    int i;
+    int j;
+    
+    FractionX = (Point[0] - Heightfield->MinX) / Heightfield->Resolution;
+    FractionZ = (Point[2] - Heightfield->MinZ) / Heightfield->Resolution;
+    if( FractionX < 0.f || FractionZ < 0.f ) {
+        return 0;
+    }
+    SampleX = (int) FractionX;
+    SampleZ = (int) FractionZ;
+    if( SampleX + 1 >= Heightfield->NumSamplesX || SampleZ + 1 >= Heightfield->NumSamplesZ ) {
+        return 0;
+    }
+    FractionX -= SampleX;
+    FractionZ -= SampleZ;
+    for( i = 0; i < 4; i++ ) {
+        Sample = (SampleZ + (i >> 1)) * Heightfield->NumSamplesX + SampleX + (i & 1);
+        NumLayers = Heightfield->NumLayersList[Sample];
+        for( j = 0; j < NumLayers; j++ ) {
+            YList[j] = Heightfield->YList[Sample * HEIGHTFIELD_MAX_LAYERS + j];
+        }
+        Layer = HeightfieldSelectLayer(YList,NumLayers,(int) Point[1]);
+        if( Layer == -1 ) {
+            return 0;
+        }
+        CornerY[i] = YList[Layer];
+        CornerFace[i] = Heightfield->FaceList[Sample * HEIGHTFIELD_MAX_LAYERS + Layer];
+        CornerTSPNumber[i] = Heightfield->TSPNumberList[Sample];
+    }
+    MinY = MaxY = CornerY[0];
+    for( i = 1; i < 4; i++ ) {
+        MinY = CornerY[i] < MinY ? CornerY[i] : MinY;
+        MaxY = CornerY[i] > MaxY ? CornerY[i] : MaxY;
+    }
+    if( MaxY - MinY > HEIGHTFIELD_MAX_INTERPOLATION_DELTA ) {
+        return 0;
+    }
+    Top = CornerY[0] + (CornerY[1] - CornerY[0]) * FractionX;
+    Bottom = CornerY[2] + (CornerY[3] - CornerY[2]) * FractionX;
+    *OutY = (int) roundf(Top + (Bottom - Top) * FractionZ);
+    Nearest = (FractionX >= 0.5f ? 1 : 0) | (FractionZ >= 0.5f ? 2 : 0);
+    if( OutFace ) {
+        *OutFace = CornerFace[Nearest];
+    }
+    if( OutTSPNumber ) {
+        *OutTSPNumber = CornerTSPNumber[Nearest];
+    }
+    return 1;
+}
+
+/*
+ * Exact queries used for the points that the heightfield cannot answer.
+ * Every point is resolved by a single batched query against the collision data.
+ */
+static int HeightfieldGetExactYList(TSP_t *TSPList,vec3 *PointList,int NumPoints,int *OutYList,int *OutFaceList,int *OutTSPNumberList)
+{
+    int *YList;
+    int *FaceList;
+    int *NumLayersList;
+    int Layer;
+    int NumHits;
+    int i;
+    
+    YList = malloc(NumPoints * HEIGHTFIELD_MAX_LAYERS * sizeof(int));
+    FaceList = malloc(NumPoints * HEIGHTFIELD_MAX_LAYERS * sizeof(int));
+    NumLayersList = malloc(NumPoints * sizeof(int));
+    NumHits = 0;
+    for( i = 0; i < NumPoints; i++ ) {
+        OutYList[i] = 0;
+        OutFaceList[i] = -1;
+        OutTSPNumberList[i] = -1;
+    }
+    if( !YList || !FaceList || !NumLayersList ) {
+        DPrintf("HeightfieldGetExactYList:Failed to allocate memory for %i points\n",NumPoints);
+        goto Cleanup;
+    }
+    if( !CollisionGetHeightLayerList(TSPList,PointList,NumPoints,HEIGHTFIELD_MAX_LAYERS,YList,FaceList,NumLayersList,OutTSPNumberList) ) {
+        goto Cleanup;
+    }
+    for( i = 0; i < NumPoints; i++ ) {
+        Layer = HeightfieldSelectLayer(&YList[i * HEIGHTFIELD_MAX_LAYERS],NumLayersList[i],(int) PointList[i][1]);
+        if( Layer == -1 ) {
+            continue;
+        }
+        OutYList[i] = YList[i * HEIGHTFIELD_MAX_LAYERS + Layer];
+        OutFaceList[i] = FaceList[i * HEIGHTFIELD_MAX_LAYERS + Layer];
+        NumHits++;
+    }
+Cleanup:
+    if( YList ) {
+        free(YList);
+    }
+    if( FaceList ) {
+        free(FaceList);
+    }
+    if( NumLayersList ) {
+        free(NumLayersList);
+    }
+    return NumHits;
+}
+
+/*
+ * Returns the height of the first surface below the point using the heightfield,falling back to an
+ * exact query against the collision data near steps,ledges and outside the baked area.
+ * OutFace receives the index of the collision face that contains the point and OutTSPNumber the number
+ * of the TSP that owns it,both are optional.
+ * Returns 0 if there is no surface below the point.
+ */
+int HeightfieldGetY(Heightfield_t *Heightfield,TSP_t *TSPList,vec3 Point,int *OutY,int *OutFace,int *OutTSPNumber)
+{
+    int YList[HEIGHTFIELD_MAX_LAYERS];
+    int FaceList[HEIGHTFIELD_MAX_LAYERS];
+    int NumLayers;
+    int TSPNumber;
+    int Layer;
+    
+    if( !OutY ) {
+        return 0;
+    }
+    if( Heightfield && HeightfieldInterpolate(Heightfield,Point,OutY,OutFace,OutTSPNumber) ) {
+        return 1;
+    }
+    if( !CollisionGetHeightLayerList(TSPList,(vec3 *) Point,1,HEIGHTFIELD_MAX_LAYERS,YList,FaceList,&NumLayers,&TSPNumber) ) {
+        return 0;
+    }
+    Layer = HeightfieldSelectLayer(YList,NumLayers,(int) Point[1]);
+    *OutY = YList[Layer];
+    if( OutFace ) {
+        *OutFace = FaceList[Layer];
+    }
+    if( OutTSPNumber ) {
+        *OutTSPNumber = TSPNumber;
+    }
+    return 1;
+}
+
+/*
+ * Batched version of HeightfieldGetY.
+ * OutYList,OutFaceList and OutTSPNumberList must hold NumPoints entries,points without a surface below them
+ * have a face index and a TSP number of -1.
+ * Returns the number of points that have a surface below them.
+ */
+int HeightfieldGetYList(Heightfield_t *Heightfield,TSP_t *TSPList,vec3 *PointList,int NumPoints,int *OutYList,
+                        int *OutFaceList,int *OutTSPNumberList)
+{
+    vec3 *MissPointList;
+    int *MissIndexList;
+    int *MissYList;
+    int *MissFaceList;
+    int *MissTSPNumberList;
+    int NumMisses;
+    int NumHits;
+    int i;
+    
+    if( !PointList || !OutYList || !OutFaceList || !OutTSPNumberList || NumPoints <= 0 ) {
+        return 0;
+    }
+    MissPointList = malloc(NumPoints * sizeof(vec3));
+    MissIndexList = malloc(NumPoints * sizeof(int));
+    MissYList = malloc(NumPoints * sizeof(int));
+    MissFaceList = malloc(NumPoints * sizeof(int));
+    MissTSPNumberList = malloc(NumPoints * sizeof(int));
+    NumHits = 0;
+    if( !MissPointList || !MissIndexList || !MissYList || !MissFaceList || !MissTSPNumberList ) {
+        DPrintf("HeightfieldGetYList:Failed to allocate memory for %i points\n",NumPoints);
+        goto Cleanup;
+    }
+    NumMisses = 0;
+    for( i = 0; i < NumPoints; i++ ) {
+        if( Heightfield && HeightfieldInterpolate(Heightfield,PointList[i],&OutYList[i],&OutFaceList[i],&OutTSPNumberList[i]) ) {
+            NumHits++;
+            continue;
+        }
+        glm_vec3_copy(PointList[i],MissPointList[NumMisses]);
+        MissIndexList[NumMisses] = i;
+        NumMisses++;
+    }
+    if( NumMisses ) {
+        NumHits += HeightfieldGetExactYList(TSPList,MissPointList,NumMisses,MissYList,MissFaceList,MissTSPNumberList);
+        for( i = 0; i < NumMisses; i++ ) {
+            OutYList[MissIndexList[i]] = MissYList[i];
+            OutFaceList[MissIndexList[i]] = MissFaceList[i];
+            OutTSPNumberList[MissIndexList[i]] = MissTSPNumberList[i];
+        }
+    }
+Cleanup:
+    if( MissPointList ) {
+        free(MissPointList);
+    }
+    if( MissIndexList ) {
+        free(MissIndexList);
+    }
+    if( MissYList ) {
+        free(MissYList);
+    }
+    if( MissFaceList ) {
+        free(MissFaceList);
+    }
+    if( MissTSPNumberList ) {
+        free(MissTSPNumberList);
+    }
+    return NumHits;
+}
+
+/*
+ * Thread pool task: bakes a square tile of samples or,during the second pass,compares the
+ * interpolated height against an exact query at the center of each cell of the tile.
+ */
+static void HeightfieldProcessTile(void *UserData,int TaskIndex)
+{
+    HeightfieldBakeContext_t *Context;
+    Heightfield_t *Heightfield;
+    vec3 *PointList;
+    int *YList;
+    int *FaceList;
+    int *NumLayersList;
+    int *TSPNumberList;
+    int StartX;
+    int StartZ;
+    int EndX;
+    int EndZ;
+    int NumPoints;
+    int Sample;
+    int Point;
+    int InterpolatedY;
+    float Error;
+    float Offset;
+    int x;
+    int z;
+    int i;
+    
+    Context = (HeightfieldBakeContext_t *) UserData;
+    Heightfield = Context->Heightfield;
+    StartX = (TaskIndex % Context->NumTilesX) * HEIGHTFIELD_TILE_SIZE;
+    StartZ = (TaskIndex / Context->NumTilesX) * HEIGHTFIELD_TILE_SIZE;
+    EndX = StartX + HEIGHTFIELD_TILE_SIZE < Heightfield->NumSamplesX ? StartX + HEIGHTFIELD_TILE_SIZE : Heightfield->NumSamplesX;
+    EndZ = StartZ + HEIGHTFIELD_TILE_SIZE < Heightfield->NumSamplesZ ? StartZ + HEIGHTFIELD_TILE_SIZE : Heightfield->NumSamplesZ;
+    NumPoints = (EndX - StartX) * (EndZ - StartZ);
+    PointList = malloc(NumPoints * sizeof(vec3));
+    YList = malloc(NumPoints * HEIGHTFIELD_MAX_LAYERS * sizeof(int));
+    FaceList = malloc(NumPoints * HEIGHTFIELD_MAX_LAYERS * sizeof(int));
+    NumLayersList = malloc(NumPoints * sizeof(int));
+    TSPNumberList = malloc(NumPoints * sizeof(int));
+    if( !PointList || !YList || !FaceList || !NumLayersList || !TSPNumberList ) {
+        Context->NumFailedList[TaskIndex] = 1;
+        goto Cleanup;
+    }
+    //NOTE(Adriano):Error is measured in the middle of the cells,the worst place for the interpolation.
+    Offset = Context->Pass == HEIGHTFIELD_PASS_MEASURE_ERROR ? Heightfield->Resolution * 0.5f : 0.f;
+    Point = 0;
+    for( z = StartZ; z < EndZ; z++ ) {
+        for( x = StartX; x < EndX; x++ ) {
+            PointList[Point][0] = Heightfield->MinX + x * Heightfield->Resolution + Offset;
+            PointList[Point][1] = 0.f;
+            PointList[Point][2] = Heightfield->MinZ + z * Heightfield->Resolution + Offset;
+            Point++;
+        }
+    }
+    //NOTE(Adriano):Tasks are already running in parallel,the query will be executed on this thread.
+    CollisionGetHeightLayerList(Context->TSPList,PointList,NumPoints,HEIGHTFIELD_MAX_LAYERS,YList,FaceList,NumLayersList,TSPNumberList);
+    Point = 0;
+    for( z = StartZ; z < EndZ; z++ ) {
+        for( x = StartX; x < EndX; x++, Point++ ) {
+            if( Context->Pass == HEIGHTFIELD_PASS_BAKE ) {
+                Sample = z * Heightfield->NumSamplesX + x;
+                Heightfield->NumLayersList[Sample] = NumLayersList[Point];
+                Heightfield->TSPNumberList[Sample] = TSPNumberList[Point];
+                for( i = 0; i < HEIGHTFIELD_MAX_LAYERS; i++ ) {
+                    Heightfield->YList[Sample * HEIGHTFIELD_MAX_LAYERS + i] = YList[Point * HEIGHTFIELD_MAX_LAYERS + i];
+                    Heightfield->FaceList[Sample * HEIGHTFIELD_MAX_LAYERS + i] = FaceList[Point * HEIGHTFIELD_MAX_LAYERS + i] == -1 ?
+                        HEIGHTFIELD_NO_FACE : FaceList[Point * HEIGHTFIELD_MAX_LAYERS + i];
+                }
+                continue;
+            }
+            for( i = 0; i < NumLayersList[Point]; i++ ) {
+                PointList[Point][1] = YList[Point * HEIGHTFIELD_MAX_LAYERS + i];
+                if( !HeightfieldInterpolate(Heightfield,PointList[Point],&InterpolatedY,NULL,NULL) ) {
+                    Context->NumFallbackSamplesList[TaskIndex]++;
+                    continue;
+                }
+                Error = abs(InterpolatedY - YList[Point * HEIGHTFIELD_MAX_LAYERS + i]);
+                Context->MaxErrorList[TaskIndex] = Error > Context->MaxErrorList[TaskIndex] ? Error : Context->MaxErrorList[TaskIndex];
+                Context->ErrorSumList[TaskIndex] += Error;
+                Context->NumErrorSamplesList[TaskIndex]++;
+            }
+        }
+    }
+Cleanup:
+    if( PointList ) {
+        free(PointList);
+    }
+    if( YList ) {
+        free(YList);
+    }
+    if( FaceList ) {
+        free(FaceList);
+    }
+    if( NumLayersList ) {
+        free(NumLayersList);
+    }
+    if( TSPNumberList ) {
+        free(TSPNumberList);
+    }
+}
+
+static int HeightfieldReadFile(Heightfield_t *Heightfield,const char *Path)
+{
+    FILE *HeightfieldFile;
+    int Magic;
+    int Version;
+    unsigned int Hash;
+    int Resolution;
+    int MinX;
+    int MinZ;
+    int NumSamplesX;
+    int NumSamplesZ;
+    int NumSamples;
+    int i;
+    
+    HeightfieldFile = fopen(Path,"rb");
+    if( !HeightfieldFile ) {
+        return 0;
+    }
+    if( fread(&Magic,sizeof(Magic),1,HeightfieldFile) != 1 || Magic != HEIGHTFIELD_FILE_MAGIC ) {
+        DPrintf("HeightfieldReadFile:%s is not a valid heightfield file\n",Path);
+        goto Failure;
+    }
+    if( fread(&Version,sizeof(Version),1,HeightfieldFile) != 1 || Version != HEIGHTFIELD_FILE_VERSION ) {
+        DPrintf("HeightfieldReadFile:%s has an unsupported version\n",Path);
+        goto Failure;
+    }
+    if( fread(&Hash,sizeof(Hash),1,HeightfieldFile) != 1 ||
+        fread(&Resolution,sizeof(Resolution),1,HeightfieldFile) != 1 ||
+        fread(&MinX,sizeof(MinX),1,HeightfieldFile) != 1 ||
+        fread(&MinZ,sizeof(MinZ),1,HeightfieldFile) != 1 ||
+        fread(&NumSamplesX,sizeof(NumSamplesX),1,HeightfieldFile) != 1 ||
+        fread(&NumSamplesZ,sizeof(NumSamplesZ),1,HeightfieldFile) != 1 ) {
+        DPrintf("HeightfieldReadFile:Truncated header in %s\n",Path);
+        goto Failure;
+    }
+    if( Hash != Heightfield->Hash || Resolution != Heightfield->Resolution || MinX != Heightfield->MinX ||
+        MinZ != Heightfield->MinZ || NumSamplesX != Heightfield->NumSamplesX || NumSamplesZ != Heightfield->NumSamplesZ ) {
+        DPrintf("HeightfieldReadFile:%s doesn't match the current level\n",Path);
+        goto Failure;
+    }
+    if( fread(&Heightfield->MaxError,sizeof(Heightfield->MaxError),1,HeightfieldFile) != 1 ||
+        fread(&Heightfield->AverageError,sizeof(Heightfield->AverageError),1,HeightfieldFile) != 1 ||
+        fread(&Heightfield->NumErrorSamples,sizeof(Heightfield->NumErrorSamples),1,HeightfieldFile) != 1 ||
+        fread(&Heightfield->NumFallbackSamples,sizeof(Heightfield->NumFallbackSamples),1,HeightfieldFile) != 1 ) {
+        DPrintf("HeightfieldReadFile:Truncated error statistics in %s\n",Path);
+        goto Failure;
+    }
+    if( !HeightfieldAllocSamples(Heightfield) ) {
+        goto Failure;
+    }
+    NumSamples = NumSamplesX * NumSamplesZ;
+    if( fread(Heightfield->NumLayersList,sizeof(Byte),NumSamples,HeightfieldFile) != NumSamples ||
+        fread(Heightfield->YList,sizeof(short),NumSamples * HEIGHTFIELD_MAX_LAYERS,HeightfieldFile) != NumSamples * HEIGHTFIELD_MAX_LAYERS ||
+        fread(Heightfield->FaceList,sizeof(unsigned short),NumSamples * HEIGHTFIELD_MAX_LAYERS,HeightfieldFile) != NumSamples * HEIGHTFIELD_MAX_LAYERS ||
+        fread(Heightfield->TSPNumberList,sizeof(short),NumSamples,HeightfieldFile) != NumSamples ) {
+        DPrintf("HeightfieldReadFile:Truncated sample data in %s\n",Path);
+        goto Failure;
+    }
+    for( i = 0; i < NumSamples; i++ ) {
+        if( Heightfield->NumLayersList[i] > HEIGHTFIELD_MAX_LAYERS ) {
+            DPrintf("HeightfieldReadFile:Invalid number of layers for sample %i\n",i);
+            goto Failure;
+        }
+    }
+    fclose(HeightfieldFile);
+    return 1;
+Failure:
+    fclose(HeightfieldFile);
+    return 0;
+}
+
+static int HeightfieldWriteFile(Heightfield_t *Heightfield,const char *Path)
+{
+    FILE *HeightfieldFile;
+    int Magic;
+    int Version;
+    int NumSamples;
+    
+    HeightfieldFile = fopen(Path,"wb");
+    if( !HeightfieldFile ) {
+        DPrintf("HeightfieldWriteFile:Failed to open %s for writing\n",Path);
+        return 0;
+    }
+    Magic = HEIGHTFIELD_FILE_MAGIC;
+    Version = HEIGHTFIELD_FILE_VERSION;
+    NumSamples = Heightfield->NumSamplesX * Heightfield->NumSamplesZ;
+    fwrite(&Magic,sizeof(Magic),1,HeightfieldFile);
+    fwrite(&Version,sizeof(Version),1,HeightfieldFile);
+    fwrite(&Heightfield->Hash,sizeof(Heightfield->Hash),1,HeightfieldFile);
+    fwrite(&Heightfield->Resolution,sizeof(Heightfield->Resolution),1,HeightfieldFile);
+    fwrite(&Heightfield->MinX,sizeof(Heightfield->MinX),1,HeightfieldFile);
+    fwrite(&Heightfield->MinZ,sizeof(Heightfield->MinZ),1,HeightfieldFile);
+    fwrite(&Heightfield->NumSamplesX,sizeof(Heightfield->NumSamplesX),1,HeightfieldFile);
+    fwrite(&Heightfield->NumSamplesZ,sizeof(Heightfield->NumSamplesZ),1,HeightfieldFile);
+    fwrite(&Heightfield->MaxError,sizeof(Heightfield->MaxError),1,HeightfieldFile);
+    fwrite(&Heightfield->AverageError,sizeof(Heightfield->AverageError),1,HeightfieldFile);
+    fwrite(&Heightfield->NumErrorSamples,sizeof(Heightfield->NumErrorSamples),1,HeightfieldFile);
+    fwrite(&Heightfield->NumFallbackSamples,sizeof(Heightfield->NumFallbackSamples),1,HeightfieldFile);
+    fwrite(Heightfield->NumLayersList,sizeof(Byte),NumSamples,HeightfieldFile);
+    fwrite(Heightfield->YList,sizeof(short),NumSamples * HEIGHTFIELD_MAX_LAYERS,HeightfieldFile);
+    fwrite(Heightfield->FaceList,sizeof(unsigned short),NumSamples * HEIGHTFIELD_MAX_LAYERS,HeightfieldFile);
+    fwrite(Heightfield->TSPNumberList,sizeof(short),NumSamples,HeightfieldFile);
+    DPrintf("HeightfieldWriteFile:Wrote %s (%i samples)\n",Path,NumSamples);
+    fclose(HeightfieldFile);
+    return 1;
+}
+
+/*
+ * Loads the heightfield of the level from its sidecar file.
+ * Returns NULL if the file doesn't exist or was baked from different collision data.
+ */
+Heightfield_t *HeightfieldLoad(TSP_t *TSPList,int Resolution)
+{
+    Heightfield_t *Heightfield;
+    char *Path;
+    
+    Heightfield = HeightfieldCreate(TSPList,Resolution);
+    if( !Heightfield ) {
+        return NULL;
+    }
+    Path = HeightfieldGetFilePath(Heightfield->Hash,Resolution);
+    if( !HeightfieldReadFile(Heightfield,Path) ) {
+        HeightfieldFree(Heightfield);
+        Heightfield = NULL;
+    } else {
+        DPrintf("HeightfieldLoad:Loaded %ix%i samples from %s (max error %.2f)\n",Heightfield->NumSamplesX,
+                Heightfield->NumSamplesZ,Path,Heightfield->MaxError);
+    }
+    free(Path);
+    return Heightfield;
+}
+
+/*
+ * Samples the collision data of the level every Resolution units on the XZ plane,using one task
+ * for each tile of HEIGHTFIELD_TILE_SIZE samples,then measures the interpolation error against exact
+ * queries and writes the result to the sidecar file.
+ */
+Heightfield_t *HeightfieldBuild(TSP_t *TSPList,int Resolution)
+{
+    HeightfieldBakeContext_t Context;
+    Heightfield_t *Heightfield;
+    double StartTime;
+    double BakeTime;
+    double ErrorSum;
+    char *Path;
+    int NumTiles;
+    int NumFailed;
+    int i;
+    
+    Heightfield = HeightfieldCreate(TSPList,Resolution);
+    if( !Heightfield ) {
+        return NULL;
+    }
+    memset(&Context,0,sizeof(Context));
+    if( !HeightfieldAllocSamples(Heightfield) ) {
+        goto Failure;
+    }
+    //NOTE(Adriano):Build the grid here since tasks would race to create it.
+    if( !TSPList->CollisionGrid ) {
+        TSPList->CollisionGrid = CollisionCreateGrid(TSPList);
+        if( !TSPList->CollisionGrid ) {
+            goto Failure;
+        }
+    }
+    Context.TSPList = TSPList;
+    Context.Heightfield = Heightfield;
+    Context.NumTilesX = (Heightfield->NumSamplesX + HEIGHTFIELD_TILE_SIZE - 1) / HEIGHTFIELD_TILE_SIZE;
+    Context.NumTilesZ = (Heightfield->NumSamplesZ + HEIGHTFIELD_TILE_SIZE - 1) / HEIGHTFIELD_TILE_SIZE;
+    NumTiles = Context.NumTilesX * Context.NumTilesZ;
+    Context.NumFailedList = calloc(NumTiles,sizeof(int));
+    Context.MaxErrorList = calloc(NumTiles,sizeof(float));
+    Context.ErrorSumList = calloc(NumTiles,sizeof(double));
+    Context.NumErrorSamplesList = calloc(NumTiles,sizeof(int));
+    Context.NumFallbackSamplesList = calloc(NumTiles,sizeof(int));
+    if( !Context.NumFailedList || !Context.MaxErrorList || !Context.ErrorSumList || 
+        !Context.NumErrorSamplesList || !Context.NumFallbackSamplesList ) {
+        DPrintf("HeightfieldBuild:Failed to allocate memory for %i tiles\n",NumTiles);
+        goto Failure;
+    }
+    StartTime = SysPreciseMilliseconds();
+    Context.Pass = HEIGHTFIELD_PASS_BAKE;
+    ThreadPoolParallelFor(NumTiles,HeightfieldProcessTile,&Context);
+    BakeTime = SysPreciseMilliseconds() - StartTime;
+    Context.Pass = HEIGHTFIELD_PASS_MEASURE_ERROR;
+    ThreadPoolParallelFor(NumTiles,HeightfieldProcessTile,&Context);
+    NumFailed = 0;
+    ErrorSum = 0.;
+    for( i = 0; i < NumTiles; i++ ) {
+        NumFailed += Context.NumFailedList[i];
+        ErrorSum += Context.ErrorSumList[i];
+        Heightfield->NumErrorSamples += Context.NumErrorSamplesList[i];
+        Heightfield->NumFallbackSamples += Context.NumFallbackSamplesList[i];
+        Heightfield->MaxError = Context.MaxErrorList[i] > Heightfield->MaxError ? Context.MaxErrorList[i] : Heightfield->MaxError;
+    }
+    if( NumFailed ) {
+        DPrintf("HeightfieldBuild:Failed to process %i tiles\n",NumFailed);
+        goto Failure;
+    }
+    Heightfield->AverageError = Heightfield->NumErrorSamples ? (float) (ErrorSum / Heightfield->NumErrorSamples) : 0.f;
+    DPrintf("HeightfieldBuild:Baked %ix%i samples (resolution %i) in %.2f ms using %i threads\n",Heightfield->NumSamplesX,
+            Heightfield->NumSamplesZ,Resolution,BakeTime,ThreadPoolGetNumThreads());
+    DPrintf("HeightfieldBuild:Error against exact queries:max %.2f average %.2f over %i samples,%i samples need an exact query\n",
+            Heightfield->MaxError,Heightfield->AverageError,Heightfield->NumErrorSamples,Heightfield->NumFallbackSamples);
+    Path = HeightfieldGetFilePath(Heightfield->Hash,Resolution);
+    HeightfieldWriteFile(Heightfield,Path);
+    free(Path);
+    goto Cleanup;
+Failure:
+    HeightfieldFree(Heightfield);
+    Heightfield = NULL;
+Cleanup:
+    if( Context.NumFailedList ) {
+        free(Context.NumFailedList);
+    }
+    if( Context.MaxErrorList ) {
+        free(Context.MaxErrorList);
+    }
+    if( Context.ErrorSumList ) {
+        free(Context.ErrorSumList);
+    }
+    if( Context.NumErrorSamplesList ) {
+        free(Context.NumErrorSamplesList);
+    }
+    if( Context.NumFallbackSamplesList ) {
+        free(Context.NumFallbackSamplesList);
+    }
+    return Heightfield;
+}
+
+/*
+ * Returns the heightfield of the level,loading it from the sidecar file or baking it on the first call.
+ * The result is owned by the head of the TSP list.
+ * A failure is remembered and the following calls return NULL without trying again.
+ */
+Heightfield_t *HeightfieldGet(TSP_t *TSPList,int Resolution)
+{
+    Heightfield_t *Heightfield;
+    
+    if( !TSPList ) {
+        return NULL;
+    }
+    if( TSPList->Heightfield && TSPList->Heightfield->Resolution == Resolution ) {
+        return TSPList->Heightfield;
+    }
+    if( TSPList->HeightfieldFailed ) {
+        return NULL;
+    }
+    Heightfield = HeightfieldLoad(TSPList,Resolution);
+    if( !Heightfield ) {
+        Heightfield = HeightfieldBuild(TSPList,Resolution);
+    }
+    if( !Heightfield ) {
+        DPrintf("HeightfieldGet:No heightfield available for this level\n");
+        TSPList->HeightfieldFailed = true;
+        return NULL;
+    }
+    HeightfieldFree(TSPList->Heightfield);
+    TSPList->Heightfield = Heightfield;
+    return Heightfield;
+}
@@ -0,0 +1,67 @@
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#ifndef __HEIGHTFIELD_H_
+#define __HEIGHTFIELD_H_
+
+#include "../Common/Common.h"
+#include "TSP.h"
+
+#define HEIGHTFIELD_FILE_MAGIC                  0x4648504A //JPHF
+#define HEIGHTFIELD_FILE_VERSION                2
+#define HEIGHTFIELD_DEFAULT_RESOLUTION          64
+#define HEIGHTFIELD_MAX_LAYERS                  4
+#define HEIGHTFIELD_TILE_SIZE                   32
+#define HEIGHTFIELD_NO_FACE                     0xFFFF
+//NOTE(Adriano):Layers this far above the point are still considered to be below it,this allows
+//              to snap to the floor when the point is slightly inside it.
+#define HEIGHTFIELD_LAYER_TOLERANCE             64
+//NOTE(Adriano):Corners whose heights differ more than this are on different surfaces (steps,ledges)
+//              and interpolating them would produce a slope that doesn't exist.
+#define HEIGHTFIELD_MAX_INTERPOLATION_DELTA     64
+
+//NOTE(Adriano):Heights sampled on a regular XZ grid over the collision bounds of a level.
+//              Each sample stores up to HEIGHTFIELD_MAX_LAYERS surfaces (sorted by height) in order to
+//              handle overhangs like bridges and multiple floors.
+//              FaceList indices refer to the collision data of the TSP stored in TSPNumberList,every layer
+//              of a sample belongs to the same TSP.
+typedef struct Heightfield_s {
+    unsigned int    Hash;
+    int             Resolution;
+    int             MinX;
+    int             MinZ;
+    int             NumSamplesX;
+    int             NumSamplesZ;
+    Byte            *NumLayersList;
+    short           *YList;
+    unsigned short  *FaceList;
+    short           *TSPNumberList;
+    float           MaxError;
+    float           AverageError;
+    int             NumErrorSamples;
+    int             NumFallbackSamples;
+} Heightfield_t;
+
+Heightfield_t   *HeightfieldLoad(TSP_t *TSPList,int Resolution);
+Heightfield_t   *HeightfieldBuild(TSP_t *TSPList,int Resolution);
+Heightfield_t   *HeightfieldGet(TSP_t *TSPList,int Resolution);
+int             HeightfieldGetY(Heightfield_t *Heightfield,TSP_t *TSPList,vec3 Point,int *OutY,int *OutFace,int *OutTSPNumber);
+int             HeightfieldGetYList(Heightfield_t *Heightfield,TSP_t *TSPList,vec3 *PointList,int NumPoints,int *OutYList,
+                                    int *OutFaceList,int *OutTSPNumberList);
+void            HeightfieldFree(Heightfield_t *Heightfield);
+#endif//__HEIGHTFIELD_H_
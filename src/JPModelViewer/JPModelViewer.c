@@ -20,6 +20,12 @@
 */ 
 #include "JPModelViewer.h"
 #include "../Common/ShaderManager.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/PNGWriter.h"
+#include "TSP.h"
+#include "PVS.h"
+#include "Heightfield.h"
+#include "QueryServer.h"
 
 void ApplicationCheckEvents(Application_t *Application)
 {
@@ -172,6 +178,7 @@ void ApplicationShutDown(Application_t *Application)
     if( Application->Engine ) {
         EngineShutDown(Application->Engine);
     }
+    ThreadPoolShutdown();
     CommonShutdown();
     free(Application);
 }
@@ -192,6 +199,18 @@ void ApplicationDraw(Application_t *Application)
     GUIDraw(Application);
     glEnable(GL_DEPTH_TEST);
 }
+void ApplicationPickFace(Application_t *Application)
+{
+    PickResult_t Result;
+    int MouseX;
+    int MouseY;
+    
+    if( !EnableFacePicking->IValue || !GUIIsMouseFree() ) {
+        return;
+    }
+    SDL_GetMouseState(&MouseX,&MouseY);
+    RenderObjectManagerPickFace(Application->RenderObjectManager,Application->Camera,MouseX,MouseY,&Result);
+}
 void ApplicationFrame(Application_t *Application)
 {
     if( !Application ) {
@@ -200,8 +219,10 @@ void ApplicationFrame(Application_t *Application)
     }
     EngineBeginFrame(Application->Engine);
     ApplicationCheckEvents(Application);
+    RenderObjectManagerUpdateCamera(Application->RenderObjectManager,Application->Camera,Application->Engine->TimeInfo->Delta);
     CameraBeginFrame(Application->Camera);
     RenderObjectManagerUpdate(Application->RenderObjectManager);
+    ApplicationPickFace(Application);
     ApplicationDraw(Application);
     EngineEndFrame(Application->Engine);
 }
@@ -209,10 +230,43 @@ void RegisterDefaultSettings()
 {
     ConfigRegister("CameraSpeed","30.f",NULL);
     ConfigRegister("CameraMouseSensitivity","1.f",NULL);
+    ConfigRegister("CameraMode","0","0 = Orbit around the view point,1 = Fly through the level,2 = Walk on the level surfaces.\n"
+                                    "Fly and Walk modes collide with the level geometry");
     
     ConfigRegister("EnableWireFrameMode","0","Draw the model surfaces as lines");
     ConfigRegister("EnableAmbientLight","1","When enabled the texture color is interpolated with the surface color to simulate lights on \n"
                                                     "surfaces");
+    ConfigRegister("EnableOcclusionCulling","0","When enabled the largest level surfaces are rendered into a small software depth buffer\n"
+                                                "which is used to skip the parts of the level that are hidden behind them");
+    ConfigRegister("EnablePVS","0","When enabled only the parts of the level that can be seen from the camera position are drawn.\n"
+                                    "Requires the visibility data to be built using the -buildpvs command line option.\n"
+                                    "The visibility is sampled from a few points in each area and can hide parts that are\n"
+                                    "actually visible");
+    ConfigRegister("EnableLevelStreaming","1","When enabled the level geometry is loaded in the background starting from the area\n"
+                                               "around the camera,changes are applied when the next level is loaded");
+    ConfigRegister("LevelStreamingMemoryBudget","256","Maximum amount of level geometry (in MB) kept on the GPU when streaming is enabled,\n"
+                                                      "the farthest areas are released when the limit is reached");
+    ConfigRegister("EnableMeshOptimization","1","When enabled duplicated and degenerate triangles are removed and the static geometry is\n"
+                                                 "reordered to reuse the transformed vertices,changes are applied to the newly loaded geometry");
+    ConfigRegister("EnableLOD","1","When enabled distant level areas and models are drawn using simplified geometry.\n"
+                                    "Requires mesh optimization,the level data is cached and can be built using the -buildlod\n"
+                                    "command line option");
+    ConfigRegister("ExportRegionType","0","Region of the level exported by the Export Region buttons,0 uses a box centered on the\n"
+                                           "camera and 1 uses the camera frustum");
+    ConfigRegister("ExportRegionSize","1024","Half size of the box centered on the camera that is used when exporting a region");
+    ConfigRegister("ExportRegionClipFaces","0","When enabled the faces that cross the border of the exported region are clipped\n"
+                                                "instead of being exported whole");
+    ConfigRegister("EnableFacePicking","0","When enabled the face under the mouse cursor is shown inside a tooltip together with its\n"
+                                            "texture page and CLUT");
+    ConfigRegister("EnableNativeVRAM","0","When enabled textures are stored using the 16-bit PSX VRAM layout and decoded by the shader\n"
+                                           "instead of being expanded when loaded,changes are applied when the next level is loaded");
+    ConfigRegister("EnableTextureAtlas","0","When enabled every texture page is decoded once for each CLUT used by the faces into an RGBA\n"
+                                             "atlas that is read with a single fetch,changes are applied when the next level is loaded");
+    ConfigRegister("VRAMMemoryBudget","128","Maximum amount of texture memory (in MB) used by the loaded packs,the textures of the packs\n"
+                                            "that were not drawn recently are released when the limit is reached and rebuilt when needed");
+    ConfigRegister("EnableContentDeduplication","1","When enabled images and models that are contained inside more than one pack are\n"
+                                                    "stored only once and packs with the same images share their VRAM,changes are applied when\n"
+                                                    "the next level is loaded");
 
 }
 
@@ -235,7 +289,12 @@ Application_t *ApplicationInit(int argc,char **argv)
     CommonInit("JPModelViewer");
     RegisterDefaultSettings();
     ConfigInit();
+    PNGWriterInit();
     
+    if( !ThreadPoolInit(0) ) {
+        printf("ApplicationInit:Failed to initialize the thread pool\n");
+        goto Failure;
+    }
     Application->Engine = EngineInit("JP Model Viewer");
     
     if( !Application->Engine ) {
@@ -275,12 +334,225 @@ Failure:
     return NULL;
 }
 
+/*
+ Offline tool that computes the visibility data for every level contained inside the BSD file.
+ The data is stored inside the user configuration folder and it is picked up automatically the next
+ time the level is loaded.
+ */
+int ApplicationBuildPVS(const char *BSDFile)
+{
+    BSDRenderObject_t *RenderObjectList;
+    BSDRenderObject_t *Iterator;
+    int NumBuilt;
+    
+    CommonInit("JPModelViewer");
+    if( !ThreadPoolInit(0) ) {
+        printf("ApplicationBuildPVS:Failed to initialize the thread pool\n");
+        CommonShutdown();
+        return -1;
+    }
+    NumBuilt = 0;
+    RenderObjectList = BSDLoadAllRenderObjects(BSDFile);
+    for( Iterator = RenderObjectList; Iterator; Iterator = Iterator->Next ) {
+        if( !Iterator->TSP ) {
+            continue;
+        }
+        printf("Building PVS for %s...\n",BSDFile);
+        if( PVSBuild(Iterator->TSP) ) {
+            NumBuilt++;
+        } else {
+            printf("ApplicationBuildPVS:Failed to build or save the visibility data for %s\n",BSDFile);
+        }
+    }
+    if( !NumBuilt ) {
+        printf("ApplicationBuildPVS:No visibility data was built for %s\n",BSDFile);
+    }
+    BSDFreeRenderObjectList(RenderObjectList);
+    ThreadPoolShutdown();
+    CommonShutdown();
+    return NumBuilt != 0 ? 0 : -1;
+}
+
+/*
+ Offline tool that bakes the heightfield of every level contained inside the BSD file.
+ Like the PVS,the data is stored inside the user configuration folder and it is picked up
+ automatically when a heightfield with the same resolution is requested.
+ */
+int ApplicationBuildHeightfield(const char *BSDFile,int Resolution)
+{
+    BSDRenderObject_t *RenderObjectList;
+    BSDRenderObject_t *Iterator;
+    Heightfield_t *Heightfield;
+    int NumBuilt;
+    
+    CommonInit("JPModelViewer");
+    if( !ThreadPoolInit(0) ) {
+        printf("ApplicationBuildHeightfield:Failed to initialize the thread pool\n");
+        CommonShutdown();
+        return -1;
+    }
+    NumBuilt = 0;
+    RenderObjectList = BSDLoadAllRenderObjects(BSDFile);
+    for( Iterator = RenderObjectList; Iterator; Iterator = Iterator->Next ) {
+        if( !Iterator->TSP ) {
+            continue;
+        }
+        printf("Building heightfield for %s...\n",BSDFile);
+        Heightfield = HeightfieldBuild(Iterator->TSP,Resolution);
+        if( Heightfield ) {
+            printf("Max error %.2f average %.2f,%i samples need an exact query\n",Heightfield->MaxError,
+                   Heightfield->AverageError,Heightfield->NumFallbackSamples);
+            HeightfieldFree(Heightfield);
+            NumBuilt++;
+        }
+    }
+    if( !NumBuilt ) {
+        printf("ApplicationBuildHeightfield:No heightfield was built for %s\n",BSDFile);
+    }
+    BSDFreeRenderObjectList(RenderObjectList);
+    ThreadPoolShutdown();
+    CommonShutdown();
+    return NumBuilt != 0 ? 0 : -1;
+}
+
+/*
+ Offline tool that simplifies the geometry of every level contained inside the BSD file.
+ The detail levels are stored inside the user configuration folder and they are used instead of
+ being built when the level is loaded.
+ */
+int ApplicationBuildLOD(const char *BSDFile)
+{
+    BSDRenderObject_t *RenderObjectList;
+    BSDRenderObject_t *Iterator;
+    const LODStats_t *LODStats;
+    int NumBuilt;
+    
+    CommonInit("JPModelViewer");
+    if( !ThreadPoolInit(0) ) {
+        printf("ApplicationBuildLOD:Failed to initialize the thread pool\n");
+        CommonShutdown();
+        return -1;
+    }
+    NumBuilt = 0;
+    RenderObjectList = BSDLoadAllRenderObjects(BSDFile);
+    for( Iterator = RenderObjectList; Iterator; Iterator = Iterator->Next ) {
+        if( !Iterator->TSP ) {
+            continue;
+        }
+        printf("Building LOD for %s...\n",BSDFile);
+        if( TSPBuildLOD(Iterator->TSP) ) {
+            NumBuilt++;
+        }
+    }
+    if( !NumBuilt ) {
+        printf("ApplicationBuildLOD:No detail level was built for %s\n",BSDFile);
+    } else {
+        LODStats = LODGetStats();
+        printf("%i meshes,triangles %i/%i/%i,%.3f ms\n",LODStats->NumMeshes,LODStats->NumTriangles[0],
+               LODStats->NumTriangles[1],LODStats->NumTriangles[2],LODStats->BuildTime);
+    }
+    BSDFreeRenderObjectList(RenderObjectList);
+    ThreadPoolShutdown();
+    CommonShutdown();
+    return NumBuilt != 0 ? 0 : -1;
+}
+
+/*
+ Offline tool that loads the first level contained inside the BSD file and answers the queries
+ sent to the given unix socket until it is interrupted.
+ */
+int ApplicationRunQueryServer(const char *BSDFile,const char *SocketPath)
+{
+    BSDRenderObject_t *RenderObjectList;
+    BSDRenderObject_t *Iterator;
+    int Result;
+    
+    CommonInit("JPModelViewer");
+    if( !ThreadPoolInit(0) ) {
+        printf("ApplicationRunQueryServer:Failed to initialize the thread pool\n");
+        CommonShutdown();
+        return -1;
+    }
+    Result = 0;
+    RenderObjectList = BSDLoadAllRenderObjects(BSDFile);
+    for( Iterator = RenderObjectList; Iterator; Iterator = Iterator->Next ) {
+        if( Iterator->TSP ) {
+            Result = QueryServerRun(Iterator,SocketPath);
+            break;
+        }
+    }
+    if( !Iterator ) {
+        printf("ApplicationRunQueryServer:No level found inside %s\n",BSDFile);
+    }
+    BSDFreeRenderObjectList(RenderObjectList);
+    ThreadPoolShutdown();
+    CommonShutdown();
+    return Result ? 0 : -1;
+}
+
+/*
+ Offline tool that checks the image conversion kernels against the reference code using every image
+ contained inside the TAF file and prints their throughput.
+ */
+int ApplicationRunTIMBenchmark(const char *TAFFile)
+{
+    int Result;
+    
+    CommonInit("JPModelViewer");
+    Result = TIMRunConversionBenchmark(TAFFile);
+    CommonShutdown();
+    return Result ? 0 : -1;
+}
+
+/*
+ Offline tool that checks that the PNG writer produces images that libpng can decode back to the same pixels using
+ every image contained inside the TAF file and prints the throughput of each compression mode.
+ */
+int ApplicationRunPNGBenchmark(const char *TAFFile)
+{
+    int Result;
+    
+    CommonInit("JPModelViewer");
+    if( !ThreadPoolInit(0) ) {
+        printf("ApplicationRunPNGBenchmark:Failed to initialize the thread pool\n");
+        CommonShutdown();
+        return -1;
+    }
+    Result = PNGWriterRunBenchmark(TAFFile);
+    ThreadPoolShutdown();
+    CommonShutdown();
+    return Result ? 0 : -1;
+}
+
 int main(int argc,char **argv)
 {
     Application_t *Application;
     
     srand(time(NULL));
     
+    if( argc > 2 && !strcmp(argv[1],"-buildpvs") ) {
+        return ApplicationBuildPVS(argv[2]);
+    }
+    if( argc > 2 && !strcmp(argv[1],"-buildheightfield") ) {
+        return ApplicationBuildHeightfield(argv[2],argc > 3 ? StringToInt(argv[3]) : HEIGHTFIELD_DEFAULT_RESOLUTION);
+    }
+    if( argc > 2 && !strcmp(argv[1],"-buildlod") ) {
+        return ApplicationBuildLOD(argv[2]);
+    }
+    if( argc > 3 && !strcmp(argv[1],"-queryserver") ) {
+        return ApplicationRunQueryServer(argv[2],argv[3]);
+    }
+    if( argc > 2 && !strcmp(argv[1],"-querybench") ) {
+        return QueryServerBenchmark(argv[2],argc > 3 ? StringToInt(argv[3]) : QUERY_BENCHMARK_DEFAULT_QUERIES,
+                                    argc > 4 ? StringToInt(argv[4]) : QUERY_BENCHMARK_DEFAULT_BATCH_SIZE,
+                                    argc > 5 ? StringToInt(argv[5]) : QUERY_BENCHMARK_DEFAULT_DEPTH) ? 0 : -1;
+    }
+    if( argc > 2 && !strcmp(argv[1],"-timbench") ) {
+        return ApplicationRunTIMBenchmark(argv[2]);
+    }
+    if( argc > 2 && !strcmp(argv[1],"-pngbench") ) {
+        return ApplicationRunPNGBenchmark(argv[2]);
+    }
     Application = ApplicationInit(argc,argv);
     
     if( !Application ) {
@@ -0,0 +1,1011 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#include "LOD.h"
+
+Config_t *EnableLOD;
+
+static LODStats_t LODStats;
+//NOTE(Adriano):Leaves are built by the streaming loader threads while models are built on the main one.
+static SDL_SpinLock LODLock;
+
+//NOTE(Adriano):Target size and maximum error (as a fraction of the mesh size) of each level.
+static const float LODTargetRatio[LOD_MAX_LEVELS] = { 1.f, 0.5f, 0.25f };
+static const float LODMaxErrorRatio[LOD_MAX_LEVELS] = { 0.f, 0.01f, 0.03f };
+//NOTE(Adriano):Projected size (as a fraction of the screen height) below which each level is used.
+static const float LODScreenSize[LOD_MAX_LEVELS] = { 0.f, 0.4f, 0.15f };
+
+static void LODQuadricFromPlane(LODQuadric_t *Quadric,double A,double B,double C,double D)
+{
+    Quadric->Data[0] = A * A;
+    Quadric->Data[1] = A * B;
+    Quadric->Data[2] = A * C;
+    Quadric->Data[3] = A * D;
+    Quadric->Data[4] = B * B;
+    Quadric->Data[5] = B * C;
+    Quadric->Data[6] = B * D;
+    Quadric->Data[7] = C * C;
+    Quadric->Data[8] = C * D;
+    Quadric->Data[9] = D * D;
+}
+
+static void LODQuadricAdd(LODQuadric_t *Quadric,const LODQuadric_t *Other)
+{
+    int i;
+    
+    for( i = 0; i < 10; i++ ) {
+        Quadric->Data[i] += Other->Data[i];
+    }
+}
+
+static double LODQuadricError(const LODQuadric_t *Quadric,const int *Position)
+{
+    const double *Q;
+    double X;
+    double Y;
+    double Z;
+    
+    Q = Quadric->Data;
+    X = Position[0];
+    Y = Position[1];
+    Z = Position[2];
+    return Q[0] * X * X + 2. * Q[1] * X * Y + 2. * Q[2] * X * Z + 2. * Q[3] * X +
+           Q[4] * Y * Y + 2. * Q[5] * Y * Z + 2. * Q[6] * Y +
+           Q[7] * Z * Z + 2. * Q[8] * Z + Q[9];
+}
+
+static void LODGetNormal(const int *P0,const int *P1,const int *P2,long long *Normal)
+{
+    long long Edge0[3];
+    long long Edge1[3];
+    int i;
+    
+    for( i = 0; i < 3; i++ ) {
+        Edge0[i] = (long long) P1[i] - P0[i];
+        Edge1[i] = (long long) P2[i] - P0[i];
+    }
+    Normal[0] = Edge0[1] * Edge1[2] - Edge0[2] * Edge1[1];
+    Normal[1] = Edge0[2] * Edge1[0] - Edge0[0] * Edge1[2];
+    Normal[2] = Edge0[0] * Edge1[1] - Edge0[1] * Edge1[0];
+}
+
+static int LODCompareEdge(const void *a,const void *b)
+{
+    unsigned long long EdgeA;
+    unsigned long long EdgeB;
+    
+    EdgeA = *(const unsigned long long *) a;
+    EdgeB = *(const unsigned long long *) b;
+    if( EdgeA != EdgeB ) {
+        return EdgeA < EdgeB ? -1 : 1;
+    }
+    return 0;
+}
+
+static int LODCompareCollapse(const void *a,const void *b)
+{
+    const LODCollapse_t *CollapseA;
+    const LODCollapse_t *CollapseB;
+    
+    CollapseA = (const LODCollapse_t *) a;
+    CollapseB = (const LODCollapse_t *) b;
+    if( CollapseA->Cost != CollapseB->Cost ) {
+        return CollapseA->Cost < CollapseB->Cost ? -1 : 1;
+    }
+    if( CollapseA->From != CollapseB->From ) {
+        return CollapseA->From - CollapseB->From;
+    }
+    return CollapseA->To - CollapseB->To;
+}
+
+/*
+ * Two vertices can be merged only if they belong to the same texture page and CLUT and
+ * their colors are close enough,texture coordinates are free to change.
+ */
+static bool LODCanMergeVertices(const int *VertexData,const LODVertexFormat_t *Format,int NumInts,int From,int To)
+{
+    const int *VertexA;
+    const int *VertexB;
+    int i;
+    
+    VertexA = &VertexData[From * NumInts];
+    VertexB = &VertexData[To * NumInts];
+    for( i = 3; i < NumInts; i++ ) {
+        if( i >= Format->UVOffset && i < Format->UVOffset + 2 ) {
+            continue;
+        }
+        if( i >= Format->ColorOffset && i < Format->ColorOffset + 3 ) {
+            if( abs(VertexA[i] - VertexB[i]) > LOD_MAX_COLOR_DIFFERENCE ) {
+                return false;
+            }
+            continue;
+        }
+        if( VertexA[i] != VertexB[i] ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Quadric error simplification based on half-edge collapses:a vertex is moved onto one of its neighbours
+ * so no new vertex is created and all the levels can share the same vertex buffer.
+ * Only vertices with a single attribute set that are not on the mesh border can be moved,this keeps
+ * the UV seams,the texture page and CLUT boundaries and the leaf borders in place.
+ * Returns the number of indices written into OutIndexList (which must hold NumIndices elements) or 0 on failure.
+ */
+static int LODSimplify(const int *VertexData,int NumVertices,const LODVertexFormat_t *Format,const unsigned int *IndexList,
+                       int NumIndices,int TargetIndices,double MaxError,unsigned int *OutIndexList)
+{
+    LODQuadric_t *QuadricList;
+    LODQuadric_t Quadric;
+    LODCollapse_t *CollapseList;
+    unsigned long long *EdgeList;
+    unsigned int *Triangle;
+    int *PositionList;
+    int *PositionVertexList;
+    int *RecordCount;
+    int *HashTable;
+    int *TriangleStart;
+    int *TriangleFill;
+    int *TriangleAdjacency;
+    int *Stamp;
+    int *SharedStamp;
+    Byte *Locked;
+    Byte *Touched;
+    Byte *Alive;
+    const int *Position;
+    const int *Corner[3];
+    long long OldNormal[3];
+    long long NewNormal[3];
+    double Normal[3];
+    double Edge0[3];
+    double Edge1[3];
+    double Length;
+    double Dot;
+    double Cost;
+    int NumInts;
+    int NumTriangles;
+    int NumPositions;
+    int NumAlive;
+    int NumCollapses;
+    int NumApplied;
+    int NumShared;
+    int NumCommon;
+    int StampValue;
+    int TableSize;
+    int Slot;
+    int Pass;
+    int From;
+    int To;
+    int PositionA;
+    int PositionB;
+    int FromCorner;
+    int ToCorner;
+    int Result;
+    bool Valid;
+    int c;
+    int i;
+    int j;
+    int k;
+    int t;
+    
+    NumInts = Format->Stride / sizeof(int);
+    NumTriangles = NumIndices / 3;
+    Result = 0;
+    QuadricList = NULL;
+    CollapseList = NULL;
+    EdgeList = NULL;
+    PositionList = NULL;
+    PositionVertexList = NULL;
+    RecordCount = NULL;
+    TriangleStart = NULL;
+    TriangleFill = NULL;
+    TriangleAdjacency = NULL;
+    Stamp = NULL;
+    SharedStamp = NULL;
+    Locked = NULL;
+    Touched = NULL;
+    Alive = NULL;
+    
+    TableSize = 1;
+    while( TableSize < NumVertices * 2 ) {
+        TableSize <<= 1;
+    }
+    HashTable = malloc(TableSize * sizeof(int));
+    PositionList = malloc(NumVertices * sizeof(int));
+    PositionVertexList = malloc(NumVertices * sizeof(int));
+    RecordCount = calloc(NumVertices,sizeof(int));
+    if( !HashTable || !PositionList || !PositionVertexList || !RecordCount ) {
+        DPrintf("LODSimplify:Failed to allocate memory for %i vertices\n",NumVertices);
+        goto Failure;
+    }
+    //NOTE(Adriano):Vertices that share the same position but not the same attributes lie on a seam.
+    memset(HashTable,0xFF,TableSize * sizeof(int));
+    NumPositions = 0;
+    for( i = 0; i < NumVertices; i++ ) {
+        Position = &VertexData[i * NumInts];
+        Slot = HashFNV1a(HASH_FNV1A_INITIAL_VALUE,Position,3 * sizeof(int)) & (TableSize - 1);
+        while( HashTable[Slot] != -1 && memcmp(&VertexData[PositionVertexList[HashTable[Slot]] * NumInts],Position,3 * sizeof(int)) ) {
+            Slot = (Slot + 1) & (TableSize - 1);
+        }
+        if( HashTable[Slot] == -1 ) {
+            HashTable[Slot] = NumPositions;
+            PositionVertexList[NumPositions++] = i;
+        }
+        PositionList[i] = HashTable[Slot];
+        RecordCount[PositionList[i]]++;
+    }
+    QuadricList = calloc(NumPositions,sizeof(LODQuadric_t));
+    Locked = malloc(NumPositions);
+    Touched = malloc(NumPositions);
+    Stamp = calloc(NumPositions,sizeof(int));
+    SharedStamp = calloc(NumPositions,sizeof(int));
+    TriangleStart = malloc((NumPositions + 1) * sizeof(int));
+    TriangleFill = malloc(NumPositions * sizeof(int));
+    TriangleAdjacency = malloc(NumIndices * sizeof(int));
+    EdgeList = malloc(NumIndices * sizeof(unsigned long long));
+    CollapseList = malloc(NumIndices * 2 * sizeof(LODCollapse_t));
+    Alive = malloc(NumTriangles);
+    if( !QuadricList || !Locked || !Touched || !Stamp || !SharedStamp || !TriangleStart || !TriangleFill || !TriangleAdjacency ||
+        !EdgeList || !CollapseList || !Alive ) {
+        DPrintf("LODSimplify:Failed to allocate memory for %i triangles\n",NumTriangles);
+        goto Failure;
+    }
+    for( i = 0; i < NumPositions; i++ ) {
+        Locked[i] = RecordCount[i] > 1;
+    }
+    //NOTE(Adriano):Edges that are not shared by exactly two triangles are on the border of the mesh.
+    for( i = 0; i < NumTriangles; i++ ) {
+        for( k = 0; k < 3; k++ ) {
+            PositionA = PositionList[IndexList[i * 3 + k]];
+            PositionB = PositionList[IndexList[i * 3 + (k + 1) % 3]];
+            if( PositionA > PositionB ) {
+                Slot = PositionA;
+                PositionA = PositionB;
+                PositionB = Slot;
+            }
+            EdgeList[i * 3 + k] = ((unsigned long long) PositionA << 32) | (unsigned int) PositionB;
+        }
+    }
+    qsort(EdgeList,NumIndices,sizeof(unsigned long long),LODCompareEdge);
+    for( i = 0; i < NumIndices; i = j ) {
+        for( j = i + 1; j < NumIndices && EdgeList[j] == EdgeList[i]; j++ );
+        if( j - i != 2 ) {
+            Locked[EdgeList[i] >> 32] = 1;
+            Locked[EdgeList[i] & 0xFFFFFFFF] = 1;
+        }
+    }
+    for( i = 0; i < NumTriangles; i++ ) {
+        for( k = 0; k < 3; k++ ) {
+            Corner[k] = &VertexData[IndexList[i * 3 + k] * NumInts];
+        }
+        for( k = 0; k < 3; k++ ) {
+            Edge0[k] = (double) Corner[1][k] - Corner[0][k];
+            Edge1[k] = (double) Corner[2][k] - Corner[0][k];
+        }
+        Normal[0] = Edge0[1] * Edge1[2] - Edge0[2] * Edge1[1];
+        Normal[1] = Edge0[2] * Edge1[0] - Edge0[0] * Edge1[2];
+        Normal[2] = Edge0[0] * Edge1[1] - Edge0[1] * Edge1[0];
+        Length = sqrt(Normal[0] * Normal[0] + Normal[1] * Normal[1] + Normal[2] * Normal[2]);
+        if( Length == 0. ) {
+            continue;
+        }
+        for( k = 0; k < 3; k++ ) {
+            Normal[k] /= Length;
+        }
+        LODQuadricFromPlane(&Quadric,Normal[0],Normal[1],Normal[2],
+                            -(Normal[0] * Corner[0][0] + Normal[1] * Corner[0][1] + Normal[2] * Corner[0][2]));
+        for( k = 0; k < 3; k++ ) {
+            LODQuadricAdd(&QuadricList[PositionList[IndexList[i * 3 + k]]],&Quadric);
+        }
+    }
+    
+    memcpy(OutIndexList,IndexList,NumIndices * sizeof(unsigned int));
+    memset(Alive,1,NumTriangles);
+    NumAlive = NumTriangles;
+    StampValue = 0;
+    for( Pass = 0; Pass < LOD_MAX_PASSES && NumAlive * 3 > TargetIndices; Pass++ ) {
+        //NOTE(Adriano):Position to triangle adjacency of the remaining triangles.
+        memset(TriangleStart,0,(NumPositions + 1) * sizeof(int));
+        for( i = 0; i < NumTriangles; i++ ) {
+            if( !Alive[i] ) {
+                continue;
+            }
+            for( k = 0; k < 3; k++ ) {
+                TriangleStart[PositionList[OutIndexList[i * 3 + k]] + 1]++;
+            }
+        }
+        for( i = 0; i < NumPositions; i++ ) {
+            TriangleStart[i + 1] += TriangleStart[i];
+            TriangleFill[i] = TriangleStart[i];
+        }
+        for( i = 0; i < NumTriangles; i++ ) {
+            if( !Alive[i] ) {
+                continue;
+            }
+            for( k = 0; k < 3; k++ ) {
+                TriangleAdjacency[TriangleFill[PositionList[OutIndexList[i * 3 + k]]]++] = i;
+            }
+        }
+        NumCollapses = 0;
+        for( i = 0; i < NumTriangles; i++ ) {
+            if( !Alive[i] ) {
+                continue;
+            }
+            for( k = 0; k < 6; k++ ) {
+                From = OutIndexList[i * 3 + k % 3];
+                To = OutIndexList[i * 3 + (k % 3 + (k < 3 ? 1 : 2)) % 3];
+                if( Locked[PositionList[From]] || !LODCanMergeVertices(VertexData,Format,NumInts,From,To) ) {
+                    continue;
+                }
+                Cost = LODQuadricError(&QuadricList[PositionList[From]],&VertexData[To * NumInts]);
+                if( Cost > MaxError ) {
+                    continue;
+                }
+                CollapseList[NumCollapses].Cost = Cost;
+                CollapseList[NumCollapses].From = From;
+                CollapseList[NumCollapses].To = To;
+                NumCollapses++;
+            }
+        }
+        if( !NumCollapses ) {
+            break;
+        }
+        qsort(CollapseList,NumCollapses,sizeof(LODCollapse_t),LODCompareCollapse);
+        memset(Touched,0,NumPositions);
+        NumApplied = 0;
+        for( c = 0; c < NumCollapses && NumAlive * 3 > TargetIndices; c++ ) {
+            From = CollapseList[c].From;
+            To = CollapseList[c].To;
+            PositionA = PositionList[From];
+            PositionB = PositionList[To];
+            if( Touched[PositionA] || Touched[PositionB] ) {
+                continue;
+            }
+            Valid = true;
+            NumShared = 0;
+            StampValue++;
+            for( j = TriangleStart[PositionA]; j < TriangleStart[PositionA + 1] && Valid; j++ ) {
+                t = TriangleAdjacency[j];
+                Triangle = &OutIndexList[t * 3];
+                FromCorner = -1;
+                ToCorner = -1;
+                for( k = 0; k < 3; k++ ) {
+                    if( PositionList[Triangle[k]] == PositionA ) {
+                        FromCorner = k;
+                    } else if( PositionList[Triangle[k]] == PositionB ) {
+                        ToCorner = k;
+                    } else {
+                        Stamp[PositionList[Triangle[k]]] = StampValue;
+                    }
+                }
+                if( ToCorner != -1 ) {
+                    //NOTE(Adriano):The collapsed edge must use the same attributes on both of its triangles.
+                    Valid = Triangle[ToCorner] == (unsigned int) To;
+                    NumShared++;
+                    continue;
+                }
+                for( k = 0; k < 3; k++ ) {
+                    Corner[k] = &VertexData[Triangle[k] * NumInts];
+                }
+                LODGetNormal(Corner[0],Corner[1],Corner[2],OldNormal);
+                Corner[FromCorner] = &VertexData[To * NumInts];
+                LODGetNormal(Corner[0],Corner[1],Corner[2],NewNormal);
+                //NOTE(Adriano):Reject the collapse if a triangle would become degenerate or rotate too much,small rotations
+                //              can add up over multiple collapses and fold the surface.
+                Dot = (double) OldNormal[0] * NewNormal[0] + (double) OldNormal[1] * NewNormal[1] + (double) OldNormal[2] * NewNormal[2];
+                Length = sqrt((double) OldNormal[0] * OldNormal[0] + (double) OldNormal[1] * OldNormal[1] + (double) OldNormal[2] * OldNormal[2]) *
+                         sqrt((double) NewNormal[0] * NewNormal[0] + (double) NewNormal[1] * NewNormal[1] + (double) NewNormal[2] * NewNormal[2]);
+                if( Length == 0. || Dot < LOD_MIN_NORMAL_COSINE * Length ) {
+                    Valid = false;
+                }
+            }
+            if( !Valid || !NumShared ) {
+                continue;
+            }
+            //NOTE(Adriano):The two vertices must not share any neighbour other than the ones across the collapsed edge,
+            //              otherwise the mesh would fold onto itself.
+            NumCommon = 0;
+            for( j = TriangleStart[PositionB]; j < TriangleStart[PositionB + 1]; j++ ) {
+                Triangle = &OutIndexList[TriangleAdjacency[j] * 3];
+                for( k = 0; k < 3; k++ ) {
+                    Slot = PositionList[Triangle[k]];
+                    if( Slot == PositionA || Slot == PositionB || Stamp[Slot] != StampValue || SharedStamp[Slot] == StampValue ) {
+                        continue;
+                    }
+                    SharedStamp[Slot] = StampValue;
+                    NumCommon++;
+                }
+            }
+            if( NumCommon != NumShared ) {
+                continue;
+            }
+            for( j = TriangleStart[PositionA]; j < TriangleStart[PositionA + 1]; j++ ) {
+                t = TriangleAdjacency[j];
+                Triangle = &OutIndexList[t * 3];
+                for( k = 0; k < 3; k++ ) {
+                    Touched[PositionList[Triangle[k]]] = 1;
+                }
+                if( PositionList[Triangle[0]] == PositionB || PositionList[Triangle[1]] == PositionB ||
+                    PositionList[Triangle[2]] == PositionB ) {
+                    Alive[t] = 0;
+                    NumAlive--;
+                    continue;
+                }
+                for( k = 0; k < 3; k++ ) {
+                    if( PositionList[Triangle[k]] == PositionA ) {
+                        Triangle[k] = To;
+                    }
+                }
+            }
+            LODQuadricAdd(&QuadricList[PositionB],&QuadricList[PositionA]);
+            NumApplied++;
+        }
+        if( !NumApplied ) {
+            break;
+        }
+    }
+    for( i = 0, Result = 0; i < NumTriangles; i++ ) {
+        if( !Alive[i] ) {
+            continue;
+        }
+        OutIndexList[Result++] = OutIndexList[i * 3 + 0];
+        OutIndexList[Result++] = OutIndexList[i * 3 + 1];
+        OutIndexList[Result++] = OutIndexList[i * 3 + 2];
+    }
+Failure:
+    free(HashTable);
+    free(PositionList);
+    free(PositionVertexList);
+    free(RecordCount);
+    free(QuadricList);
+    free(Locked);
+    free(Touched);
+    free(Stamp);
+    free(SharedStamp);
+    free(TriangleStart);
+    free(TriangleFill);
+    free(TriangleAdjacency);
+    free(EdgeList);
+    free(CollapseList);
+    free(Alive);
+    return Result;
+}
+
+static void LODComputeBounds(const int *VertexData,int NumVertices,const LODVertexFormat_t *Format,LODMesh_t *LOD)
+{
+    const int *Position;
+    vec3 Min;
+    vec3 Max;
+    vec3 Delta;
+    float Distance;
+    int NumInts;
+    int i;
+    int j;
+    
+    NumInts = Format->Stride / sizeof(int);
+    for( j = 0; j < 3; j++ ) {
+        Min[j] = VertexData[j];
+        Max[j] = VertexData[j];
+    }
+    for( i = 1; i < NumVertices; i++ ) {
+        Position = &VertexData[i * NumInts];
+        for( j = 0; j < 3; j++ ) {
+            Min[j] = Position[j] < Min[j] ? Position[j] : Min[j];
+            Max[j] = Position[j] > Max[j] ? Position[j] : Max[j];
+        }
+    }
+    for( j = 0; j < 3; j++ ) {
+        LOD->Center[j] = (Min[j] + Max[j]) * 0.5f;
+    }
+    LOD->Radius = 0.f;
+    for( i = 0; i < NumVertices; i++ ) {
+        Position = &VertexData[i * NumInts];
+        for( j = 0; j < 3; j++ ) {
+            Delta[j] = Position[j] - LOD->Center[j];
+        }
+        Distance = glm_vec3_norm(Delta);
+        if( Distance > LOD->Radius ) {
+            LOD->Radius = Distance;
+        }
+    }
+}
+
+static LODCacheEntry_t *LODCacheFind(LODCache_t *Cache,unsigned int MeshHash)
+{
+    int i;
+    
+    if( !Cache ) {
+        return NULL;
+    }
+    for( i = 0; i < Cache->NumEntries; i++ ) {
+        if( Cache->EntryList[i].MeshHash == MeshHash ) {
+            return &Cache->EntryList[i];
+        }
+    }
+    return NULL;
+}
+
+static int LODCacheGetNumIndices(const LODCacheEntry_t *Entry)
+{
+    int NumIndices;
+    int i;
+    
+    NumIndices = 0;
+    for( i = 1; i < Entry->NumLevels; i++ ) {
+        NumIndices += Entry->IndexCount[i];
+    }
+    return NumIndices;
+}
+
+/*
+ * Entries are only identified by the hash of their mesh,a collision or a stale file must not feed
+ * indices that are out of range to the GPU.
+ */
+static bool LODCacheIsEntryValid(const LODCacheEntry_t *Entry,int NumIndices,int NumVertices)
+{
+    int NumLevelIndices;
+    int Level;
+    int i;
+    
+    if( Entry->NumLevels < 1 || Entry->NumLevels > LOD_MAX_LEVELS || Entry->IndexCount[0] != NumIndices ) {
+        return false;
+    }
+    for( Level = 1; Level < Entry->NumLevels; Level++ ) {
+        if( Entry->IndexCount[Level] <= 0 || Entry->IndexCount[Level] > Entry->IndexCount[Level - 1] ) {
+            return false;
+        }
+    }
+    NumLevelIndices = LODCacheGetNumIndices(Entry);
+    if( NumLevelIndices && !Entry->IndexList ) {
+        return false;
+    }
+    for( i = 0; i < NumLevelIndices; i++ ) {
+        if( Entry->IndexList[i] >= (unsigned int) NumVertices ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void LODCacheRemoveEntry(LODCache_t *Cache,LODCacheEntry_t *Entry)
+{
+    if( Entry->IndexList ) {
+        free(Entry->IndexList);
+    }
+    *Entry = Cache->EntryList[--Cache->NumEntries];
+    Cache->Dirty = true;
+}
+
+static LODCacheEntry_t *LODCacheAddEntry(LODCache_t *Cache)
+{
+    LODCacheEntry_t *Temp;
+    
+    if( Cache->NumEntries == Cache->MaxEntries ) {
+        Cache->MaxEntries = Cache->MaxEntries ? Cache->MaxEntries * 2 : 64;
+        Temp = realloc(Cache->EntryList,Cache->MaxEntries * sizeof(LODCacheEntry_t));
+        if( !Temp ) {
+            DPrintf("LODCacheAddEntry:Failed to grow the entry list\n");
+            return NULL;
+        }
+        Cache->EntryList = Temp;
+    }
+    memset(&Cache->EntryList[Cache->NumEntries],0,sizeof(LODCacheEntry_t));
+    return &Cache->EntryList[Cache->NumEntries++];
+}
+
+static void LODCacheStore(LODCache_t *Cache,unsigned int MeshHash,const LODMesh_t *LOD,const unsigned int *IndexList)
+{
+    LODCacheEntry_t *Entry;
+    int NumIndices;
+    
+    if( !Cache ) {
+        return;
+    }
+    Entry = LODCacheAddEntry(Cache);
+    if( !Entry ) {
+        return;
+    }
+    Entry->MeshHash = MeshHash;
+    Entry->NumLevels = LOD->NumLevels;
+    memcpy(Entry->IndexCount,LOD->IndexCount,sizeof(Entry->IndexCount));
+    NumIndices = LODCacheGetNumIndices(Entry);
+    if( NumIndices ) {
+        Entry->IndexList = malloc(NumIndices * sizeof(unsigned int));
+        if( !Entry->IndexList ) {
+            DPrintf("LODCacheStore:Failed to allocate memory for %i indices\n",NumIndices);
+            Cache->NumEntries--;
+            return;
+        }
+        memcpy(Entry->IndexList,IndexList,NumIndices * sizeof(unsigned int));
+    }
+    Cache->Dirty = true;
+}
+
+/*
+ * Builds the detail levels of an indexed mesh,or takes them from the cache if the same mesh was already processed.
+ * The indices of the new levels are appended to IndexList (which is reallocated) and LOD stores where each level starts.
+ * Meshes that are too small or cannot be simplified end up with a single level.
+ * Can be called from any thread.
+ */
+int LODBuildMesh(LODCache_t *Cache,const int *VertexData,int NumVertices,const LODVertexFormat_t *Format,
+                 unsigned int **IndexList,int *NumIndices,LODMesh_t *LOD)
+{
+    LODCacheEntry_t *Entry;
+    unsigned int *LevelIndexList;
+    unsigned int *Temp;
+    const unsigned int *SourceIndexList;
+    unsigned int MeshHash;
+    double StartTime;
+    double MaxError;
+    int SourceCount;
+    int TargetCount;
+    int NumLevelIndices;
+    int Count;
+    int Level;
+    
+    if( !VertexData || !Format || !IndexList || !*IndexList || !NumIndices || !LOD || NumVertices <= 0 ) {
+        DPrintf("LODBuildMesh:Invalid data\n");
+        return 0;
+    }
+    memset(LOD,0,sizeof(LODMesh_t));
+    LODComputeBounds(VertexData,NumVertices,Format,LOD);
+    LOD->NumLevels = 1;
+    LOD->IndexCount[0] = *NumIndices;
+    if( *NumIndices / 3 < LOD_MIN_TRIANGLES ) {
+        return 1;
+    }
+    StartTime = SysPreciseMilliseconds();
+    MeshHash = HashFNV1a(HASH_FNV1A_INITIAL_VALUE,VertexData,NumVertices * Format->Stride);
+    MeshHash = HashFNV1a(MeshHash,*IndexList,*NumIndices * sizeof(unsigned int));
+    LevelIndexList = NULL;
+    SDL_AtomicLock(&LODLock);
+    Entry = LODCacheFind(Cache,MeshHash);
+    if( Entry && !LODCacheIsEntryValid(Entry,*NumIndices,NumVertices) ) {
+        DPrintf("LODBuildMesh:Discarding invalid cache entry for mesh %u\n",MeshHash);
+        LODCacheRemoveEntry(Cache,Entry);
+        Entry = NULL;
+    }
+    if( Entry ) {
+        LOD->NumLevels = Entry->NumLevels;
+        memcpy(LOD->IndexCount,Entry->IndexCount,sizeof(LOD->IndexCount));
+        NumLevelIndices = LODCacheGetNumIndices(Entry);
+        if( NumLevelIndices ) {
+            LevelIndexList = malloc(NumLevelIndices * sizeof(unsigned int));
+            if( LevelIndexList ) {
+                memcpy(LevelIndexList,Entry->IndexList,NumLevelIndices * sizeof(unsigned int));
+            } else {
+                LOD->NumLevels = 1;
+            }
+        }
+        LODStats.NumCacheHits++;
+    }
+    SDL_AtomicUnlock(&LODLock);
+    if( !Entry ) {
+        LevelIndexList = malloc(*NumIndices * (LOD_MAX_LEVELS - 1) * sizeof(unsigned int));
+        if( !LevelIndexList ) {
+            DPrintf("LODBuildMesh:Failed to allocate memory for %i indices\n",*NumIndices);
+            return 0;
+        }
+        SourceIndexList = *IndexList;
+        SourceCount = *NumIndices;
+        NumLevelIndices = 0;
+        for( Level = 1; Level < LOD_MAX_LEVELS; Level++ ) {
+            TargetCount = (int) (*NumIndices / 3 * LODTargetRatio[Level]) * 3;
+            MaxError = LODMaxErrorRatio[Level] * 2.f * LOD->Radius;
+            MaxError *= MaxError;
+            Count = LODSimplify(VertexData,NumVertices,Format,SourceIndexList,SourceCount,TargetCount,MaxError,
+                                &LevelIndexList[NumLevelIndices]);
+            if( !Count || Count > SourceCount * LOD_MIN_REDUCTION ) {
+                break;
+            }
+            LOD->IndexCount[Level] = Count;
+            LOD->NumLevels++;
+            SourceIndexList = &LevelIndexList[NumLevelIndices];
+            SourceCount = Count;
+            NumLevelIndices += Count;
+        }
+        SDL_AtomicLock(&LODLock);
+        LODCacheStore(Cache,MeshHash,LOD,LevelIndexList);
+        SDL_AtomicUnlock(&LODLock);
+    }
+    NumLevelIndices = 0;
+    for( Level = 1; Level < LOD->NumLevels; Level++ ) {
+        NumLevelIndices += LOD->IndexCount[Level];
+    }
+    if( NumLevelIndices ) {
+        Temp = realloc(*IndexList,(*NumIndices + NumLevelIndices) * sizeof(unsigned int));
+        if( !Temp ) {
+            DPrintf("LODBuildMesh:Failed to grow the index list\n");
+            LOD->NumLevels = 1;
+        } else {
+            *IndexList = Temp;
+            memcpy(&Temp[*NumIndices],LevelIndexList,NumLevelIndices * sizeof(unsigned int));
+            for( Level = 1; Level < LOD->NumLevels; Level++ ) {
+                LOD->IndexOffset[Level] = LOD->IndexOffset[Level - 1] + LOD->IndexCount[Level - 1];
+            }
+            *NumIndices += NumLevelIndices;
+        }
+    }
+    if( LevelIndexList ) {
+        free(LevelIndexList);
+    }
+    SDL_AtomicLock(&LODLock);
+    for( Level = 0; Level < LOD->NumLevels; Level++ ) {
+        LODStats.NumTriangles[Level] += LOD->IndexCount[Level] / 3;
+    }
+    LODStats.NumMeshes++;
+    LODStats.BuildTime += SysPreciseMilliseconds() - StartTime;
+    SDL_AtomicUnlock(&LODLock);
+    return 1;
+}
+
+/*
+ * Picks the level to draw using the projected size of the mesh bounding sphere,ProjectionScale is the
+ * vertical scale of the projection matrix multiplied by the scale of the model.
+ */
+void LODUpdateLevel(LODMesh_t *LOD,mat4 MVPMatrix,float ProjectionScale)
+{
+    vec4 Center;
+    vec4 ClipCenter;
+    float ScreenSize;
+    int Level;
+    
+    if( LOD->NumLevels <= 1 ) {
+        LOD->CurrentLevel = 0;
+        return;
+    }
+    Center[0] = LOD->Center[0];
+    Center[1] = LOD->Center[1];
+    Center[2] = LOD->Center[2];
+    Center[3] = 1.f;
+    glm_mat4_mulv(MVPMatrix,Center,ClipCenter);
+    if( ClipCenter[3] <= LOD->Radius * ProjectionScale ) {
+        LOD->CurrentLevel = 0;
+        return;
+    }
+    ScreenSize = LOD->Radius * ProjectionScale / ClipCenter[3];
+    Level = LOD->CurrentLevel;
+    while( Level + 1 < LOD->NumLevels && ScreenSize < LODScreenSize[Level + 1] * (1.f - LOD_HYSTERESIS) ) {
+        Level++;
+    }
+    while( Level > 0 && ScreenSize > LODScreenSize[Level] * (1.f + LOD_HYSTERESIS) ) {
+        Level--;
+    }
+    LOD->CurrentLevel = Level;
+}
+
+/*
+ * Draws the current level of the mesh,the VAO must have been created with an index buffer.
+ */
+void LODDrawElements(VAO_t *VAO,LODMesh_t *LOD)
+{
+    int Level;
+    int Offset;
+    int Count;
+    
+    Level = 0;
+    if( LOD->NumLevels > 1 && EnableLOD->IValue ) {
+        Level = LOD->CurrentLevel;
+    }
+    if( LOD->NumLevels ) {
+        Offset = LOD->IndexOffset[Level];
+        Count = LOD->IndexCount[Level];
+    } else {
+        Offset = 0;
+        Count = VAO->Count;
+    }
+    glDrawElements(GL_TRIANGLES, Count, GL_UNSIGNED_INT, BUFFER_INT_OFFSET(Offset));
+    LODStats.NumDrawnMeshes[Level]++;
+    LODStats.NumDrawnTriangles += Count / 3;
+}
+
+void LODBeginFrame()
+{
+    memset(LODStats.NumDrawnMeshes,0,sizeof(LODStats.NumDrawnMeshes));
+    LODStats.NumDrawnTriangles = 0;
+}
+
+static char *LODGetFilePath(unsigned int Hash)
+{
+    char *ConfigPath;
+    char *Directory;
+    char *Path;
+    
+    ConfigPath = AppGetConfigPath();
+    asprintf(&Directory,"%sLOD",ConfigPath);
+    CreateDirIfNotExists(Directory);
+    asprintf(&Path,"%s/%08X.lod",Directory,Hash);
+    free(Directory);
+    free(ConfigPath);
+    return Path;
+}
+
+static int LODCacheReadFile(LODCache_t *Cache,const char *Path)
+{
+    FILE *LODFile;
+    LODCacheEntry_t *Entry;
+    int Magic;
+    int Version;
+    unsigned int Hash;
+    int NumEntries;
+    int NumIndices;
+    int i;
+    int j;
+    
+    LODFile = fopen(Path,"rb");
+    if( !LODFile ) {
+        return 0;
+    }
+    if( fread(&Magic,sizeof(Magic),1,LODFile) != 1 || Magic != LOD_FILE_MAGIC ) {
+        DPrintf("LODCacheReadFile:%s is not a valid LOD file\n",Path);
+        goto Failure;
+    }
+    if( fread(&Version,sizeof(Version),1,LODFile) != 1 || Version != LOD_FILE_VERSION ) {
+        DPrintf("LODCacheReadFile:%s has an unsupported version\n",Path);
+        goto Failure;
+    }
+    if( fread(&Hash,sizeof(Hash),1,LODFile) != 1 || fread(&NumEntries,sizeof(NumEntries),1,LODFile) != 1 ||
+        Hash != Cache->SourceHash || NumEntries < 0 ) {
+        DPrintf("LODCacheReadFile:%s doesn't match the current source\n",Path);
+        goto Failure;
+    }
+    for( i = 0; i < NumEntries; i++ ) {
+        Entry = LODCacheAddEntry(Cache);
+        if( !Entry ) {
+            goto Failure;
+        }
+        if( fread(&Entry->MeshHash,sizeof(Entry->MeshHash),1,LODFile) != 1 ||
+            fread(&Entry->NumLevels,sizeof(Entry->NumLevels),1,LODFile) != 1 ||
+            fread(Entry->IndexCount,sizeof(Entry->IndexCount),1,LODFile) != 1 ||
+            Entry->NumLevels < 1 || Entry->NumLevels > LOD_MAX_LEVELS ) {
+            DPrintf("LODCacheReadFile:Invalid entry %i\n",i);
+            goto Failure;
+        }
+        for( j = 0; j < LOD_MAX_LEVELS; j++ ) {
+            if( Entry->IndexCount[j] < 0 || (Entry->IndexCount[j] % 3) != 0 ) {
+                DPrintf("LODCacheReadFile:Invalid entry %i\n",i);
+                goto Failure;
+            }
+        }
+        NumIndices = LODCacheGetNumIndices(Entry);
+        if( !NumIndices ) {
+            continue;
+        }
+        Entry->IndexList = malloc(NumIndices * sizeof(unsigned int));
+        if( !Entry->IndexList || fread(Entry->IndexList,NumIndices * sizeof(unsigned int),1,LODFile) != 1 ) {
+            DPrintf("LODCacheReadFile:Truncated entry %i\n",i);
+            goto Failure;
+        }
+    }
+    fclose(LODFile);
+    return 1;
+Failure:
+    for( i = 0; i < Cache->NumEntries; i++ ) {
+        if( Cache->EntryList[i].IndexList ) {
+            free(Cache->EntryList[i].IndexList);
+        }
+    }
+    Cache->NumEntries = 0;
+    fclose(LODFile);
+    return 0;
+}
+
+/*
+ * Loads the detail levels that were built for the meshes of the source identified by the given hash.
+ * An empty cache is returned if they are not available.
+ */
+LODCache_t *LODCacheLoad(unsigned int SourceHash)
+{
+    LODCache_t *Cache;
+    char *Path;
+    
+    Cache = malloc(sizeof(LODCache_t));
+    if( !Cache ) {
+        DPrintf("LODCacheLoad:Failed to allocate memory for LOD cache\n");
+        return NULL;
+    }
+    Cache->SourceHash = SourceHash;
+    Cache->EntryList = NULL;
+    Cache->NumEntries = 0;
+    Cache->MaxEntries = 0;
+    Cache->Dirty = false;
+    Path = LODGetFilePath(SourceHash);
+    if( LODCacheReadFile(Cache,Path) ) {
+        DPrintf("LODCacheLoad:Loaded %i meshes from %s\n",Cache->NumEntries,Path);
+    }
+    free(Path);
+    return Cache;
+}
+
+/*
+ * Writes the cache to disk if new meshes were added since it was loaded.
+ */
+int LODCacheSave(LODCache_t *Cache)
+{
+    FILE *LODFile;
+    LODCacheEntry_t *Entry;
+    char *Path;
+    int Magic;
+    int Version;
+    int i;
+    
+    if( !Cache || !Cache->Dirty ) {
+        return 1;
+    }
+    Path = LODGetFilePath(Cache->SourceHash);
+    LODFile = fopen(Path,"wb");
+    if( !LODFile ) {
+        DPrintf("LODCacheSave:Failed to open %s for writing\n",Path);
+        free(Path);
+        return 0;
+    }
+    Magic = LOD_FILE_MAGIC;
+    Version = LOD_FILE_VERSION;
+    fwrite(&Magic,sizeof(Magic),1,LODFile);
+    fwrite(&Version,sizeof(Version),1,LODFile);
+    fwrite(&Cache->SourceHash,sizeof(Cache->SourceHash),1,LODFile);
+    fwrite(&Cache->NumEntries,sizeof(Cache->NumEntries),1,LODFile);
+    for( i = 0; i < Cache->NumEntries; i++ ) {
+        Entry = &Cache->EntryList[i];
+        fwrite(&Entry->MeshHash,sizeof(Entry->MeshHash),1,LODFile);
+        fwrite(&Entry->NumLevels,sizeof(Entry->NumLevels),1,LODFile);
+        fwrite(Entry->IndexCount,sizeof(Entry->IndexCount),1,LODFile);
+        if( Entry->IndexList ) {
+            fwrite(Entry->IndexList,LODCacheGetNumIndices(Entry) * sizeof(unsigned int),1,LODFile);
+        }
+    }
+    DPrintf("LODCacheSave:Wrote %i meshes to %s\n",Cache->NumEntries,Path);
+    fclose(LODFile);
+    free(Path);
+    Cache->Dirty = false;
+    return 1;
+}
+
+void LODCacheFree(LODCache_t *Cache)
+{
+    int i;
+    
+    if( !Cache ) {
+        return;
+    }
+    for( i = 0; i < Cache->NumEntries; i++ ) {
+        if( Cache->EntryList[i].IndexList ) {
+            free(Cache->EntryList[i].IndexList);
+        }
+    }
+    if( Cache->EntryList ) {
+        free(Cache->EntryList);
+    }
+    free(Cache);
+}
+
+const LODStats_t *LODGetStats()
+{
+    return &LODStats;
+}
+
+int LODInit()
+{
+    EnableLOD = ConfigGet("EnableLOD");
+    memset(&LODStats,0,sizeof(LODStats));
+    return 1;
+}
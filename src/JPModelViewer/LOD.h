@@ -0,0 +1,104 @@
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#ifndef __LOD_H_
+#define __LOD_H_
+
+#include "../Common/Common.h"
+#include "../Common/Config.h"
+#include "../Common/VAO.h"
+
+#define LOD_FILE_MAGIC                  0x444F4C4A //JLOD
+#define LOD_FILE_VERSION                1
+#define LOD_MAX_LEVELS                  3
+//NOTE(Adriano):Meshes smaller than this are always drawn at full detail.
+#define LOD_MIN_TRIANGLES               32
+//NOTE(Adriano):A level is kept only if it has less triangles than this fraction of the previous one.
+#define LOD_MIN_REDUCTION               0.9f
+#define LOD_MAX_PASSES                  16
+//NOTE(Adriano):Largest difference on a single color channel between two vertices that can be merged.
+#define LOD_MAX_COLOR_DIFFERENCE        24
+//NOTE(Adriano):Cosine of the largest rotation that a collapse can apply to a triangle.
+#define LOD_MIN_NORMAL_COSINE           0.7
+//NOTE(Adriano):A level is left only when the screen size moves past its threshold by this fraction.
+#define LOD_HYSTERESIS                  0.15f
+
+typedef struct LODVertexFormat_s {
+    int Stride;
+    int UVOffset;
+    int ColorOffset;
+} LODVertexFormat_t;
+
+typedef struct LODMesh_s {
+    int     NumLevels;
+    int     IndexOffset[LOD_MAX_LEVELS];
+    int     IndexCount[LOD_MAX_LEVELS];
+    int     CurrentLevel;
+    vec3    Center;
+    float   Radius;
+} LODMesh_t;
+
+typedef struct LODQuadric_s {
+    double  Data[10];
+} LODQuadric_t;
+
+typedef struct LODCollapse_s {
+    double  Cost;
+    int     From;
+    int     To;
+} LODCollapse_t;
+
+typedef struct LODCacheEntry_s {
+    unsigned int    MeshHash;
+    int             NumLevels;
+    int             IndexCount[LOD_MAX_LEVELS];
+    //NOTE(Adriano):Indices of all the levels except the first one which is the source mesh.
+    unsigned int    *IndexList;
+} LODCacheEntry_t;
+
+typedef struct LODCache_s {
+    unsigned int    SourceHash;
+    LODCacheEntry_t *EntryList;
+    int             NumEntries;
+    int             MaxEntries;
+    bool            Dirty;
+} LODCache_t;
+
+typedef struct LODStats_s {
+    int     NumMeshes;
+    int     NumCacheHits;
+    int     NumTriangles[LOD_MAX_LEVELS];
+    double  BuildTime;
+    //NOTE(Adriano):Reset every frame.
+    int     NumDrawnMeshes[LOD_MAX_LEVELS];
+    int     NumDrawnTriangles;
+} LODStats_t;
+
+extern Config_t *EnableLOD;
+
+int                 LODInit();
+int                 LODBuildMesh(LODCache_t *Cache,const int *VertexData,int NumVertices,const LODVertexFormat_t *Format,
+                                 unsigned int **IndexList,int *NumIndices,LODMesh_t *LOD);
+void                LODUpdateLevel(LODMesh_t *LOD,mat4 MVPMatrix,float ProjectionScale);
+void                LODDrawElements(VAO_t *VAO,LODMesh_t *LOD);
+void                LODBeginFrame();
+LODCache_t          *LODCacheLoad(unsigned int SourceHash);
+int                 LODCacheSave(LODCache_t *Cache);
+void                LODCacheFree(LODCache_t *Cache);
+const LODStats_t    *LODGetStats();
+#endif//__LOD_H_
@@ -0,0 +1,804 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#include "MeshOptimizer.h"
+
+Config_t *EnableMeshOptimization;
+
+static MeshOptimizerStats_t MeshOptimizerStats;
+static SDL_SpinLock MeshOptimizerStatsLock;
+
+//NOTE(Adriano):Vertex scoring parameters from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+#define MESH_OPTIMIZER_CACHE_DECAY_POWER    1.5f
+#define MESH_OPTIMIZER_LAST_TRIANGLE_SCORE  0.75f
+#define MESH_OPTIMIZER_VALENCE_BOOST_SCALE  2.f
+#define MESH_OPTIMIZER_VALENCE_BOOST_POWER  0.5f
+
+static float MeshOptimizerGetVertexScore(int CachePosition,int NumActiveTriangles)
+{
+    float Score;
+    float Scale;
+    
+    if( NumActiveTriangles == 0 ) {
+        return -1.f;
+    }
+    Score = 0.f;
+    if( CachePosition >= 0 ) {
+        if( CachePosition < 3 ) {
+            Score = MESH_OPTIMIZER_LAST_TRIANGLE_SCORE;
+        } else {
+            Scale = 1.f / (MESH_OPTIMIZER_CACHE_SIZE - 3);
+            Score = powf(1.f - (CachePosition - 3) * Scale,MESH_OPTIMIZER_CACHE_DECAY_POWER);
+        }
+    }
+    Score += MESH_OPTIMIZER_VALENCE_BOOST_SCALE * powf((float) NumActiveTriangles,-MESH_OPTIMIZER_VALENCE_BOOST_POWER);
+    return Score;
+}
+
+static void MeshOptimizerGetPosition(const int *VertexData,int NumInts,int Vertex,long long *Position)
+{
+    Position[0] = VertexData[Vertex * NumInts + 0];
+    Position[1] = VertexData[Vertex * NumInts + 1];
+    Position[2] = VertexData[Vertex * NumInts + 2];
+}
+
+static void MeshOptimizerGetNormal(const int *VertexData,int NumInts,const int *UniqueList,const int *Triangle,long long *Normal)
+{
+    long long P0[3];
+    long long P1[3];
+    long long P2[3];
+    long long Edge0[3];
+    long long Edge1[3];
+    int i;
+    
+    MeshOptimizerGetPosition(VertexData,NumInts,UniqueList[Triangle[0]],P0);
+    MeshOptimizerGetPosition(VertexData,NumInts,UniqueList[Triangle[1]],P1);
+    MeshOptimizerGetPosition(VertexData,NumInts,UniqueList[Triangle[2]],P2);
+    for( i = 0; i < 3; i++ ) {
+        Edge0[i] = P1[i] - P0[i];
+        Edge1[i] = P2[i] - P0[i];
+    }
+    Normal[0] = Edge0[1] * Edge1[2] - Edge0[2] * Edge1[1];
+    Normal[1] = Edge0[2] * Edge1[0] - Edge0[0] * Edge1[2];
+    Normal[2] = Edge0[0] * Edge1[1] - Edge0[1] * Edge1[0];
+}
+
+/*
+ * Rotates the triangle so that it starts from its smallest index,the winding is preserved.
+ */
+static void MeshOptimizerGetTriangleKey(const int *Triangle,int *Key)
+{
+    int Rotation;
+    int i;
+    
+    Rotation = 0;
+    if( Triangle[1] < Triangle[Rotation] ) {
+        Rotation = 1;
+    }
+    if( Triangle[2] < Triangle[Rotation] ) {
+        Rotation = 2;
+    }
+    for( i = 0; i < 3; i++ ) {
+        Key[i] = Triangle[(Rotation + i) % 3];
+    }
+}
+
+static long long MeshOptimizerGCD(long long A,long long B)
+{
+    long long Temp;
+    
+    if( A < 0 ) {
+        A = -A;
+    }
+    if( B < 0 ) {
+        B = -B;
+    }
+    while( B ) {
+        Temp = A % B;
+        A = B;
+        B = Temp;
+    }
+    return A;
+}
+
+static int MeshOptimizerComparePlane(const void *a,const void *b)
+{
+    const MeshOptimizerPlane_t *PlaneA;
+    const MeshOptimizerPlane_t *PlaneB;
+    int i;
+    
+    PlaneA = (const MeshOptimizerPlane_t *) a;
+    PlaneB = (const MeshOptimizerPlane_t *) b;
+    for( i = 0; i < 3; i++ ) {
+        if( PlaneA->Normal[i] != PlaneB->Normal[i] ) {
+            return PlaneA->Normal[i] < PlaneB->Normal[i] ? -1 : 1;
+        }
+    }
+    if( PlaneA->Distance != PlaneB->Distance ) {
+        return PlaneA->Distance < PlaneB->Distance ? -1 : 1;
+    }
+    return PlaneA->Triangle - PlaneB->Triangle;
+}
+
+static long long MeshOptimizerCross2D(const long long *A,const long long *B,const long long *C)
+{
+    return (B[0] - A[0]) * (C[1] - A[1]) - (B[1] - A[1]) * (C[0] - A[0]);
+}
+
+/*
+ * Returns true if one of the edges of the counter-clockwise triangle P leaves all the
+ * vertices of Q on its outer side (or on the edge itself).
+ */
+static bool MeshOptimizerHasSeparatingEdge(long long P[3][2],long long Q[3][2])
+{
+    int i;
+    int j;
+    int k;
+    
+    for( i = 0; i < 3; i++ ) {
+        j = (i + 1) % 3;
+        for( k = 0; k < 3; k++ ) {
+            if( MeshOptimizerCross2D(P[i],P[j],Q[k]) > 0 ) {
+                break;
+            }
+        }
+        if( k == 3 ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void MeshOptimizerProjectTriangle(const int *VertexData,int NumInts,const int *UniqueList,const int *Triangle,
+                                         int Axis,long long Projected[3][2])
+{
+    long long Position[3];
+    long long Temp;
+    int i;
+    
+    for( i = 0; i < 3; i++ ) {
+        MeshOptimizerGetPosition(VertexData,NumInts,UniqueList[Triangle[i]],Position);
+        Projected[i][0] = Position[(Axis + 1) % 3];
+        Projected[i][1] = Position[(Axis + 2) % 3];
+    }
+    if( MeshOptimizerCross2D(Projected[0],Projected[1],Projected[2]) < 0 ) {
+        Temp = Projected[1][0];
+        Projected[1][0] = Projected[2][0];
+        Projected[2][0] = Temp;
+        Temp = Projected[1][1];
+        Projected[1][1] = Projected[2][1];
+        Projected[2][1] = Temp;
+    }
+}
+
+/*
+ * Returns the axis that is dropped when projecting the plane on 2D,the projection never
+ * collapses a triangle lying on the plane.
+ */
+static int MeshOptimizerGetDominantAxis(const long long *Normal)
+{
+    int Axis;
+    
+    Axis = 0;
+    if( llabs(Normal[1]) > llabs(Normal[Axis]) ) {
+        Axis = 1;
+    }
+    if( llabs(Normal[2]) > llabs(Normal[Axis]) ) {
+        Axis = 2;
+    }
+    return Axis;
+}
+
+static void MeshOptimizerGetProjectedBounds(const int *VertexData,int NumInts,const int *UniqueList,const int *Triangle,
+                                            int Axis,MeshOptimizerBounds_t *Bounds)
+{
+    long long Projected[3][2];
+    int i;
+    int j;
+    
+    MeshOptimizerProjectTriangle(VertexData,NumInts,UniqueList,Triangle,Axis,Projected);
+    for( j = 0; j < 2; j++ ) {
+        Bounds->Min[j] = Projected[0][j];
+        Bounds->Max[j] = Projected[0][j];
+        for( i = 1; i < 3; i++ ) {
+            if( Projected[i][j] < Bounds->Min[j] ) {
+                Bounds->Min[j] = Projected[i][j];
+            }
+            if( Projected[i][j] > Bounds->Max[j] ) {
+                Bounds->Max[j] = Projected[i][j];
+            }
+        }
+    }
+}
+
+static int MeshOptimizerCompareBounds(const void *a,const void *b)
+{
+    const MeshOptimizerBounds_t *BoundsA;
+    const MeshOptimizerBounds_t *BoundsB;
+    
+    BoundsA = (const MeshOptimizerBounds_t *) a;
+    BoundsB = (const MeshOptimizerBounds_t *) b;
+    if( BoundsA->Min[0] != BoundsB->Min[0] ) {
+        return BoundsA->Min[0] < BoundsB->Min[0] ? -1 : 1;
+    }
+    return BoundsA->Triangle - BoundsB->Triangle;
+}
+
+/*
+ * Two coplanar triangles that share some area produce fragments at the same depth and since
+ * the level is drawn using GL_LEQUAL the last one wins:their relative order must be kept.
+ * Triangles that only share an edge or a vertex do not overlap.
+ */
+static bool MeshOptimizerTrianglesOverlap(const int *VertexData,int NumInts,const int *UniqueList,const int *TriangleA,
+                                          const int *TriangleB,int Axis)
+{
+    long long P[3][2];
+    long long Q[3][2];
+    
+    MeshOptimizerProjectTriangle(VertexData,NumInts,UniqueList,TriangleA,Axis,P);
+    MeshOptimizerProjectTriangle(VertexData,NumInts,UniqueList,TriangleB,Axis,Q);
+    return !MeshOptimizerHasSeparatingEdge(P,Q) && !MeshOptimizerHasSeparatingEdge(Q,P);
+}
+
+static int MeshOptimizerAddConstraint(MeshOptimizerConstraint_t **ConstraintList,int *NumConstraints,int *MaxConstraints,
+                                      int From,int To)
+{
+    MeshOptimizerConstraint_t *Temp;
+    
+    if( *NumConstraints == *MaxConstraints ) {
+        *MaxConstraints = *MaxConstraints ? *MaxConstraints * 2 : 256;
+        Temp = realloc(*ConstraintList,*MaxConstraints * sizeof(MeshOptimizerConstraint_t));
+        if( !Temp ) {
+            DPrintf("MeshOptimizerAddConstraint:Failed to grow the constraint list\n");
+            return 0;
+        }
+        *ConstraintList = Temp;
+    }
+    (*ConstraintList)[*NumConstraints].From = From;
+    (*ConstraintList)[*NumConstraints].To = To;
+    (*NumConstraints)++;
+    return 1;
+}
+
+/*
+ * Simulates a FIFO post-transform cache followed by a cache of the vertex buffer lines.
+ * Returns the number of transformed vertices and stores the number of fetched bytes.
+ */
+static int MeshOptimizerSimulateCache(const unsigned int *IndexList,int NumIndices,int Stride,int *FetchedBytes)
+{
+    unsigned int Cache[MESH_OPTIMIZER_SIMULATED_CACHE_SIZE];
+    int LineCache[MESH_OPTIMIZER_SIMULATED_NUM_LINES];
+    int CacheHead;
+    int LineHead;
+    int NumTransformed;
+    int FirstLine;
+    int LastLine;
+    int Line;
+    int i;
+    int j;
+    
+    memset(Cache,0xFF,sizeof(Cache));
+    memset(LineCache,0xFF,sizeof(LineCache));
+    CacheHead = 0;
+    LineHead = 0;
+    NumTransformed = 0;
+    *FetchedBytes = 0;
+    for( i = 0; i < NumIndices; i++ ) {
+        for( j = 0; j < MESH_OPTIMIZER_SIMULATED_CACHE_SIZE; j++ ) {
+            if( Cache[j] == IndexList[i] ) {
+                break;
+            }
+        }
+        if( j != MESH_OPTIMIZER_SIMULATED_CACHE_SIZE ) {
+            continue;
+        }
+        Cache[CacheHead] = IndexList[i];
+        CacheHead = (CacheHead + 1) % MESH_OPTIMIZER_SIMULATED_CACHE_SIZE;
+        NumTransformed++;
+        FirstLine = (IndexList[i] * Stride) / MESH_OPTIMIZER_SIMULATED_LINE_SIZE;
+        LastLine = (IndexList[i] * Stride + Stride - 1) / MESH_OPTIMIZER_SIMULATED_LINE_SIZE;
+        for( Line = FirstLine; Line <= LastLine; Line++ ) {
+            for( j = 0; j < MESH_OPTIMIZER_SIMULATED_NUM_LINES; j++ ) {
+                if( LineCache[j] == Line ) {
+                    break;
+                }
+            }
+            if( j != MESH_OPTIMIZER_SIMULATED_NUM_LINES ) {
+                continue;
+            }
+            LineCache[LineHead] = Line;
+            LineHead = (LineHead + 1) % MESH_OPTIMIZER_SIMULATED_NUM_LINES;
+            *FetchedBytes += MESH_OPTIMIZER_SIMULATED_LINE_SIZE;
+        }
+    }
+    return NumTransformed;
+}
+
+void MeshOptimizerFreeMesh(MeshOptimizerMesh_t *Mesh)
+{
+    if( !Mesh ) {
+        return;
+    }
+    if( Mesh->VertexData ) {
+        free(Mesh->VertexData);
+    }
+    if( Mesh->IndexList ) {
+        free(Mesh->IndexList);
+    }
+    Mesh->VertexData = NULL;
+    Mesh->IndexList = NULL;
+    Mesh->NumVertices = 0;
+    Mesh->NumIndices = 0;
+}
+
+/*
+ * Converts a non-indexed triangle list into an indexed one that renders the same image:
+ * identical vertices are merged,degenerate triangles and exact duplicates are removed,then the
+ * triangles are reordered for the post-transform cache (Forsyth) and the vertices are sorted by
+ * their first use to improve the fetch locality.
+ * Coplanar triangles that overlap keep their original relative order.
+ * Stride is in bytes and the vertex must start with its integer XYZ position.
+ * Returns 0 if the mesh could not be optimized,in this case the original data should be used.
+ * Can be called from any thread.
+ */
+int MeshOptimizerOptimize(const int *VertexData,int NumVertices,int Stride,MeshOptimizerMesh_t *Mesh)
+{
+    MeshOptimizerVertex_t *VertexList;
+    MeshOptimizerPlane_t *PlaneList;
+    MeshOptimizerBounds_t *BoundsList;
+    MeshOptimizerConstraint_t *ConstraintList;
+    unsigned int *FileOrderIndexList;
+    int *HashTable;
+    int *UniqueList;
+    int *TriangleList;
+    int *KeptList;
+    Byte *Removed;
+    Byte *Emitted;
+    int *Pending;
+    int *SuccessorStart;
+    int *SuccessorList;
+    int *AdjacencyList;
+    float *TriangleScore;
+    int *OrderList;
+    int *Remap;
+    int Cache[MESH_OPTIMIZER_CACHE_SIZE + 3];
+    int NewCache[MESH_OPTIMIZER_CACHE_SIZE + 3];
+    int NumCached;
+    int NumNewCached;
+    int NumConstraints;
+    int MaxConstraints;
+    int NumInts;
+    int NumTriangles;
+    int NumKept;
+    int NumUnique;
+    int NumEmitted;
+    int NumDegenerate;
+    int NumDuplicate;
+    int NumOutputVertices;
+    int TableSize;
+    int Slot;
+    int Key[3];
+    int StoredKey[3];
+    long long Normal[3];
+    long long Position[3];
+    long long Divisor;
+    const int *Vertex;
+    const int *Triangle;
+    int GroupStart;
+    int Axis;
+    int From;
+    int To;
+    int GroupEnd;
+    int Best;
+    float BestScore;
+    int Cursor;
+    int FetchedBytes;
+    int FetchedBytesFileOrder;
+    int NumTransformedFileOrder;
+    int NumTransformedAfter;
+    double StartTime;
+    int Result;
+    int i;
+    int j;
+    int k;
+    int t;
+    
+    if( !VertexData || !Mesh || NumVertices < 3 || (Stride % sizeof(int)) != 0 ) {
+        DPrintf("MeshOptimizerOptimize:Invalid data\n");
+        return 0;
+    }
+    StartTime = SysPreciseMilliseconds();
+    Result = 0;
+    memset(Mesh,0,sizeof(MeshOptimizerMesh_t));
+    NumInts = Stride / sizeof(int);
+    NumTriangles = NumVertices / 3;
+    VertexList = NULL;
+    PlaneList = NULL;
+    BoundsList = NULL;
+    ConstraintList = NULL;
+    FileOrderIndexList = NULL;
+    UniqueList = NULL;
+    TriangleList = NULL;
+    KeptList = NULL;
+    Removed = NULL;
+    Emitted = NULL;
+    Pending = NULL;
+    SuccessorStart = NULL;
+    SuccessorList = NULL;
+    AdjacencyList = NULL;
+    TriangleScore = NULL;
+    OrderList = NULL;
+    Remap = NULL;
+    NumConstraints = 0;
+    MaxConstraints = 0;
+    
+    TableSize = 1;
+    while( TableSize < NumVertices * 2 ) {
+        TableSize <<= 1;
+    }
+    HashTable = malloc(TableSize * sizeof(int));
+    UniqueList = malloc(NumVertices * sizeof(int));
+    TriangleList = malloc(NumTriangles * 3 * sizeof(int));
+    Removed = malloc(NumTriangles);
+    if( !HashTable || !UniqueList || !TriangleList || !Removed ) {
+        DPrintf("MeshOptimizerOptimize:Failed to allocate memory for %i vertices\n",NumVertices);
+        goto Failure;
+    }
+    //NOTE(Adriano):Merge identical vertices.
+    memset(HashTable,0xFF,TableSize * sizeof(int));
+    NumUnique = 0;
+    for( i = 0; i < NumTriangles * 3; i++ ) {
+        Vertex = &VertexData[i * NumInts];
+        Slot = HashFNV1a(HASH_FNV1A_INITIAL_VALUE,Vertex,Stride) & (TableSize - 1);
+        while( HashTable[Slot] != -1 ) {
+            if( !memcmp(&VertexData[UniqueList[HashTable[Slot]] * NumInts],Vertex,Stride) ) {
+                break;
+            }
+            Slot = (Slot + 1) & (TableSize - 1);
+        }
+        if( HashTable[Slot] == -1 ) {
+            HashTable[Slot] = NumUnique;
+            UniqueList[NumUnique++] = i;
+        }
+        TriangleList[i] = HashTable[Slot];
+    }
+    //NOTE(Adriano):Remove degenerate triangles,they do not produce any fragment.
+    NumDegenerate = 0;
+    for( i = 0; i < NumTriangles; i++ ) {
+        Triangle = &TriangleList[i * 3];
+        Removed[i] = 0;
+        if( Triangle[0] == Triangle[1] || Triangle[1] == Triangle[2] || Triangle[0] == Triangle[2] ) {
+            Removed[i] = 1;
+        } else {
+            MeshOptimizerGetNormal(VertexData,NumInts,UniqueList,Triangle,Normal);
+            Removed[i] = !Normal[0] && !Normal[1] && !Normal[2];
+        }
+        NumDegenerate += Removed[i];
+    }
+    //NOTE(Adriano):Remove exact duplicates,going backward keeps the last definition which is the one
+    //              that was visible when drawing in file order.
+    TableSize = 1;
+    while( TableSize < NumTriangles * 2 ) {
+        TableSize <<= 1;
+    }
+    free(HashTable);
+    HashTable = malloc(TableSize * sizeof(int));
+    if( !HashTable ) {
+        DPrintf("MeshOptimizerOptimize:Failed to allocate the triangle table\n");
+        goto Failure;
+    }
+    memset(HashTable,0xFF,TableSize * sizeof(int));
+    NumDuplicate = 0;
+    for( i = NumTriangles - 1; i >= 0; i-- ) {
+        if( Removed[i] ) {
+            continue;
+        }
+        MeshOptimizerGetTriangleKey(&TriangleList[i * 3],Key);
+        Slot = HashFNV1a(HASH_FNV1A_INITIAL_VALUE,Key,sizeof(Key)) & (TableSize - 1);
+        while( HashTable[Slot] != -1 ) {
+            MeshOptimizerGetTriangleKey(&TriangleList[HashTable[Slot] * 3],StoredKey);
+            if( !memcmp(Key,StoredKey,sizeof(Key)) ) {
+                break;
+            }
+            Slot = (Slot + 1) & (TableSize - 1);
+        }
+        if( HashTable[Slot] == -1 ) {
+            HashTable[Slot] = i;
+        } else {
+            Removed[i] = 1;
+            NumDuplicate++;
+        }
+    }
+    NumKept = NumTriangles - NumDegenerate - NumDuplicate;
+    if( !NumKept ) {
+        goto Failure;
+    }
+    KeptList = malloc(NumKept * 3 * sizeof(int));
+    PlaneList = malloc(NumKept * sizeof(MeshOptimizerPlane_t));
+    BoundsList = malloc(NumKept * sizeof(MeshOptimizerBounds_t));
+    if( !KeptList || !PlaneList || !BoundsList ) {
+        DPrintf("MeshOptimizerOptimize:Failed to allocate memory for %i triangles\n",NumKept);
+        goto Failure;
+    }
+    for( i = 0, k = 0; i < NumTriangles; i++ ) {
+        if( Removed[i] ) {
+            continue;
+        }
+        Triangle = &TriangleList[i * 3];
+        KeptList[k * 3 + 0] = Triangle[0];
+        KeptList[k * 3 + 1] = Triangle[1];
+        KeptList[k * 3 + 2] = Triangle[2];
+        MeshOptimizerGetNormal(VertexData,NumInts,UniqueList,Triangle,Normal);
+        Divisor = MeshOptimizerGCD(MeshOptimizerGCD(Normal[0],Normal[1]),Normal[2]);
+        for( j = 0; j < 3; j++ ) {
+            Normal[j] /= Divisor;
+        }
+        //NOTE(Adriano):Both windings describe the same plane.
+        if( Normal[0] < 0 || (Normal[0] == 0 && (Normal[1] < 0 || (Normal[1] == 0 && Normal[2] < 0))) ) {
+            for( j = 0; j < 3; j++ ) {
+                Normal[j] = -Normal[j];
+            }
+        }
+        MeshOptimizerGetPosition(VertexData,NumInts,UniqueList[Triangle[0]],Position);
+        memcpy(PlaneList[k].Normal,Normal,sizeof(Normal));
+        PlaneList[k].Distance = Normal[0] * Position[0] + Normal[1] * Position[1] + Normal[2] * Position[2];
+        PlaneList[k].Triangle = k;
+        k++;
+    }
+    //NOTE(Adriano):Find the order constraints between the overlapping coplanar triangles.
+    qsort(PlaneList,NumKept,sizeof(MeshOptimizerPlane_t),MeshOptimizerComparePlane);
+    for( GroupStart = 0; GroupStart < NumKept; GroupStart = GroupEnd ) {
+        for( GroupEnd = GroupStart + 1; GroupEnd < NumKept; GroupEnd++ ) {
+            if( memcmp(PlaneList[GroupStart].Normal,PlaneList[GroupEnd].Normal,sizeof(Normal)) ||
+                PlaneList[GroupStart].Distance != PlaneList[GroupEnd].Distance ) {
+                break;
+            }
+        }
+        //NOTE(Adriano):Sweep the group along the first projected axis and only test the triangles whose bounds overlap.
+        Axis = MeshOptimizerGetDominantAxis(PlaneList[GroupStart].Normal);
+        for( i = GroupStart; i < GroupEnd; i++ ) {
+            MeshOptimizerGetProjectedBounds(VertexData,NumInts,UniqueList,&KeptList[PlaneList[i].Triangle * 3],Axis,
+                                            &BoundsList[i - GroupStart]);
+            BoundsList[i - GroupStart].Triangle = PlaneList[i].Triangle;
+        }
+        qsort(BoundsList,GroupEnd - GroupStart,sizeof(MeshOptimizerBounds_t),MeshOptimizerCompareBounds);
+        for( i = 0; i < GroupEnd - GroupStart; i++ ) {
+            for( j = i + 1; j < GroupEnd - GroupStart && BoundsList[j].Min[0] < BoundsList[i].Max[0]; j++ ) {
+                if( BoundsList[j].Min[1] >= BoundsList[i].Max[1] || BoundsList[i].Min[1] >= BoundsList[j].Max[1] ) {
+                    continue;
+                }
+                if( !MeshOptimizerTrianglesOverlap(VertexData,NumInts,UniqueList,&KeptList[BoundsList[i].Triangle * 3],
+                    &KeptList[BoundsList[j].Triangle * 3],Axis) ) {
+                    continue;
+                }
+                From = BoundsList[i].Triangle < BoundsList[j].Triangle ? BoundsList[i].Triangle : BoundsList[j].Triangle;
+                To = BoundsList[i].Triangle < BoundsList[j].Triangle ? BoundsList[j].Triangle : BoundsList[i].Triangle;
+                if( !MeshOptimizerAddConstraint(&ConstraintList,&NumConstraints,&MaxConstraints,From,To) ) {
+                    goto Failure;
+                }
+            }
+        }
+    }
+    Pending = calloc(NumKept,sizeof(int));
+    SuccessorStart = calloc(NumKept + 1,sizeof(int));
+    SuccessorList = malloc((NumConstraints + 1) * sizeof(int));
+    VertexList = calloc(NumUnique,sizeof(MeshOptimizerVertex_t));
+    AdjacencyList = malloc(NumKept * 3 * sizeof(int));
+    TriangleScore = malloc(NumKept * sizeof(float));
+    Emitted = calloc(NumKept,1);
+    OrderList = malloc(NumKept * sizeof(int));
+    if( !Pending || !SuccessorStart || !SuccessorList || !VertexList || !AdjacencyList || !TriangleScore || !Emitted || !OrderList ) {
+        DPrintf("MeshOptimizerOptimize:Failed to allocate memory for %i triangles\n",NumKept);
+        goto Failure;
+    }
+    for( i = 0; i < NumConstraints; i++ ) {
+        SuccessorStart[ConstraintList[i].From + 1]++;
+        Pending[ConstraintList[i].To]++;
+    }
+    for( i = 0; i < NumKept; i++ ) {
+        SuccessorStart[i + 1] += SuccessorStart[i];
+    }
+    for( i = 0; i < NumConstraints; i++ ) {
+        SuccessorList[SuccessorStart[ConstraintList[i].From]++] = ConstraintList[i].To;
+    }
+    //NOTE(Adriano):The fill moved each start offset to the next one,shift them back.
+    for( i = NumKept; i > 0; i-- ) {
+        SuccessorStart[i] = SuccessorStart[i - 1];
+    }
+    SuccessorStart[0] = 0;
+    //NOTE(Adriano):Vertex to triangle adjacency.
+    for( i = 0; i < NumKept * 3; i++ ) {
+        VertexList[KeptList[i]].NumTriangles++;
+    }
+    for( i = 0, k = 0; i < NumUnique; i++ ) {
+        VertexList[i].FirstTriangle = k;
+        VertexList[i].NumActiveTriangles = VertexList[i].NumTriangles;
+        VertexList[i].CachePosition = -1;
+        k += VertexList[i].NumTriangles;
+        VertexList[i].NumTriangles = 0;
+    }
+    for( i = 0; i < NumKept * 3; i++ ) {
+        AdjacencyList[VertexList[KeptList[i]].FirstTriangle + VertexList[KeptList[i]].NumTriangles++] = i / 3;
+    }
+    for( i = 0; i < NumUnique; i++ ) {
+        VertexList[i].Score = MeshOptimizerGetVertexScore(-1,VertexList[i].NumActiveTriangles);
+    }
+    for( i = 0; i < NumKept; i++ ) {
+        TriangleScore[i] = VertexList[KeptList[i * 3 + 0]].Score + VertexList[KeptList[i * 3 + 1]].Score +
+                           VertexList[KeptList[i * 3 + 2]].Score;
+    }
+    //NOTE(Adriano):Greedy reorder,only triangles whose constraints are satisfied can be picked.
+    NumCached = 0;
+    NumEmitted = 0;
+    Cursor = 0;
+    while( NumEmitted < NumKept ) {
+        Best = -1;
+        BestScore = -1.f;
+        for( i = 0; i < NumCached; i++ ) {
+            for( j = 0; j < VertexList[Cache[i]].NumTriangles; j++ ) {
+                t = AdjacencyList[VertexList[Cache[i]].FirstTriangle + j];
+                if( Emitted[t] || Pending[t] ) {
+                    continue;
+                }
+                if( TriangleScore[t] > BestScore ) {
+                    BestScore = TriangleScore[t];
+                    Best = t;
+                }
+            }
+        }
+        if( Best == -1 ) {
+            //NOTE(Adriano):Constraints always point forward so the first triangle left is always ready.
+            while( Emitted[Cursor] ) {
+                Cursor++;
+            }
+            Best = Cursor;
+        }
+        Emitted[Best] = 1;
+        OrderList[NumEmitted++] = Best;
+        for( i = SuccessorStart[Best]; i < SuccessorStart[Best + 1]; i++ ) {
+            Pending[SuccessorList[i]]--;
+        }
+        NumNewCached = 0;
+        for( i = 0; i < 3; i++ ) {
+            NewCache[NumNewCached++] = KeptList[Best * 3 + i];
+            VertexList[KeptList[Best * 3 + i]].NumActiveTriangles--;
+        }
+        for( i = 0; i < NumCached; i++ ) {
+            if( Cache[i] != NewCache[0] && Cache[i] != NewCache[1] && Cache[i] != NewCache[2] ) {
+                NewCache[NumNewCached++] = Cache[i];
+            }
+        }
+        for( i = 0; i < NumNewCached; i++ ) {
+            VertexList[NewCache[i]].CachePosition = i < MESH_OPTIMIZER_CACHE_SIZE ? i : -1;
+            VertexList[NewCache[i]].Score = MeshOptimizerGetVertexScore(VertexList[NewCache[i]].CachePosition,
+                                                                        VertexList[NewCache[i]].NumActiveTriangles);
+        }
+        for( i = 0; i < NumNewCached; i++ ) {
+            for( j = 0; j < VertexList[NewCache[i]].NumTriangles; j++ ) {
+                t = AdjacencyList[VertexList[NewCache[i]].FirstTriangle + j];
+                if( Emitted[t] ) {
+                    continue;
+                }
+                TriangleScore[t] = VertexList[KeptList[t * 3 + 0]].Score + VertexList[KeptList[t * 3 + 1]].Score +
+                                   VertexList[KeptList[t * 3 + 2]].Score;
+            }
+        }
+        NumCached = NumNewCached < MESH_OPTIMIZER_CACHE_SIZE ? NumNewCached : MESH_OPTIMIZER_CACHE_SIZE;
+        memcpy(Cache,NewCache,NumCached * sizeof(int));
+    }
+    //NOTE(Adriano):Sort the vertices by their first use.
+    Remap = malloc(NumUnique * sizeof(int));
+    Mesh->IndexList = malloc(NumKept * 3 * sizeof(unsigned int));
+    if( !Remap || !Mesh->IndexList ) {
+        DPrintf("MeshOptimizerOptimize:Failed to allocate the index buffer\n");
+        goto Failure;
+    }
+    memset(Remap,0xFF,NumUnique * sizeof(int));
+    NumOutputVertices = 0;
+    for( i = 0; i < NumKept; i++ ) {
+        for( j = 0; j < 3; j++ ) {
+            k = KeptList[OrderList[i] * 3 + j];
+            if( Remap[k] == -1 ) {
+                Remap[k] = NumOutputVertices++;
+            }
+            Mesh->IndexList[i * 3 + j] = Remap[k];
+        }
+    }
+    Mesh->VertexData = malloc(NumOutputVertices * Stride);
+    if( !Mesh->VertexData ) {
+        DPrintf("MeshOptimizerOptimize:Failed to allocate memory for %i vertices\n",NumOutputVertices);
+        goto Failure;
+    }
+    for( i = 0; i < NumUnique; i++ ) {
+        if( Remap[i] != -1 ) {
+            memcpy(&Mesh->VertexData[Remap[i] * NumInts],&VertexData[UniqueList[i] * NumInts],Stride);
+        }
+    }
+    Mesh->NumVertices = NumOutputVertices;
+    Mesh->NumIndices = NumKept * 3;
+    
+    FileOrderIndexList = malloc(NumTriangles * 3 * sizeof(unsigned int));
+    NumTransformedFileOrder = 0;
+    FetchedBytesFileOrder = 0;
+    if( FileOrderIndexList ) {
+        for( i = 0; i < NumTriangles * 3; i++ ) {
+            FileOrderIndexList[i] = TriangleList[i];
+        }
+        NumTransformedFileOrder = MeshOptimizerSimulateCache(FileOrderIndexList,NumTriangles * 3,Stride,&FetchedBytesFileOrder);
+    }
+    NumTransformedAfter = MeshOptimizerSimulateCache(Mesh->IndexList,Mesh->NumIndices,Stride,&FetchedBytes);
+    //NOTE(Adriano):Leaves are optimized by the streaming loader thread while models are optimized on the main one.
+    SDL_AtomicLock(&MeshOptimizerStatsLock);
+    MeshOptimizerStats.NumTransformedFileOrder += NumTransformedFileOrder;
+    MeshOptimizerStats.FetchedBytesFileOrder += FetchedBytesFileOrder;
+    MeshOptimizerStats.NumTransformedAfter += NumTransformedAfter;
+    MeshOptimizerStats.FetchedBytesAfter += FetchedBytes;
+    MeshOptimizerStats.NumTransformedBefore += NumTriangles * 3;
+    MeshOptimizerStats.FetchedBytesBefore += NumTriangles * 3 * Stride;
+    MeshOptimizerStats.NumMeshes++;
+    MeshOptimizerStats.NumInputTriangles += NumTriangles;
+    MeshOptimizerStats.NumDegenerateTriangles += NumDegenerate;
+    MeshOptimizerStats.NumDuplicateTriangles += NumDuplicate;
+    MeshOptimizerStats.NumOutputTriangles += NumKept;
+    MeshOptimizerStats.NumInputVertices += NumTriangles * 3;
+    MeshOptimizerStats.NumOutputVertices += NumOutputVertices;
+    MeshOptimizerStats.NumOrderConstraints += NumConstraints;
+    MeshOptimizerStats.VertexBufferSize += NumOutputVertices * Stride;
+    SDL_AtomicUnlock(&MeshOptimizerStatsLock);
+    Result = 1;
+Failure:
+    if( !Result ) {
+        MeshOptimizerFreeMesh(Mesh);
+    }
+    SDL_AtomicLock(&MeshOptimizerStatsLock);
+    MeshOptimizerStats.Time += SysPreciseMilliseconds() - StartTime;
+    SDL_AtomicUnlock(&MeshOptimizerStatsLock);
+    free(HashTable);
+    free(UniqueList);
+    free(TriangleList);
+    free(Removed);
+    free(KeptList);
+    free(PlaneList);
+    free(BoundsList);
+    free(ConstraintList);
+    free(Pending);
+    free(SuccessorStart);
+    free(SuccessorList);
+    free(VertexList);
+    free(AdjacencyList);
+    free(TriangleScore);
+    free(Emitted);
+    free(OrderList);
+    free(Remap);
+    free(FileOrderIndexList);
+    return Result;
+}
+
+const MeshOptimizerStats_t *MeshOptimizerGetStats()
+{
+    return &MeshOptimizerStats;
+}
+
+int MeshOptimizerInit()
+{
+    EnableMeshOptimization = ConfigGet("EnableMeshOptimization");
+    memset(&MeshOptimizerStats,0,sizeof(MeshOptimizerStats));
+    return 1;
+}
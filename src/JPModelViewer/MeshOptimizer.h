@@ -0,0 +1,92 @@
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#ifndef __MESH_OPTIMIZER_H_
+#define __MESH_OPTIMIZER_H_
+
+#include "../Common/Common.h"
+#include "../Common/Config.h"
+
+//NOTE(Adriano):Size of the post-transform cache modeled when reordering the triangles.
+#define MESH_OPTIMIZER_CACHE_SIZE               32
+//NOTE(Adriano):FIFO caches used to measure the result,they are smaller than the modeled one to
+//              match older hardware.
+#define MESH_OPTIMIZER_SIMULATED_CACHE_SIZE     16
+#define MESH_OPTIMIZER_SIMULATED_LINE_SIZE      64
+#define MESH_OPTIMIZER_SIMULATED_NUM_LINES      64
+
+typedef struct MeshOptimizerMesh_s {
+    int             *VertexData;
+    int             NumVertices;
+    unsigned int    *IndexList;
+    int             NumIndices;
+} MeshOptimizerMesh_t;
+
+typedef struct MeshOptimizerVertex_s {
+    int     FirstTriangle;
+    int     NumTriangles;
+    int     NumActiveTriangles;
+    int     CachePosition;
+    float   Score;
+} MeshOptimizerVertex_t;
+
+typedef struct MeshOptimizerPlane_s {
+    long long   Normal[3];
+    long long   Distance;
+    int         Triangle;
+} MeshOptimizerPlane_t;
+
+typedef struct MeshOptimizerBounds_s {
+    long long   Min[2];
+    long long   Max[2];
+    int         Triangle;
+} MeshOptimizerBounds_t;
+
+typedef struct MeshOptimizerConstraint_s {
+    int From;
+    int To;
+} MeshOptimizerConstraint_t;
+
+typedef struct MeshOptimizerStats_s {
+    int     NumMeshes;
+    int     NumInputTriangles;
+    int     NumDegenerateTriangles;
+    int     NumDuplicateTriangles;
+    int     NumOutputTriangles;
+    int     NumInputVertices;
+    int     NumOutputVertices;
+    int     NumOrderConstraints;
+    //NOTE(Adriano):Number of vertices that go through the vertex shader,
+    //              without an index buffer every vertex is transformed.
+    int     NumTransformedBefore;
+    int     NumTransformedFileOrder;
+    int     NumTransformedAfter;
+    int     FetchedBytesBefore;
+    int     FetchedBytesFileOrder;
+    int     FetchedBytesAfter;
+    int     VertexBufferSize;
+    double  Time;
+} MeshOptimizerStats_t;
+
+extern Config_t *EnableMeshOptimization;
+
+int                         MeshOptimizerInit();
+int                         MeshOptimizerOptimize(const int *VertexData,int NumVertices,int Stride,MeshOptimizerMesh_t *Mesh);
+void                        MeshOptimizerFreeMesh(MeshOptimizerMesh_t *Mesh);
+const MeshOptimizerStats_t  *MeshOptimizerGetStats();
+#endif//__MESH_OPTIMIZER_H_
@@ -0,0 +1,587 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#include "Occlusion.h"
+#include "../Common/ThreadPool.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+Config_t *EnableOcclusionCulling;
+
+OcclusionBuffer_t *OcclusionBuffer = NULL;
+
+typedef struct OcclusionCandidate_s {
+    float           Area;
+    int             FaceIndex;
+} OcclusionCandidate_t;
+
+static int OcclusionCompareCandidates(const void *a,const void *b)
+{
+    const OcclusionCandidate_t *CandidateA;
+    const OcclusionCandidate_t *CandidateB;
+    
+    CandidateA = (const OcclusionCandidate_t *) a;
+    CandidateB = (const OcclusionCandidate_t *) b;
+    if( CandidateA->Area < CandidateB->Area ) {
+        return 1;
+    }
+    if( CandidateA->Area > CandidateB->Area ) {
+        return -1;
+    }
+    return 0;
+}
+
+static float OcclusionGetFaceArea(TSP_t *TSP,TSPRenderingFaceData_t *FaceData)
+{
+    vec3 V0;
+    vec3 V1;
+    vec3 V2;
+    vec3 Edge0;
+    vec3 Edge1;
+    vec3 Normal;
+    
+    TSPVec3ToGLMVec3(TSP->Vertex[FaceData->Vert[0]].Position,V0);
+    TSPVec3ToGLMVec3(TSP->Vertex[FaceData->Vert[1]].Position,V1);
+    TSPVec3ToGLMVec3(TSP->Vertex[FaceData->Vert[2]].Position,V2);
+    glm_vec3_sub(V1,V0,Edge0);
+    glm_vec3_sub(V2,V0,Edge1);
+    glm_vec3_cross(Edge0,Edge1,Normal);
+    return glm_vec3_norm(Normal) * 0.5f;
+}
+
+static void OcclusionStoreOccluderVertex(float *OccluderList,int *Pointer,TSPVert_t Vertex)
+{
+    OccluderList[*Pointer] = Vertex.Position.x;
+    OccluderList[*Pointer + 1] = Vertex.Position.y;
+    OccluderList[*Pointer + 2] = Vertex.Position.z;
+    *Pointer += 3;
+}
+
+/*
+ * Picks the largest opaque faces of the TSP tree and stores them as the occluder set.
+ * Transparent faces are never used since they don't hide what lies behind them.
+ */
+void OcclusionSelectOccluders(TSP_t *TSP)
+{
+    OcclusionCandidate_t *CandidateList;
+    TSPRenderingFaceData_t *FaceData;
+    int NumCandidates;
+    int Pointer;
+    int i;
+    
+    if( !TSP ) {
+        DPrintf("OcclusionSelectOccluders:Invalid TSP\n");
+        return;
+    }
+    
+    if( TSP->OccluderList ) {
+        free(TSP->OccluderList);
+        TSP->OccluderList = NULL;
+    }
+    TSP->NumOccluders = 0;
+    
+    NumCandidates = TSP->NumOpaqueRenderingFaces;
+    if( !NumCandidates ) {
+        return;
+    }
+    CandidateList = malloc(NumCandidates * sizeof(OcclusionCandidate_t));
+    if( !CandidateList ) {
+        DPrintf("OcclusionSelectOccluders:Failed to allocate memory for candidate list\n");
+        return;
+    }
+    //NOTE(Adriano):Opaque faces are stored at the start of the rendering face array.
+    for( i = 0; i < NumCandidates; i++ ) {
+        CandidateList[i].FaceIndex = i;
+        CandidateList[i].Area = OcclusionGetFaceArea(TSP,&TSP->RenderingFaceDataList[i]);
+    }
+    qsort(CandidateList,NumCandidates,sizeof(OcclusionCandidate_t),OcclusionCompareCandidates);
+    
+    if( NumCandidates > OCCLUSION_MAX_OCCLUDERS_PER_TSP ) {
+        NumCandidates = OCCLUSION_MAX_OCCLUDERS_PER_TSP;
+    }
+    TSP->OccluderList = malloc(NumCandidates * 9 * sizeof(float));
+    if( !TSP->OccluderList ) {
+        DPrintf("OcclusionSelectOccluders:Failed to allocate memory for occluder list\n");
+        free(CandidateList);
+        return;
+    }
+    Pointer = 0;
+    for( i = 0; i < NumCandidates; i++ ) {
+        if( CandidateList[i].Area <= 0.f ) {
+            break;
+        }
+        FaceData = &TSP->RenderingFaceDataList[CandidateList[i].FaceIndex];
+        OcclusionStoreOccluderVertex(TSP->OccluderList,&Pointer,TSP->Vertex[FaceData->Vert[0]]);
+        OcclusionStoreOccluderVertex(TSP->OccluderList,&Pointer,TSP->Vertex[FaceData->Vert[1]]);
+        OcclusionStoreOccluderVertex(TSP->OccluderList,&Pointer,TSP->Vertex[FaceData->Vert[2]]);
+        TSP->NumOccluders++;
+    }
+    DPrintf("OcclusionSelectOccluders:Selected %i occluders out of %i opaque faces\n",TSP->NumOccluders,
+            NumCandidates);
+    free(CandidateList);
+}
+
+static bool OcclusionSetupTriangle(OcclusionScreenTriangle_t *Triangle,float *Vertex,mat4 MVPMatrix)
+{
+    vec4 Position;
+    vec4 ClipPosition;
+    float Temp;
+    float Area;
+    int i;
+    
+    for( i = 0; i < 3; i++ ) {
+        glm_vec4_copy((vec4){Vertex[i * 3],Vertex[i * 3 + 1],Vertex[i * 3 + 2],1.f},Position);
+        glm_mat4_mulv(MVPMatrix,Position,ClipPosition);
+        //NOTE(Adriano):Triangles crossing the near plane are not clipped,they are simply discarded.
+        if( ClipPosition[3] < OCCLUSION_NEAR_PLANE_W ) {
+            return false;
+        }
+        Triangle->X[i] = (ClipPosition[0] / ClipPosition[3] * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH;
+        Triangle->Y[i] = (ClipPosition[1] / ClipPosition[3] * 0.5f + 0.5f) * OCCLUSION_BUFFER_HEIGHT;
+        Triangle->Z[i] = ClipPosition[2] / ClipPosition[3] * 0.5f + 0.5f;
+    }
+    Area = (Triangle->X[1] - Triangle->X[0]) * (Triangle->Y[2] - Triangle->Y[0]) - 
+            (Triangle->X[2] - Triangle->X[0]) * (Triangle->Y[1] - Triangle->Y[0]);
+    if( fabs(Area) < 1.f ) {
+        return false;
+    }
+    //NOTE(Adriano):Occluders are drawn double sided,make the winding consistent so that edge functions are positive inside.
+    if( Area < 0.f ) {
+        Temp = Triangle->X[1]; Triangle->X[1] = Triangle->X[2]; Triangle->X[2] = Temp;
+        Temp = Triangle->Y[1]; Triangle->Y[1] = Triangle->Y[2]; Triangle->Y[2] = Temp;
+        Temp = Triangle->Z[1]; Triangle->Z[1] = Triangle->Z[2]; Triangle->Z[2] = Temp;
+    }
+    Triangle->MinX = (int) floorf(fminf(Triangle->X[0],fminf(Triangle->X[1],Triangle->X[2])));
+    Triangle->MaxX = (int) ceilf(fmaxf(Triangle->X[0],fmaxf(Triangle->X[1],Triangle->X[2])));
+    Triangle->MinY = (int) floorf(fminf(Triangle->Y[0],fminf(Triangle->Y[1],Triangle->Y[2])));
+    Triangle->MaxY = (int) ceilf(fmaxf(Triangle->Y[0],fmaxf(Triangle->Y[1],Triangle->Y[2])));
+    if( Triangle->MaxX < 0 || Triangle->MinX >= OCCLUSION_BUFFER_WIDTH ||
+        Triangle->MaxY < 0 || Triangle->MinY >= OCCLUSION_BUFFER_HEIGHT ) {
+        return false;
+    }
+    if( Triangle->MinX < 0 ) {
+        Triangle->MinX = 0;
+    }
+    if( Triangle->MinY < 0 ) {
+        Triangle->MinY = 0;
+    }
+    if( Triangle->MaxX > OCCLUSION_BUFFER_WIDTH - 1 ) {
+        Triangle->MaxX = OCCLUSION_BUFFER_WIDTH - 1;
+    }
+    if( Triangle->MaxY > OCCLUSION_BUFFER_HEIGHT - 1 ) {
+        Triangle->MaxY = OCCLUSION_BUFFER_HEIGHT - 1;
+    }
+    return true;
+}
+
+/*
+ * Rasterizes the rows [StartY,EndY] of a single triangle into the depth buffer keeping the nearest depth.
+ * Edge functions are evaluated at pixel centers, 4 pixels at a time when SSE2 is available.
+ * Rasterization is conservative: the triangle is shrunk by half a texel so that only the pixels it covers
+ * entirely are written,using the farthest depth the triangle reaches inside each of them.
+ */
+static void OcclusionRasterizeTriangle(OcclusionScreenTriangle_t *Triangle,float *DepthBuffer,int StartY,int EndY)
+{
+    float EdgeA[3];
+    float EdgeB[3];
+    float EdgeC[3];
+    float Area;
+    float DepthDX;
+    float DepthDY;
+    float DepthBias;
+    float PixelY;
+    float RowEdge[3];
+    float RowDepth;
+    float *Row;
+    int StartX;
+    int x;
+    int y;
+    int i;
+    int Next;
+#if defined(__SSE2__)
+    __m128 PixelX;
+    __m128 Edge0;
+    __m128 Edge1;
+    __m128 Edge2;
+    __m128 Depth;
+    __m128 Mask;
+    __m128 Zero;
+    __m128 Old;
+#else
+    float PixelXScalar;
+    float Depth;
+#endif
+
+    for( i = 0; i < 3; i++ ) {
+        Next = (i + 1) % 3;
+        EdgeA[i] = Triangle->Y[i] - Triangle->Y[Next];
+        EdgeB[i] = Triangle->X[Next] - Triangle->X[i];
+        EdgeC[i] = (Triangle->Y[Next] - Triangle->Y[i]) * Triangle->X[i] - (Triangle->X[Next] - Triangle->X[i]) * Triangle->Y[i];
+        //NOTE(Adriano):Largest change of the edge function between the center and a corner of the pixel,
+        //              subtracting it moves the edge half a texel inwards.
+        EdgeC[i] -= 0.5f * (fabsf(EdgeA[i]) + fabsf(EdgeB[i]));
+    }
+    Area = (Triangle->X[1] - Triangle->X[0]) * (Triangle->Y[2] - Triangle->Y[0]) - 
+            (Triangle->X[2] - Triangle->X[0]) * (Triangle->Y[1] - Triangle->Y[0]);
+    DepthDX = ((Triangle->Z[1] - Triangle->Z[0]) * (Triangle->Y[2] - Triangle->Y[0]) - 
+                (Triangle->Z[2] - Triangle->Z[0]) * (Triangle->Y[1] - Triangle->Y[0])) / Area;
+    DepthDY = ((Triangle->Z[2] - Triangle->Z[0]) * (Triangle->X[1] - Triangle->X[0]) - 
+                (Triangle->Z[1] - Triangle->Z[0]) * (Triangle->X[2] - Triangle->X[0])) / Area;
+    DepthBias = 0.5f * (fabsf(DepthDX) + fabsf(DepthDY));
+    //NOTE(Adriano):Start on a 4 pixel boundary so that the SIMD path never crosses the end of the row.
+    StartX = Triangle->MinX & ~3;
+    
+    for( y = StartY; y <= EndY; y++ ) {
+        PixelY = y + 0.5f;
+        for( i = 0; i < 3; i++ ) {
+            RowEdge[i] = EdgeB[i] * PixelY + EdgeC[i];
+        }
+        RowDepth = Triangle->Z[0] - DepthDX * Triangle->X[0] + DepthDY * (PixelY - Triangle->Y[0]) + DepthBias;
+        Row = &DepthBuffer[y * OCCLUSION_BUFFER_WIDTH];
+#if defined(__SSE2__)
+        Zero = _mm_setzero_ps();
+        for( x = StartX; x <= Triangle->MaxX; x += 4 ) {
+            PixelX = _mm_set_ps(x + 3.5f,x + 2.5f,x + 1.5f,x + 0.5f);
+            Edge0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(EdgeA[0]),PixelX),_mm_set1_ps(RowEdge[0]));
+            Edge1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(EdgeA[1]),PixelX),_mm_set1_ps(RowEdge[1]));
+            Edge2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(EdgeA[2]),PixelX),_mm_set1_ps(RowEdge[2]));
+            Mask = _mm_and_ps(_mm_cmpge_ps(Edge0,Zero),_mm_and_ps(_mm_cmpge_ps(Edge1,Zero),_mm_cmpge_ps(Edge2,Zero)));
+            if( !_mm_movemask_ps(Mask) ) {
+                continue;
+            }
+            Depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(DepthDX),PixelX),_mm_set1_ps(RowDepth));
+            Old = _mm_loadu_ps(&Row[x]);
+            Depth = _mm_min_ps(Old,Depth);
+            _mm_storeu_ps(&Row[x],_mm_or_ps(_mm_and_ps(Mask,Depth),_mm_andnot_ps(Mask,Old)));
+        }
+#else
+        for( x = StartX; x <= Triangle->MaxX; x++ ) {
+            PixelXScalar = x + 0.5f;
+            if( EdgeA[0] * PixelXScalar + RowEdge[0] < 0.f ||
+                EdgeA[1] * PixelXScalar + RowEdge[1] < 0.f ||
+                EdgeA[2] * PixelXScalar + RowEdge[2] < 0.f ) {
+                continue;
+            }
+            Depth = DepthDX * PixelXScalar + RowDepth;
+            if( Depth < Row[x] ) {
+                Row[x] = Depth;
+            }
+        }
+#endif
+    }
+}
+
+/*
+ * Thread pool task: each task owns a horizontal band of the depth buffer so that no locking is required.
+ */
+static void OcclusionRasterizeBand(void *UserData,int TaskIndex)
+{
+    OcclusionBuffer_t *Buffer;
+    OcclusionScreenTriangle_t *Triangle;
+    float *DepthBuffer;
+    int StartY;
+    int EndY;
+    int i;
+    int y;
+    
+    Buffer = (OcclusionBuffer_t *) UserData;
+    DepthBuffer = Buffer->Level[0].MaxDepth;
+    StartY = TaskIndex * OCCLUSION_TILE_HEIGHT;
+    EndY = StartY + OCCLUSION_TILE_HEIGHT - 1;
+    
+    for( y = StartY; y <= EndY; y++ ) {
+        for( i = 0; i < OCCLUSION_BUFFER_WIDTH; i++ ) {
+            DepthBuffer[y * OCCLUSION_BUFFER_WIDTH + i] = 1.f;
+        }
+    }
+    for( i = 0; i < Buffer->NumTriangles; i++ ) {
+        Triangle = &Buffer->TriangleList[i];
+        if( Triangle->MaxY < StartY || Triangle->MinY > EndY ) {
+            continue;
+        }
+        OcclusionRasterizeTriangle(Triangle,DepthBuffer,Triangle->MinY > StartY ? Triangle->MinY : StartY,
+                                   Triangle->MaxY < EndY ? Triangle->MaxY : EndY);
+    }
+}
+
+static void OcclusionBuildPyramid(OcclusionBuffer_t *Buffer)
+{
+    OcclusionPyramidLevel_t *Source;
+    OcclusionPyramidLevel_t *Destination;
+    int SourceIndex;
+    int Level;
+    int x;
+    int y;
+    
+    for( Level = 1; Level < Buffer->NumLevels; Level++ ) {
+        Source = &Buffer->Level[Level - 1];
+        Destination = &Buffer->Level[Level];
+        for( y = 0; y < Destination->Height; y++ ) {
+            for( x = 0; x < Destination->Width; x++ ) {
+                SourceIndex = (y * 2) * Source->Width + (x * 2);
+                Destination->MinDepth[y * Destination->Width + x] = 
+                    fminf(fminf(Source->MinDepth[SourceIndex],Source->MinDepth[SourceIndex + 1]),
+                          fminf(Source->MinDepth[SourceIndex + Source->Width],Source->MinDepth[SourceIndex + Source->Width + 1]));
+                Destination->MaxDepth[y * Destination->Width + x] = 
+                    fmaxf(fmaxf(Source->MaxDepth[SourceIndex],Source->MaxDepth[SourceIndex + 1]),
+                          fmaxf(Source->MaxDepth[SourceIndex + Source->Width],Source->MaxDepth[SourceIndex + Source->Width + 1]));
+            }
+        }
+    }
+}
+
+/*
+ * Fills the occlusion buffer using the occluders of every TSP in the list and rebuilds the min/max depth pyramid.
+ * Must be called once per frame before any call to OcclusionIsBoxVisible.
+ */
+void OcclusionBeginFrame(TSP_t *TSPList,mat4 MVPMatrix)
+{
+    TSP_t *Iterator;
+    OcclusionScreenTriangle_t *TriangleList;
+    double StartTime;
+    int NumTriangles;
+    int i;
+    
+    if( !OcclusionBuffer ) {
+        return;
+    }
+    OcclusionBuffer->Valid = false;
+    OcclusionBuffer->Stats.NumOccluders = 0;
+    OcclusionBuffer->Stats.NumNodesTested = 0;
+    OcclusionBuffer->Stats.NumNodesOccluded = 0;
+    OcclusionBuffer->Stats.RasterizationTime = 0.;
+    OcclusionBuffer->Stats.TestTime = 0.;
+
+    if( !EnableOcclusionCulling->IValue ) {
+        return;
+    }
+    StartTime = SysPreciseMilliseconds();
+    NumTriangles = 0;
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        NumTriangles += Iterator->NumOccluders;
+    }
+    if( NumTriangles > OcclusionBuffer->MaxTriangles ) {
+        TriangleList = realloc(OcclusionBuffer->TriangleList,NumTriangles * sizeof(OcclusionScreenTriangle_t));
+        if( !TriangleList ) {
+            DPrintf("OcclusionBeginFrame:Failed to grow triangle list to %i elements\n",NumTriangles);
+            return;
+        }
+        OcclusionBuffer->TriangleList = TriangleList;
+        OcclusionBuffer->MaxTriangles = NumTriangles;
+    }
+    OcclusionBuffer->NumTriangles = 0;
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        for( i = 0; i < Iterator->NumOccluders; i++ ) {
+            if( OcclusionSetupTriangle(&OcclusionBuffer->TriangleList[OcclusionBuffer->NumTriangles],
+                &Iterator->OccluderList[i * 9],MVPMatrix) ) {
+                OcclusionBuffer->NumTriangles++;
+            }
+        }
+    }
+    ThreadPoolParallelFor(OCCLUSION_BUFFER_HEIGHT / OCCLUSION_TILE_HEIGHT,OcclusionRasterizeBand,OcclusionBuffer);
+    OcclusionBuildPyramid(OcclusionBuffer);
+    OcclusionBuffer->Stats.NumOccluders = OcclusionBuffer->NumTriangles;
+    OcclusionBuffer->Stats.RasterizationTime = SysPreciseMilliseconds() - StartTime;
+    OcclusionBuffer->Valid = true;
+}
+
+static void OcclusionGetRegionDepth(OcclusionPyramidLevel_t *Level,int MinX,int MinY,int MaxX,int MaxY,float *OutMin,float *OutMax)
+{
+    float RegionMin;
+    float RegionMax;
+    int x;
+    int y;
+    
+    RegionMin = 1.f;
+    RegionMax = 0.f;
+    for( y = MinY; y <= MaxY; y++ ) {
+        for( x = MinX; x <= MaxX; x++ ) {
+            RegionMin = fminf(RegionMin,Level->MinDepth[y * Level->Width + x]);
+            RegionMax = fmaxf(RegionMax,Level->MaxDepth[y * Level->Width + x]);
+        }
+    }
+    *OutMin = RegionMin;
+    *OutMax = RegionMax;
+}
+
+/*
+ * Returns false only when the box is fully hidden behind the occluders rasterized in the current frame.
+ * The test starts at the pyramid level where the box covers at most 2x2 texels and refines towards
+ * the finer levels only while the result is ambiguous.
+ */
+bool OcclusionIsBoxVisible(TSPBBox_t BBox,mat4 MVPMatrix)
+{
+    vec4 Corner;
+    vec4 ClipPosition;
+    float ScreenMinX;
+    float ScreenMinY;
+    float ScreenMaxX;
+    float ScreenMaxY;
+    float BoxMinZ;
+    float ScreenX;
+    float ScreenY;
+    float RegionMin;
+    float RegionMax;
+    double StartTime;
+    bool Result;
+    int MinX;
+    int MinY;
+    int MaxX;
+    int MaxY;
+    int Level;
+    int Refinement;
+    int i;
+    
+    if( !OcclusionBuffer || !OcclusionBuffer->Valid ) {
+        return true;
+    }
+    StartTime = SysPreciseMilliseconds();
+    OcclusionBuffer->Stats.NumNodesTested++;
+    Result = true;
+    
+    ScreenMinX = ScreenMinY = BoxMinZ = 1e30f;
+    ScreenMaxX = ScreenMaxY = -1e30f;
+    for( i = 0; i < 8; i++ ) {
+        Corner[0] = (i & 1) ? BBox.Max.x : BBox.Min.x;
+        Corner[1] = (i & 2) ? BBox.Max.y : BBox.Min.y;
+        Corner[2] = (i & 4) ? BBox.Max.z : BBox.Min.z;
+        Corner[3] = 1.f;
+        glm_mat4_mulv(MVPMatrix,Corner,ClipPosition);
+        if( ClipPosition[3] < OCCLUSION_NEAR_PLANE_W ) {
+            goto End;
+        }
+        ScreenX = (ClipPosition[0] / ClipPosition[3] * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH;
+        ScreenY = (ClipPosition[1] / ClipPosition[3] * 0.5f + 0.5f) * OCCLUSION_BUFFER_HEIGHT;
+        ScreenMinX = fminf(ScreenMinX,ScreenX);
+        ScreenMaxX = fmaxf(ScreenMaxX,ScreenX);
+        ScreenMinY = fminf(ScreenMinY,ScreenY);
+        ScreenMaxY = fmaxf(ScreenMaxY,ScreenY);
+        BoxMinZ = fminf(BoxMinZ,ClipPosition[2] / ClipPosition[3] * 0.5f + 0.5f);
+    }
+    //NOTE(Adriano):Boxes outside the screen are left to the frustum test.
+    if( ScreenMaxX < 0.f || ScreenMinX >= OCCLUSION_BUFFER_WIDTH || ScreenMaxY < 0.f || ScreenMinY >= OCCLUSION_BUFFER_HEIGHT ) {
+        goto End;
+    }
+    //NOTE(Adriano):Every pixel touched by the projected box must be tested,round outwards.
+    MinX = ScreenMinX < 0.f ? 0 : (int) floorf(ScreenMinX);
+    MinY = ScreenMinY < 0.f ? 0 : (int) floorf(ScreenMinY);
+    MaxX = ScreenMaxX > OCCLUSION_BUFFER_WIDTH - 1 ? OCCLUSION_BUFFER_WIDTH - 1 : (int) ceilf(ScreenMaxX);
+    MaxY = ScreenMaxY > OCCLUSION_BUFFER_HEIGHT - 1 ? OCCLUSION_BUFFER_HEIGHT - 1 : (int) ceilf(ScreenMaxY);
+    
+    Level = 0;
+    while( Level < OcclusionBuffer->NumLevels - 1 && ((MaxX >> Level) - (MinX >> Level) > 1 || (MaxY >> Level) - (MinY >> Level) > 1) ) {
+        Level++;
+    }
+    for( Refinement = 0; Refinement <= OCCLUSION_MAX_REFINEMENT_LEVELS && Level >= 0; Refinement++, Level-- ) {
+        OcclusionGetRegionDepth(&OcclusionBuffer->Level[Level],MinX >> Level,MinY >> Level,MaxX >> Level,MaxY >> Level,
+                                &RegionMin,&RegionMax);
+        if( BoxMinZ > RegionMax ) {
+            Result = false;
+            break;
+        }
+        //NOTE(Adriano):Box is in front of every occluder in the region,finer levels cannot change the result.
+        if( BoxMinZ <= RegionMin ) {
+            break;
+        }
+    }
+End:
+    if( !Result ) {
+        OcclusionBuffer->Stats.NumNodesOccluded++;
+    }
+    OcclusionBuffer->Stats.TestTime += SysPreciseMilliseconds() - StartTime;
+    return Result;
+}
+
+const OcclusionStats_t *OcclusionGetStats()
+{
+    if( !OcclusionBuffer ) {
+        return NULL;
+    }
+    return &OcclusionBuffer->Stats;
+}
+
+void OcclusionShutdown()
+{
+    int i;
+    
+    if( !OcclusionBuffer ) {
+        return;
+    }
+    //NOTE(Adriano):Level 0 shares the same buffer for min and max depth.
+    for( i = 0; i < OcclusionBuffer->NumLevels; i++ ) {
+        if( OcclusionBuffer->Level[i].MaxDepth ) {
+            free(OcclusionBuffer->Level[i].MaxDepth);
+        }
+        if( i != 0 && OcclusionBuffer->Level[i].MinDepth ) {
+            free(OcclusionBuffer->Level[i].MinDepth);
+        }
+    }
+    if( OcclusionBuffer->TriangleList ) {
+        free(OcclusionBuffer->TriangleList);
+    }
+    free(OcclusionBuffer);
+    OcclusionBuffer = NULL;
+}
+
+int OcclusionInit()
+{
+    int Width;
+    int Height;
+    int i;
+    
+    EnableOcclusionCulling = ConfigGet("EnableOcclusionCulling");
+    
+    OcclusionBuffer = malloc(sizeof(OcclusionBuffer_t));
+    if( !OcclusionBuffer ) {
+        DPrintf("OcclusionInit:Failed to allocate memory for occlusion buffer\n");
+        return 0;
+    }
+    OcclusionBuffer->TriangleList = NULL;
+    OcclusionBuffer->NumTriangles = 0;
+    OcclusionBuffer->MaxTriangles = 0;
+    OcclusionBuffer->Valid = false;
+    memset(&OcclusionBuffer->Stats,0,sizeof(OcclusionBuffer->Stats));
+    memset(OcclusionBuffer->Level,0,sizeof(OcclusionBuffer->Level));
+    OcclusionBuffer->NumLevels = 0;
+    
+    Width = OCCLUSION_BUFFER_WIDTH;
+    Height = OCCLUSION_BUFFER_HEIGHT;
+    for( i = 0; i < OCCLUSION_MAX_PYRAMID_LEVELS && Width >= 1 && Height >= 1; i++ ) {
+        OcclusionBuffer->Level[i].Width = Width;
+        OcclusionBuffer->Level[i].Height = Height;
+        OcclusionBuffer->Level[i].MaxDepth = malloc(Width * Height * sizeof(float));
+        if( i == 0 ) {
+            OcclusionBuffer->Level[i].MinDepth = OcclusionBuffer->Level[i].MaxDepth;
+        } else {
+            OcclusionBuffer->Level[i].MinDepth = malloc(Width * Height * sizeof(float));
+        }
+        OcclusionBuffer->NumLevels++;
+        if( !OcclusionBuffer->Level[i].MaxDepth || !OcclusionBuffer->Level[i].MinDepth ) {
+            DPrintf("OcclusionInit:Failed to allocate memory for pyramid level %i\n",i);
+            OcclusionShutdown();
+            return 0;
+        }
+        Width /= 2;
+        Height /= 2;
+    }
+    return 1;
+}
@@ -0,0 +1,78 @@
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#ifndef __OCCLUSION_H_
+#define __OCCLUSION_H_
+
+#include "../Common/Common.h"
+#include "../Common/Config.h"
+#include "TSP.h"
+
+#define OCCLUSION_BUFFER_WIDTH              256
+#define OCCLUSION_BUFFER_HEIGHT             128
+#define OCCLUSION_TILE_HEIGHT               16
+#define OCCLUSION_MAX_PYRAMID_LEVELS        8
+#define OCCLUSION_MAX_OCCLUDERS_PER_TSP     2048
+#define OCCLUSION_MAX_REFINEMENT_LEVELS     2
+//NOTE(Adriano):Clip space W is the view space distance, anything closer than the near plane is treated as visible.
+#define OCCLUSION_NEAR_PLANE_W              1.f
+
+typedef struct OcclusionScreenTriangle_s {
+    float   X[3];
+    float   Y[3];
+    float   Z[3];
+    int     MinX;
+    int     MaxX;
+    int     MinY;
+    int     MaxY;
+} OcclusionScreenTriangle_t;
+
+typedef struct OcclusionPyramidLevel_s {
+    int     Width;
+    int     Height;
+    float   *MinDepth;
+    float   *MaxDepth;
+} OcclusionPyramidLevel_t;
+
+typedef struct OcclusionStats_s {
+    int     NumOccluders;
+    int     NumNodesTested;
+    int     NumNodesOccluded;
+    double  RasterizationTime;
+    double  TestTime;
+} OcclusionStats_t;
+
+typedef struct OcclusionBuffer_s {
+    OcclusionPyramidLevel_t     Level[OCCLUSION_MAX_PYRAMID_LEVELS];
+    int                         NumLevels;
+    OcclusionScreenTriangle_t   *TriangleList;
+    int                         NumTriangles;
+    int                         MaxTriangles;
+    bool                        Valid;
+    OcclusionStats_t            Stats;
+} OcclusionBuffer_t;
+
+extern Config_t *EnableOcclusionCulling;
+
+int                     OcclusionInit();
+void                    OcclusionSelectOccluders(TSP_t *TSP);
+void                    OcclusionBeginFrame(TSP_t *TSPList,mat4 MVPMatrix);
+bool                    OcclusionIsBoxVisible(TSPBBox_t BBox,mat4 MVPMatrix);
+const OcclusionStats_t  *OcclusionGetStats();
+void                    OcclusionShutdown();
+#endif//__OCCLUSION_H_
@@ -0,0 +1,752 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#include "PVS.h"
+#include "../Common/ThreadPool.h"
+
+Config_t *EnablePVS = NULL;
+
+//NOTE(Adriano):Shared by all the TSP files,it is overwritten by every call to PVSUpdate so it only
+//              shows the last TSP that was updated during the frame.
+PVSStats_t PVSStats;
+
+typedef struct PVSBuildContext_s {
+    TSP_t   *TSP;
+    vec3    *SampleList;
+    vec3    *BoundMinList;
+    vec3    *BoundMaxList;
+} PVSBuildContext_t;
+
+/*
+ * FNV-1a hash of the data that affects visibility (tree layout,faces and vertices).
+ * Used to find the sidecar file that belongs to a level.
+ */
+static unsigned int PVSComputeLevelHash(TSP_t *TSP)
+{
+    unsigned int Hash;
+    int i;
+    int j;
+    
+    Hash = HASH_FNV1A_INITIAL_VALUE;
+    Hash = HashFNV1a(Hash,&TSP->Header.NumNodes,sizeof(TSP->Header.NumNodes));
+    Hash = HashFNV1a(Hash,&TSP->Header.NumVertices,sizeof(TSP->Header.NumVertices));
+    for( i = 0; i < TSP->Header.NumNodes; i++ ) {
+        Hash = HashFNV1a(Hash,&TSP->Node[i].BBox,sizeof(TSP->Node[i].BBox));
+        Hash = HashFNV1a(Hash,&TSP->Node[i].NumFaces,sizeof(TSP->Node[i].NumFaces));
+        if( !TSP->Node[i].FaceList ) {
+            continue;
+        }
+        for( j = 0; j < TSP->Node[i].NumFaces; j++ ) {
+            Hash = HashFNV1a(Hash,&TSP->Node[i].FaceList[j].V0,sizeof(TSP->Node[i].FaceList[j].V0));
+            Hash = HashFNV1a(Hash,&TSP->Node[i].FaceList[j].V1,sizeof(TSP->Node[i].FaceList[j].V1));
+            Hash = HashFNV1a(Hash,&TSP->Node[i].FaceList[j].V2,sizeof(TSP->Node[i].FaceList[j].V2));
+        }
+    }
+    for( i = 0; i < TSP->Header.NumVertices; i++ ) {
+        Hash = HashFNV1a(Hash,&TSP->Vertex[i].Position,sizeof(TSP->Vertex[i].Position));
+    }
+    return Hash;
+}
+
+static char *PVSGetFilePath(unsigned int Hash)
+{
+    char *ConfigPath;
+    char *Directory;
+    char *Path;
+    
+    ConfigPath = AppGetConfigPath();
+    asprintf(&Directory,"%sPVS",ConfigPath);
+    CreateDirIfNotExists(Directory);
+    asprintf(&Path,"%s/%08X.pvs",Directory,Hash);
+    free(Directory);
+    free(ConfigPath);
+    return Path;
+}
+
+static void PVSGetLeafBounds(TSPNode_t *Leaf,vec3 Min,vec3 Max)
+{
+    Min[0] = Leaf->BBox.Min.x;
+    Min[1] = Leaf->BBox.Min.y - PVS_LEAF_VERTICAL_MARGIN;
+    Min[2] = Leaf->BBox.Min.z;
+    Max[0] = Leaf->BBox.Max.x;
+    Max[1] = Leaf->BBox.Max.y + PVS_LEAF_VERTICAL_MARGIN;
+    Max[2] = Leaf->BBox.Max.z;
+}
+
+static float PVSGetPointBoxDistance(vec3 Point,vec3 Min,vec3 Max)
+{
+    vec3 Delta;
+    int i;
+    
+    for( i = 0; i < 3; i++ ) {
+        Delta[i] = fmaxf(fmaxf(Min[i] - Point[i],0.f),Point[i] - Max[i]);
+    }
+    return glm_vec3_norm(Delta);
+}
+
+static float PVSGetBoxBoxDistance(vec3 MinA,vec3 MaxA,vec3 MinB,vec3 MaxB)
+{
+    vec3 Delta;
+    int i;
+    
+    for( i = 0; i < 3; i++ ) {
+        Delta[i] = fmaxf(fmaxf(MinA[i] - MaxB[i],0.f),MinB[i] - MaxA[i]);
+    }
+    return glm_vec3_norm(Delta);
+}
+
+/*
+ * Assigns a sequential index to every leaf of the tree and stores them inside the PVS leaf list.
+ */
+static int PVSCollectLeaves(TSP_t *TSP,PVS_t *PVS)
+{
+    int i;
+    
+    PVS->NumLeaves = 0;
+    for( i = 0; i < TSP->Header.NumNodes; i++ ) {
+        TSP->Node[i].PVSVisible = true;
+        if( TSP->Node[i].NumFaces != 0 ) {
+            PVS->NumLeaves++;
+        }
+    }
+    PVS->RowSize = (PVS->NumLeaves + 7) / 8;
+    PVS->LeafList = malloc(PVS->NumLeaves * sizeof(TSPNode_t *));
+    if( !PVS->LeafList ) {
+        DPrintf("PVSCollectLeaves:Failed to allocate memory for leaf list\n");
+        return 0;
+    }
+    PVS->NumLeaves = 0;
+    for( i = 0; i < TSP->Header.NumNodes; i++ ) {
+        if( TSP->Node[i].NumFaces != 0 ) {
+            TSP->Node[i].LeafIndex = PVS->NumLeaves;
+            PVS->LeafList[PVS->NumLeaves] = &TSP->Node[i];
+            PVS->NumLeaves++;
+        } else {
+            TSP->Node[i].LeafIndex = -1;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Zero bytes are stored as a zero followed by the length of the run,every other byte is stored as is.
+ */
+static int PVSCompressRow(const Byte *Row,int RowSize,Byte *Out)
+{
+    int OutSize;
+    int Run;
+    int i;
+    
+    OutSize = 0;
+    for( i = 0; i < RowSize; i++ ) {
+        if( Row[i] ) {
+            Out[OutSize++] = Row[i];
+            continue;
+        }
+        Run = 1;
+        while( i + Run < RowSize && !Row[i + Run] && Run < 255 ) {
+            Run++;
+        }
+        Out[OutSize++] = 0;
+        Out[OutSize++] = Run;
+        i += Run - 1;
+    }
+    return OutSize;
+}
+
+static int PVSDecompressRow(const Byte *In,int InSize,Byte *Row,int RowSize)
+{
+    int OutSize;
+    int Run;
+    int i;
+    
+    OutSize = 0;
+    for( i = 0; i < InSize; i++ ) {
+        if( In[i] ) {
+            if( OutSize >= RowSize ) {
+                return 0;
+            }
+            Row[OutSize++] = In[i];
+            continue;
+        }
+        if( i + 1 >= InSize ) {
+            return 0;
+        }
+        Run = In[++i];
+        if( OutSize + Run > RowSize ) {
+            return 0;
+        }
+        memset(&Row[OutSize],0,Run);
+        OutSize += Run;
+    }
+    return OutSize == RowSize;
+}
+
+static int PVSReadFile(PVS_t *PVS,const char *Path)
+{
+    FILE *PVSFile;
+    Byte *CompressedRow;
+    int Magic;
+    int Version;
+    unsigned int Hash;
+    int NumLeaves;
+    int CompressedSize;
+    int i;
+    
+    PVSFile = fopen(Path,"rb");
+    if( !PVSFile ) {
+        return 0;
+    }
+    CompressedRow = NULL;
+    if( fread(&Magic,sizeof(Magic),1,PVSFile) != 1 || Magic != PVS_FILE_MAGIC ) {
+        DPrintf("PVSReadFile:%s is not a valid PVS file\n",Path);
+        goto Failure;
+    }
+    if( fread(&Version,sizeof(Version),1,PVSFile) != 1 || Version != PVS_FILE_VERSION ) {
+        DPrintf("PVSReadFile:%s has an unsupported version\n",Path);
+        goto Failure;
+    }
+    if( fread(&Hash,sizeof(Hash),1,PVSFile) != 1 || fread(&NumLeaves,sizeof(NumLeaves),1,PVSFile) != 1 ) {
+        DPrintf("PVSReadFile:Truncated header in %s\n",Path);
+        goto Failure;
+    }
+    if( Hash != PVS->Hash || NumLeaves != PVS->NumLeaves ) {
+        DPrintf("PVSReadFile:%s doesn't match the current level\n",Path);
+        goto Failure;
+    }
+    //NOTE(Adriano):Worst case is a row made of isolated zero bytes.
+    CompressedRow = malloc(PVS->RowSize * 2 + 1);
+    PVS->VisibilityList = malloc(PVS->NumLeaves * PVS->RowSize + 1);
+    if( !CompressedRow || !PVS->VisibilityList ) {
+        DPrintf("PVSReadFile:Failed to allocate memory for visibility data\n");
+        goto Failure;
+    }
+    for( i = 0; i < PVS->NumLeaves; i++ ) {
+        if( fread(&CompressedSize,sizeof(CompressedSize),1,PVSFile) != 1 || 
+            CompressedSize < 0 || CompressedSize > PVS->RowSize * 2 + 1 ) {
+            DPrintf("PVSReadFile:Invalid row %i\n",i);
+            goto Failure;
+        }
+        if( fread(CompressedRow,CompressedSize,1,PVSFile) != 1 && CompressedSize != 0 ) {
+            DPrintf("PVSReadFile:Truncated row %i\n",i);
+            goto Failure;
+        }
+        if( !PVSDecompressRow(CompressedRow,CompressedSize,&PVS->VisibilityList[i * PVS->RowSize],PVS->RowSize) ) {
+            DPrintf("PVSReadFile:Failed to decompress row %i\n",i);
+            goto Failure;
+        }
+    }
+    free(CompressedRow);
+    fclose(PVSFile);
+    return 1;
+Failure:
+    if( CompressedRow ) {
+        free(CompressedRow);
+    }
+    if( PVS->VisibilityList ) {
+        free(PVS->VisibilityList);
+        PVS->VisibilityList = NULL;
+    }
+    fclose(PVSFile);
+    return 0;
+}
+
+static int PVSWriteFile(PVS_t *PVS,const char *Path)
+{
+    FILE *PVSFile;
+    Byte *CompressedRow;
+    int Magic;
+    int Version;
+    int CompressedSize;
+    int TotalSize;
+    int Result;
+    int i;
+    
+    PVSFile = fopen(Path,"wb");
+    if( !PVSFile ) {
+        DPrintf("PVSWriteFile:Failed to open %s for writing\n",Path);
+        return 0;
+    }
+    CompressedRow = malloc(PVS->RowSize * 2 + 1);
+    if( !CompressedRow ) {
+        DPrintf("PVSWriteFile:Failed to allocate memory for compressed row\n");
+        fclose(PVSFile);
+        return 0;
+    }
+    Magic = PVS_FILE_MAGIC;
+    Version = PVS_FILE_VERSION;
+    fwrite(&Magic,sizeof(Magic),1,PVSFile);
+    fwrite(&Version,sizeof(Version),1,PVSFile);
+    fwrite(&PVS->Hash,sizeof(PVS->Hash),1,PVSFile);
+    fwrite(&PVS->NumLeaves,sizeof(PVS->NumLeaves),1,PVSFile);
+    TotalSize = 0;
+    for( i = 0; i < PVS->NumLeaves; i++ ) {
+        CompressedSize = PVSCompressRow(&PVS->VisibilityList[i * PVS->RowSize],PVS->RowSize,CompressedRow);
+        fwrite(&CompressedSize,sizeof(CompressedSize),1,PVSFile);
+        fwrite(CompressedRow,CompressedSize,1,PVSFile);
+        TotalSize += CompressedSize;
+    }
+    free(CompressedRow);
+    Result = !ferror(PVSFile);
+    if( fclose(PVSFile) != 0 ) {
+        Result = 0;
+    }
+    if( !Result ) {
+        DPrintf("PVSWriteFile:Failed to write %s\n",Path);
+        //NOTE(Adriano):Don't leave a truncated file behind.
+        remove(Path);
+        return 0;
+    }
+    DPrintf("PVSWriteFile:Wrote %s (%i bytes of visibility data,%i uncompressed)\n",Path,TotalSize,
+            PVS->NumLeaves * PVS->RowSize);
+    return 1;
+}
+
+void PVSFree(PVS_t *PVS)
+{
+    if( !PVS ) {
+        return;
+    }
+    if( PVS->LeafList ) {
+        free(PVS->LeafList);
+    }
+    if( PVS->VisibilityList ) {
+        free(PVS->VisibilityList);
+    }
+    free(PVS);
+}
+
+/*
+ * Prepares the PVS data for the given TSP and loads the precomputed visibility if a sidecar file
+ * matching the level hash exists.
+ * Returns 0 only on allocation failures,missing visibility data is not considered an error.
+ */
+int PVSLoad(TSP_t *TSP)
+{
+    PVS_t *PVS;
+    char *Path;
+    
+    if( !TSP ) {
+        DPrintf("PVSLoad:Invalid TSP\n");
+        return 0;
+    }
+    PVS = malloc(sizeof(PVS_t));
+    if( !PVS ) {
+        DPrintf("PVSLoad:Failed to allocate memory for PVS\n");
+        return 0;
+    }
+    PVS->LeafList = NULL;
+    PVS->VisibilityList = NULL;
+    PVS->Loaded = false;
+    PVS->CurrentLeaf = -1;
+    if( !PVSCollectLeaves(TSP,PVS) ) {
+        PVSFree(PVS);
+        return 0;
+    }
+    PVS->Hash = PVSComputeLevelHash(TSP);
+    TSP->PVS = PVS;
+    
+    Path = PVSGetFilePath(PVS->Hash);
+    PVS->Loaded = PVSReadFile(PVS,Path);
+    DPrintf("PVSLoad:Level hash %08X,%i leaves,visibility data %s\n",PVS->Hash,PVS->NumLeaves,
+            PVS->Loaded ? "loaded" : "not available");
+    free(Path);
+    return 1;
+}
+
+static bool PVSRayIntersectsBox(vec3 Origin,vec3 Direction,TSPBBox_t BBox)
+{
+    float Min[3];
+    float Max[3];
+    float Near;
+    float Far;
+    float T0;
+    float T1;
+    float Temp;
+    int i;
+    
+    Min[0] = BBox.Min.x; Min[1] = BBox.Min.y; Min[2] = BBox.Min.z;
+    Max[0] = BBox.Max.x; Max[1] = BBox.Max.y; Max[2] = BBox.Max.z;
+    Near = 0.f;
+    Far = 1.f;
+    for( i = 0; i < 3; i++ ) {
+        if( fabsf(Direction[i]) < 1e-6f ) {
+            if( Origin[i] < Min[i] || Origin[i] > Max[i] ) {
+                return false;
+            }
+            continue;
+        }
+        T0 = (Min[i] - Origin[i]) / Direction[i];
+        T1 = (Max[i] - Origin[i]) / Direction[i];
+        if( T0 > T1 ) {
+            Temp = T0; T0 = T1; T1 = Temp;
+        }
+        Near = fmaxf(Near,T0);
+        Far = fminf(Far,T1);
+        if( Near > Far ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Moller-Trumbore test restricted to the open segment (0,1) so that surfaces touching the
+ * sample points don't block the ray.
+ */
+static bool PVSRayIntersectsTriangle(vec3 Origin,vec3 Direction,vec3 V0,vec3 V1,vec3 V2)
+{
+    vec3 Edge0;
+    vec3 Edge1;
+    vec3 P;
+    vec3 T;
+    vec3 Q;
+    float Determinant;
+    float InvDeterminant;
+    float U;
+    float V;
+    float Distance;
+    
+    glm_vec3_sub(V1,V0,Edge0);
+    glm_vec3_sub(V2,V0,Edge1);
+    glm_vec3_cross(Direction,Edge1,P);
+    Determinant = glm_vec3_dot(Edge0,P);
+    if( fabsf(Determinant) < 1e-6f ) {
+        return false;
+    }
+    InvDeterminant = 1.f / Determinant;
+    glm_vec3_sub(Origin,V0,T);
+    U = glm_vec3_dot(T,P) * InvDeterminant;
+    if( U < 0.f || U > 1.f ) {
+        return false;
+    }
+    glm_vec3_cross(T,Edge0,Q);
+    V = glm_vec3_dot(Direction,Q) * InvDeterminant;
+    if( V < 0.f || U + V > 1.f ) {
+        return false;
+    }
+    Distance = glm_vec3_dot(Edge1,Q) * InvDeterminant;
+    return Distance > 1e-3f && Distance < 1.f - 1e-3f;
+}
+
+static bool PVSIsSegmentBlocked(TSP_t *TSP,TSPNode_t *Node,vec3 Origin,vec3 Direction)
+{
+    TSPFace_t *Face;
+    vec3 V0;
+    vec3 V1;
+    vec3 V2;
+    int i;
+    
+    if( !Node ) {
+        return false;
+    }
+    if( !PVSRayIntersectsBox(Origin,Direction,Node->BBox) ) {
+        return false;
+    }
+    if( Node->NumFaces == 0 ) {
+        return PVSIsSegmentBlocked(TSP,Node->Child[0],Origin,Direction) ||
+                PVSIsSegmentBlocked(TSP,Node->Child[1],Origin,Direction) ||
+                PVSIsSegmentBlocked(TSP,Node->Child[2],Origin,Direction);
+    }
+    for( i = 0; i < Node->NumFaces; i++ ) {
+        Face = &Node->FaceList[i];
+        //NOTE(Adriano):Semi-transparent surfaces don't block the view.
+        if( Face->IsTextured && (Face->TSB & 0x4000) != 0 ) {
+            continue;
+        }
+        TSPVec3ToGLMVec3(TSP->Vertex[Face->V0].Position,V0);
+        TSPVec3ToGLMVec3(TSP->Vertex[Face->V1].Position,V1);
+        TSPVec3ToGLMVec3(TSP->Vertex[Face->V2].Position,V2);
+        if( PVSRayIntersectsTriangle(Origin,Direction,V0,V1,V2) ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool PVSAreLeavesVisible(PVSBuildContext_t *Context,int SourceLeaf,int TargetLeaf)
+{
+    vec3 Direction;
+    float *Source;
+    float *Target;
+    int i;
+    int j;
+    
+    for( i = 0; i < PVS_NUM_SAMPLES_PER_LEAF; i++ ) {
+        Source = Context->SampleList[SourceLeaf * PVS_NUM_SAMPLES_PER_LEAF + i];
+        for( j = 0; j < PVS_NUM_SAMPLES_PER_LEAF; j++ ) {
+            Target = Context->SampleList[TargetLeaf * PVS_NUM_SAMPLES_PER_LEAF + j];
+            glm_vec3_sub(Target,Source,Direction);
+            if( !PVSIsSegmentBlocked(Context->TSP,&Context->TSP->Node[0],Source,Direction) ) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * Thread pool task: computes the visibility between the given leaf and every leaf that follows it.
+ * The remaining half of the matrix is filled by mirroring once all the tasks are done.
+ */
+static void PVSBuildLeafRow(void *UserData,int TaskIndex)
+{
+    PVSBuildContext_t *Context;
+    PVS_t *PVS;
+    Byte *Row;
+    bool Visible;
+    int i;
+    
+    Context = (PVSBuildContext_t *) UserData;
+    PVS = Context->TSP->PVS;
+    Row = &PVS->VisibilityList[TaskIndex * PVS->RowSize];
+    Row[TaskIndex >> 3] |= 1 << (TaskIndex & 7);
+    
+    for( i = TaskIndex + 1; i < PVS->NumLeaves; i++ ) {
+        if( PVSGetBoxBoxDistance(Context->BoundMinList[TaskIndex],Context->BoundMaxList[TaskIndex],
+            Context->BoundMinList[i],Context->BoundMaxList[i]) > PVS_MAX_VISIBLE_DISTANCE ) {
+            continue;
+        }
+        if( PVSGetBoxBoxDistance(Context->BoundMinList[TaskIndex],Context->BoundMaxList[TaskIndex],
+            Context->BoundMinList[i],Context->BoundMaxList[i]) <= 0.f ) {
+            Visible = true;
+        } else {
+            Visible = PVSAreLeavesVisible(Context,TaskIndex,i);
+        }
+        if( Visible ) {
+            Row[i >> 3] |= 1 << (i & 7);
+        }
+    }
+}
+
+static bool PVSMarkVisibleNodes(TSPNode_t *Node,Byte *Row)
+{
+    bool Visible;
+    
+    if( !Node ) {
+        return false;
+    }
+    if( Node->NumFaces != 0 ) {
+        Node->PVSVisible = Row == NULL || (Row[Node->LeafIndex >> 3] & (1 << (Node->LeafIndex & 7))) != 0;
+        return Node->PVSVisible;
+    }
+    Visible = PVSMarkVisibleNodes(Node->Child[0],Row);
+    Visible |= PVSMarkVisibleNodes(Node->Child[1],Row);
+    Visible |= PVSMarkVisibleNodes(Node->Child[2],Row);
+    Node->PVSVisible = Visible;
+    return Visible;
+}
+
+/*
+ * Computes the potentially visible set of every leaf by casting segments between a fixed set of
+ * sample points placed inside each pair of leaves and writes the result to the sidecar file.
+ * This is an offline step that can take a while on large levels.
+ */
+int PVSBuild(TSP_t *TSP)
+{
+    PVSBuildContext_t Context;
+    PVS_t *PVS;
+    vec3 Min;
+    vec3 Max;
+    vec3 Extent;
+    double StartTime;
+    char *Path;
+    int NumVisible;
+    int Result;
+    int Sample;
+    int i;
+    int j;
+    
+    if( !TSP || !TSP->PVS ) {
+        DPrintf("PVSBuild:Invalid TSP\n");
+        return 0;
+    }
+    PVS = TSP->PVS;
+    if( !PVS->NumLeaves ) {
+        DPrintf("PVSBuild:TSP has no leaves\n");
+        return 0;
+    }
+    if( PVS->VisibilityList ) {
+        free(PVS->VisibilityList);
+    }
+    PVS->Loaded = false;
+    PVS->CurrentLeaf = -1;
+    PVSMarkVisibleNodes(&TSP->Node[0],NULL);
+    PVS->VisibilityList = calloc(PVS->NumLeaves * PVS->RowSize,1);
+    Context.TSP = TSP;
+    Context.SampleList = malloc(PVS->NumLeaves * PVS_NUM_SAMPLES_PER_LEAF * sizeof(vec3));
+    Context.BoundMinList = malloc(PVS->NumLeaves * sizeof(vec3));
+    Context.BoundMaxList = malloc(PVS->NumLeaves * sizeof(vec3));
+    Result = 0;
+    if( !PVS->VisibilityList || !Context.SampleList || !Context.BoundMinList || !Context.BoundMaxList ) {
+        DPrintf("PVSBuild:Failed to allocate memory\n");
+        goto Failure;
+    }
+    StartTime = SysPreciseMilliseconds();
+    //NOTE(Adriano):Center of the leaf plus 8 points placed in the middle of each octant.
+    for( i = 0; i < PVS->NumLeaves; i++ ) {
+        PVSGetLeafBounds(PVS->LeafList[i],Min,Max);
+        glm_vec3_copy(Min,Context.BoundMinList[i]);
+        glm_vec3_copy(Max,Context.BoundMaxList[i]);
+        glm_vec3_sub(Max,Min,Extent);
+        glm_vec3_lerp(Min,Max,0.5f,Context.SampleList[i * PVS_NUM_SAMPLES_PER_LEAF]);
+        for( Sample = 0; Sample < 8; Sample++ ) {
+            for( j = 0; j < 3; j++ ) {
+                Context.SampleList[i * PVS_NUM_SAMPLES_PER_LEAF + Sample + 1][j] = Min[j] + 
+                    Extent[j] * ((Sample & (1 << j)) ? 0.75f : 0.25f);
+            }
+        }
+    }
+    ThreadPoolParallelFor(PVS->NumLeaves,PVSBuildLeafRow,&Context);
+    NumVisible = 0;
+    for( i = 0; i < PVS->NumLeaves; i++ ) {
+        for( j = i + 1; j < PVS->NumLeaves; j++ ) {
+            if( PVS->VisibilityList[i * PVS->RowSize + (j >> 3)] & (1 << (j & 7)) ) {
+                PVS->VisibilityList[j * PVS->RowSize + (i >> 3)] |= 1 << (i & 7);
+                NumVisible += 2;
+            }
+        }
+        NumVisible++;
+    }
+    DPrintf("PVSBuild:Computed visibility for %i leaves in %.2f ms using %i threads (average %.1f visible leaves)\n",
+            PVS->NumLeaves,SysPreciseMilliseconds() - StartTime,ThreadPoolGetNumThreads(),
+            (float) NumVisible / PVS->NumLeaves);
+    //NOTE(Adriano):The visibility data can be used right away even when it cannot be saved,the failure is
+    //              still returned since the next run will have to build it again.
+    PVS->Loaded = true;
+    Path = PVSGetFilePath(PVS->Hash);
+    Result = PVSWriteFile(PVS,Path);
+    if( !Result ) {
+        DPrintf("PVSBuild:Failed to save the visibility data to %s\n",Path);
+    }
+    free(Path);
+Failure:
+    if( Context.SampleList ) {
+        free(Context.SampleList);
+    }
+    if( Context.BoundMinList ) {
+        free(Context.BoundMinList);
+    }
+    if( Context.BoundMaxList ) {
+        free(Context.BoundMaxList);
+    }
+    return Result;
+}
+
+static int PVSFindLeafInTree(TSPNode_t *Node,vec3 Point)
+{
+    int Leaf;
+    int i;
+    
+    if( !Node ) {
+        return -1;
+    }
+    if( Point[0] < Node->BBox.Min.x || Point[0] > Node->BBox.Max.x ||
+        Point[1] < Node->BBox.Min.y - PVS_LEAF_VERTICAL_MARGIN || Point[1] > Node->BBox.Max.y + PVS_LEAF_VERTICAL_MARGIN ||
+        Point[2] < Node->BBox.Min.z || Point[2] > Node->BBox.Max.z ) {
+        return -1;
+    }
+    if( Node->NumFaces != 0 ) {
+        return Node->LeafIndex;
+    }
+    for( i = 0; i < 3; i++ ) {
+        Leaf = PVSFindLeafInTree(Node->Child[i],Point);
+        if( Leaf != -1 ) {
+            return Leaf;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Walks the tree looking for the leaf that contains the point,if the point is outside every leaf
+ * then the closest one is used as long as it is not too far away.
+ */
+static int PVSFindLeaf(PVS_t *PVS,TSP_t *TSP,vec3 Point)
+{
+    vec3 Min;
+    vec3 Max;
+    float Distance;
+    float BestDistance;
+    int BestLeaf;
+    int i;
+    
+    BestLeaf = PVSFindLeafInTree(&TSP->Node[0],Point);
+    if( BestLeaf != -1 ) {
+        return BestLeaf;
+    }
+    BestDistance = PVS_MAX_CAMERA_LEAF_DISTANCE;
+    for( i = 0; i < PVS->NumLeaves; i++ ) {
+        PVSGetLeafBounds(PVS->LeafList[i],Min,Max);
+        Distance = PVSGetPointBoxDistance(Point,Min,Max);
+        if( Distance < BestDistance ) {
+            BestDistance = Distance;
+            BestLeaf = i;
+        }
+    }
+    return BestLeaf;
+}
+
+/*
+ * Finds the leaf containing the camera and flags the nodes that can be seen from it.
+ * Camera position must be expressed in the TSP coordinate system.
+ */
+void PVSUpdate(TSP_t *TSP,vec3 CameraPosition)
+{
+    PVS_t *PVS;
+    int Leaf;
+    int i;
+    
+    if( !TSP || !TSP->PVS ) {
+        return;
+    }
+    PVS = TSP->PVS;
+    PVSStats.Loaded = PVS->Loaded;
+    PVSStats.NumLeaves = PVS->NumLeaves;
+    if( !PVS->Loaded || !EnablePVS || !EnablePVS->IValue ) {
+        Leaf = -1;
+    } else {
+        Leaf = PVSFindLeaf(PVS,TSP,CameraPosition);
+    }
+    if( Leaf != PVS->CurrentLeaf ) {
+        PVS->CurrentLeaf = Leaf;
+        PVSMarkVisibleNodes(&TSP->Node[0],Leaf == -1 ? NULL : &PVS->VisibilityList[Leaf * PVS->RowSize]);
+    }
+    PVSStats.CurrentLeaf = PVS->CurrentLeaf;
+    PVSStats.NumVisibleLeaves = 0;
+    for( i = 0; i < PVS->NumLeaves; i++ ) {
+        if( PVS->LeafList[i]->PVSVisible ) {
+            PVSStats.NumVisibleLeaves++;
+        }
+    }
+}
+
+const PVSStats_t *PVSGetStats()
+{
+    return &PVSStats;
+}
+
+int PVSInit()
+{
+    EnablePVS = ConfigGet("EnablePVS");
+    memset(&PVSStats,0,sizeof(PVSStats));
+    PVSStats.CurrentLeaf = -1;
+    return 1;
+}
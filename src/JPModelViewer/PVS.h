@@ -0,0 +1,63 @@
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#ifndef __PVS_H_
+#define __PVS_H_
+
+#include "../Common/Common.h"
+#include "../Common/Config.h"
+#include "TSP.h"
+
+#define PVS_FILE_MAGIC                  0x5356504A //JPVS
+#define PVS_FILE_VERSION                1
+//NOTE(Adriano):Point sampling is not conservative,a leaf seen only through a gap that no sample ray crosses
+//              is culled,this is why PVS culling is disabled by default.
+#define PVS_NUM_SAMPLES_PER_LEAF        9
+//NOTE(Adriano):Leaf bounding boxes only enclose their geometry,extend them vertically so that
+//              the space above the floor still belongs to a leaf.
+#define PVS_LEAF_VERTICAL_MARGIN        256
+//NOTE(Adriano):Same value as the far plane used by RenderObjectManagerDraw.
+#define PVS_MAX_VISIBLE_DISTANCE        4096.f
+#define PVS_MAX_CAMERA_LEAF_DISTANCE    1024.f
+
+typedef struct PVS_s {
+    unsigned int    Hash;
+    int             NumLeaves;
+    int             RowSize;
+    TSPNode_t       **LeafList;
+    Byte            *VisibilityList;
+    bool            Loaded;
+    int             CurrentLeaf;
+} PVS_t;
+
+typedef struct PVSStats_s {
+    bool    Loaded;
+    int     NumLeaves;
+    int     CurrentLeaf;
+    int     NumVisibleLeaves;
+} PVSStats_t;
+
+extern Config_t *EnablePVS;
+
+int                 PVSInit();
+int                 PVSLoad(TSP_t *TSP);
+int                 PVSBuild(TSP_t *TSP);
+void                PVSUpdate(TSP_t *TSP,vec3 CameraPosition);
+const PVSStats_t    *PVSGetStats();
+void                PVSFree(PVS_t *PVS);
+#endif//__PVS_H_
@@ -0,0 +1,358 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#include "Pick.h"
+
+Config_t *EnableFacePicking = NULL;
+
+PickStats_t PickStats;
+
+static int PickCountFaces(BSDRenderObject_t *RenderObject)
+{
+    TSP_t *Iterator;
+    int NumFaces;
+    int i;
+    
+    NumFaces = 0;
+    if( RenderObject->TSP ) {
+        for( Iterator = RenderObject->TSP; Iterator; Iterator = Iterator->Next ) {
+            for( i = 0; i < Iterator->Header.NumNodes; i++ ) {
+                if( Iterator->Node[i].FaceList ) {
+                    NumFaces += Iterator->Node[i].NumFaces;
+                }
+            }
+        }
+        return NumFaces;
+    }
+    if( RenderObject->FaceList && RenderObject->CurrentVertexTable ) {
+        NumFaces += RenderObject->NumFaces;
+    }
+    if( RenderObject->Vertex ) {
+        NumFaces += RenderObject->NumTexturedFaces + RenderObject->NumUntexturedFaces;
+    }
+    return NumFaces;
+}
+
+static void PickAddFace(PickData_t *PickData,vec3 *VertexList,int *NumFaces,int Type,int TSPNumber,int NodeIndex,int FaceIndex,
+                        vec3 V0,vec3 V1,vec3 V2)
+{
+    glm_vec3_copy(V0,VertexList[*NumFaces * 3]);
+    glm_vec3_copy(V1,VertexList[*NumFaces * 3 + 1]);
+    glm_vec3_copy(V2,VertexList[*NumFaces * 3 + 2]);
+    PickData->FaceList[*NumFaces].Type = Type;
+    PickData->FaceList[*NumFaces].TSPNumber = TSPNumber;
+    PickData->FaceList[*NumFaces].NodeIndex = NodeIndex;
+    PickData->FaceList[*NumFaces].FaceIndex = FaceIndex;
+    (*NumFaces)++;
+}
+
+static void PickBSDVertexToGLMVec3(BSDVertex_t In,vec3 Out)
+{
+    Out[0] = In.x;
+    Out[1] = In.y;
+    Out[2] = In.z;
+}
+
+/*
+ * Collects the triangles of the render object using the same coordinates that are uploaded to the GPU
+ * and builds the BVH.
+ * Animated objects use their current pose.
+ */
+static PickData_t *PickBuildData(BSDRenderObject_t *RenderObject)
+{
+    PickData_t *PickData;
+    BSDAnimatedModelFace_t *AnimatedFace;
+    BSDFace_t *Face;
+    TSPFace_t *TSPFace;
+    TSP_t *Iterator;
+    vec3 *VertexList;
+    vec3 V0;
+    vec3 V1;
+    vec3 V2;
+    double StartTime;
+    int NumFaces;
+    int MaxFaces;
+    int i;
+    int j;
+    
+    MaxFaces = PickCountFaces(RenderObject);
+    if( !MaxFaces ) {
+        return NULL;
+    }
+    PickData = malloc(sizeof(PickData_t));
+    if( !PickData ) {
+        DPrintf("PickBuildData:Failed to allocate memory for pick data\n");
+        return NULL;
+    }
+    StartTime = SysPreciseMilliseconds();
+    PickData->BVH = NULL;
+    PickData->AnimationIndex = RenderObject->CurrentAnimationIndex;
+    PickData->FrameIndex = RenderObject->CurrentFrameIndex;
+    PickData->FaceList = malloc(MaxFaces * sizeof(PickFaceRef_t));
+    VertexList = malloc(MaxFaces * 3 * sizeof(vec3));
+    if( !PickData->FaceList || !VertexList ) {
+        DPrintf("PickBuildData:Failed to allocate memory for %i faces\n",MaxFaces);
+        if( VertexList ) {
+            free(VertexList);
+        }
+        PickFree(PickData);
+        return NULL;
+    }
+    NumFaces = 0;
+    if( RenderObject->TSP ) {
+        for( Iterator = RenderObject->TSP; Iterator; Iterator = Iterator->Next ) {
+            for( i = 0; i < Iterator->Header.NumNodes; i++ ) {
+                if( !Iterator->Node[i].FaceList ) {
+                    continue;
+                }
+                for( j = 0; j < Iterator->Node[i].NumFaces; j++ ) {
+                    TSPFace = &Iterator->Node[i].FaceList[j];
+                    TSPVec3ToGLMVec3(Iterator->Vertex[TSPFace->V0].Position,V0);
+                    TSPVec3ToGLMVec3(Iterator->Vertex[TSPFace->V1].Position,V1);
+                    TSPVec3ToGLMVec3(Iterator->Vertex[TSPFace->V2].Position,V2);
+                    PickAddFace(PickData,VertexList,&NumFaces,PICK_TARGET_LEVEL_FACE,Iterator->Number,i,j,V0,V1,V2);
+                }
+            }
+        }
+    } else {
+        if( RenderObject->FaceList && RenderObject->CurrentVertexTable ) {
+            for( i = 0; i < RenderObject->NumFaces; i++ ) {
+                AnimatedFace = &RenderObject->FaceList[i];
+                PickBSDVertexToGLMVec3(RenderObject->CurrentVertexTable[AnimatedFace->VertexTableIndex0&0x1F].
+                                        VertexList[AnimatedFace->VertexTableDataIndex0],V0);
+                PickBSDVertexToGLMVec3(RenderObject->CurrentVertexTable[AnimatedFace->VertexTableIndex1&0x1F].
+                                        VertexList[AnimatedFace->VertexTableDataIndex1],V1);
+                PickBSDVertexToGLMVec3(RenderObject->CurrentVertexTable[AnimatedFace->VertexTableIndex2&0x1F].
+                                        VertexList[AnimatedFace->VertexTableDataIndex2],V2);
+                PickAddFace(PickData,VertexList,&NumFaces,PICK_TARGET_ANIMATED_FACE,-1,-1,i,V0,V1,V2);
+            }
+        }
+        if( RenderObject->Vertex ) {
+            for( i = 0; i < RenderObject->NumTexturedFaces; i++ ) {
+                Face = &RenderObject->TexturedFaceList[i];
+                PickBSDVertexToGLMVec3(RenderObject->Vertex[Face->Vert0],V0);
+                PickBSDVertexToGLMVec3(RenderObject->Vertex[Face->Vert1],V1);
+                PickBSDVertexToGLMVec3(RenderObject->Vertex[Face->Vert2],V2);
+                PickAddFace(PickData,VertexList,&NumFaces,PICK_TARGET_TEXTURED_FACE,-1,-1,i,V0,V1,V2);
+            }
+            for( i = 0; i < RenderObject->NumUntexturedFaces; i++ ) {
+                Face = &RenderObject->UntexturedFaceList[i];
+                PickBSDVertexToGLMVec3(RenderObject->Vertex[Face->Vert0],V0);
+                PickBSDVertexToGLMVec3(RenderObject->Vertex[Face->Vert1],V1);
+                PickBSDVertexToGLMVec3(RenderObject->Vertex[Face->Vert2],V2);
+                PickAddFace(PickData,VertexList,&NumFaces,PICK_TARGET_UNTEXTURED_FACE,-1,-1,i,V0,V1,V2);
+            }
+        }
+    }
+    PickData->BVH = BVHBuild(VertexList,NumFaces);
+    if( !PickData->BVH ) {
+        PickFree(PickData);
+        return NULL;
+    }
+    PickData->BuildTime = SysPreciseMilliseconds() - StartTime;
+    DPrintf("PickBuildData:Built BVH for RenderObject %i with %i triangles and %i nodes in %.3f ms\n",RenderObject->Id,
+            NumFaces,PickData->BVH->NumNodes,PickData->BuildTime);
+    return PickData;
+}
+
+/*
+ * Returns the pick data of the render object building it on the first call,animated objects are rebuilt
+ * every time their pose changes.
+ */
+static PickData_t *PickGetData(BSDRenderObject_t *RenderObject)
+{
+    if( RenderObject->PickData && RenderObject->FaceList &&
+        (RenderObject->PickData->AnimationIndex != RenderObject->CurrentAnimationIndex ||
+        RenderObject->PickData->FrameIndex != RenderObject->CurrentFrameIndex) ) {
+        PickFree(RenderObject->PickData);
+        RenderObject->PickData = NULL;
+    }
+    if( !RenderObject->PickData ) {
+        RenderObject->PickData = PickBuildData(RenderObject);
+    }
+    if( RenderObject->PickData ) {
+        PickStats.BuildTime = RenderObject->PickData->BuildTime;
+        PickStats.NumTriangles = RenderObject->PickData->BVH->NumTriangles;
+        PickStats.NumNodes = RenderObject->PickData->BVH->NumNodes;
+    }
+    return RenderObject->PickData;
+}
+
+static TSP_t *PickGetTSP(TSP_t *TSPList,int Number)
+{
+    TSP_t *Iterator;
+    
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        if( Iterator->Number == Number ) {
+            return Iterator;
+        }
+    }
+    return NULL;
+}
+
+static void PickFillResult(BSDRenderObject_t *RenderObject,PickData_t *PickData,BVHHit_t *Hit,vec3 Origin,vec3 Direction,
+                           PickResult_t *Result)
+{
+    PickFaceRef_t *FaceRef;
+    TSP_t *TSP;
+    TSPFace_t *TSPFace;
+    int TexInfo;
+    int CLUT;
+    
+    FaceRef = &PickData->FaceList[Hit->TriangleIndex];
+    Result->Type = FaceRef->Type;
+    Result->RenderObjectId = RenderObject->Id;
+    Result->TSPNumber = FaceRef->TSPNumber;
+    Result->NodeIndex = FaceRef->NodeIndex;
+    Result->FaceIndex = FaceRef->FaceIndex;
+    Result->Distance = Hit->Distance;
+    glm_vec3_scale(Direction,Hit->Distance,Result->Position);
+    glm_vec3_add(Origin,Result->Position,Result->Position);
+    TexInfo = 0;
+    CLUT = 0;
+    Result->Textured = true;
+    switch( FaceRef->Type ) {
+        case PICK_TARGET_LEVEL_FACE:
+            TSP = PickGetTSP(RenderObject->TSP,FaceRef->TSPNumber);
+            TSPFace = &TSP->Node[FaceRef->NodeIndex].FaceList[FaceRef->FaceIndex];
+            TexInfo = TSPFace->TSB;
+            CLUT = TSPFace->CBA;
+            Result->Textured = TSPFace->IsTextured;
+            break;
+        case PICK_TARGET_ANIMATED_FACE:
+            TexInfo = RenderObject->FaceList[FaceRef->FaceIndex].TexInfo;
+            CLUT = RenderObject->FaceList[FaceRef->FaceIndex].CLUT;
+            break;
+        case PICK_TARGET_TEXTURED_FACE:
+            TexInfo = RenderObject->TexturedFaceList[FaceRef->FaceIndex].TexInfo;
+            CLUT = RenderObject->TexturedFaceList[FaceRef->FaceIndex].CBA;
+            break;
+        default:
+            Result->Textured = false;
+            break;
+    }
+    Result->TexturePage = TexInfo & 0x1F;
+    Result->ColorMode = (TexInfo >> 7) & 0x3;
+    Result->CLUTX = (CLUT << 4) & 0x3F0;
+    Result->CLUTY = (CLUT >> 6) & 0x1ff;
+}
+
+/*
+ * Finds the face of the render object hit by the ray.
+ * Origin and Direction are in the render object space,the same space used by its vertices.
+ * Returns 1 if a face was hit and fills Result with its location,texture page and CLUT.
+ */
+int PickRenderObject(BSDRenderObject_t *RenderObject,vec3 Origin,vec3 Direction,PickResult_t *Result)
+{
+    PickData_t *PickData;
+    BVHHit_t Hit;
+    double StartTime;
+    int HasHit;
+    
+    if( !RenderObject || !Result ) {
+        return 0;
+    }
+    Result->Type = PICK_TARGET_NONE;
+    PickStats.Hit = false;
+    PickData = PickGetData(RenderObject);
+    if( !PickData ) {
+        return 0;
+    }
+    StartTime = SysPreciseMilliseconds();
+    HasHit = BVHIntersectRay(PickData->BVH,Origin,Direction,PICK_MAX_DISTANCE,&Hit);
+    PickStats.QueryTime = SysPreciseMilliseconds() - StartTime;
+    if( !HasHit ) {
+        return 0;
+    }
+    PickFillResult(RenderObject,PickData,&Hit,Origin,Direction,Result);
+    PickStats.Hit = true;
+    PickStats.Result = *Result;
+    return 1;
+}
+
+/*
+ * Same as PickRenderObject for a list of rays,the rays are traced in packets so that coherent rays
+ * (E.G:a rectangle of pixels) share the tree traversal.
+ * Returns the number of rays that hit a face.
+ */
+int PickRenderObjectRayList(BSDRenderObject_t *RenderObject,vec3 *OriginList,vec3 *DirectionList,int NumRays,
+                            PickResult_t *ResultList)
+{
+    PickData_t *PickData;
+    BVHHit_t *HitList;
+    double StartTime;
+    int NumHits;
+    int i;
+    
+    if( !RenderObject || !OriginList || !DirectionList || !ResultList || NumRays <= 0 ) {
+        return 0;
+    }
+    for( i = 0; i < NumRays; i++ ) {
+        ResultList[i].Type = PICK_TARGET_NONE;
+    }
+    PickData = PickGetData(RenderObject);
+    if( !PickData ) {
+        return 0;
+    }
+    HitList = malloc(NumRays * sizeof(BVHHit_t));
+    if( !HitList ) {
+        DPrintf("PickRenderObjectRayList:Failed to allocate memory for %i rays\n",NumRays);
+        return 0;
+    }
+    StartTime = SysPreciseMilliseconds();
+    NumHits = BVHIntersectRayList(PickData->BVH,OriginList,DirectionList,NumRays,PICK_MAX_DISTANCE,HitList);
+    PickStats.QueryTime = SysPreciseMilliseconds() - StartTime;
+    for( i = 0; i < NumRays; i++ ) {
+        if( HitList[i].TriangleIndex != -1 ) {
+            PickFillResult(RenderObject,PickData,&HitList[i],OriginList[i],DirectionList[i],&ResultList[i]);
+        }
+    }
+    free(HitList);
+    return NumHits;
+}
+
+const PickStats_t *PickGetStats()
+{
+    return &PickStats;
+}
+
+void PickClearStats()
+{
+    memset(&PickStats,0,sizeof(PickStats));
+}
+
+void PickFree(PickData_t *PickData)
+{
+    if( !PickData ) {
+        return;
+    }
+    BVHFree(PickData->BVH);
+    if( PickData->FaceList ) {
+        free(PickData->FaceList);
+    }
+    free(PickData);
+}
+
+int PickInit()
+{
+    EnableFacePicking = ConfigGet("EnableFacePicking");
+    PickClearStats();
+    return 1;
+}
@@ -0,0 +1,87 @@
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#ifndef __PICK_H_
+#define __PICK_H_
+
+#include "../Common/Common.h"
+#include "../Common/Config.h"
+#include "BVH.h"
+#include "BSD.h"
+#include "TSP.h"
+
+#define PICK_MAX_DISTANCE 8192.f
+
+typedef enum {
+    PICK_TARGET_NONE,
+    PICK_TARGET_LEVEL_FACE,
+    PICK_TARGET_ANIMATED_FACE,
+    PICK_TARGET_TEXTURED_FACE,
+    PICK_TARGET_UNTEXTURED_FACE
+} PickTargetType_t;
+
+//NOTE(Adriano):Identifies the face that generated each triangle of the BVH.
+typedef struct PickFaceRef_s {
+    short   Type;
+    short   TSPNumber;
+    int     NodeIndex;
+    int     FaceIndex;
+} PickFaceRef_t;
+
+typedef struct PickData_s {
+    BVH_t           *BVH;
+    PickFaceRef_t   *FaceList;
+    int             AnimationIndex;
+    int             FrameIndex;
+    double          BuildTime;
+} PickData_t;
+
+typedef struct PickResult_s {
+    int     Type;
+    int     RenderObjectId;
+    int     TSPNumber;
+    int     NodeIndex;
+    int     FaceIndex;
+    int     TexturePage;
+    int     CLUTX;
+    int     CLUTY;
+    int     ColorMode;
+    bool    Textured;
+    float   Distance;
+    vec3    Position;
+} PickResult_t;
+
+typedef struct PickStats_s {
+    bool            Hit;
+    PickResult_t    Result;
+    double          QueryTime;
+    double          BuildTime;
+    int             NumTriangles;
+    int             NumNodes;
+} PickStats_t;
+
+extern Config_t *EnableFacePicking;
+
+int                 PickInit();
+int                 PickRenderObject(BSDRenderObject_t *RenderObject,vec3 Origin,vec3 Direction,PickResult_t *Result);
+int                 PickRenderObjectRayList(BSDRenderObject_t *RenderObject,vec3 *OriginList,vec3 *DirectionList,int NumRays,
+                                            PickResult_t *ResultList);
+const PickStats_t   *PickGetStats();
+void                PickClearStats();
+void                PickFree(PickData_t *PickData);
+#endif//__PICK_H_
@@ -0,0 +1,880 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#include "QueryServer.h"
+#include "TSP.h"
+#include "Pick.h"
+#include "Collision.h"
+#include "Heightfield.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+
+typedef struct QueryBuffer_s {
+    Byte    *Data;
+    int     Size;
+    int     Offset;
+    int     Capacity;
+} QueryBuffer_t;
+
+typedef struct QueryClient_s {
+    int             Socket;
+    QueryBuffer_t   Input;
+    QueryBuffer_t   Output;
+} QueryClient_t;
+
+typedef struct QueryServer_s {
+    int                 Socket;
+    BSDRenderObject_t   *Level;
+    QueryClient_t       ClientList[QUERY_SERVER_MAX_CLIENTS];
+    int                 NumClients;
+    //NOTE(Adriano):Scratch memory used to convert a message into the arguments of the batched queries.
+    vec3                *PointList;
+    vec3                *DirectionList;
+    int                 *YList;
+    int                 *FaceList;
+    int                 *TSPNumberList;
+    PickResult_t        *PickList;
+    int                 ScratchSize;
+    long long           NumMessages;
+    long long           NumQueries;
+} QueryServer_t;
+
+static volatile sig_atomic_t QueryServerRunning;
+
+static void QueryServerStop(int Signal)
+{
+    QueryServerRunning = 0;
+}
+
+/*
+ * Makes room for Size more bytes at the end of the buffer and returns a pointer to them.
+ */
+static Byte *QueryBufferReserve(QueryBuffer_t *Buffer,int Size)
+{
+    Byte *Data;
+    int Capacity;
+    
+    if( Buffer->Offset && Buffer->Offset == Buffer->Size ) {
+        Buffer->Offset = 0;
+        Buffer->Size = 0;
+    }
+    if( Buffer->Size + Size > Buffer->Capacity && Buffer->Offset ) {
+        memmove(Buffer->Data,Buffer->Data + Buffer->Offset,Buffer->Size - Buffer->Offset);
+        Buffer->Size -= Buffer->Offset;
+        Buffer->Offset = 0;
+    }
+    if( Buffer->Size + Size > Buffer->Capacity ) {
+        Capacity = Buffer->Capacity ? Buffer->Capacity : QUERY_SERVER_READ_SIZE;
+        while( Capacity < Buffer->Size + Size ) {
+            Capacity *= 2;
+        }
+        Data = realloc(Buffer->Data,Capacity);
+        if( !Data ) {
+            DPrintf("QueryBufferReserve:Failed to allocate %i bytes\n",Capacity);
+            return NULL;
+        }
+        Buffer->Data = Data;
+        Buffer->Capacity = Capacity;
+    }
+    Data = Buffer->Data + Buffer->Size;
+    Buffer->Size += Size;
+    return Data;
+}
+
+static void QueryBufferFree(QueryBuffer_t *Buffer)
+{
+    if( Buffer->Data ) {
+        free(Buffer->Data);
+    }
+    memset(Buffer,0,sizeof(QueryBuffer_t));
+}
+
+static int QueryGetItemSize(int Type)
+{
+    switch( Type ) {
+        case QUERY_TYPE_INFO:
+            return 0;
+        case QUERY_TYPE_HEIGHT:
+        case QUERY_TYPE_LEAF:
+            return sizeof(QueryPoint_t);
+        case QUERY_TYPE_RAY_PICK:
+            return sizeof(QueryRay_t);
+        case QUERY_TYPE_FACE_INFO:
+            return sizeof(QueryFaceRef_t);
+        default:
+            return -1;
+    }
+}
+
+static int QueryGetResultSize(int Type)
+{
+    switch( Type ) {
+        case QUERY_TYPE_INFO:
+            return sizeof(QueryInfoResult_t);
+        case QUERY_TYPE_HEIGHT:
+            return sizeof(QueryHeightResult_t);
+        case QUERY_TYPE_RAY_PICK:
+            return sizeof(QueryPickResult_t);
+        case QUERY_TYPE_FACE_INFO:
+            return sizeof(QueryFaceInfoResult_t);
+        case QUERY_TYPE_LEAF:
+            return sizeof(QueryLeafResult_t);
+        default:
+            return -1;
+    }
+}
+
+static int QueryServerReserveScratch(QueryServer_t *Server,int Count)
+{
+    if( Count <= Server->ScratchSize ) {
+        return 1;
+    }
+    free(Server->PointList);
+    free(Server->DirectionList);
+    free(Server->YList);
+    free(Server->FaceList);
+    free(Server->TSPNumberList);
+    free(Server->PickList);
+    Server->PointList = malloc(Count * sizeof(vec3));
+    Server->DirectionList = malloc(Count * sizeof(vec3));
+    Server->YList = malloc(Count * sizeof(int));
+    Server->FaceList = malloc(Count * sizeof(int));
+    Server->TSPNumberList = malloc(Count * sizeof(int));
+    Server->PickList = malloc(Count * sizeof(PickResult_t));
+    if( !Server->PointList || !Server->DirectionList || !Server->YList || !Server->FaceList || !Server->TSPNumberList ||
+        !Server->PickList ) {
+        DPrintf("QueryServerReserveScratch:Failed to allocate memory for %i queries\n",Count);
+        Server->ScratchSize = 0;
+        return 0;
+    }
+    Server->ScratchSize = Count;
+    return 1;
+}
+
+static TSP_t *QueryServerGetTSP(QueryServer_t *Server,int Number)
+{
+    TSP_t *Iterator;
+    
+    for( Iterator = Server->Level->TSP; Iterator; Iterator = Iterator->Next ) {
+        if( Iterator->Number == Number ) {
+            return Iterator;
+        }
+    }
+    return NULL;
+}
+
+static TSPNode_t *QueryFindLeaf(TSPNode_t *Node,const float *Point)
+{
+    TSPNode_t *Leaf;
+    int i;
+    
+    if( !Node ) {
+        return NULL;
+    }
+    if( Point[0] < Node->BBox.Min.x || Point[0] > Node->BBox.Max.x ||
+        Point[1] < Node->BBox.Min.y || Point[1] > Node->BBox.Max.y ||
+        Point[2] < Node->BBox.Min.z || Point[2] > Node->BBox.Max.z ) {
+        return NULL;
+    }
+    if( Node->NumFaces != 0 ) {
+        return Node;
+    }
+    for( i = 0; i < 3; i++ ) {
+        Leaf = QueryFindLeaf(Node->Child[i],Point);
+        if( Leaf ) {
+            return Leaf;
+        }
+    }
+    return NULL;
+}
+
+static void QueryServerHandleInfo(QueryServer_t *Server,QueryInfoResult_t *Result)
+{
+    TSP_t *Iterator;
+    TSPBBox_t *BBox;
+    
+    memset(Result,0,sizeof(QueryInfoResult_t));
+    for( Iterator = Server->Level->TSP; Iterator; Iterator = Iterator->Next ) {
+        if( Iterator->Header.NumNodes <= 0 ) {
+            continue;
+        }
+        BBox = &Iterator->Node[0].BBox;
+        if( !Result->NumTSP || BBox->Min.x < Result->Min[0] ) Result->Min[0] = BBox->Min.x;
+        if( !Result->NumTSP || BBox->Min.y < Result->Min[1] ) Result->Min[1] = BBox->Min.y;
+        if( !Result->NumTSP || BBox->Min.z < Result->Min[2] ) Result->Min[2] = BBox->Min.z;
+        if( !Result->NumTSP || BBox->Max.x > Result->Max[0] ) Result->Max[0] = BBox->Max.x;
+        if( !Result->NumTSP || BBox->Max.y > Result->Max[1] ) Result->Max[1] = BBox->Max.y;
+        if( !Result->NumTSP || BBox->Max.z > Result->Max[2] ) Result->Max[2] = BBox->Max.z;
+        Result->NumTSP++;
+        Result->NumFaces += Iterator->Header.NumFaces;
+    }
+}
+
+static int QueryServerHandleHeight(QueryServer_t *Server,const QueryPoint_t *PointList,int Count,QueryHeightResult_t *ResultList)
+{
+    int i;
+    
+    if( !QueryServerReserveScratch(Server,Count) ) {
+        return 0;
+    }
+    for( i = 0; i < Count; i++ ) {
+        Server->PointList[i][0] = PointList[i].Position[0];
+        Server->PointList[i][1] = PointList[i].Position[1];
+        Server->PointList[i][2] = PointList[i].Position[2];
+        Server->FaceList[i] = -1;
+        Server->TSPNumberList[i] = -1;
+    }
+    HeightfieldGetYList(Server->Level->TSP->Heightfield,Server->Level->TSP,Server->PointList,Count,Server->YList,
+                        Server->FaceList,Server->TSPNumberList);
+    for( i = 0; i < Count; i++ ) {
+        ResultList[i].CollisionFace = Server->FaceList[i];
+        ResultList[i].TSPNumber = Server->FaceList[i] != -1 ? Server->TSPNumberList[i] : -1;
+        ResultList[i].Y = Server->FaceList[i] != -1 ? Server->YList[i] : 0;
+    }
+    return 1;
+}
+
+static int QueryServerHandleRayPick(QueryServer_t *Server,const QueryRay_t *RayList,int Count,QueryPickResult_t *ResultList)
+{
+    PickResult_t *Pick;
+    int i;
+    
+    if( !QueryServerReserveScratch(Server,Count) ) {
+        return 0;
+    }
+    for( i = 0; i < Count; i++ ) {
+        glm_vec3_copy((float *) RayList[i].Origin,Server->PointList[i]);
+        glm_vec3_copy((float *) RayList[i].Direction,Server->DirectionList[i]);
+        glm_vec3_normalize(Server->DirectionList[i]);
+    }
+    PickRenderObjectRayList(Server->Level,Server->PointList,Server->DirectionList,Count,Server->PickList);
+    for( i = 0; i < Count; i++ ) {
+        Pick = &Server->PickList[i];
+        if( Pick->Type != PICK_TARGET_LEVEL_FACE ) {
+            memset(&ResultList[i],0,sizeof(QueryPickResult_t));
+            ResultList[i].Face.TSPNumber = -1;
+            ResultList[i].Face.NodeIndex = -1;
+            ResultList[i].Face.FaceIndex = -1;
+            continue;
+        }
+        ResultList[i].Face.TSPNumber = Pick->TSPNumber;
+        ResultList[i].Face.NodeIndex = Pick->NodeIndex;
+        ResultList[i].Face.FaceIndex = Pick->FaceIndex;
+        ResultList[i].Distance = Pick->Distance;
+        ResultList[i].Position[0] = Pick->Position[0];
+        ResultList[i].Position[1] = Pick->Position[1];
+        ResultList[i].Position[2] = Pick->Position[2];
+    }
+    return 1;
+}
+
+static void QueryServerHandleFaceInfo(QueryServer_t *Server,const QueryFaceRef_t *FaceRef,QueryFaceInfoResult_t *Result)
+{
+    TSP_t *TSP;
+    TSPNode_t *Node;
+    TSPFace_t *Face;
+    
+    memset(Result,0,sizeof(QueryFaceInfoResult_t));
+    TSP = QueryServerGetTSP(Server,FaceRef->TSPNumber);
+    if( !TSP || FaceRef->NodeIndex < 0 || FaceRef->NodeIndex >= TSP->Header.NumNodes ) {
+        return;
+    }
+    Node = &TSP->Node[FaceRef->NodeIndex];
+    if( !Node->FaceList || FaceRef->FaceIndex < 0 || FaceRef->FaceIndex >= Node->NumFaces ) {
+        return;
+    }
+    Face = &Node->FaceList[FaceRef->FaceIndex];
+    Result->Valid = 1;
+    if( Face->IsTextured ) {
+        Result->Flags |= QUERY_FACE_TEXTURED;
+    }
+    if( (Face->TSB & 0x4000) != 0 ) {
+        Result->Flags |= QUERY_FACE_TRANSPARENT;
+    }
+    if( TSPIsFaceDynamic(TSP,Node->FirstFaceIndex + FaceRef->FaceIndex) ) {
+        Result->Flags |= QUERY_FACE_DYNAMIC;
+    }
+    Result->TexturePage = Face->TSB & 0x1F;
+    Result->ColorMode = (Face->TSB >> 7) & 0x3;
+    Result->CLUTX = (Face->CBA << 4) & 0x3F0;
+    Result->CLUTY = (Face->CBA >> 6) & 0x1ff;
+    Result->Vertex[0] = TSP->Vertex[Face->V0].Position.x;
+    Result->Vertex[1] = TSP->Vertex[Face->V0].Position.y;
+    Result->Vertex[2] = TSP->Vertex[Face->V0].Position.z;
+    Result->Vertex[3] = TSP->Vertex[Face->V1].Position.x;
+    Result->Vertex[4] = TSP->Vertex[Face->V1].Position.y;
+    Result->Vertex[5] = TSP->Vertex[Face->V1].Position.z;
+    Result->Vertex[6] = TSP->Vertex[Face->V2].Position.x;
+    Result->Vertex[7] = TSP->Vertex[Face->V2].Position.y;
+    Result->Vertex[8] = TSP->Vertex[Face->V2].Position.z;
+}
+
+static void QueryServerHandleLeaf(QueryServer_t *Server,const QueryPoint_t *Point,QueryLeafResult_t *Result)
+{
+    TSP_t *Iterator;
+    TSPNode_t *Leaf;
+    
+    Result->TSPNumber = -1;
+    Result->NodeIndex = -1;
+    Result->LeafIndex = -1;
+    for( Iterator = Server->Level->TSP; Iterator; Iterator = Iterator->Next ) {
+        if( Iterator->Header.NumNodes <= 0 ) {
+            continue;
+        }
+        Leaf = QueryFindLeaf(&Iterator->Node[0],Point->Position);
+        if( Leaf ) {
+            Result->TSPNumber = Iterator->Number;
+            Result->NodeIndex = Leaf - Iterator->Node;
+            Result->LeafIndex = Leaf->LeafIndex;
+            return;
+        }
+    }
+}
+
+/*
+ * Answers a single message,the payload has already been validated against the header.
+ */
+static int QueryServerHandleMessage(QueryServer_t *Server,QueryClient_t *Client,const QueryHeader_t *Header,const Byte *Payload)
+{
+    QueryResponseHeader_t *Response;
+    Byte *ResultList;
+    int ResultSize;
+    int Count;
+    int Status;
+    int i;
+    
+    Count = Header->Type == QUERY_TYPE_INFO ? 1 : Header->Count;
+    ResultSize = QueryGetResultSize(Header->Type);
+    Response = (QueryResponseHeader_t *) QueryBufferReserve(&Client->Output,sizeof(QueryResponseHeader_t) + Count * ResultSize);
+    if( !Response ) {
+        return 0;
+    }
+    ResultList = (Byte *) (Response + 1);
+    Status = 1;
+    switch( Header->Type ) {
+        case QUERY_TYPE_INFO:
+            QueryServerHandleInfo(Server,(QueryInfoResult_t *) ResultList);
+            break;
+        case QUERY_TYPE_HEIGHT:
+            Status = QueryServerHandleHeight(Server,(const QueryPoint_t *) Payload,Count,(QueryHeightResult_t *) ResultList);
+            break;
+        case QUERY_TYPE_RAY_PICK:
+            Status = QueryServerHandleRayPick(Server,(const QueryRay_t *) Payload,Count,(QueryPickResult_t *) ResultList);
+            break;
+        case QUERY_TYPE_FACE_INFO:
+            for( i = 0; i < Count; i++ ) {
+                QueryServerHandleFaceInfo(Server,&((const QueryFaceRef_t *) Payload)[i],&((QueryFaceInfoResult_t *) ResultList)[i]);
+            }
+            break;
+        case QUERY_TYPE_LEAF:
+            for( i = 0; i < Count; i++ ) {
+                QueryServerHandleLeaf(Server,&((const QueryPoint_t *) Payload)[i],&((QueryLeafResult_t *) ResultList)[i]);
+            }
+            break;
+    }
+    Response->Type = Header->Type;
+    Response->Id = Header->Id;
+    Response->Count = Count;
+    Response->Status = QUERY_STATUS_OK;
+    if( !Status ) {
+        //NOTE(Adriano):Drop the results but keep the connection alive.
+        Client->Output.Size -= Count * ResultSize;
+        Response->Count = 0;
+        Response->Status = QUERY_STATUS_ERROR;
+    }
+    Server->NumMessages++;
+    Server->NumQueries += Count;
+    return 1;
+}
+
+/*
+ * Answers every complete message received from the client.
+ * Returns 0 if the client sent an invalid message and must be disconnected.
+ */
+static int QueryServerProcessInput(QueryServer_t *Server,QueryClient_t *Client)
+{
+    QueryHeader_t Header;
+    int ItemSize;
+    int MessageSize;
+    
+    while( Client->Input.Size - Client->Input.Offset >= (int) sizeof(QueryHeader_t) ) {
+        if( Client->Output.Size - Client->Output.Offset > QUERY_SERVER_MAX_PENDING_OUTPUT ) {
+            break;
+        }
+        memcpy(&Header,Client->Input.Data + Client->Input.Offset,sizeof(QueryHeader_t));
+        ItemSize = QueryGetItemSize(Header.Type);
+        if( ItemSize == -1 || Header.Count > QUERY_SERVER_MAX_BATCH ) {
+            DPrintf("QueryServerProcessInput:Invalid message type %u with %u queries\n",Header.Type,Header.Count);
+            return 0;
+        }
+        MessageSize = sizeof(QueryHeader_t) + Header.Count * ItemSize;
+        if( Client->Input.Size - Client->Input.Offset < MessageSize ) {
+            break;
+        }
+        if( !QueryServerHandleMessage(Server,Client,&Header,Client->Input.Data + Client->Input.Offset + sizeof(QueryHeader_t)) ) {
+            return 0;
+        }
+        Client->Input.Offset += MessageSize;
+    }
+    return 1;
+}
+
+static int QueryServerReadClient(QueryClient_t *Client)
+{
+    Byte *Data;
+    ssize_t Size;
+    
+    Data = QueryBufferReserve(&Client->Input,QUERY_SERVER_READ_SIZE);
+    if( !Data ) {
+        return 0;
+    }
+    Size = recv(Client->Socket,Data,QUERY_SERVER_READ_SIZE,0);
+    Client->Input.Size -= QUERY_SERVER_READ_SIZE - (Size > 0 ? Size : 0);
+    if( Size == 0 ) {
+        return 0;
+    }
+    if( Size < 0 ) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    return 1;
+}
+
+static int QueryServerWriteClient(QueryClient_t *Client)
+{
+    ssize_t Size;
+    
+    while( Client->Output.Offset < Client->Output.Size ) {
+        Size = send(Client->Socket,Client->Output.Data + Client->Output.Offset,Client->Output.Size - Client->Output.Offset,
+                    MSG_NOSIGNAL);
+        if( Size < 0 ) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        Client->Output.Offset += Size;
+    }
+    return 1;
+}
+
+static void QueryServerAcceptClients(QueryServer_t *Server)
+{
+    QueryClient_t *Client;
+    int Socket;
+    
+    while( Server->NumClients < QUERY_SERVER_MAX_CLIENTS ) {
+        Socket = accept(Server->Socket,NULL,NULL);
+        if( Socket < 0 ) {
+            return;
+        }
+        fcntl(Socket,F_SETFL,fcntl(Socket,F_GETFL,0) | O_NONBLOCK);
+        Client = &Server->ClientList[Server->NumClients++];
+        memset(Client,0,sizeof(QueryClient_t));
+        Client->Socket = Socket;
+        DPrintf("QueryServerAcceptClients:Client connected,%i active\n",Server->NumClients);
+    }
+}
+
+static void QueryServerDropClient(QueryServer_t *Server,int Index)
+{
+    QueryClient_t *Client;
+    
+    Client = &Server->ClientList[Index];
+    close(Client->Socket);
+    QueryBufferFree(&Client->Input);
+    QueryBufferFree(&Client->Output);
+    Server->ClientList[Index] = Server->ClientList[Server->NumClients - 1];
+    Server->NumClients--;
+    DPrintf("QueryServerDropClient:Client disconnected,%i active\n",Server->NumClients);
+}
+
+/*
+ Loads nothing by itself,it answers the queries about the given level until the process receives
+ SIGINT or SIGTERM.
+ Each client is served in the order it sends its messages while the poll loop keeps every other
+ client going.
+ */
+int QueryServerRun(BSDRenderObject_t *Level,const char *SocketPath)
+{
+    QueryServer_t Server;
+    QueryClient_t *Client;
+    struct sockaddr_un Address;
+    struct pollfd PollList[QUERY_SERVER_MAX_CLIENTS + 1];
+    double StartTime;
+    int NumClients;
+    int i;
+    
+    if( !Level || !Level->TSP || !SocketPath ) {
+        printf("QueryServerRun:Invalid level\n");
+        return 0;
+    }
+    if( strlen(SocketPath) >= sizeof(Address.sun_path) ) {
+        printf("QueryServerRun:Socket path %s is too long\n",SocketPath);
+        return 0;
+    }
+    memset(&Server,0,sizeof(Server));
+    Server.Level = Level;
+    Server.Socket = socket(AF_UNIX,SOCK_STREAM,0);
+    if( Server.Socket < 0 ) {
+        printf("QueryServerRun:Failed to create the socket (%s)\n",strerror(errno));
+        return 0;
+    }
+    memset(&Address,0,sizeof(Address));
+    Address.sun_family = AF_UNIX;
+    strcpy(Address.sun_path,SocketPath);
+    unlink(SocketPath);
+    if( bind(Server.Socket,(struct sockaddr *) &Address,sizeof(Address)) < 0 ||
+        listen(Server.Socket,QUERY_SERVER_MAX_CLIENTS) < 0 ) {
+        printf("QueryServerRun:Failed to listen on %s (%s)\n",SocketPath,strerror(errno));
+        close(Server.Socket);
+        return 0;
+    }
+    fcntl(Server.Socket,F_SETFL,fcntl(Server.Socket,F_GETFL,0) | O_NONBLOCK);
+    //NOTE(Adriano):Load (or bake) the heightfield before serving,height queries fall back to the collision data without it.
+    if( !HeightfieldGet(Level->TSP,HEIGHTFIELD_DEFAULT_RESOLUTION) ) {
+        DPrintf("QueryServerRun:No heightfield available,height queries will use the collision data\n");
+    }
+    QueryServerRunning = 1;
+    signal(SIGINT,QueryServerStop);
+    signal(SIGTERM,QueryServerStop);
+    signal(SIGPIPE,SIG_IGN);
+    printf("Serving queries on %s,press CTRL+C to stop.\n",SocketPath);
+    StartTime = SysPreciseMilliseconds();
+    while( QueryServerRunning ) {
+        PollList[0].fd = Server.Socket;
+        PollList[0].events = Server.NumClients < QUERY_SERVER_MAX_CLIENTS ? POLLIN : 0;
+        PollList[0].revents = 0;
+        for( i = 0; i < Server.NumClients; i++ ) {
+            Client = &Server.ClientList[i];
+            PollList[i + 1].fd = Client->Socket;
+            PollList[i + 1].events = 0;
+            PollList[i + 1].revents = 0;
+            if( Client->Output.Size - Client->Output.Offset <= QUERY_SERVER_MAX_PENDING_OUTPUT ) {
+                PollList[i + 1].events |= POLLIN;
+            }
+            if( Client->Output.Offset < Client->Output.Size ) {
+                PollList[i + 1].events |= POLLOUT;
+            }
+        }
+        NumClients = Server.NumClients;
+        if( poll(PollList,NumClients + 1,500) < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            printf("QueryServerRun:poll failed (%s)\n",strerror(errno));
+            break;
+        }
+        //NOTE(Adriano):Walk backward since dropping a client moves the last one in its place.
+        for( i = NumClients - 1; i >= 0; i-- ) {
+            Client = &Server.ClientList[i];
+            if( (PollList[i + 1].revents & POLLIN) && !QueryServerReadClient(Client) ) {
+                QueryServerDropClient(&Server,i);
+                continue;
+            }
+            if( (PollList[i + 1].revents & (POLLERR | POLLNVAL)) ||
+                ((PollList[i + 1].revents & POLLHUP) && !(PollList[i + 1].revents & POLLIN)) ) {
+                QueryServerDropClient(&Server,i);
+                continue;
+            }
+            if( !QueryServerProcessInput(&Server,Client) || !QueryServerWriteClient(Client) ) {
+                QueryServerDropClient(&Server,i);
+                continue;
+            }
+        }
+        if( PollList[0].revents & POLLIN ) {
+            QueryServerAcceptClients(&Server);
+        }
+    }
+    printf("Answered %lli queries in %lli messages in %.3f seconds.\n",Server.NumQueries,Server.NumMessages,
+           (SysPreciseMilliseconds() - StartTime) / 1000.f);
+    while( Server.NumClients ) {
+        QueryServerDropClient(&Server,Server.NumClients - 1);
+    }
+    close(Server.Socket);
+    unlink(SocketPath);
+    free(Server.PointList);
+    free(Server.DirectionList);
+    free(Server.YList);
+    free(Server.FaceList);
+    free(Server.TSPNumberList);
+    free(Server.PickList);
+    signal(SIGINT,SIG_DFL);
+    signal(SIGTERM,SIG_DFL);
+    return 1;
+}
+
+static int QueryBenchmarkWrite(int Socket,const void *Data,int Size)
+{
+    ssize_t Written;
+    
+    while( Size > 0 ) {
+        Written = send(Socket,Data,Size,MSG_NOSIGNAL);
+        if( Written <= 0 ) {
+            if( Written < 0 && errno == EINTR ) {
+                continue;
+            }
+            return 0;
+        }
+        Data = (const Byte *) Data + Written;
+        Size -= Written;
+    }
+    return 1;
+}
+
+static int QueryBenchmarkRead(int Socket,void *Data,int Size)
+{
+    ssize_t Read;
+    
+    while( Size > 0 ) {
+        Read = recv(Socket,Data,Size,0);
+        if( Read <= 0 ) {
+            if( Read < 0 && errno == EINTR ) {
+                continue;
+            }
+            return 0;
+        }
+        Data = (Byte *) Data + Read;
+        Size -= Read;
+    }
+    return 1;
+}
+
+/*
+ * Sends NumQueries queries in messages of BatchSize entries keeping at most Depth messages in flight
+ * and stores the results in ResultList.
+ * Returns the time in milliseconds or a negative value on error.
+ */
+static double QueryBenchmarkRun(int Socket,int Type,const void *Payload,int NumQueries,int BatchSize,int Depth,
+                                unsigned int *NextId,void *ResultList)
+{
+    QueryHeader_t Header;
+    QueryResponseHeader_t Response;
+    unsigned int FirstId;
+    double StartTime;
+    int ItemSize;
+    int ResultSize;
+    int Sent;
+    int Received;
+    int NumInFlight;
+    int ExpectedCount;
+    
+    ItemSize = QueryGetItemSize(Type);
+    ResultSize = QueryGetResultSize(Type);
+    FirstId = *NextId;
+    Sent = 0;
+    Received = 0;
+    NumInFlight = 0;
+    StartTime = SysPreciseMilliseconds();
+    while( Received < NumQueries ) {
+        if( Sent < NumQueries && NumInFlight < Depth ) {
+            Header.Type = Type;
+            Header.Id = (*NextId)++;
+            Header.Count = NumQueries - Sent < BatchSize ? NumQueries - Sent : BatchSize;
+            if( !QueryBenchmarkWrite(Socket,&Header,sizeof(Header)) ||
+                !QueryBenchmarkWrite(Socket,(const Byte *) Payload + Sent * ItemSize,Header.Count * ItemSize) ) {
+                printf("QueryBenchmarkRun:Failed to send a message\n");
+                return -1.;
+            }
+            Sent += Header.Count;
+            NumInFlight++;
+            continue;
+        }
+        if( !QueryBenchmarkRead(Socket,&Response,sizeof(Response)) ) {
+            printf("QueryBenchmarkRun:Connection closed by the server\n");
+            return -1.;
+        }
+        //NOTE(Adriano):Responses must arrive in the same order of the messages.
+        ExpectedCount = NumQueries - Received < BatchSize ? NumQueries - Received : BatchSize;
+        if( Response.Type != Type || Response.Id != FirstId + Received / BatchSize || Response.Status != QUERY_STATUS_OK ||
+            Response.Count != ExpectedCount ) {
+            printf("QueryBenchmarkRun:Unexpected response %u for type %u (status %i)\n",Response.Id,Response.Type,Response.Status);
+            return -1.;
+        }
+        if( !QueryBenchmarkRead(Socket,(Byte *) ResultList + Received * ResultSize,Response.Count * ResultSize) ) {
+            printf("QueryBenchmarkRun:Connection closed by the server\n");
+            return -1.;
+        }
+        Received += Response.Count;
+        NumInFlight--;
+    }
+    return SysPreciseMilliseconds() - StartTime;
+}
+
+static float QueryBenchmarkRandom(float Min,float Max)
+{
+    return Min + (Max - Min) * ((float) rand() / (float) RAND_MAX);
+}
+
+static void QueryBenchmarkPrint(const char *Name,int NumQueries,int NumHits,double Time)
+{
+    printf("%-10s %8i queries %8i hits %10.3f ms %12.0f queries/sec\n",Name,NumQueries,NumHits,Time,
+           Time > 0. ? NumQueries / (Time / 1000.) : 0.);
+}
+
+/*
+ Connects to a running query server and measures the throughput of each query type using random
+ points and rays inside the level bounds,face info queries use the faces hit by the rays.
+ */
+int QueryServerBenchmark(const char *SocketPath,int NumQueries,int BatchSize,int Depth)
+{
+    struct sockaddr_un Address;
+    QueryInfoResult_t Info;
+    QueryPoint_t *PointList;
+    QueryRay_t *RayList;
+    QueryFaceRef_t *FaceRefList;
+    QueryHeightResult_t *HeightList;
+    QueryPickResult_t *PickList;
+    QueryFaceInfoResult_t *FaceInfoList;
+    QueryLeafResult_t *LeafList;
+    unsigned int NextId;
+    double Time;
+    int Socket;
+    int NumHits;
+    int NumFaces;
+    int Result;
+    int i;
+    int j;
+    
+    if( !SocketPath || NumQueries <= 0 ) {
+        printf("QueryServerBenchmark:Invalid arguments\n");
+        return 0;
+    }
+    if( strlen(SocketPath) >= sizeof(Address.sun_path) ) {
+        printf("QueryServerBenchmark:Socket path %s is too long\n",SocketPath);
+        return 0;
+    }
+    BatchSize = BatchSize < 1 ? 1 : (BatchSize > QUERY_SERVER_MAX_BATCH ? QUERY_SERVER_MAX_BATCH : BatchSize);
+    Depth = Depth < 1 ? 1 : Depth;
+    //NOTE(Adriano):Avoid stalling the server by requesting more results than it keeps for a single client.
+    while( Depth > 1 && (long long) Depth * BatchSize * sizeof(QueryFaceInfoResult_t) > QUERY_SERVER_MAX_PENDING_OUTPUT / 2 ) {
+        Depth--;
+    }
+    Socket = socket(AF_UNIX,SOCK_STREAM,0);
+    if( Socket < 0 ) {
+        printf("QueryServerBenchmark:Failed to create the socket (%s)\n",strerror(errno));
+        return 0;
+    }
+    memset(&Address,0,sizeof(Address));
+    Address.sun_family = AF_UNIX;
+    strcpy(Address.sun_path,SocketPath);
+    if( connect(Socket,(struct sockaddr *) &Address,sizeof(Address)) < 0 ) {
+        printf("QueryServerBenchmark:Failed to connect to %s (%s)\n",SocketPath,strerror(errno));
+        close(Socket);
+        return 0;
+    }
+    Result = 0;
+    PointList = malloc(NumQueries * sizeof(QueryPoint_t));
+    RayList = malloc(NumQueries * sizeof(QueryRay_t));
+    FaceRefList = malloc(NumQueries * sizeof(QueryFaceRef_t));
+    HeightList = malloc(NumQueries * sizeof(QueryHeightResult_t));
+    PickList = malloc(NumQueries * sizeof(QueryPickResult_t));
+    FaceInfoList = malloc(NumQueries * sizeof(QueryFaceInfoResult_t));
+    LeafList = malloc(NumQueries * sizeof(QueryLeafResult_t));
+    if( !PointList || !RayList || !FaceRefList || !HeightList || !PickList || !FaceInfoList || !LeafList ) {
+        printf("QueryServerBenchmark:Failed to allocate memory for %i queries\n",NumQueries);
+        goto Failure;
+    }
+    NextId = 0;
+    if( QueryBenchmarkRun(Socket,QUERY_TYPE_INFO,NULL,1,1,1,&NextId,&Info) < 0. ) {
+        goto Failure;
+    }
+    printf("Level has %i TSP files and %i faces,bounds %.0f;%.0f;%.0f - %.0f;%.0f;%.0f\n",Info.NumTSP,Info.NumFaces,
+           Info.Min[0],Info.Min[1],Info.Min[2],Info.Max[0],Info.Max[1],Info.Max[2]);
+    printf("%i queries per type,%i queries per message,%i messages in flight\n",NumQueries,BatchSize,Depth);
+    for( i = 0; i < NumQueries; i++ ) {
+        for( j = 0; j < 3; j++ ) {
+            PointList[i].Position[j] = QueryBenchmarkRandom(Info.Min[j],Info.Max[j]);
+            RayList[i].Origin[j] = PointList[i].Position[j];
+        }
+        //NOTE(Adriano):Y points down inside the level so most rays are cast toward the floor.
+        RayList[i].Direction[0] = QueryBenchmarkRandom(-1.f,1.f);
+        RayList[i].Direction[1] = QueryBenchmarkRandom(0.25f,1.f);
+        RayList[i].Direction[2] = QueryBenchmarkRandom(-1.f,1.f);
+    }
+    
+    Time = QueryBenchmarkRun(Socket,QUERY_TYPE_HEIGHT,PointList,NumQueries,BatchSize,Depth,&NextId,HeightList);
+    if( Time < 0. ) {
+        goto Failure;
+    }
+    for( i = 0, NumHits = 0; i < NumQueries; i++ ) {
+        NumHits += HeightList[i].CollisionFace != -1;
+    }
+    QueryBenchmarkPrint("Height",NumQueries,NumHits,Time);
+    
+    Time = QueryBenchmarkRun(Socket,QUERY_TYPE_LEAF,PointList,NumQueries,BatchSize,Depth,&NextId,LeafList);
+    if( Time < 0. ) {
+        goto Failure;
+    }
+    for( i = 0, NumHits = 0; i < NumQueries; i++ ) {
+        NumHits += LeafList[i].NodeIndex != -1;
+    }
+    QueryBenchmarkPrint("Leaf",NumQueries,NumHits,Time);
+    
+    Time = QueryBenchmarkRun(Socket,QUERY_TYPE_RAY_PICK,RayList,NumQueries,BatchSize,Depth,&NextId,PickList);
+    if( Time < 0. ) {
+        goto Failure;
+    }
+    NumFaces = 0;
+    for( i = 0; i < NumQueries; i++ ) {
+        if( PickList[i].Face.TSPNumber != -1 ) {
+            FaceRefList[NumFaces++] = PickList[i].Face;
+        }
+    }
+    QueryBenchmarkPrint("Ray Pick",NumQueries,NumFaces,Time);
+    
+    if( NumFaces ) {
+        Time = QueryBenchmarkRun(Socket,QUERY_TYPE_FACE_INFO,FaceRefList,NumFaces,BatchSize,Depth,&NextId,FaceInfoList);
+        if( Time < 0. ) {
+            goto Failure;
+        }
+        for( i = 0, NumHits = 0; i < NumFaces; i++ ) {
+            NumHits += FaceInfoList[i].Valid;
+        }
+        QueryBenchmarkPrint("Face Info",NumFaces,NumHits,Time);
+    }
+    Result = 1;
+Failure:
+    free(PointList);
+    free(RayList);
+    free(FaceRefList);
+    free(HeightList);
+    free(PickList);
+    free(FaceInfoList);
+    free(LeafList);
+    close(Socket);
+    return Result;
+}
+#else
+int QueryServerRun(BSDRenderObject_t *Level,const char *SocketPath)
+{
+    printf("QueryServerRun:Unix domain sockets are not supported on this platform\n");
+    return 0;
+}
+
+int QueryServerBenchmark(const char *SocketPath,int NumQueries,int BatchSize,int Depth)
+{
+    printf("QueryServerBenchmark:Unix domain sockets are not supported on this platform\n");
+    return 0;
+}
+#endif
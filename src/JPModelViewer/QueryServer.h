@@ -0,0 +1,130 @@
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#ifndef __QUERY_SERVER_H_
+#define __QUERY_SERVER_H_
+
+#include "../Common/Common.h"
+#include "BSD.h"
+
+#define QUERY_SERVER_MAX_CLIENTS 16
+#define QUERY_SERVER_MAX_BATCH 65536
+#define QUERY_SERVER_READ_SIZE 65536
+//NOTE(Adriano):Clients that do not read their results are not served until they go below this size.
+#define QUERY_SERVER_MAX_PENDING_OUTPUT (16 * 1024 * 1024)
+#define QUERY_BENCHMARK_DEFAULT_QUERIES 100000
+#define QUERY_BENCHMARK_DEFAULT_BATCH_SIZE 256
+#define QUERY_BENCHMARK_DEFAULT_DEPTH 8
+
+/*
+ Every message starts with a QueryHeader_t followed by Count items of the same type,the server answers
+ each message with a QueryResponseHeader_t followed by Count results in the same order.
+ Messages are processed in the order they are received so clients can send more of them without waiting.
+ Positions are expressed in the TSP coordinate system and all values use the byte order of the host.
+ */
+typedef enum {
+    QUERY_TYPE_INFO,
+    QUERY_TYPE_HEIGHT,
+    QUERY_TYPE_RAY_PICK,
+    QUERY_TYPE_FACE_INFO,
+    QUERY_TYPE_LEAF,
+    QUERY_TYPE_MAX
+} QueryType_t;
+
+typedef enum {
+    QUERY_STATUS_OK,
+    QUERY_STATUS_ERROR
+} QueryStatus_t;
+
+typedef enum {
+    QUERY_FACE_TEXTURED = 1,
+    QUERY_FACE_TRANSPARENT = 2,
+    QUERY_FACE_DYNAMIC = 4
+} QueryFaceFlags_t;
+
+typedef struct QueryHeader_s {
+    unsigned int    Type;
+    unsigned int    Id;
+    unsigned int    Count;
+} QueryHeader_t;
+
+typedef struct QueryResponseHeader_s {
+    unsigned int    Type;
+    unsigned int    Id;
+    unsigned int    Count;
+    int             Status;
+} QueryResponseHeader_t;
+
+//NOTE(Adriano):Used by QUERY_TYPE_HEIGHT and QUERY_TYPE_LEAF,QUERY_TYPE_INFO has no payload.
+typedef struct QueryPoint_s {
+    float   Position[3];
+} QueryPoint_t;
+
+typedef struct QueryRay_s {
+    float   Origin[3];
+    float   Direction[3];
+} QueryRay_t;
+
+typedef struct QueryFaceRef_s {
+    int     TSPNumber;
+    int     NodeIndex;
+    int     FaceIndex;
+} QueryFaceRef_t;
+
+typedef struct QueryInfoResult_s {
+    float   Min[3];
+    float   Max[3];
+    int     NumTSP;
+    int     NumFaces;
+} QueryInfoResult_t;
+
+//NOTE(Adriano):CollisionFace and TSPNumber are -1 when there is no surface below the point.
+//              CollisionFace indexes the collision faces of the TSP with the given number.
+typedef struct QueryHeightResult_s {
+    int     Y;
+    int     CollisionFace;
+    int     TSPNumber;
+} QueryHeightResult_t;
+
+//NOTE(Adriano):Face.TSPNumber is -1 when the ray does not hit the level.
+typedef struct QueryPickResult_s {
+    QueryFaceRef_t  Face;
+    float           Distance;
+    float           Position[3];
+} QueryPickResult_t;
+
+typedef struct QueryFaceInfoResult_s {
+    int     Valid;
+    int     Flags;
+    int     TexturePage;
+    int     ColorMode;
+    int     CLUTX;
+    int     CLUTY;
+    int     Vertex[9];
+} QueryFaceInfoResult_t;
+
+//NOTE(Adriano):All the fields are -1 when the point is not inside any leaf.
+typedef struct QueryLeafResult_s {
+    int     TSPNumber;
+    int     NodeIndex;
+    int     LeafIndex;
+} QueryLeafResult_t;
+
+int     QueryServerRun(BSDRenderObject_t *Level,const char *SocketPath);
+int     QueryServerBenchmark(const char *SocketPath,int NumQueries,int BatchSize,int Depth);
+#endif//__QUERY_SERVER_H_
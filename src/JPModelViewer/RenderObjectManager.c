@@ -20,20 +20,121 @@
 */
 #include "RenderObjectManager.h"
 #include "JPModelViewer.h"
+#include "Occlusion.h"
+#include "PVS.h"
+#include "Pick.h"
+#include "Streaming.h"
+#include "MeshOptimizer.h"
+#include "LOD.h"
 
 Config_t *EnableWireFrameMode;
 Config_t *EnableAmbientLight;
+Config_t *ExportRegionType;
+Config_t *ExportRegionSize;
+Config_t *ExportRegionClipFaces;
+Config_t *EnableNativeVRAM;
+Config_t *EnableTextureAtlas;
+Config_t *VRAMMemoryBudget;
+Config_t *EnableContentDeduplication;
+
+static RenderObjectManagerResidencyStats_t RenderObjectManagerResidencyStats;
+static RenderObjectManagerDeduplicationStats_t RenderObjectManagerDeduplicationStats;
+static RenderObjectManagerTextureSet_t *RenderObjectManagerTextureSetList;
+
+/*
+ * Drops a reference to the texture set,the images and the VRAM are released together with the last one.
+ */
+void RenderObjectManagerReleaseTextureSet(RenderObjectManagerTextureSet_t *TextureSet)
+{
+    RenderObjectManagerTextureSet_t **Iterator;
+    
+    TextureSet->RefCount--;
+    if( TextureSet->RefCount > 0 ) {
+        return;
+    }
+    for( Iterator = &RenderObjectManagerTextureSetList; *Iterator; Iterator = &(*Iterator)->Next ) {
+        if( *Iterator == TextureSet ) {
+            *Iterator = TextureSet->Next;
+            break;
+        }
+    }
+    TIMImageListFree(TextureSet->ImageList);
+    VRAMFree(TextureSet->VRAM);
+    free(TextureSet);
+}
+
+/*
+ * Sets the image list and the VRAM of the pack,if another pack was loaded with the same images its VRAM is
+ * shared instead of being uploaded again and the images of the pack are released.
+ * The image list of the pack must have been interned.
+ * Returns 1 on success,0 if the VRAM could not be created.
+ */
+int RenderObjectManagerAcquireTextureSet(BSDRenderObjectPack_t *BSDPack,bool NativeLayout)
+{
+    RenderObjectManagerTextureSet_t *TextureSet;
+    
+    for( TextureSet = RenderObjectManagerTextureSetList; TextureSet; TextureSet = TextureSet->Next ) {
+        if( TextureSet->VRAM->NativeLayout == NativeLayout && TIMImageListEquals(TextureSet->ImageList,BSDPack->ImageList) ) {
+            DPrintf("RenderObjectManagerAcquireTextureSet:Sharing VRAM with %i packs\n",TextureSet->RefCount);
+            TIMImageListFree(BSDPack->ImageList);
+            TextureSet->RefCount++;
+            BSDPack->ImageList = TextureSet->ImageList;
+            BSDPack->VRAM = TextureSet->VRAM;
+            BSDPack->TextureSet = TextureSet;
+            return 1;
+        }
+    }
+    TextureSet = malloc(sizeof(RenderObjectManagerTextureSet_t));
+    if( !TextureSet ) {
+        DPrintf("RenderObjectManagerAcquireTextureSet:Failed to allocate memory for texture set\n");
+        return 0;
+    }
+    TextureSet->VRAM = VRAMInit(BSDPack->ImageList,NativeLayout);
+    if( !TextureSet->VRAM ) {
+        free(TextureSet);
+        return 0;
+    }
+    TextureSet->ImageList = BSDPack->ImageList;
+    TextureSet->VRAMSize = VRAMGetSize(TextureSet->VRAM);
+    TextureSet->RefCount = 1;
+    TextureSet->Next = RenderObjectManagerTextureSetList;
+    RenderObjectManagerTextureSetList = TextureSet;
+    BSDPack->VRAM = TextureSet->VRAM;
+    BSDPack->TextureSet = TextureSet;
+    return 1;
+}
+
+const RenderObjectManagerDeduplicationStats_t *RenderObjectManagerGetDeduplicationStats()
+{
+    RenderObjectManagerDeduplicationStats_t *Stats;
+    RenderObjectManagerTextureSet_t *TextureSet;
+    
+    Stats = &RenderObjectManagerDeduplicationStats;
+    Stats->NumTextureSets = 0;
+    Stats->NumSharedTextureSets = 0;
+    Stats->SavedVRAMSize = 0;
+    for( TextureSet = RenderObjectManagerTextureSetList; TextureSet; TextureSet = TextureSet->Next ) {
+        Stats->NumTextureSets++;
+        Stats->NumSharedTextureSets += TextureSet->RefCount - 1;
+        Stats->SavedVRAMSize += (TextureSet->RefCount - 1) * TextureSet->VRAMSize;
+    }
+    return Stats;
+}
 
 void RenderObjectManagerFreeBSDRenderObjectPack(BSDRenderObjectPack_t *BSDRenderObjectPack)
 {
     if( !BSDRenderObjectPack ) {
         return;
     }
-    if( BSDRenderObjectPack->ImageList ) {
-        TIMImageListFree(BSDRenderObjectPack->ImageList);
-    }
-    if( BSDRenderObjectPack->VRAM ) {
-        VRAMFree(BSDRenderObjectPack->VRAM);
+    if( BSDRenderObjectPack->TextureSet ) {
+        RenderObjectManagerReleaseTextureSet(BSDRenderObjectPack->TextureSet);
+    } else {
+        if( BSDRenderObjectPack->ImageList ) {
+            TIMImageListFree(BSDRenderObjectPack->ImageList);
+        }
+        if( BSDRenderObjectPack->VRAM ) {
+            VRAMFree(BSDRenderObjectPack->VRAM);
+        }
     }
     if( BSDRenderObjectPack->Name ) {
         free(BSDRenderObjectPack->Name);
@@ -72,6 +173,7 @@ void RenderObjectManagerCleanUp(RenderObjectManager_t *RenderObjectManager)
     if( FileDialogIsOpen(RenderObjectManager->ExportFileDialog) ) {
         RenderObjectManagerFreeDialogData(RenderObjectManager->ExportFileDialog);
     }
+    OcclusionShutdown();
     free(RenderObjectManager);
 }
 int RenderObjectManagerIsAnimationPlaying(RenderObjectManager_t *RenderObjectManager)
@@ -155,12 +257,92 @@ void RenderObjectManagerExportSelectedModel(RenderObjectManager_t *RenderObjectM
     Exporter->VideoSystem = VideoSystem;
     Exporter->GUI = GUI;
     Exporter->OutputFormat = OutputFormat;
+    Exporter->ExportRegion = false;
 
     FileDialogSetTitle(RenderObjectManager->ExportFileDialog,"Export Model");
     FileDialogOpen(RenderObjectManager->ExportFileDialog,Exporter);
 
 }
 
+void RenderObjectManagerExportSelectedRegionToFile(RenderObjectManager_t *RenderObjectManager,GUI_t *GUI,VideoSystem_t *VideoSystem,
+                                                   const TSPExportRegion_t *Region,int OutputFormat,const char *Directory)
+{
+    char *BSDName;
+    char *BaseName;
+    BSDRenderObjectPack_t *CurrentBSDPack;
+    BSDRenderObject_t *CurrentRenderObject;
+    int Format;
+    
+    CurrentBSDPack = RenderObjectManagerGetSelectedBSDPack(RenderObjectManager);
+    CurrentRenderObject = RenderObjectManagerGetSelectedRenderObject(RenderObjectManager);
+    if( !CurrentBSDPack || !CurrentRenderObject || !CurrentRenderObject->TSP ) {
+        DPrintf("RenderObjectManagerExportSelectedRegionToFile:No level selected\n");
+        return;
+    }
+    Format = OutputFormat == RENDER_OBJECT_MANAGER_EXPORT_FORMAT_OBJ ? TSP_EXPORT_FORMAT_OBJ : TSP_EXPORT_FORMAT_PLY;
+    BSDName = SwitchExt(CurrentBSDPack->Name,"");
+    asprintf(&BaseName,"Region-%s-JP",BSDName);
+    ProgressBarSetDialogTitle(GUI->ProgressBar,"Exporting Region...");
+    ProgressBarIncrement(GUI->ProgressBar,VideoSystem,10,"Writing level data.");
+    if( !TSPExportRegion(CurrentRenderObject->TSP,CurrentBSDPack->VRAM,Region,Format,Directory,BaseName) ) {
+        ErrorMessageDialogSet(GUI->ErrorMessageDialog,"The selected region does not contain any face");
+    }
+    ProgressBarIncrement(GUI->ProgressBar,VideoSystem,100,"Done.");
+    free(BaseName);
+    free(BSDName);
+}
+
+/*
+ Exports the part of the selected level that is inside the box centered on the camera or inside
+ the camera frustum,the region is captured when this function is called.
+ */
+void RenderObjectManagerExportSelectedRegion(RenderObjectManager_t *RenderObjectManager,GUI_t *GUI,VideoSystem_t *VideoSystem,
+                                             Camera_t *Camera,int OutputFormat)
+{
+    RenderObjectManagerDialogData_t *Exporter;
+    BSDRenderObject_t *RenderObject;
+    mat4 ProjectionMatrix;
+    mat4 MVPMatrix;
+    vec3 Min;
+    vec3 Max;
+    
+    if( !RenderObjectManager || !GUI || !Camera ) {
+        DPrintf("RenderObjectManagerExportSelectedRegion:Invalid data\n");
+        return;
+    }
+    RenderObject = RenderObjectManagerGetSelectedRenderObject(RenderObjectManager);
+    if( !RenderObject || !RenderObject->TSP ) {
+        DPrintf("RenderObjectManagerExportSelectedRegion:No level selected\n");
+        return;
+    }
+    Exporter = malloc(sizeof(RenderObjectManagerDialogData_t));
+    if( !Exporter ) {
+        DPrintf("RenderObjectManagerExportSelectedRegion:Couldn't allocate data for the exporter\n");
+        return;
+    }
+    Exporter->RenderObjectManager = RenderObjectManager;
+    Exporter->VideoSystem = VideoSystem;
+    Exporter->GUI = GUI;
+    Exporter->OutputFormat = OutputFormat;
+    Exporter->ExportRegion = true;
+    if( ExportRegionType->IValue == RENDER_OBJECT_MANAGER_EXPORT_REGION_FRUSTUM ) {
+        RenderObjectManagerGetProjectionMatrix(ProjectionMatrix);
+        BSDGetRenderObjectMVPMatrix(RenderObject,Camera,ProjectionMatrix,MVPMatrix);
+        TSPExportRegionFromFrustum(&Exporter->Region,MVPMatrix,ExportRegionClipFaces->IValue);
+    } else {
+        //NOTE(Adriano):Bring the camera back into the PSX coordinate system.
+        Min[0] = Camera->Eye[0] - ExportRegionSize->FValue;
+        Min[1] = -Camera->Eye[1] - ExportRegionSize->FValue;
+        Min[2] = -Camera->Eye[2] - ExportRegionSize->FValue;
+        Max[0] = Camera->Eye[0] + ExportRegionSize->FValue;
+        Max[1] = -Camera->Eye[1] + ExportRegionSize->FValue;
+        Max[2] = -Camera->Eye[2] + ExportRegionSize->FValue;
+        TSPExportRegionFromBox(&Exporter->Region,Min,Max,ExportRegionClipFaces->IValue);
+    }
+    FileDialogSetTitle(RenderObjectManager->ExportFileDialog,"Export Region");
+    FileDialogOpen(RenderObjectManager->ExportFileDialog,Exporter);
+}
+
 const char *RenderObjectManagerErrorToString(int ErrorCode)
 {
     switch( ErrorCode ) {
@@ -288,6 +470,170 @@ BSDRenderObjectPack_t *RenderObjectManagerGetBSDPack(RenderObjectManager_t *Rend
     return NULL;
 }
 
+/*
+ * Returns the last time that any of the packs sharing the VRAM was drawn.
+ */
+int RenderObjectManagerGetVRAMLastDrawTime(RenderObjectManager_t *RenderObjectManager,VRAM_t *VRAM)
+{
+    BSDRenderObjectPack_t *Iterator;
+    int LastDrawTime;
+    
+    LastDrawTime = 0;
+    for( Iterator = RenderObjectManager->BSDList; Iterator; Iterator = Iterator->Next ) {
+        if( Iterator->VRAM == VRAM && Iterator->LastDrawTime > LastDrawTime ) {
+            LastDrawTime = Iterator->LastDrawTime;
+        }
+    }
+    return LastDrawTime;
+}
+
+/*
+ * Returns true if the pack is the first one of the list that uses its VRAM,used to count shared VRAMs once.
+ */
+bool RenderObjectManagerIsVRAMOwner(RenderObjectManager_t *RenderObjectManager,BSDRenderObjectPack_t *BSDPack)
+{
+    BSDRenderObjectPack_t *Iterator;
+    
+    for( Iterator = RenderObjectManager->BSDList; Iterator != BSDPack; Iterator = Iterator->Next ) {
+        if( Iterator->VRAM == BSDPack->VRAM ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Evicts the VRAM of the packs that were drawn least recently until the resident size fits inside the budget.
+ * The VRAM of CurrentPack is never evicted,VRAMs shared by more packs are counted once and evicted only when
+ * none of them was drawn recently.
+ */
+void RenderObjectManagerEnforceVRAMBudget(RenderObjectManager_t *RenderObjectManager,BSDRenderObjectPack_t *CurrentPack)
+{
+    BSDRenderObjectPack_t *Iterator;
+    BSDRenderObjectPack_t *Oldest;
+    RenderObjectManagerResidencyStats_t *Stats;
+    int Budget;
+    int LastDrawTime;
+    int OldestDrawTime;
+    
+    Stats = &RenderObjectManagerResidencyStats;
+    Budget = VRAMMemoryBudget->IValue * 1024 * 1024;
+    while( 1 ) {
+        Stats->NumPacks = 0;
+        Stats->NumResidentPacks = 0;
+        Stats->ResidentSize = 0;
+        Oldest = NULL;
+        OldestDrawTime = 0;
+        for( Iterator = RenderObjectManager->BSDList; Iterator; Iterator = Iterator->Next ) {
+            Stats->NumPacks++;
+            if( !Iterator->VRAM->Resident ) {
+                continue;
+            }
+            Stats->NumResidentPacks++;
+            if( !RenderObjectManagerIsVRAMOwner(RenderObjectManager,Iterator) ) {
+                continue;
+            }
+            Stats->ResidentSize += VRAMGetSize(Iterator->VRAM);
+            if( Iterator->VRAM == CurrentPack->VRAM ) {
+                continue;
+            }
+            LastDrawTime = RenderObjectManagerGetVRAMLastDrawTime(RenderObjectManager,Iterator->VRAM);
+            if( !Oldest || LastDrawTime < OldestDrawTime ) {
+                Oldest = Iterator;
+                OldestDrawTime = LastDrawTime;
+            }
+        }
+        if( Stats->ResidentSize <= Budget || !Oldest ) {
+            break;
+        }
+        DPrintf("RenderObjectManagerEnforceVRAMBudget:Evicting VRAM of %s\n",Oldest->Name);
+        VRAMEvict(Oldest->VRAM);
+        Stats->NumEvictions++;
+    }
+    Stats->Budget = Budget;
+}
+
+/*
+ * Marks the pack as used and recreates its VRAM textures if they were evicted.
+ */
+void RenderObjectManagerMakePackResident(RenderObjectManager_t *RenderObjectManager,BSDRenderObjectPack_t *BSDPack)
+{
+    double StartTime;
+    
+    BSDPack->LastDrawTime = SysMilliseconds();
+    if( !BSDPack->VRAM->Resident ) {
+        StartTime = SysPreciseMilliseconds();
+        VRAMRestore(BSDPack->VRAM);
+        RenderObjectManagerResidencyStats.NumRestores++;
+        RenderObjectManagerResidencyStats.RestoreTime = SysPreciseMilliseconds() - StartTime;
+    }
+    RenderObjectManagerEnforceVRAMBudget(RenderObjectManager,BSDPack);
+}
+
+const RenderObjectManagerResidencyStats_t *RenderObjectManagerGetResidencyStats()
+{
+    return &RenderObjectManagerResidencyStats;
+}
+
+/*
+ * Registers every texture used by the pack faces (including the ones referenced by dynamic data) and
+ * builds the atlas,faces are pointed to it only if it was built successfully.
+ * Must be called before any VAO is generated.
+ */
+void RenderObjectManagerBuildTextureAtlas(BSDRenderObjectPack_t *BSDPack)
+{
+    BSDRenderObject_t *Iterator;
+    TSP_t *TSP;
+    TSPNode_t *Node;
+    TSPDynamicData_t *DynamicData;
+    BSDAnimatedModelFace_t *AnimatedFace;
+    BSDFace_t *Face;
+    const TSPFace_t *TSPFace;
+    const TSPDynamicFaceData_t *FaceData;
+    int i;
+    int j;
+    
+    for( Iterator = BSDPack->RenderObjectList; Iterator; Iterator = Iterator->Next ) {
+        for( i = 0; i < Iterator->NumFaces; i++ ) {
+            AnimatedFace = &Iterator->FaceList[i];
+            VRAMAtlasAddTexture(BSDPack->VRAM,AnimatedFace->TexInfo & 0x1F,(AnimatedFace->TexInfo >> 7) & 0x3,AnimatedFace->CLUT);
+        }
+        for( i = 0; i < Iterator->NumTexturedFaces; i++ ) {
+            //NOTE(Adriano):Same color mode used when building the static VAO.
+            Face = &Iterator->TexturedFaceList[i];
+            VRAMAtlasAddTexture(BSDPack->VRAM,Face->TexInfo & 0x1F,(Face->TexInfo & 0xC0) >> 7,Face->CBA);
+        }
+        for( TSP = Iterator->TSP; TSP; TSP = TSP->Next ) {
+            for( i = 0; i < TSP->Header.NumNodes; i++ ) {
+                Node = &TSP->Node[i];
+                for( j = 0; j < Node->NumFaces && Node->FaceList; j++ ) {
+                    TSPFace = &Node->FaceList[j];
+                    if( TSPFace->IsTextured ) {
+                        VRAMAtlasAddTexture(BSDPack->VRAM,TSPFace->TSB & 0x1F,(TSPFace->TSB >> 7) & 0x3,TSPFace->CBA);
+                    }
+                }
+            }
+            for( i = 0; i < TSP->Header.NumDynamicDataBlock && TSP->DynamicData; i++ ) {
+                DynamicData = &TSP->DynamicData[i];
+                for( j = 0; j < DynamicData->NumFrames * DynamicData->Header.NumFacesIndex && DynamicData->FaceDataList; j++ ) {
+                    FaceData = &DynamicData->FaceDataList[j];
+                    VRAMAtlasAddTexture(BSDPack->VRAM,FaceData->TSB & 0x1F,(FaceData->TSB >> 7) & 0x3,FaceData->CBA);
+                }
+            }
+        }
+    }
+    if( !VRAMAtlasBuild(BSDPack->VRAM) ) {
+        DPrintf("RenderObjectManagerBuildTextureAtlas:Failed to build the atlas,using the VRAM pages\n");
+        return;
+    }
+    for( Iterator = BSDPack->RenderObjectList; Iterator; Iterator = Iterator->Next ) {
+        Iterator->Atlas = BSDPack->VRAM->Atlas;
+        for( TSP = Iterator->TSP; TSP; TSP = TSP->Next ) {
+            TSP->Atlas = BSDPack->VRAM->Atlas;
+        }
+    }
+}
+
 int RenderObjectManagerLoadBSD(RenderObjectManager_t *RenderObjectManager,GUI_t *GUI,VideoSystem_t *VideoSystem,const char *File)
 {
     BSDRenderObjectPack_t *BSDPack;
@@ -317,9 +663,11 @@ int RenderObjectManagerLoadBSD(RenderObjectManager_t *RenderObjectManager,GUI_t
     BSDPack->Name = GetBaseName(File);
     BSDPack->ImageList = NULL;
     BSDPack->VRAM = NULL;
+    BSDPack->TextureSet = NULL;
     BSDPack->RenderObjectList = NULL;
     BSDPack->SelectedRenderObject = NULL;
     BSDPack->LastUpdateTime = 0;
+    BSDPack->LastDrawTime = SysMilliseconds();
     BSDPack->Next = NULL;
     TAFFile = NULL;
     
@@ -348,15 +696,29 @@ int RenderObjectManagerLoadBSD(RenderObjectManager_t *RenderObjectManager,GUI_t
         ErrorCode = RENDER_OBJECT_MANAGER_BSD_ERROR_ALREADY_LOADED;
         goto Failure;
     }
+    if( EnableContentDeduplication->IValue ) {
+        TIMInternImageList(BSDPack->ImageList);
+        BSDInternRenderObjectList(BSDPack->RenderObjectList);
+    }
     ProgressBarIncrement(GUI->ProgressBar,VideoSystem,70,"Initializing VRAM");
-    BSDPack->VRAM = VRAMInit(BSDPack->ImageList);
+    //NOTE(Adriano):The atlas only contains the textures used by the pack so it cannot be shared.
+    if( EnableContentDeduplication->IValue && !EnableTextureAtlas->IValue && BSDPack->ImageList->Interned ) {
+        RenderObjectManagerAcquireTextureSet(BSDPack,EnableNativeVRAM->IValue);
+    } else {
+        BSDPack->VRAM = VRAMInit(BSDPack->ImageList,EnableNativeVRAM->IValue);
+    }
     if( !BSDPack->VRAM ) {
         DPrintf("RenderObjectManagerLoadBSD:Failed to initialize VRAM\n");
         ErrorCode = RENDER_OBJECT_MANAGER_BSD_ERROR_VRAM_INITIALIZATION;
         goto Failure;
     }
+    if( EnableTextureAtlas->IValue ) {
+        ProgressBarIncrement(GUI->ProgressBar,VideoSystem,85,"Building texture atlas");
+        RenderObjectManagerBuildTextureAtlas(BSDPack);
+    }
     ProgressBarIncrement(GUI->ProgressBar,VideoSystem,100,"Done");
     RenderObjectManagerAppendBSDPack(RenderObjectManager,BSDPack);
+    RenderObjectManagerEnforceVRAMBudget(RenderObjectManager,BSDPack);
     if( !RenderObjectManager->SelectedBSDPack ) {
         RenderObjectManagerSetSelectedRenderObject(RenderObjectManager,BSDPack,BSDPack->RenderObjectList);
     }
@@ -398,6 +760,14 @@ void RenderObjectManagerOnExportDirSelect(FileDialog_t *FileDialog,const char *D
         
     ProgressBarBegin(Exporter->GUI->ProgressBar,"Exporting...");
 
+    if( Exporter->ExportRegion ) {
+        RenderObjectManagerExportSelectedRegionToFile(RenderObjectManager,Exporter->GUI,Exporter->VideoSystem,&Exporter->Region,
+                                                      Exporter->OutputFormat,Directory);
+        ProgressBarEnd(Exporter->GUI->ProgressBar,Exporter->VideoSystem);
+        FileDialogClose(FileDialog);
+        free(Exporter);
+        return;
+    }
     switch( Exporter->OutputFormat ) {
         case RENDER_OBJECT_MANAGER_EXPORT_FORMAT_PLY:
             RenderObjectManagerExportSelectedModelToPly(RenderObjectManager,Exporter->GUI->ProgressBar,Exporter->VideoSystem,Directory);
@@ -487,6 +857,60 @@ void RenderObjectManagerUpdate(RenderObjectManager_t *RenderObjectManager)
     BSDRenderObjectSetAnimationPose(CurrentRenderObject,CurrentRenderObject->CurrentAnimationIndex,NextFrame,0);
     RenderObjectManager->SelectedBSDPack->LastUpdateTime = Now;
 }
+void RenderObjectManagerGetProjectionMatrix(mat4 ProjectionMatrix)
+{
+    glm_perspective(glm_rad(90.f),(float) VidConfigWidth->IValue / (float) VidConfigHeight->IValue,1.f, 4096.f,ProjectionMatrix);
+}
+/*
+ Casts a ray from the camera through the given window position and picks the face of the selected render object
+ that lies under it.
+ The result is available through PickGetStats.
+ */
+int RenderObjectManagerPickFace(RenderObjectManager_t *RenderObjectManager,Camera_t *Camera,int MouseX,int MouseY,PickResult_t *Result)
+{
+    BSDRenderObject_t *RenderObject;
+    mat4 ProjectionMatrix;
+    mat4 MVPMatrix;
+    vec4 Viewport;
+    vec3 WindowPosition;
+    vec3 Near;
+    vec3 Far;
+    vec3 Direction;
+    
+    RenderObject = RenderObjectManagerGetSelectedRenderObject(RenderObjectManager);
+    if( !RenderObject ) {
+        PickClearStats();
+        return 0;
+    }
+    RenderObjectManagerGetProjectionMatrix(ProjectionMatrix);
+    BSDGetRenderObjectMVPMatrix(RenderObject,Camera,ProjectionMatrix,MVPMatrix);
+    Viewport[0] = 0.f;
+    Viewport[1] = 0.f;
+    Viewport[2] = VidConfigWidth->IValue;
+    Viewport[3] = VidConfigHeight->IValue;
+    WindowPosition[0] = MouseX;
+    WindowPosition[1] = VidConfigHeight->IValue - MouseY;
+    WindowPosition[2] = 0.f;
+    glm_unproject(WindowPosition,MVPMatrix,Viewport,Near);
+    WindowPosition[2] = 1.f;
+    glm_unproject(WindowPosition,MVPMatrix,Viewport,Far);
+    glm_vec3_sub(Far,Near,Direction);
+    glm_vec3_normalize(Direction);
+    return PickRenderObject(RenderObject,Near,Direction,Result);
+}
+/*
+ Moves the camera inside the level of the selected render object,if any.
+ */
+void RenderObjectManagerUpdateCamera(RenderObjectManager_t *RenderObjectManager,Camera_t *Camera,float Delta)
+{
+    BSDRenderObject_t *RenderObject;
+    
+    if( !RenderObjectManager ) {
+        return;
+    }
+    RenderObject = RenderObjectManagerGetSelectedRenderObject(RenderObjectManager);
+    CameraApplyMovement(Camera,RenderObject ? RenderObject->TSP : NULL,Delta);
+}
 void RenderObjectManagerDraw(RenderObjectManager_t *RenderObjectManager,Camera_t *Camera)
 {
     mat4 ProjectionMatrix;
@@ -495,8 +919,10 @@ void RenderObjectManagerDraw(RenderObjectManager_t *RenderObjectManager,Camera_t
         return;
     }
     glViewport(0,0,VidConfigWidth->IValue,VidConfigHeight->IValue);
+    LODBeginFrame();
     if( RenderObjectManager->SelectedBSDPack ) {
-        glm_perspective(glm_rad(90.f),(float) VidConfigWidth->IValue / (float) VidConfigHeight->IValue,1.f, 4096.f,ProjectionMatrix);
+        RenderObjectManagerGetProjectionMatrix(ProjectionMatrix);
+        RenderObjectManagerMakePackResident(RenderObjectManager,RenderObjectManager->SelectedBSDPack);
         RenderObjectManagerDrawPack(RenderObjectManager->SelectedBSDPack,Camera,ProjectionMatrix);
     }
 }
@@ -526,7 +952,24 @@ RenderObjectManager_t *RenderObjectManagerInit(GUI_t *GUI)
                                                            RenderObjectManagerOnExportDirCancel);
     EnableWireFrameMode = ConfigGet("EnableWireFrameMode");
     EnableAmbientLight = ConfigGet("EnableAmbientLight");
+    ExportRegionType = ConfigGet("ExportRegionType");
+    ExportRegionSize = ConfigGet("ExportRegionSize");
+    ExportRegionClipFaces = ConfigGet("ExportRegionClipFaces");
+    EnableNativeVRAM = ConfigGet("EnableNativeVRAM");
+    EnableTextureAtlas = ConfigGet("EnableTextureAtlas");
+    VRAMMemoryBudget = ConfigGet("VRAMMemoryBudget");
+    EnableContentDeduplication = ConfigGet("EnableContentDeduplication");
     
+    PVSInit();
+    PickInit();
+    StreamingInit();
+    MeshOptimizerInit();
+    LODInit();
+    if( !OcclusionInit() ) {
+        DPrintf("RenderObjectManagerInit:Failed to initialize occlusion culling\n");
+        free(RenderObjectManager);
+        return NULL;
+    }
     RenderObjectManager->PlayAnimation = 0;
 
     return RenderObjectManager;
@@ -24,6 +24,8 @@
 #include "../Common/VRAM.h"
 #include "../Common/TIM.h"
 #include "Camera.h"
+#include "Pick.h"
+#include "TSP.h"
 
 typedef enum {
     RENDER_OBJECT_MANAGER_BSD_NO_ERRORS = 1,
@@ -36,18 +38,37 @@ typedef enum {
 
 typedef enum {
     RENDER_OBJECT_MANAGER_EXPORT_FORMAT_PLY,
+    RENDER_OBJECT_MANAGER_EXPORT_FORMAT_OBJ,
     RENDER_OBJECT_MANAGER_EXPORT_FORMAT_UNKNOWN
 } LevelManagerExportFormats_t;
 
+typedef enum {
+    RENDER_OBJECT_MANAGER_EXPORT_REGION_BOX,
+    RENDER_OBJECT_MANAGER_EXPORT_REGION_FRUSTUM
+} RenderObjectManagerExportRegionType_t;
+
+//NOTE(Adriano):Packs whose TAF files contain the same images share a single image list and VRAM.
+typedef struct RenderObjectManagerTextureSet_s {
+    TIMImage_t                              *ImageList;
+    VRAM_t                                  *VRAM;
+    int                                     VRAMSize;
+    int                                     RefCount;
+    struct RenderObjectManagerTextureSet_s  *Next;
+} RenderObjectManagerTextureSet_t;
+
 //NOTE(Adriano):A single BSD file that gets loaded together with his corresponding TAF goes
 //              here...this allows for multiple BSD files to be loaded without overlapping VRAMs.
 typedef struct BSDRenderObjectPack_s {
     char                            *Name;
     VRAM_t                          *VRAM;
     TIMImage_t                      *ImageList;
+    //NOTE(Adriano):When set VRAM and ImageList are owned by the texture set.
+    RenderObjectManagerTextureSet_t *TextureSet;
     BSDRenderObject_t               *RenderObjectList;
     BSDRenderObject_t               *SelectedRenderObject;
     int                             LastUpdateTime;
+    //NOTE(Adriano):Used to pick the VRAM that gets evicted when the memory budget is exceeded.
+    int                             LastDrawTime;
     struct BSDRenderObjectPack_s    *Next;
 } BSDRenderObjectPack_t;
 
@@ -63,23 +84,57 @@ typedef struct RenderObjectManager_s {
     int                     PlayAnimation;
 } RenderObjectManager_t;
 
+typedef struct RenderObjectManagerResidencyStats_s {
+    int     NumPacks;
+    int     NumResidentPacks;
+    int     ResidentSize;
+    int     Budget;
+    int     NumEvictions;
+    int     NumRestores;
+    double  RestoreTime;
+} RenderObjectManagerResidencyStats_t;
+
+typedef struct RenderObjectManagerDeduplicationStats_s {
+    int     NumTextureSets;
+    int     NumSharedTextureSets;
+    int     SavedVRAMSize;
+} RenderObjectManagerDeduplicationStats_t;
+
 typedef struct RenderObjectManagerDialogData_s {
     RenderObjectManager_t           *RenderObjectManager;
     VideoSystem_t                   *VideoSystem;
     GUI_t                           *GUI;
     int                             OutputFormat;
+    //NOTE(Adriano):Set when only a part of the selected level has to be exported.
+    bool                            ExportRegion;
+    TSPExportRegion_t               Region;
 } RenderObjectManagerDialogData_t;
 
 extern Config_t *EnableWireFrameMode;
 extern Config_t *EnableAmbientLight;
+extern Config_t *ExportRegionType;
+extern Config_t *ExportRegionSize;
+extern Config_t *ExportRegionClipFaces;
+extern Config_t *EnableNativeVRAM;
+extern Config_t *EnableTextureAtlas;
+extern Config_t *VRAMMemoryBudget;
+extern Config_t *EnableContentDeduplication;
 
 RenderObjectManager_t   *RenderObjectManagerInit(GUI_t *GUI);
+const RenderObjectManagerResidencyStats_t *RenderObjectManagerGetResidencyStats();
+const RenderObjectManagerDeduplicationStats_t *RenderObjectManagerGetDeduplicationStats();
 int                     RenderObjectManagerDeleteBSDPack(RenderObjectManager_t *RenderObjectManager,const char *BSDPackName);
 void                    RenderObjectManagerOpenFileDialog(RenderObjectManager_t *RenderObjectManager,GUI_t *GUI,VideoSystem_t *VideoSystem);
 void                    RenderObjectManagerExportSelectedModel(RenderObjectManager_t *RenderObjectManager,
                                                              GUI_t *GUI,VideoSystem_t *VideoSystem,int OutputFormat,bool ExportCurrentAnimation);
+void                    RenderObjectManagerExportSelectedRegion(RenderObjectManager_t *RenderObjectManager,GUI_t *GUI,
+                                                                VideoSystem_t *VideoSystem,Camera_t *Camera,int OutputFormat);
 void                    RenderObjectManagerUpdate(RenderObjectManager_t *RenderObjectManager);
 void                    RenderObjectManagerDraw(RenderObjectManager_t *RenderObjectManager,Camera_t *Camera);
+void                    RenderObjectManagerGetProjectionMatrix(mat4 ProjectionMatrix);
+void                    RenderObjectManagerUpdateCamera(RenderObjectManager_t *RenderObjectManager,Camera_t *Camera,float Delta);
+int                     RenderObjectManagerPickFace(RenderObjectManager_t *RenderObjectManager,Camera_t *Camera,int MouseX,int MouseY,
+                                                    PickResult_t *Result);
 void                    RenderObjectManagerCleanUp(RenderObjectManager_t *RenderObjectManager);
 int                     RenderObjectManagerLoadPack(RenderObjectManager_t *RenderObjectManager,GUI_t *GUI,
                                                     VideoSystem_t *VideoSystem,const char *File);
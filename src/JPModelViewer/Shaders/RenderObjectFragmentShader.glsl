@@ -11,6 +11,11 @@ flat in int textured;
 
 uniform usampler2D indexTexture;
 uniform sampler2D paletteTexture;
+//NOTE(Adriano):When set indexTexture contains the 16-bit PSX VRAM and paletteTexture is not used.
+uniform bool nativeVRAM;
+//NOTE(Adriano):When set texCoord points inside atlasTexture that contains every texture already decoded.
+uniform sampler2D atlasTexture;
+uniform bool atlasMode;
         
 
 uint InternalToPsxColor(vec4 c) {
@@ -21,6 +26,36 @@ uint InternalToPsxColor(vec4 c) {
     return (a << 15) | (b << 10) | (g << 5) | r;
 }
 
+vec4 PsxToInternalColor(uint c) {
+    return vec4(float(c & 0x1Fu) / 31.0, float((c >> 5) & 0x1Fu) / 31.0, float((c >> 10) & 0x1Fu) / 31.0, float(c >> 15));
+}
+
+//NOTE(Adriano):Converts a position inside the expanded pages to the position of the word that contains it
+//              inside the PSX VRAM.
+ivec2 ExpandedToNative(ivec2 position, int pixelsPerWord) {
+    return ivec2((position.x / 256) * 64 + (position.x % 256) / pixelsPerWord, position.y % 512);
+}
+
+vec4 FetchNativeTexel() {
+    ivec2 position;
+    ivec2 CLUTPosition;
+    int pixelsPerWord;
+    uint bitsPerPixel;
+    uint word;
+    uint CLUTIndex;
+
+    position = ivec2(texCoord);
+    if( colorMode == 2 ) {
+        return PsxToInternalColor(texelFetch(indexTexture, ExpandedToNative(position, 1), 0).r);
+    }
+    pixelsPerWord = colorMode == 0 ? 4 : 2;
+    bitsPerPixel = colorMode == 0 ? 4u : 8u;
+    word = texelFetch(indexTexture, ExpandedToNative(position, pixelsPerWord), 0).r;
+    CLUTIndex = (word >> (uint(position.x % pixelsPerWord) * bitsPerPixel)) & ((1u << bitsPerPixel) - 1u);
+    CLUTPosition = ExpandedToNative(ivec2(CLUTCoord), 1);
+    return PsxToInternalColor(texelFetch(indexTexture, ivec2(CLUTPosition.x + int(CLUTIndex), CLUTPosition.y), 0).r);
+}
+
 void main()
 {
     uvec4 texColor;
@@ -31,7 +66,12 @@ void main()
 
     if( textured == 1 ) {
         //NOTE(Adriano):16-bpp mode textures are encoded directly into CLUT.
-        if( colorMode == 2 ) {
+        if( atlasMode ) {
+            //NOTE(Adriano):Transparent texels are stored as 0 so they are discarded below.
+            CLUTTexel = texelFetch(atlasTexture, ivec2(texCoord), 0);
+        } else if( nativeVRAM ) {
+            CLUTTexel = FetchNativeTexel();
+        } else if( colorMode == 2 ) {
             CLUTTexel = texelFetch(paletteTexture, ivec2(texCoord), 0);
         } else {
             texColor = texelFetch(indexTexture, ivec2(texCoord), 0);
@@ -5,9 +5,13 @@ layout (location = 2) in ivec3 inColor;
 layout (location = 3) in ivec2 inCLUTCoord;
 layout (location = 4) in int   inColorMode;
 layout (location = 5) in int   inTextured;
+layout (location = 6) in int   inLightIndex;
 
 uniform mat4 MVPMatrix;
 uniform bool enableLighting;
+uniform bool enableAnimatedLights;
+//NOTE(Adriano):Current color of each animated light,-1 when the light is not animated.
+uniform ivec3 animatedLightColors[40];
 out vec3 color;
 out vec2 texCoord;
 out float lightingEnabled;
@@ -17,8 +21,19 @@ flat out int textured;
 
 void main()
 {
+    ivec3 vertexColor;
+    ivec3 lightColor;
+
     gl_Position =  MVPMatrix * vec4(inPos, 1.0);
-    color = vec3(inColor) / 255.f;
+    vertexColor = inColor;
+    if( enableAnimatedLights && inLightIndex >= 0 && inLightIndex < 40 ) {
+        lightColor = animatedLightColors[inLightIndex];
+        if( lightColor.r >= 0 ) {
+            //NOTE(Adriano):The green component of the original color is preserved.
+            vertexColor = ivec3(lightColor.r, lightColor.g | inColor.g, lightColor.b);
+        }
+    }
+    color = vec3(vertexColor) / 255.f;
     texCoord = vec2(inTexCoord) + vec2(0.001, 0.001);
     lightingEnabled = enableLighting ? 1.0 : 0.0;
     CLUTCoord = vec2(inCLUTCoord) + vec2(0.001, 0.001);
@@ -0,0 +1,356 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#include "Streaming.h"
+
+Config_t *EnableLevelStreaming;
+Config_t *LevelStreamingMemoryBudget;
+
+static StreamingStats_t StreamingStats;
+
+static int StreamingComparePriority(const void *a,const void *b)
+{
+    const StreamingPriority_t *PriorityA;
+    const StreamingPriority_t *PriorityB;
+    
+    PriorityA = (const StreamingPriority_t *) a;
+    PriorityB = (const StreamingPriority_t *) b;
+    if( PriorityA->Distance != PriorityB->Distance ) {
+        return PriorityA->Distance < PriorityB->Distance ? -1 : 1;
+    }
+    return PriorityA->Index - PriorityB->Index;
+}
+
+/*
+ * Returns the squared distance between the point and the leaf bounds.
+ */
+static float StreamingGetDistance(TSPBBox_t *BBox,vec3 Point)
+{
+    float Delta;
+    float Distance;
+    int Min[3];
+    int Max[3];
+    int i;
+    
+    Min[0] = BBox->Min.x;
+    Min[1] = BBox->Min.y;
+    Min[2] = BBox->Min.z;
+    Max[0] = BBox->Max.x;
+    Max[1] = BBox->Max.y;
+    Max[2] = BBox->Max.z;
+    Distance = 0.f;
+    for( i = 0; i < 3; i++ ) {
+        if( Point[i] < Min[i] ) {
+            Delta = Min[i] - Point[i];
+        } else if( Point[i] > Max[i] ) {
+            Delta = Point[i] - Max[i];
+        } else {
+            Delta = 0.f;
+        }
+        Distance += Delta * Delta;
+    }
+    return Distance;
+}
+
+/*
+ * Loader thread,builds the mesh (optimized when enabled) of the requested leaves in priority order.
+ */
+static int StreamingThread(void *Data)
+{
+    Streaming_t *Streaming;
+    StreamingLeaf_t *Leaf;
+    TSPNodeMesh_t *Mesh;
+    
+    Streaming = (Streaming_t *) Data;
+    SDL_LockMutex(Streaming->Lock);
+    while( !Streaming->Quit ) {
+        if( Streaming->NextRequest >= Streaming->NumRequests ) {
+            SDL_CondWait(Streaming->WorkAvailable,Streaming->Lock);
+            continue;
+        }
+        Leaf = &Streaming->LeafList[Streaming->RequestList[Streaming->NextRequest++]];
+        if( Leaf->State != STREAMING_LEAF_UNLOADED ) {
+            continue;
+        }
+        Leaf->State = STREAMING_LEAF_BUILDING;
+        SDL_UnlockMutex(Streaming->Lock);
+        Mesh = TSPBuildNodeVertexData(Streaming->TSP,Leaf->Node);
+        SDL_LockMutex(Streaming->Lock);
+        Leaf->State = Mesh ? STREAMING_LEAF_READY : STREAMING_LEAF_FAILED;
+    }
+    SDL_UnlockMutex(Streaming->Lock);
+    return 0;
+}
+
+/*
+ * Evicts the farthest leaves that are outside the working set until the resident size fits inside TargetSize.
+ */
+static void StreamingEvict(Streaming_t *Streaming,int TargetSize)
+{
+    StreamingLeaf_t *Leaf;
+    int Index;
+    int i;
+    
+    for( i = Streaming->NumLeaves - 1; i >= 0 && Streaming->ResidentSize > TargetSize; i-- ) {
+        Index = Streaming->PriorityList[i].Index;
+        Leaf = &Streaming->LeafList[Index];
+        if( Leaf->State != STREAMING_LEAF_RESIDENT || Leaf->Pinned || Streaming->WorkingSet[Index] ) {
+            continue;
+        }
+        TSPEvictNodeVertexData(Leaf->Node);
+        SDL_LockMutex(Streaming->Lock);
+        Leaf->State = STREAMING_LEAF_UNLOADED;
+        SDL_UnlockMutex(Streaming->Lock);
+        Streaming->ResidentSize -= Leaf->Size;
+        Streaming->NumResidentLeaves--;
+        StreamingStats.NumEvictions++;
+    }
+}
+
+/*
+ * Sorts the leaves by their distance from the camera (in level space),the nearest ones that fit inside the memory
+ * budget form the working set.
+ * Leaves of the working set are requested to the loader thread and then uploaded within a fixed time budget,
+ * leaves outside of it are evicted when their memory is needed.
+ */
+void StreamingUpdate(Streaming_t *Streaming,vec3 CameraPosition)
+{
+    StreamingLeaf_t *Leaf;
+    int ReadyList[STREAMING_MAX_PENDING_LEAVES];
+    int NumReady;
+    int NumRequests;
+    int NumPending;
+    int Budget;
+    int Size;
+    int Index;
+    bool Full;
+    double StartTime;
+    int i;
+    
+    if( !Streaming ) {
+        return;
+    }
+    StreamingStats.NumUploads = 0;
+    StreamingStats.NumEvictions = 0;
+    StreamingStats.UploadTime = 0.;
+    Budget = LevelStreamingMemoryBudget->IValue * 1024 * 1024;
+    for( i = 0; i < Streaming->NumLeaves; i++ ) {
+        Streaming->PriorityList[i].Distance = StreamingGetDistance(&Streaming->LeafList[i].Node->BBox,CameraPosition);
+        Streaming->PriorityList[i].Index = i;
+    }
+    qsort(Streaming->PriorityList,Streaming->NumLeaves,sizeof(StreamingPriority_t),StreamingComparePriority);
+    Size = 0;
+    Full = false;
+    for( i = 0; i < Streaming->NumLeaves; i++ ) {
+        Index = Streaming->PriorityList[i].Index;
+        Leaf = &Streaming->LeafList[Index];
+        if( !Full && Size + Leaf->Size > Budget ) {
+            Full = true;
+        }
+        Streaming->WorkingSet[Index] = !Full || Leaf->Pinned;
+        if( Streaming->WorkingSet[Index] ) {
+            Size += Leaf->Size;
+        }
+    }
+    if( Streaming->ResidentSize > Budget ) {
+        StreamingEvict(Streaming,Budget);
+    }
+    
+    NumReady = 0;
+    NumRequests = 0;
+    NumPending = 0;
+    SDL_LockMutex(Streaming->Lock);
+    for( i = 0; i < Streaming->NumLeaves; i++ ) {
+        Index = Streaming->PriorityList[i].Index;
+        Leaf = &Streaming->LeafList[Index];
+        if( !Streaming->WorkingSet[Index] ) {
+            //NOTE(Adriano):The camera moved away before the leaf could be uploaded.
+            if( Leaf->State == STREAMING_LEAF_READY ) {
+                Leaf->State = STREAMING_LEAF_UNLOADED;
+            }
+            continue;
+        }
+        switch( Leaf->State ) {
+            case STREAMING_LEAF_UNLOADED:
+                if( NumRequests < STREAMING_MAX_PENDING_LEAVES ) {
+                    Streaming->RequestList[NumRequests++] = Index;
+                }
+                NumPending++;
+                break;
+            case STREAMING_LEAF_READY:
+                if( NumReady < STREAMING_MAX_PENDING_LEAVES ) {
+                    ReadyList[NumReady++] = Index;
+                }
+                NumPending++;
+                break;
+            case STREAMING_LEAF_BUILDING:
+                NumPending++;
+                break;
+            default:
+                break;
+        }
+    }
+    Streaming->NumRequests = NumRequests;
+    Streaming->NextRequest = 0;
+    if( NumRequests ) {
+        SDL_CondSignal(Streaming->WorkAvailable);
+    }
+    SDL_UnlockMutex(Streaming->Lock);
+
+    StartTime = SysPreciseMilliseconds();
+    for( i = 0; i < NumReady; i++ ) {
+        Leaf = &Streaming->LeafList[ReadyList[i]];
+        if( Streaming->ResidentSize + Leaf->Size > Budget ) {
+            StreamingEvict(Streaming,Budget - Leaf->Size);
+        }
+        TSPUploadNodeVertexData(Streaming->TSP,Leaf->Node);
+        SDL_LockMutex(Streaming->Lock);
+        Leaf->State = Leaf->Node->OpaqueFacesVAO ? STREAMING_LEAF_RESIDENT : STREAMING_LEAF_FAILED;
+        SDL_UnlockMutex(Streaming->Lock);
+        if( Leaf->State == STREAMING_LEAF_RESIDENT ) {
+            Streaming->ResidentSize += Leaf->Size;
+            Streaming->NumResidentLeaves++;
+            StreamingStats.NumUploads++;
+        }
+        NumPending--;
+        if( SysPreciseMilliseconds() - StartTime >= STREAMING_UPLOAD_TIME_BUDGET ) {
+            break;
+        }
+    }
+    StreamingStats.UploadTime = SysPreciseMilliseconds() - StartTime;
+    StreamingStats.Enabled = true;
+    StreamingStats.NumLeaves = Streaming->NumLeaves;
+    StreamingStats.NumResidentLeaves = Streaming->NumResidentLeaves;
+    StreamingStats.NumPendingLeaves = NumPending;
+    StreamingStats.ResidentSize = Streaming->ResidentSize;
+    StreamingStats.Budget = Budget;
+}
+
+void StreamingFree(Streaming_t *Streaming)
+{
+    if( !Streaming ) {
+        return;
+    }
+    if( Streaming->Thread ) {
+        SDL_LockMutex(Streaming->Lock);
+        Streaming->Quit = 1;
+        SDL_CondSignal(Streaming->WorkAvailable);
+        SDL_UnlockMutex(Streaming->Lock);
+        SDL_WaitThread(Streaming->Thread,NULL);
+    }
+    if( Streaming->WorkAvailable ) {
+        SDL_DestroyCond(Streaming->WorkAvailable);
+    }
+    if( Streaming->Lock ) {
+        SDL_DestroyMutex(Streaming->Lock);
+    }
+    if( Streaming->LeafList ) {
+        free(Streaming->LeafList);
+    }
+    if( Streaming->PriorityList ) {
+        free(Streaming->PriorityList);
+    }
+    if( Streaming->WorkingSet ) {
+        free(Streaming->WorkingSet);
+    }
+    if( Streaming->RequestList ) {
+        free(Streaming->RequestList);
+    }
+    free(Streaming);
+    memset(&StreamingStats,0,sizeof(StreamingStats));
+}
+
+/*
+ * Creates the streaming state of the TSP and starts its loader thread.
+ * Leaves without opaque faces have no vertex buffer and are not tracked.
+ */
+Streaming_t *StreamingCreate(TSP_t *TSP)
+{
+    Streaming_t *Streaming;
+    StreamingLeaf_t *Leaf;
+    int NumLeaves;
+    int i;
+    
+    Streaming = malloc(sizeof(Streaming_t));
+    if( !Streaming ) {
+        DPrintf("StreamingCreate:Failed to allocate memory for streaming data\n");
+        return NULL;
+    }
+    memset(Streaming,0,sizeof(Streaming_t));
+    Streaming->TSP = TSP;
+    NumLeaves = 0;
+    for( i = 0; i < TSP->Header.NumNodes; i++ ) {
+        if( TSP->Node[i].NumFaces && TSP->Node[i].NumOpaqueFaces ) {
+            NumLeaves++;
+        }
+    }
+    if( !NumLeaves ) {
+        DPrintf("StreamingCreate:TSP has no opaque leaves\n");
+        goto Failure;
+    }
+    Streaming->LeafList = malloc(NumLeaves * sizeof(StreamingLeaf_t));
+    Streaming->PriorityList = malloc(NumLeaves * sizeof(StreamingPriority_t));
+    Streaming->WorkingSet = malloc(NumLeaves * sizeof(Byte));
+    Streaming->RequestList = malloc(STREAMING_MAX_PENDING_LEAVES * sizeof(int));
+    if( !Streaming->LeafList || !Streaming->PriorityList || !Streaming->WorkingSet || !Streaming->RequestList ) {
+        DPrintf("StreamingCreate:Failed to allocate memory for %i leaves\n",NumLeaves);
+        goto Failure;
+    }
+    for( i = 0; i < TSP->Header.NumNodes; i++ ) {
+        if( !TSP->Node[i].NumFaces || !TSP->Node[i].NumOpaqueFaces ) {
+            continue;
+        }
+        Leaf = &Streaming->LeafList[Streaming->NumLeaves++];
+        Leaf->Node = &TSP->Node[i];
+        Leaf->State = STREAMING_LEAF_UNLOADED;
+        Leaf->Size = TSP_VERTEX_STRIDE * 3 * TSP->Node[i].NumOpaqueFaces;
+        //NOTE(Adriano):Leaves referenced by dynamic blocks are never evicted.
+        Leaf->Pinned = TSPNodeHasDynamicFaces(TSP,&TSP->Node[i]);
+    }
+    Streaming->Lock = SDL_CreateMutex();
+    Streaming->WorkAvailable = SDL_CreateCond();
+    if( !Streaming->Lock || !Streaming->WorkAvailable ) {
+        DPrintf("StreamingCreate:Failed to create synchronization primitives:%s\n",SDL_GetError());
+        goto Failure;
+    }
+    Streaming->Thread = SDL_CreateThread(StreamingThread,"StreamingThread",Streaming);
+    if( !Streaming->Thread ) {
+        DPrintf("StreamingCreate:Failed to create loader thread:%s\n",SDL_GetError());
+        goto Failure;
+    }
+    DPrintf("StreamingCreate:Streaming %i leaves\n",Streaming->NumLeaves);
+    return Streaming;
+Failure:
+    StreamingFree(Streaming);
+    return NULL;
+}
+
+const StreamingStats_t *StreamingGetStats()
+{
+    return &StreamingStats;
+}
+
+int StreamingInit()
+{
+    EnableLevelStreaming = ConfigGet("EnableLevelStreaming");
+    LevelStreamingMemoryBudget = ConfigGet("LevelStreamingMemoryBudget");
+    memset(&StreamingStats,0,sizeof(StreamingStats));
+    return 1;
+}
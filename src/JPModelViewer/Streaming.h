@@ -0,0 +1,90 @@
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    JPModelViewer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    JPModelViewer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with JPModelViewer.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#ifndef __STREAMING_H_
+#define __STREAMING_H_
+
+#include "../Common/Common.h"
+#include "../Common/Config.h"
+#include "TSP.h"
+
+//NOTE(Adriano):Time spent uploading leaves on each frame,at least one leaf is always uploaded.
+#define STREAMING_UPLOAD_TIME_BUDGET    2.0
+//NOTE(Adriano):Number of leaves that the loader thread can prepare ahead of the uploads.
+#define STREAMING_MAX_PENDING_LEAVES    64
+
+typedef enum {
+    STREAMING_LEAF_UNLOADED,
+    STREAMING_LEAF_BUILDING,
+    STREAMING_LEAF_READY,
+    STREAMING_LEAF_RESIDENT,
+    STREAMING_LEAF_FAILED
+} StreamingLeafState_t;
+
+typedef struct StreamingLeaf_s {
+    TSPNode_t   *Node;
+    int         State;
+    int         Size;
+    bool        Pinned;
+} StreamingLeaf_t;
+
+typedef struct StreamingPriority_s {
+    float   Distance;
+    int     Index;
+} StreamingPriority_t;
+
+typedef struct Streaming_s {
+    TSP_t               *TSP;
+    StreamingLeaf_t     *LeafList;
+    int                 NumLeaves;
+    StreamingPriority_t *PriorityList;
+    Byte                *WorkingSet;
+    //NOTE(Adriano):Shared with the loader thread and protected by Lock.
+    int                 *RequestList;
+    int                 NumRequests;
+    int                 NextRequest;
+    int                 Quit;
+    SDL_Thread          *Thread;
+    SDL_mutex           *Lock;
+    SDL_cond            *WorkAvailable;
+    //
+    int                 ResidentSize;
+    int                 NumResidentLeaves;
+} Streaming_t;
+
+typedef struct StreamingStats_s {
+    bool    Enabled;
+    int     NumLeaves;
+    int     NumResidentLeaves;
+    int     NumPendingLeaves;
+    int     NumUploads;
+    int     NumEvictions;
+    int     ResidentSize;
+    int     Budget;
+    double  UploadTime;
+} StreamingStats_t;
+
+extern Config_t *EnableLevelStreaming;
+extern Config_t *LevelStreamingMemoryBudget;
+
+int                     StreamingInit();
+Streaming_t             *StreamingCreate(TSP_t *TSP);
+void                    StreamingUpdate(Streaming_t *Streaming,vec3 CameraPosition);
+const StreamingStats_t  *StreamingGetStats();
+void                    StreamingFree(Streaming_t *Streaming);
+#endif//__STREAMING_H_
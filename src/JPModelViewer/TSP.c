@@ -22,26 +22,124 @@
 #include "TSP.h"
 #include "../Common/ShaderManager.h"
 #include "JPModelViewer.h"
+#include "Occlusion.h"
+#include "PVS.h"
+#include "Collision.h"
+#include "Streaming.h"
+#include "Heightfield.h"
+#include "MeshOptimizer.h"
+
+//NOTE(Adriano):XYZ UV RGB CLUT ColorMode Textured LightIndex
+static const LODVertexFormat_t TSPLODVertexFormat = { TSP_VERTEX_STRIDE, 3, 5 };
+
+void TSPFreeTransparentBatch(TSPTransparentBatch_t *Batch)
+{
+    if( !Batch ) {
+        return;
+    }
+    if( Batch->CenterList ) {
+        free(Batch->CenterList);
+    }
+    if( Batch->KeyList ) {
+        free(Batch->KeyList);
+    }
+    if( Batch->SortedList ) {
+        free(Batch->SortedList);
+    }
+    if( Batch->TempSortedList ) {
+        free(Batch->TempSortedList);
+    }
+    if( Batch->IndexList ) {
+        free(Batch->IndexList);
+    }
+    free(Batch);
+}
+
+void TSPFreeCollisionData(TSP_t *TSP)
+{
+    if( !TSP->CollisionData ) {
+        return;
+    }
+    if( TSP->CollisionData->KDTree ) {
+        free(TSP->CollisionData->KDTree);
+    }
+    if( TSP->CollisionData->FaceIndexList ) {
+        free(TSP->CollisionData->FaceIndexList);
+    }
+    if( TSP->CollisionData->Vertex ) {
+        free(TSP->CollisionData->Vertex);
+    }
+    if( TSP->CollisionData->Normal ) {
+        free(TSP->CollisionData->Normal);
+    }
+    if( TSP->CollisionData->Face ) {
+        free(TSP->CollisionData->Face);
+    }
+    free(TSP->CollisionData);
+    TSP->CollisionData = NULL;
+}
+
+void TSPFreeDynamicData(TSP_t *TSP)
+{
+    int i;
+    
+    if( TSP->DynamicData ) {
+        for( i = 0; i < TSP->Header.NumDynamicDataBlock; i++ ) {
+            if( TSP->DynamicData[i].FaceIndexList ) {
+                free(TSP->DynamicData[i].FaceIndexList);
+            }
+            if( TSP->DynamicData[i].FaceDataList ) {
+                free(TSP->DynamicData[i].FaceDataList);
+            }
+            if( TSP->DynamicData[i].FaceDataListV3 ) {
+                free(TSP->DynamicData[i].FaceDataListV3);
+            }
+            if( TSP->DynamicData[i].TargetList ) {
+                free(TSP->DynamicData[i].TargetList);
+            }
+            if( TSP->DynamicData[i].VertexData ) {
+                free(TSP->DynamicData[i].VertexData);
+            }
+        }
+        free(TSP->DynamicData);
+        TSP->DynamicData = NULL;
+    }
+    TSP->Header.NumDynamicDataBlock = 0;
+}
+
+void TSPFreeNodeMesh(TSPNode_t *Node)
+{
+    if( !Node->Mesh ) {
+        return;
+    }
+    if( Node->Mesh->VertexData ) {
+        free(Node->Mesh->VertexData);
+    }
+    if( Node->Mesh->IndexList ) {
+        free(Node->Mesh->IndexList);
+    }
+    free(Node->Mesh);
+    Node->Mesh = NULL;
+}
 
 void TSPFree(TSP_t *TSP)
 {
-    TSPRenderingFace_t *Temp;
     int i;
     
     if( !TSP ) {
         return;
     }
     
+    //NOTE(Adriano):Stop the loader thread before releasing the data that it reads.
+    StreamingFree(TSP->Streaming);
+    LODCacheSave(TSP->LODCache);
+    LODCacheFree(TSP->LODCache);
     if( TSP->Node ) {
         for( i = 0; i < TSP->Header.NumNodes; i++ ) {
             VAOFree(TSP->Node[i].BBoxVAO);
             VAOFree(TSP->Node[i].OpaqueFacesVAO);
             VAOFree(TSP->Node[i].LeafCollisionFaceListVAO);
-            while( TSP->Node[i].OpaqueFaceList ) {
-                Temp = TSP->Node[i].OpaqueFaceList;
-                TSP->Node[i].OpaqueFaceList = TSP->Node[i].OpaqueFaceList->Next;
-                free(Temp);
-            }
+            TSPFreeNodeMesh(&TSP->Node[i]);
             if( TSP->Node[i].FaceList ) {
                 free(TSP->Node[i].FaceList);
             }
@@ -61,48 +159,26 @@ void TSPFree(TSP_t *TSP)
     if( TSP->Color ) {
         free(TSP->Color);
     }
-    if( TSP->DynamicData ) {
-        if( TSP->Header.NumDynamicDataBlock != 0 ) {
-            for( i = 0; i < TSP->Header.NumDynamicDataBlock; i++ ) {
-                free(TSP->DynamicData[i].FaceIndexList);
-                if( TSP->DynamicData[i].FaceDataList ) {
-                    free(TSP->DynamicData[i].FaceDataList);
-                }
-                if( TSP->DynamicData[i].FaceDataListV3 ) {
-                    free(TSP->DynamicData[i].FaceDataListV3);
-                }
-            }
-            free(TSP->DynamicData);
-        }
-    }
+    TSPFreeDynamicData(TSP);
+    TSPFreeCollisionData(TSP);
     
-    if( TSP->CollisionData ) {
-        if( TSP->CollisionData->KDTree ) {
-            free(TSP->CollisionData->KDTree);
-        }
-        if( TSP->CollisionData->FaceIndexList ) {
-            free(TSP->CollisionData->FaceIndexList);
-        }
-        if( TSP->CollisionData->Vertex ) {
-            free(TSP->CollisionData->Vertex);
-        }
-        if( TSP->CollisionData->Normal ) {
-            free(TSP->CollisionData->Normal);
-        }
-        if( TSP->CollisionData->Face ) {
-            free(TSP->CollisionData->Face);
-        }
-        free(TSP->CollisionData);
+    if( TSP->RenderingFaceList ) {
+        free(TSP->RenderingFaceList);
     }
-    
-    while( TSP->TransparentFaceList ) {
-        Temp = TSP->TransparentFaceList;
-        TSP->TransparentFaceList = TSP->TransparentFaceList->Next;
-        free(Temp);
+    if( TSP->RenderingFaceDataList ) {
+        free(TSP->RenderingFaceDataList);
     }
+    TSPFreeTransparentBatch(TSP->TransparentBatch);
     VAOFree(TSP->VAOList);
     VAOFree(TSP->CollisionVAOList);
     VAOFree(TSP->TransparentVAO);
+    if( TSP->OccluderList ) {
+        free(TSP->OccluderList);
+    }
+    PVSFree(TSP->PVS);
+    CollisionFreeGrid(TSP->CollisionGrid);
+    HeightfieldFree(TSP->Heightfield);
+    BVHFree(TSP->CollisionBVH);
     free(TSP->FName);
     free(TSP);
 }
@@ -354,6 +430,448 @@ void TSPDumpDataToPlyFile(TSP_t *TSPList,VRAM_t *VRAM,FILE* OutFile)
 
 }
 
+/*
+ * Builds an export region from an axis aligned box given in level space.
+ */
+void TSPExportRegionFromBox(TSPExportRegion_t *Region,vec3 Min,vec3 Max,bool ClipFaces)
+{
+    int i;
+    
+    memset(Region->PlaneList,0,sizeof(Region->PlaneList));
+    for( i = 0; i < 3; i++ ) {
+        Region->PlaneList[i * 2][i] = 1.f;
+        Region->PlaneList[i * 2][3] = -Min[i];
+        Region->PlaneList[i * 2 + 1][i] = -1.f;
+        Region->PlaneList[i * 2 + 1][3] = Max[i];
+    }
+    Region->ClipFaces = ClipFaces;
+}
+
+/*
+ * Builds an export region from the camera frustum,MVPMatrix must be the one used to draw the level.
+ */
+void TSPExportRegionFromFrustum(TSPExportRegion_t *Region,mat4 MVPMatrix,bool ClipFaces)
+{
+    glm_frustum_planes(MVPMatrix,Region->PlaneList);
+    Region->ClipFaces = ClipFaces;
+}
+
+float TSPExportGetPlaneDistance(const vec4 Plane,const float *Point)
+{
+    return Plane[0] * Point[0] + Plane[1] * Point[1] + Plane[2] * Point[2] + Plane[3];
+}
+
+/*
+ * Returns false if the box is outside the region,otherwise removes from PlaneMask the planes
+ * that cannot clip anything inside the box.
+ */
+bool TSPExportClassifyBox(const TSPExportRegion_t *Region,TSPBBox_t BBox,int *PlaneMask)
+{
+    float NearCorner[3];
+    float FarCorner[3];
+    int i;
+    
+    for( i = 0; i < 6; i++ ) {
+        if( !(*PlaneMask & (1 << i)) ) {
+            continue;
+        }
+        FarCorner[0] = Region->PlaneList[i][0] >= 0.f ? BBox.Max.x : BBox.Min.x;
+        FarCorner[1] = Region->PlaneList[i][1] >= 0.f ? BBox.Max.y : BBox.Min.y;
+        FarCorner[2] = Region->PlaneList[i][2] >= 0.f ? BBox.Max.z : BBox.Min.z;
+        NearCorner[0] = Region->PlaneList[i][0] >= 0.f ? BBox.Min.x : BBox.Max.x;
+        NearCorner[1] = Region->PlaneList[i][1] >= 0.f ? BBox.Min.y : BBox.Max.y;
+        NearCorner[2] = Region->PlaneList[i][2] >= 0.f ? BBox.Min.z : BBox.Max.z;
+        if( TSPExportGetPlaneDistance(Region->PlaneList[i],FarCorner) < 0.f ) {
+            return false;
+        }
+        if( TSPExportGetPlaneDistance(Region->PlaneList[i],NearCorner) >= 0.f ) {
+            *PlaneMask &= ~(1 << i);
+        }
+    }
+    return true;
+}
+
+int TSPExportMeshGrowHashTable(TSPExportMesh_t *Mesh)
+{
+    int *HashTable;
+    int HashTableSize;
+    unsigned int Hash;
+    int i;
+    
+    HashTableSize = Mesh->HashTableSize ? Mesh->HashTableSize * 2 : 1024;
+    HashTable = malloc(HashTableSize * sizeof(int));
+    if( !HashTable ) {
+        DPrintf("TSPExportMeshGrowHashTable:Failed to allocate memory for %i entries\n",HashTableSize);
+        return 0;
+    }
+    memset(HashTable,-1,HashTableSize * sizeof(int));
+    for( i = 0; i < Mesh->NumVertices; i++ ) {
+        Hash = HashFNV1a(HASH_FNV1A_INITIAL_VALUE,&Mesh->VertexList[i],sizeof(TSPExportVertex_t)) & (HashTableSize - 1);
+        while( HashTable[Hash] != -1 ) {
+            Hash = (Hash + 1) & (HashTableSize - 1);
+        }
+        HashTable[Hash] = i;
+    }
+    free(Mesh->HashTable);
+    Mesh->HashTable = HashTable;
+    Mesh->HashTableSize = HashTableSize;
+    return 1;
+}
+
+/*
+ * Returns the index of the vertex inside the mesh,vertices that are shared by more than one face are
+ * stored only once.
+ */
+int TSPExportMeshAddVertex(TSPExportMesh_t *Mesh,const TSPExportVertex_t *Vertex)
+{
+    TSPExportVertex_t *VertexList;
+    unsigned int Hash;
+    
+    if( (Mesh->NumVertices + 1) * 2 > Mesh->HashTableSize && !TSPExportMeshGrowHashTable(Mesh) ) {
+        return -1;
+    }
+    Hash = HashFNV1a(HASH_FNV1A_INITIAL_VALUE,Vertex,sizeof(TSPExportVertex_t)) & (Mesh->HashTableSize - 1);
+    while( Mesh->HashTable[Hash] != -1 ) {
+        if( !memcmp(&Mesh->VertexList[Mesh->HashTable[Hash]],Vertex,sizeof(TSPExportVertex_t)) ) {
+            return Mesh->HashTable[Hash];
+        }
+        Hash = (Hash + 1) & (Mesh->HashTableSize - 1);
+    }
+    if( Mesh->NumVertices == Mesh->MaxVertices ) {
+        Mesh->MaxVertices = Mesh->MaxVertices ? Mesh->MaxVertices * 2 : 1024;
+        VertexList = realloc(Mesh->VertexList,Mesh->MaxVertices * sizeof(TSPExportVertex_t));
+        if( !VertexList ) {
+            DPrintf("TSPExportMeshAddVertex:Failed to allocate memory for %i vertices\n",Mesh->MaxVertices);
+            return -1;
+        }
+        Mesh->VertexList = VertexList;
+    }
+    Mesh->VertexList[Mesh->NumVertices] = *Vertex;
+    Mesh->HashTable[Hash] = Mesh->NumVertices;
+    return Mesh->NumVertices++;
+}
+
+int TSPExportMeshAddTriangle(TSPExportMesh_t *Mesh,const TSPExportVertex_t *Vertex0,const TSPExportVertex_t *Vertex1,
+                             const TSPExportVertex_t *Vertex2)
+{
+    int *IndexList;
+    int Index[3];
+    
+    Index[0] = TSPExportMeshAddVertex(Mesh,Vertex0);
+    Index[1] = TSPExportMeshAddVertex(Mesh,Vertex1);
+    Index[2] = TSPExportMeshAddVertex(Mesh,Vertex2);
+    if( Index[0] == -1 || Index[1] == -1 || Index[2] == -1 ) {
+        return 0;
+    }
+    if( Mesh->NumIndices + 3 > Mesh->MaxIndices ) {
+        Mesh->MaxIndices = Mesh->MaxIndices ? Mesh->MaxIndices * 2 : 3072;
+        IndexList = realloc(Mesh->IndexList,Mesh->MaxIndices * sizeof(int));
+        if( !IndexList ) {
+            DPrintf("TSPExportMeshAddTriangle:Failed to allocate memory for %i indices\n",Mesh->MaxIndices);
+            return 0;
+        }
+        Mesh->IndexList = IndexList;
+    }
+    memcpy(&Mesh->IndexList[Mesh->NumIndices],Index,sizeof(Index));
+    Mesh->NumIndices += 3;
+    if( Mesh->TileSlot[Vertex0->Tile] == -1 ) {
+        Mesh->TileSlot[Vertex0->Tile] = Mesh->NumTiles;
+        Mesh->TileList[Mesh->NumTiles] = Vertex0->Tile;
+        Mesh->NumTiles++;
+    }
+    return 1;
+}
+
+void TSPExportLerpVertex(const TSPExportVertex_t *From,const TSPExportVertex_t *To,float t,TSPExportVertex_t *Out)
+{
+    int i;
+    
+    for( i = 0; i < 3; i++ ) {
+        Out->Position[i] = From->Position[i] + (To->Position[i] - From->Position[i]) * t;
+        Out->Color[i] = From->Color[i] + (To->Color[i] - From->Color[i]) * t;
+    }
+    Out->UV[0] = From->UV[0] + (To->UV[0] - From->UV[0]) * t;
+    Out->UV[1] = From->UV[1] + (To->UV[1] - From->UV[1]) * t;
+    Out->Tile = From->Tile;
+}
+
+/*
+ * Clips the polygon against a single plane and returns the number of vertices left.
+ */
+int TSPExportClipPolygon(const vec4 Plane,const TSPExportVertex_t *In,int NumIn,TSPExportVertex_t *Out)
+{
+    float Distance;
+    float NextDistance;
+    int NumOut;
+    int Next;
+    int i;
+    
+    NumOut = 0;
+    for( i = 0; i < NumIn; i++ ) {
+        Next = (i + 1) % NumIn;
+        Distance = TSPExportGetPlaneDistance(Plane,In[i].Position);
+        NextDistance = TSPExportGetPlaneDistance(Plane,In[Next].Position);
+        if( Distance >= 0.f ) {
+            Out[NumOut++] = In[i];
+        }
+        if( (Distance >= 0.f) != (NextDistance >= 0.f) ) {
+            TSPExportLerpVertex(&In[i],&In[Next],Distance / (Distance - NextDistance),&Out[NumOut++]);
+        }
+    }
+    return NumOut;
+}
+
+void TSPExportFace(TSPExportMesh_t *Mesh,TSP_t *TSP,TSPFace_t *Face,const TSPExportRegion_t *Region,int PlaneMask)
+{
+    TSPExportVertex_t Polygon[2][TSP_EXPORT_MAX_CLIP_VERTICES];
+    const unsigned short *VertexIndex[3];
+    const TSPUv_t *UV[3];
+    float Distance;
+    int ClipMask;
+    int NumInside;
+    int NumVertices;
+    int Current;
+    int Tile;
+    int i;
+    int j;
+    
+    VertexIndex[0] = &Face->V0;
+    VertexIndex[1] = &Face->V1;
+    VertexIndex[2] = &Face->V2;
+    UV[0] = &Face->UV0;
+    UV[1] = &Face->UV1;
+    UV[2] = &Face->UV2;
+    Tile = VRAMGetTile(Face->TSB & 0x1F,(Face->TSB >> 7) & 0x3);
+    for( i = 0; i < 3; i++ ) {
+        Polygon[0][i].Position[0] = TSP->Vertex[*VertexIndex[i]].Position.x;
+        Polygon[0][i].Position[1] = TSP->Vertex[*VertexIndex[i]].Position.y;
+        Polygon[0][i].Position[2] = TSP->Vertex[*VertexIndex[i]].Position.z;
+        Polygon[0][i].Color[0] = TSP->Color[*VertexIndex[i]].rgba[0] / 255.f;
+        Polygon[0][i].Color[1] = TSP->Color[*VertexIndex[i]].rgba[1] / 255.f;
+        Polygon[0][i].Color[2] = TSP->Color[*VertexIndex[i]].rgba[2] / 255.f;
+        Polygon[0][i].UV[0] = UV[i]->u;
+        Polygon[0][i].UV[1] = UV[i]->v;
+        Polygon[0][i].Tile = Tile;
+    }
+    ClipMask = 0;
+    for( i = 0; i < 6; i++ ) {
+        if( !(PlaneMask & (1 << i)) ) {
+            continue;
+        }
+        NumInside = 0;
+        for( j = 0; j < 3; j++ ) {
+            Distance = TSPExportGetPlaneDistance(Region->PlaneList[i],Polygon[0][j].Position);
+            if( Distance >= 0.f ) {
+                NumInside++;
+            }
+        }
+        if( !NumInside ) {
+            return;
+        }
+        if( NumInside != 3 ) {
+            ClipMask |= 1 << i;
+        }
+    }
+    if( !ClipMask || !Region->ClipFaces ) {
+        TSPExportMeshAddTriangle(Mesh,&Polygon[0][0],&Polygon[0][1],&Polygon[0][2]);
+        return;
+    }
+    Current = 0;
+    NumVertices = 3;
+    for( i = 0; i < 6 && NumVertices >= 3; i++ ) {
+        if( ClipMask & (1 << i) ) {
+            NumVertices = TSPExportClipPolygon(Region->PlaneList[i],Polygon[Current],NumVertices,Polygon[!Current]);
+            Current = !Current;
+        }
+    }
+    for( i = 1; i < NumVertices - 1; i++ ) {
+        TSPExportMeshAddTriangle(Mesh,&Polygon[Current][0],&Polygon[Current][i],&Polygon[Current][i + 1]);
+    }
+    Mesh->NumClippedFaces++;
+}
+
+/*
+ * Walks the node tree skipping the subtrees that are outside the region,planes that are
+ * not crossed by a node bounding box are not tested again by its children.
+ */
+void TSPExportNode(TSPExportMesh_t *Mesh,TSP_t *TSP,TSPNode_t *Node,const TSPExportRegion_t *Region,int PlaneMask)
+{
+    int i;
+    
+    if( !Node ) {
+        return;
+    }
+    Mesh->NumVisitedNodes++;
+    if( !TSPExportClassifyBox(Region,Node->BBox,&PlaneMask) ) {
+        Mesh->NumSkippedNodes++;
+        return;
+    }
+    if( Node->NumFaces != 0 ) {
+        for( i = 0; i < Node->NumFaces; i++ ) {
+            TSPExportFace(Mesh,TSP,&Node->FaceList[i],Region,PlaneMask);
+        }
+        return;
+    }
+    TSPExportNode(Mesh,TSP,Node->Child[0],Region,PlaneMask);
+    TSPExportNode(Mesh,TSP,Node->Child[1],Region,PlaneMask);
+    TSPExportNode(Mesh,TSP,Node->Child[2],Region,PlaneMask);
+}
+
+/*
+ * Converts the page relative UV of the vertex into the coordinates of the exported texture,pages
+ * are stored in the order they were first used.
+ */
+void TSPExportGetTextureCoordinates(TSPExportMesh_t *Mesh,const TSPExportVertex_t *Vertex,float *U,float *V)
+{
+    int NumColumns;
+    int NumRows;
+    int Slot;
+    
+    NumColumns = Mesh->NumTiles < VRAM_NUM_TILES_X ? Mesh->NumTiles : VRAM_NUM_TILES_X;
+    NumRows = (Mesh->NumTiles + NumColumns - 1) / NumColumns;
+    Slot = Mesh->TileSlot[Vertex->Tile];
+    *U = ((Slot % NumColumns) * VRAM_TILE_SIZE + Vertex->UV[0]) / (NumColumns * VRAM_TILE_SIZE);
+    *V = 1.f - (((Slot / NumColumns) * VRAM_TILE_SIZE + Vertex->UV[1]) / (NumRows * VRAM_TILE_SIZE));
+}
+
+void TSPExportMeshWritePly(TSPExportMesh_t *Mesh,FILE *OutFile)
+{
+    TSPExportVertex_t *Vertex;
+    char Buffer[256];
+    float U;
+    float V;
+    int i;
+    
+    sprintf(Buffer,"ply\nformat ascii 1.0\n");
+    fwrite(Buffer,strlen(Buffer),1,OutFile);
+    sprintf(Buffer,
+        "element vertex %i\nproperty float x\nproperty float y\nproperty float z\nproperty float red\nproperty float green\nproperty float blue\nproperty float s\nproperty float t\n",Mesh->NumVertices);
+    fwrite(Buffer,strlen(Buffer),1,OutFile);
+    sprintf(Buffer,"element face %i\nproperty list uchar int vertex_indices\nend_header\n",Mesh->NumIndices / 3);
+    fwrite(Buffer,strlen(Buffer),1,OutFile);
+    for( i = 0; i < Mesh->NumVertices; i++ ) {
+        Vertex = &Mesh->VertexList[i];
+        TSPExportGetTextureCoordinates(Mesh,Vertex,&U,&V);
+        //NOTE(Adriano):Same as rotating by 180 degrees around the X axis like TSPDumpDataToPlyFile.
+        sprintf(Buffer,"%f %f %f %f %f %f %f %f\n",Vertex->Position[0] / 4096.f,-Vertex->Position[1] / 4096.f,
+                -Vertex->Position[2] / 4096.f,Vertex->Color[0],Vertex->Color[1],Vertex->Color[2],U,V);
+        fwrite(Buffer,strlen(Buffer),1,OutFile);
+    }
+    for( i = 0; i < Mesh->NumIndices; i += 3 ) {
+        sprintf(Buffer,"3 %i %i %i\n",Mesh->IndexList[i],Mesh->IndexList[i + 1],Mesh->IndexList[i + 2]);
+        fwrite(Buffer,strlen(Buffer),1,OutFile);
+    }
+}
+
+void TSPExportMeshWriteObj(TSPExportMesh_t *Mesh,const char *BaseName,FILE *OutFile)
+{
+    TSPExportVertex_t *Vertex;
+    char Buffer[256];
+    float U;
+    float V;
+    int i;
+    
+    sprintf(Buffer,"mtllib %s.mtl\no Region\n",BaseName);
+    fwrite(Buffer,strlen(Buffer),1,OutFile);
+    for( i = 0; i < Mesh->NumVertices; i++ ) {
+        Vertex = &Mesh->VertexList[i];
+        sprintf(Buffer,"v %f %f %f %f %f %f\n",Vertex->Position[0] / 4096.f,-Vertex->Position[1] / 4096.f,
+                -Vertex->Position[2] / 4096.f,Vertex->Color[0],Vertex->Color[1],Vertex->Color[2]);
+        fwrite(Buffer,strlen(Buffer),1,OutFile);
+    }
+    for( i = 0; i < Mesh->NumVertices; i++ ) {
+        TSPExportGetTextureCoordinates(Mesh,&Mesh->VertexList[i],&U,&V);
+        sprintf(Buffer,"vt %f %f\n",U,V);
+        fwrite(Buffer,strlen(Buffer),1,OutFile);
+    }
+    sprintf(Buffer,"usemtl vram\n");
+    fwrite(Buffer,strlen(Buffer),1,OutFile);
+    for( i = 0; i < Mesh->NumIndices; i += 3 ) {
+        sprintf(Buffer,"f %i/%i %i/%i %i/%i\n",Mesh->IndexList[i] + 1,Mesh->IndexList[i] + 1,Mesh->IndexList[i + 1] + 1,
+                Mesh->IndexList[i + 1] + 1,Mesh->IndexList[i + 2] + 1,Mesh->IndexList[i + 2] + 1);
+        fwrite(Buffer,strlen(Buffer),1,OutFile);
+    }
+}
+
+void TSPExportMeshFree(TSPExportMesh_t *Mesh)
+{
+    if( Mesh->VertexList ) {
+        free(Mesh->VertexList);
+    }
+    if( Mesh->IndexList ) {
+        free(Mesh->IndexList);
+    }
+    if( Mesh->HashTable ) {
+        free(Mesh->HashTable);
+    }
+}
+
+/*
+ * Exports the faces of the level that are inside the region to Directory/BaseName.ply (or .obj and .mtl)
+ * together with Directory/BaseName.png which contains only the texture pages referenced by them.
+ * Returns the number of exported faces.
+ */
+int TSPExportRegion(TSP_t *TSPList,VRAM_t *VRAM,const TSPExportRegion_t *Region,int Format,const char *Directory,
+                    const char *BaseName)
+{
+    TSPExportMesh_t Mesh;
+    TSP_t *Iterator;
+    FILE *OutFile;
+    char *FileName;
+    char Buffer[256];
+    int NumFaces;
+    
+    if( !TSPList || !VRAM || !Region || !Directory || !BaseName ) {
+        DPrintf("TSPExportRegion:Invalid data\n");
+        return 0;
+    }
+    memset(&Mesh,0,sizeof(Mesh));
+    memset(Mesh.TileSlot,-1,sizeof(Mesh.TileSlot));
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        if( Iterator->Header.NumNodes > 0 ) {
+            TSPExportNode(&Mesh,Iterator,&Iterator->Node[0],Region,0x3F);
+        }
+    }
+    NumFaces = Mesh.NumIndices / 3;
+    DPrintf("TSPExportRegion:%i faces (%i clipped),%i vertices,%i texture pages,skipped %i nodes out of %i\n",
+            NumFaces,Mesh.NumClippedFaces,Mesh.NumVertices,Mesh.NumTiles,Mesh.NumSkippedNodes,Mesh.NumVisitedNodes);
+    if( !NumFaces ) {
+        DPrintf("TSPExportRegion:The region is empty\n");
+        TSPExportMeshFree(&Mesh);
+        return 0;
+    }
+    asprintf(&FileName,"%s%c%s.%s",Directory,PATH_SEPARATOR,BaseName,Format == TSP_EXPORT_FORMAT_OBJ ? "obj" : "ply");
+    OutFile = fopen(FileName,"w");
+    if( !OutFile ) {
+        DPrintf("TSPExportRegion:Failed to open %s for writing\n",FileName);
+        free(FileName);
+        TSPExportMeshFree(&Mesh);
+        return 0;
+    }
+    if( Format == TSP_EXPORT_FORMAT_OBJ ) {
+        TSPExportMeshWriteObj(&Mesh,BaseName,OutFile);
+    } else {
+        TSPExportMeshWritePly(&Mesh,OutFile);
+    }
+    fclose(OutFile);
+    free(FileName);
+    if( Format == TSP_EXPORT_FORMAT_OBJ ) {
+        asprintf(&FileName,"%s%c%s.mtl",Directory,PATH_SEPARATOR,BaseName);
+        OutFile = fopen(FileName,"w");
+        if( OutFile ) {
+            sprintf(Buffer,"newmtl vram\nKa 1.000 1.000 1.000\nKd 1.000 1.000 1.000\nKs 1.000 1.000 1.000\nmap_Kd %s.png\n",BaseName);
+            fwrite(Buffer,strlen(Buffer),1,OutFile);
+            fclose(OutFile);
+        }
+        free(FileName);
+    }
+    asprintf(&FileName,"%s%c%s.png",Directory,PATH_SEPARATOR,BaseName);
+    VRAMSaveTiles(VRAM,FileName,Mesh.TileList,Mesh.NumTiles,Mesh.NumTiles < VRAM_NUM_TILES_X ? Mesh.NumTiles : VRAM_NUM_TILES_X);
+    free(FileName);
+    TSPExportMeshFree(&Mesh);
+    return NumFaces;
+}
+
 bool TSPBoxInFrustum(TSPBBox_t BBox,mat4 MVPMatrix)
 {
     vec4 BoxCornerList[8];
@@ -389,27 +907,16 @@ bool TSPBoxInFrustum(TSPBBox_t BBox,mat4 MVPMatrix)
 }
 
 /*
- * Check if a given face is dynamic by looking into the dynamic array from the given TSP file.
- * Note that Face is either an index to the face array or an offset to the face data.
- * This is due to the difference that exists between MOH and MOH:Underground where in the
- * latter case the faces are stored differently and they cannot be referenced by index.
+ * Check if a given face is dynamic by looking into the dynamic face bitset of the given TSP file.
+ * Note that Face is the index of the face in file order (see TSPComputeFaceIndices).
+ * The block and slot that reference the face can then be found in DynamicFaceLookUp.
  */
 int TSPIsFaceDynamic(TSP_t *TSP,int Face)
 {
-    int i;
-    int j;
-
-    if( TSP->Header.NumDynamicDataBlock == 0 ) {
+    if( !TSP->DynamicFaceBitSet || Face < 0 || Face >= TSP->NumIndexedFaces ) {
         return false;
     }
-    for( i = 0; i < TSP->Header.NumDynamicDataBlock; i++ ) {
-        for( j = 0; j < TSP->DynamicData[i].Header.NumFacesIndex; j++ ) {
-            if( TSP->DynamicData[i].FaceIndexList[j] == Face ) {
-                return true;
-            }
-        }
-    }
-    return false;
+    return (TSP->DynamicFaceBitSet[Face >> 5] & (1u << (Face & 31))) != 0;
 }
 
 void TSPNodeCountTransparentFaces(TSP_t *TSP,TSPNode_t *Node)
@@ -461,181 +968,463 @@ void TSPFillFaceVertexBuffer(int *Buffer,int *BufferSize,TSPVert_t Vertex,Color1
     Buffer[*BufferSize+9] = CLUTY;
     Buffer[*BufferSize+10] = ColorMode;
     Buffer[*BufferSize+11] = Textured;
-    *BufferSize += 12;
+    //NOTE(Adriano):Animated light index resolved by the shader,-1 if the vertex color is static.
+    Buffer[*BufferSize+12] = TSPGetColorIndex(Color.c) < BSD_ANIMATED_LIGHTS_TABLE_SIZE ? (int) (Color.c & 0xFF) : -1;
+    *BufferSize += 13;
 }
 
-void TSPCreateFaceVAO(TSP_t *TSP,TSPNode_t *Node)
+/*
+ * Converts the given face into three vertices and appends them to Buffer.
+ */
+void TSPFillFaceVertices(TSP_t *TSP,const TSPFace_t *Face,int *Buffer,int *BufferPointer)
 {
-    int Base;
-    int Target;
-    int Stride;
     int CBA;
     int TSB;
-    int Vert0;
-    int Vert1;
-    int Vert2;
     int U0,V0;
     int U1,V1;
     int U2,V2;
-    int *VertexData;
-    int *TransparentVertexData;
-    int TotalVertexSize;
-    int VertexSize;
-    int TransparentVertexSize;
-    int VertexPointer;
-    int TransparentVertexPointer;
-    int VertexOffset;
-    int TextureOffset;
-    int ColorOffset;
-    int CLUTOffset;
-    int ColorModeOffset;
-    int TexturedOffset;
     int CLUTPosX;
     int CLUTPosY;
     int CLUTDestX;
     int CLUTDestY;
     int CLUTPage;
-    int NumTransparentFaces;
     int ColorMode;
     int VRAMPage;
     int ABRRate;
+    int PageX;
+    int PageY;
+    
+    U0 = Face->UV0.u;
+    V0 = Face->UV0.v;
+    U1 = Face->UV1.u;
+    V1 = Face->UV1.v;
+    U2 = Face->UV2.u;
+    V2 = Face->UV2.v;
+    TSB = Face->TSB;
+    CBA = Face->CBA;
+    
+    ColorMode = (TSB >> 7) & 0x3;
+    VRAMPage = TSB & 0x1F;
+    ABRRate = (TSB & 0x60) >> 5;
+    
+    CLUTPosX = (CBA << 4) & 0x3F0;
+    CLUTPosY = (CBA >> 6) & 0x1ff;
+    CLUTPage = VRAMGetCLUTPage(CLUTPosX,CLUTPosY);
+    CLUTDestX = VRAMGetCLUTPositionX(CLUTPosX,CLUTPosY,CLUTPage);
+    CLUTDestY = CLUTPosY + VRAMGetCLUTOffsetY(ColorMode);
+    CLUTDestX += VRAMGetTexturePageX(CLUTPage);
+
+    DPrintf("TSB is %u\n",TSB);
+    DPrintf("Expected VRam Page:%i\n",VRAMPage);
+    DPrintf("Expected Color Mode:%i\n",ColorMode);
+    DPrintf("Expected ABR rate:%i\n",ABRRate);
+    DPrintf("Expected CLUT Position:%ix%i at page %i\n",CLUTPosX,CLUTPosY,CLUTPage);
+
+    if( TSP->Atlas && Face->IsTextured ) {
+        VRAMAtlasGetTile(TSP->Atlas,VRAMPage,ColorMode,CBA,&PageX,&PageY);
+    } else {
+        PageX = VRAMGetTexturePageX(VRAMPage);
+        PageY = VRAMGetTexturePageY(VRAMPage,ColorMode);
+    }
+    U0 += PageX;
+    V0 += PageY;
+    U1 += PageX;
+    V1 += PageY;
+    U2 += PageX;
+    V2 += PageY;
+    
+    DPrintf("Tex Coords are %i;%i %i;%i %i;%i\n",
+                U0,V0,
+                U1,V1,
+                U2,V2);
+    TSPFillFaceVertexBuffer(Buffer,BufferPointer,TSP->Vertex[Face->V0],
+                            TSP->Color[Face->V0],U0,V0,CLUTDestX,CLUTDestY,ColorMode,Face->IsTextured);
+    TSPFillFaceVertexBuffer(Buffer,BufferPointer,TSP->Vertex[Face->V1],
+                            TSP->Color[Face->V1],U1,V1,CLUTDestX,CLUTDestY,ColorMode,Face->IsTextured);
+    TSPFillFaceVertexBuffer(Buffer,BufferPointer,TSP->Vertex[Face->V2],
+                            TSP->Color[Face->V2],U2,V2,CLUTDestX,CLUTDestY,ColorMode,Face->IsTextured);
+}
+
+/*
+ * Registers the rendering face as a target of the dynamic block that references it.
+ */
+void TSPAddDynamicFaceTarget(TSP_t *TSP,int FaceIndex,int RenderingFaceIndex,VAO_t *VAO)
+{
+    TSPDynamicFaceRef_t Ref;
+    TSPDynamicData_t *DynamicData;
+    TSPDynamicFaceTarget_t *Target;
+    
+    if( !TSPIsFaceDynamic(TSP,FaceIndex) ) {
+        return;
+    }
+    Ref = TSP->DynamicFaceLookUp[FaceIndex];
+    DynamicData = &TSP->DynamicData[Ref.Block];
+    Target = &DynamicData->TargetList[DynamicData->NumTargets];
+    Target->Slot = Ref.Slot;
+    Target->RenderingFaceIndex = RenderingFaceIndex;
+    Target->VAOBufferOffset = TSP->RenderingFaceList[RenderingFaceIndex].VAOBufferOffset;
+    Target->VAO = VAO;
+    DynamicData->NumTargets++;
+    TSP->RenderingFaceList[RenderingFaceIndex].Flags |= TSP_FX_DYNAMIC_FACE;
+    TSP->RenderingFaceDataList[RenderingFaceIndex].DynamicDataIndex = Ref.Block;
+}
+
+/*
+ * Assigns a rendering face to each face of the node.
+ * Opaque faces get a fixed slot inside the node vertex buffer so that it can be created (or created again after
+ * being evicted) at any time using TSPBuildNodeVertexData and TSPUploadNodeVertexData.
+ * Transparent faces are uploaded right away into the shared buffer.
+ */
+void TSPRegisterNodeFaces(TSP_t *TSP,TSPNode_t *Node)
+{
+    int TSB;
+    int Vert0;
+    int Vert1;
+    int Vert2;
+    int *TransparentVertexData;
+    int TransparentVertexSize;
+    int TransparentVertexPointer;
     TSPRenderingFace_t *RenderingFace;
-    VAO_t *VAO;
+    TSPRenderingFaceData_t *RenderingFaceData;
+    bool IsTransparent;
+    int FaceIndex;
     int i;
     
-
-    Base = 0;
-    Target = Node->NumFaces;
-
-//            XYZ UV RGB CLUT ColorMode Textured
-    Stride = (3 + 2 + 3 + 2 + 1 + 1) * sizeof(int);
-                
-    VertexOffset = 0;
-    TextureOffset = 3;
-    ColorOffset = 5;
-    CLUTOffset = 8;
-    ColorModeOffset = 10;
-    TexturedOffset = 11;
-
-    NumTransparentFaces = Node->NumTransparentFaces;
-    VertexSize = Stride * 3;
-    TotalVertexSize = VertexSize * (Node->NumFaces - NumTransparentFaces);
-    VertexData = malloc(VertexSize);
-    VertexPointer = 0;
-    TransparentVertexSize = Stride * 3;
+    TransparentVertexSize = TSP_VERTEX_STRIDE * 3;
     TransparentVertexData = malloc(TransparentVertexSize);
     TransparentVertexPointer = 0;
-    VAO = VAOInitXYZUVRGBCLUTColorModeTexturedInteger(NULL,TotalVertexSize,Stride,VertexOffset,TextureOffset,ColorOffset,CLUTOffset,ColorModeOffset,
-                                                      TexturedOffset,(Node->NumFaces - NumTransparentFaces) * 3);
-    Node->OpaqueFacesVAO = VAO;
+    Node->OpaqueFacesVAO = NULL;
+    Node->OpaqueFaceStart = TSP->NumOpaqueRenderingFaces;
+    Node->NumOpaqueFaces = 0;
     //NOTE(Adriano):Some levels have duplicated triangles...we need to make sure that the order in which they are rendered
     //              is such that they do not get overwritten by a later triangle definition with an invalid texture coordinate.
     //              An example can be found in MOH MSN4:LVL2 where in some part of the level the geometry is specified twice.
-    for( i = Target - 1; i >= Base; i-- ) {
+    for( i = Node->NumFaces - 1; i >= 0; i-- ) {
 
         Vert0 = Node->FaceList[i].V0;
         Vert1 = Node->FaceList[i].V1;
         Vert2 = Node->FaceList[i].V2;
-        U0 = Node->FaceList[i].UV0.u;
-        V0 = Node->FaceList[i].UV0.v;
-        U1 = Node->FaceList[i].UV1.u;
-        V1 = Node->FaceList[i].UV1.v;
-        U2 = Node->FaceList[i].UV2.u;
-        V2 = Node->FaceList[i].UV2.v;
         TSB = Node->FaceList[i].TSB;
-        CBA = Node->FaceList[i].CBA;
-        
-
-        ColorMode = (TSB >> 7) & 0x3;
-        VRAMPage = TSB & 0x1F;
-        ABRRate = (TSB & 0x60) >> 5;
         
-        RenderingFace = malloc(sizeof(TSPRenderingFace_t));
+        IsTransparent = (TSB & 0x4000) != 0;
+        //NOTE(Adriano):Opaque faces are stored leaf by leaf at the start of the array,transparent ones at the end.
+        if( IsTransparent ) {
+            FaceIndex = TSP->TransparentFaceStart + TSP->NumTransparentRenderingFaces;
+            TSP->NumTransparentRenderingFaces++;
+        } else {
+            FaceIndex = TSP->NumOpaqueRenderingFaces;
+            TSP->NumOpaqueRenderingFaces++;
+        }
+        RenderingFace = &TSP->RenderingFaceList[FaceIndex];
+        RenderingFaceData = &TSP->RenderingFaceDataList[FaceIndex];
         RenderingFace->Flags = 0;
-        RenderingFace->Next = NULL;
+        RenderingFace->BlendingMode = 0;
         DPrintf("Vert0:%i Vert1:%i Vert2:%i\n",Vert0,Vert1,Vert2);
-        RenderingFace->Vert0 = TSP->Vertex[Vert0];
-        RenderingFace->Vert1 = TSP->Vertex[Vert1];
-        RenderingFace->Vert2 = TSP->Vertex[Vert2];
-        RenderingFace->Colors[0]= TSP->Color[Vert0];
-        RenderingFace->Colors[1] = TSP->Color[Vert1];
-        RenderingFace->Colors[2] = TSP->Color[Vert2];
-        
-        CLUTPosX = (CBA << 4) & 0x3F0;
-        CLUTPosY = (CBA >> 6) & 0x1ff;
-        CLUTPage = VRAMGetCLUTPage(CLUTPosX,CLUTPosY);
-        CLUTDestX = VRAMGetCLUTPositionX(CLUTPosX,CLUTPosY,CLUTPage);
-        CLUTDestY = CLUTPosY + VRAMGetCLUTOffsetY(ColorMode);
-        CLUTDestX += VRAMGetTexturePageX(CLUTPage);
-
-        DPrintf("TSB is %u\n",TSB);
-        DPrintf("Expected VRam Page:%i\n",VRAMPage);
-        DPrintf("Expected Color Mode:%i\n",ColorMode);
-        DPrintf("Expected ABR rate:%i\n",ABRRate);
-        DPrintf("Expected CLUT Position:%ix%i at page %i\n",CLUTPosX,CLUTPosY,CLUTPage);
-
-
-        U0 += VRAMGetTexturePageX(VRAMPage);
-        V0 += VRAMGetTexturePageY(VRAMPage,ColorMode);
-        U1 += VRAMGetTexturePageX(VRAMPage);
-        V1 += VRAMGetTexturePageY(VRAMPage,ColorMode);
-        U2 += VRAMGetTexturePageX(VRAMPage);
-        V2 += VRAMGetTexturePageY(VRAMPage,ColorMode);
-     
+        RenderingFaceData->Vert[0] = Vert0;
+        RenderingFaceData->Vert[1] = Vert1;
+        RenderingFaceData->Vert[2] = Vert2;
+        RenderingFaceData->DynamicDataIndex = -1;
         
         if( TSPGetColorIndex(TSP->Color[Vert0].c) < BSD_ANIMATED_LIGHTS_TABLE_SIZE || 
             TSPGetColorIndex(TSP->Color[Vert1].c) < BSD_ANIMATED_LIGHTS_TABLE_SIZE || 
             TSPGetColorIndex(TSP->Color[Vert2].c) < BSD_ANIMATED_LIGHTS_TABLE_SIZE ) {
             RenderingFace->Flags |= TSP_FX_ANIMATED_LIGHT_FACE;
         }
-                    
-        DPrintf("Tex Coords are %i;%i %i;%i %i;%i\n",
-                    U0,V0,
-                    U1,V1,
-                    U2,V2);
-        if( (TSB & 0x4000) != 0) {
-            TSPFillFaceVertexBuffer(TransparentVertexData,&TransparentVertexPointer,TSP->Vertex[Vert0],
-                                   TSP->Color[Vert0],U0,V0,CLUTDestX,CLUTDestY,ColorMode,Node->FaceList[i].IsTextured);
-            TSPFillFaceVertexBuffer(TransparentVertexData,&TransparentVertexPointer,TSP->Vertex[Vert1],
-                                   TSP->Color[Vert1],U1,V1,CLUTDestX,CLUTDestY,ColorMode,Node->FaceList[i].IsTextured);
-            TSPFillFaceVertexBuffer(TransparentVertexData,&TransparentVertexPointer,TSP->Vertex[Vert2],
-                                   TSP->Color[Vert2],U2,V2,CLUTDestX,CLUTDestY,ColorMode,Node->FaceList[i].IsTextured);
-            RenderingFace->VAOBufferOffset = TSP->TransparentVAO->CurrentSize;
-            RenderingFace->BlendingMode = (TSB >> 5 ) & 3;
-            RenderingFace->Flags |= TSP_FX_TRANSPARENT_FACE;
-            VAOUpdate(TSP->TransparentVAO,TransparentVertexData,TransparentVertexSize,3);
-            RenderingFace->Next = TSP->TransparentFaceList;
-            TSP->TransparentFaceList = RenderingFace;
-            TransparentVertexPointer = 0;
-            
-        } else {
-            TSPFillFaceVertexBuffer(VertexData,&VertexPointer,TSP->Vertex[Vert0],
-                                    TSP->Color[Vert0],U0,V0,CLUTDestX,CLUTDestY,ColorMode,Node->FaceList[i].IsTextured);
-            TSPFillFaceVertexBuffer(VertexData,&VertexPointer,TSP->Vertex[Vert1],
-                                    TSP->Color[Vert1],U1,V1,CLUTDestX,CLUTDestY,ColorMode,Node->FaceList[i].IsTextured);
-            TSPFillFaceVertexBuffer(VertexData,&VertexPointer,TSP->Vertex[Vert2],
-                                    TSP->Color[Vert2],U2,V2,CLUTDestX,CLUTDestY,ColorMode,Node->FaceList[i].IsTextured);
-            
-            RenderingFace->VAOBufferOffset = Node->OpaqueFacesVAO->CurrentSize;
-            RenderingFace->Flags |= TSP_FX_NONE;
-            VAOUpdate(Node->OpaqueFacesVAO,VertexData,VertexSize,3);
-            RenderingFace->Next = Node->OpaqueFaceList;
-            Node->OpaqueFaceList = RenderingFace;
-            VertexPointer = 0;
+                    
+        if( IsTransparent ) {
+            TSPFillFaceVertices(TSP,&Node->FaceList[i],TransparentVertexData,&TransparentVertexPointer);
+            RenderingFace->VAOBufferOffset = TSP->TransparentVAO->CurrentSize;
+            RenderingFace->BlendingMode = (TSB >> 5 ) & 3;
+            RenderingFace->Flags |= TSP_FX_TRANSPARENT_FACE;
+            TSPAddDynamicFaceTarget(TSP,Node->FirstFaceIndex + i,FaceIndex,TSP->TransparentVAO);
+            VAOUpdate(TSP->TransparentVAO,TransparentVertexData,TransparentVertexSize,3);
+            TransparentVertexPointer = 0;
+        } else {
+            RenderingFace->VAOBufferOffset = Node->NumOpaqueFaces * 3;
+            RenderingFace->Flags |= TSP_FX_NONE;
+            Node->NumOpaqueFaces++;
+        }
+    }
+    free(TransparentVertexData);
+}
+
+/*
+ * Returns the vertex data of the opaque faces of the node in the order used by TSPRegisterNodeFaces.
+ * Only reads the TSP data and can be called from any thread.
+ */
+int *TSPFillNodeVertexData(TSP_t *TSP,TSPNode_t *Node)
+{
+    int *VertexData;
+    int VertexPointer;
+    int i;
+    
+    if( !Node->NumOpaqueFaces ) {
+        return NULL;
+    }
+    VertexData = malloc(TSP_VERTEX_STRIDE * 3 * Node->NumOpaqueFaces);
+    if( !VertexData ) {
+        DPrintf("TSPFillNodeVertexData:Failed to allocate memory for %i faces\n",Node->NumOpaqueFaces);
+        return NULL;
+    }
+    VertexPointer = 0;
+    for( i = Node->NumFaces - 1; i >= 0; i-- ) {
+        if( (Node->FaceList[i].TSB & 0x4000) != 0 ) {
+            continue;
+        }
+        TSPFillFaceVertices(TSP,&Node->FaceList[i],VertexData,&VertexPointer);
+    }
+    return VertexData;
+}
+
+/*
+ * Builds the geometry of the opaque faces of the node that is used by TSPUploadNodeVertexData.
+ * Leaves without dynamic faces are converted to an optimized indexed mesh when EnableMeshOptimization is set
+ * and their detail levels are built when EnableLOD is set.
+ * The result is kept inside the node so that this work is done only once,even if the leaf is evicted.
+ * Only reads the TSP data and can be called from any thread.
+ */
+TSPNodeMesh_t *TSPBuildNodeVertexData(TSP_t *TSP,TSPNode_t *Node)
+{
+    TSPNodeMesh_t *Mesh;
+    MeshOptimizerMesh_t OptimizedMesh;
+    int *VertexData;
+    
+    if( Node->Mesh ) {
+        return Node->Mesh;
+    }
+    VertexData = TSPFillNodeVertexData(TSP,Node);
+    if( !VertexData ) {
+        return NULL;
+    }
+    Mesh = malloc(sizeof(TSPNodeMesh_t));
+    if( !Mesh ) {
+        DPrintf("TSPBuildNodeVertexData:Failed to allocate memory for the mesh\n");
+        free(VertexData);
+        return NULL;
+    }
+    memset(Mesh,0,sizeof(TSPNodeMesh_t));
+    //NOTE(Adriano):Dynamic faces are updated in place using their fixed slot so only the leaves without them can
+    //              be converted to an optimized indexed mesh.
+    if( EnableMeshOptimization->IValue && !TSPNodeHasDynamicFaces(TSP,Node) &&
+        MeshOptimizerOptimize(VertexData,Node->NumOpaqueFaces * 3,TSP_VERTEX_STRIDE,&OptimizedMesh) ) {
+        free(VertexData);
+        Mesh->VertexData = OptimizedMesh.VertexData;
+        Mesh->NumVertices = OptimizedMesh.NumVertices;
+        Mesh->IndexList = OptimizedMesh.IndexList;
+        Mesh->NumIndices = OptimizedMesh.NumIndices;
+        Mesh->NumDrawIndices = OptimizedMesh.NumIndices;
+        if( !EnableLOD->IValue || !LODBuildMesh(TSP->LODCache,Mesh->VertexData,Mesh->NumVertices,&TSPLODVertexFormat,
+                                                 &Mesh->IndexList,&Mesh->NumIndices,&Mesh->LOD) ) {
+            memset(&Mesh->LOD,0,sizeof(LODMesh_t));
+        }
+    } else {
+        Mesh->VertexData = VertexData;
+        Mesh->NumVertices = Node->NumOpaqueFaces * 3;
+    }
+    Node->Mesh = Mesh;
+    return Mesh;
+}
+
+/*
+ * Creates the vertex buffer of the opaque faces of the node using the mesh built by TSPBuildNodeVertexData.
+ * Returns true if the node contains dynamic faces,in this case the buffer must not be evicted since it is
+ * referenced by the dynamic blocks.
+ */
+bool TSPUploadNodeVertexData(TSP_t *TSP,TSPNode_t *Node)
+{
+    TSPNodeMesh_t *Mesh;
+    int OpaqueFaceIndex;
+    bool HasDynamicFaces;
+    int i;
+    
+    Mesh = Node->Mesh;
+    if( !Mesh ) {
+        return false;
+    }
+    if( Mesh->IndexList ) {
+        Node->LOD = Mesh->LOD;
+        Node->OpaqueFacesVAO = VAOInitXYZUVRGBCLUTColorModeTexturedLightIndexInteger(Mesh->VertexData,Mesh->NumVertices * TSP_VERTEX_STRIDE,
+                                                                                     TSP_VERTEX_STRIDE,0,3,5,8,10,11,12,Mesh->NumVertices);
+        if( Node->OpaqueFacesVAO ) {
+            Node->OpaqueFacesVAO->CurrentSize = Mesh->NumVertices;
+            VAOAttachIndexBuffer(Node->OpaqueFacesVAO,Mesh->IndexList,Mesh->NumIndices * sizeof(unsigned int),Mesh->NumDrawIndices);
+        }
+        return false;
+    }
+    memset(&Node->LOD,0,sizeof(LODMesh_t));
+    Node->OpaqueFacesVAO = VAOInitXYZUVRGBCLUTColorModeTexturedLightIndexInteger(Mesh->VertexData,Mesh->NumVertices * TSP_VERTEX_STRIDE,
+                                                                                 TSP_VERTEX_STRIDE,0,3,5,8,10,11,12,Mesh->NumVertices);
+    if( !Node->OpaqueFacesVAO ) {
+        return false;
+    }
+    Node->OpaqueFacesVAO->CurrentSize = Node->NumOpaqueFaces * 3;
+    HasDynamicFaces = false;
+    OpaqueFaceIndex = Node->OpaqueFaceStart;
+    for( i = Node->NumFaces - 1; i >= 0; i-- ) {
+        if( (Node->FaceList[i].TSB & 0x4000) != 0 ) {
+            continue;
+        }
+        if( TSPIsFaceDynamic(TSP,Node->FirstFaceIndex + i) ) {
+            TSPAddDynamicFaceTarget(TSP,Node->FirstFaceIndex + i,OpaqueFaceIndex,Node->OpaqueFacesVAO);
+            HasDynamicFaces = true;
+        }
+        OpaqueFaceIndex++;
+    }
+    if( HasDynamicFaces ) {
+        TSPSortDynamicFaceTargets(TSP);
+        //NOTE(Adriano):The leaf could be streamed in after its blocks have moved,bring its faces to the current frame.
+        for( i = 0; i < TSP->Header.NumDynamicDataBlock; i++ ) {
+            if( TSP->DynamicData[i].CurrentStride != 0 ) {
+                TSPUploadDynamicData(TSP,&TSP->DynamicData[i]);
+            }
+        }
+    }
+    return HasDynamicFaces;
+}
+
+bool TSPNodeHasDynamicFaces(TSP_t *TSP,TSPNode_t *Node)
+{
+    int i;
+    
+    for( i = 0; i < Node->NumFaces; i++ ) {
+        if( TSPIsFaceDynamic(TSP,Node->FirstFaceIndex + i) ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TSPEvictNodeVertexData(TSPNode_t *Node)
+{
+    VAOFree(Node->OpaqueFacesVAO);
+    Node->OpaqueFacesVAO = NULL;
+    memset(&Node->LOD,0,sizeof(LODMesh_t));
+}
+
+/*
+ * Builds the detail levels of every leaf and stores them inside the LOD cache of the level.
+ * Only needs the data read from the file,used by the -buildlod command line option.
+ */
+int TSPBuildLOD(TSP_t *TSP)
+{
+    MeshOptimizerMesh_t Mesh;
+    LODMesh_t LOD;
+    TSPNode_t *Node;
+    int *VertexData;
+    int NumBuilt;
+    int i;
+    
+    if( !TSP || !TSP->LODCache ) {
+        DPrintf("TSPBuildLOD:Invalid TSP\n");
+        return 0;
+    }
+    NumBuilt = 0;
+    for( i = 0; i < TSP->Header.NumNodes; i++ ) {
+        Node = &TSP->Node[i];
+        if( Node->NumFaces <= 0 ) {
+            continue;
+        }
+        TSPNodeCountTransparentFaces(TSP,Node);
+        Node->NumOpaqueFaces = Node->NumFaces - Node->NumTransparentFaces;
+        if( !Node->NumOpaqueFaces || TSPNodeHasDynamicFaces(TSP,Node) ) {
+            continue;
         }
-        
-        if( RenderingFace->Flags & TSP_FX_ANIMATED_LIGHT_FACE ) {
-            RenderingFace->ColorIndex[0] = (TSPGetColorIndex(TSP->Color[Vert0].c) < BSD_ANIMATED_LIGHTS_TABLE_SIZE) 
-                ? (TSP->Color[Vert0].c & 0xFF) : -1;
-            RenderingFace->ColorIndex[1] = (TSPGetColorIndex(TSP->Color[Vert1].c) < BSD_ANIMATED_LIGHTS_TABLE_SIZE) 
-                ? (TSP->Color[Vert1].c & 0xFF) : -1; 
-            RenderingFace->ColorIndex[2] = (TSPGetColorIndex(TSP->Color[Vert2].c) < BSD_ANIMATED_LIGHTS_TABLE_SIZE) 
-                ? (TSP->Color[Vert2].c & 0xFF) : -1;
+        VertexData = TSPFillNodeVertexData(TSP,Node);
+        if( !VertexData ) {
+            continue;
+        }
+        if( MeshOptimizerOptimize(VertexData,Node->NumOpaqueFaces * 3,TSP_VERTEX_STRIDE,&Mesh) ) {
+            if( LODBuildMesh(TSP->LODCache,Mesh.VertexData,Mesh.NumVertices,&TSPLODVertexFormat,&Mesh.IndexList,
+                             &Mesh.NumIndices,&LOD) ) {
+                NumBuilt++;
+            }
+            MeshOptimizerFreeMesh(&Mesh);
         }
+        free(VertexData);
     }
-    free(VertexData);
-    free(TransparentVertexData);
+    return LODCacheSave(TSP->LODCache) && NumBuilt != 0;
+}
+
+/*
+ * Collects all the transparent faces into an array that can be sorted every frame and creates
+ * the index buffer that is used to draw them.
+ */
+TSPTransparentBatch_t *TSPCreateTransparentBatch(TSP_t *TSP)
+{
+    TSPTransparentBatch_t *Batch;
+    TSPRenderingFaceData_t *FaceData;
+    int NumFaces;
+    int i;
+    int j;
+    
+    NumFaces = TSP->NumTransparentRenderingFaces;
+    if( !NumFaces ) {
+        return NULL;
+    }
+    Batch = malloc(sizeof(TSPTransparentBatch_t));
+    if( !Batch ) {
+        DPrintf("TSPCreateTransparentBatch:Failed to allocate memory for batch\n");
+        return NULL;
+    }
+    Batch->NumFaces = NumFaces;
+    Batch->CenterList = malloc(NumFaces * sizeof(vec3));
+    Batch->KeyList = malloc(NumFaces * sizeof(unsigned int));
+    Batch->SortedList = malloc(NumFaces * sizeof(int));
+    Batch->TempSortedList = malloc(NumFaces * sizeof(int));
+    Batch->IndexList = malloc(NumFaces * 3 * sizeof(unsigned int));
+    if( !Batch->CenterList || !Batch->KeyList || !Batch->SortedList || !Batch->TempSortedList || 
+        !Batch->IndexList ) {
+        DPrintf("TSPCreateTransparentBatch:Failed to allocate memory for batch data\n");
+        TSPFreeTransparentBatch(Batch);
+        return NULL;
+    }
+    for( i = 0; i < NumFaces; i++ ) {
+        FaceData = &TSP->RenderingFaceDataList[TSP->TransparentFaceStart + i];
+        glm_vec3_zero(Batch->CenterList[i]);
+        for( j = 0; j < 3; j++ ) {
+            Batch->CenterList[i][0] += TSP->Vertex[FaceData->Vert[j]].Position.x / 3.f;
+            Batch->CenterList[i][1] += TSP->Vertex[FaceData->Vert[j]].Position.y / 3.f;
+            Batch->CenterList[i][2] += TSP->Vertex[FaceData->Vert[j]].Position.z / 3.f;
+        }
+    }
+    for( i = 0; i < TSP_NUM_BLENDING_MODES; i++ ) {
+        Batch->Offset[i] = 0;
+        Batch->Count[i] = 0;
+    }
+    //NOTE(Adriano):The index buffer is owned by the VAO and gets released together with it.
+    glBindVertexArray(TSP->TransparentVAO->VAOId[0]);
+    glGenBuffers(1,TSP->TransparentVAO->IBOId);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,TSP->TransparentVAO->IBOId[0]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,NumFaces * 3 * sizeof(unsigned int),NULL,GL_STREAM_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+    return Batch;
+}
+
+int TSPCompareDynamicFaceTarget(const void *a,const void *b)
+{
+    const TSPDynamicFaceTarget_t *TargetA;
+    const TSPDynamicFaceTarget_t *TargetB;
+    
+    TargetA = (const TSPDynamicFaceTarget_t *) a;
+    TargetB = (const TSPDynamicFaceTarget_t *) b;
+    if( TargetA->VAO->VAOId[0] != TargetB->VAO->VAOId[0] ) {
+        return TargetA->VAO->VAOId[0] < TargetB->VAO->VAOId[0] ? -1 : 1;
+    }
+    return TargetA->VAOBufferOffset - TargetB->VAOBufferOffset;
+}
 
+/*
+ * Sorts the faces of each dynamic block by their position inside the vertex buffers,faces that are
+ * next to each other can then be updated using a single call.
+ */
+void TSPSortDynamicFaceTargets(TSP_t *TSP)
+{
+    int i;
+    
+    for( i = 0; i < TSP->Header.NumDynamicDataBlock; i++ ) {
+        qsort(TSP->DynamicData[i].TargetList,TSP->DynamicData[i].NumTargets,sizeof(TSPDynamicFaceTarget_t),TSPCompareDynamicFaceTarget);
+    }
 }
 
 void TSPCreateNodeBBoxVAO(TSP_t *TSPList)
@@ -647,6 +1436,7 @@ void TSPCreateNodeBBoxVAO(TSP_t *TSPList)
     int VertexPointer;
     int Stride;
     int NumTransparentFaces;
+    int NumFaces;
     vec4 BoxColor;
     int i;
     
@@ -658,17 +1448,30 @@ void TSPCreateNodeBBoxVAO(TSP_t *TSPList)
     
     for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
         NumTransparentFaces = 0;
+        NumFaces = 0;
          for( i = 0; i < Iterator->Header.NumNodes; i++ ) {
              TSPNodeCountTransparentFaces(Iterator,&Iterator->Node[i]);
              NumTransparentFaces += Iterator->Node[i].NumTransparentFaces;
+             NumFaces += Iterator->Node[i].NumFaces;
          }
-        Stride = (3 + 2 + 3 + 2 + 1) * sizeof(int);
+        Iterator->RenderingFaceList = malloc(NumFaces * sizeof(TSPRenderingFace_t));
+        Iterator->RenderingFaceDataList = malloc(NumFaces * sizeof(TSPRenderingFaceData_t));
+        if( !Iterator->RenderingFaceList || !Iterator->RenderingFaceDataList ) {
+            DPrintf("TSPCreateNodeBBoxVAO:Failed to allocate memory for %i rendering faces\n",NumFaces);
+            return;
+        }
+        Iterator->NumRenderingFaces = NumFaces;
+        Iterator->NumOpaqueRenderingFaces = 0;
+        Iterator->TransparentFaceStart = NumFaces - NumTransparentFaces;
+        Iterator->NumTransparentRenderingFaces = 0;
+        Stride = (3 + 2 + 3 + 2 + 1 + 1 + 1) * sizeof(int);
         TransparentVertexSize = Stride * 3 * NumTransparentFaces;
-        Iterator->TransparentVAO = VAOInitXYZUVRGBCLUTColorModeTexturedInteger(NULL,TransparentVertexSize,Stride,0,3,5,8,10,11,NumTransparentFaces * 3);
+        Iterator->TransparentVAO = VAOInitXYZUVRGBCLUTColorModeTexturedLightIndexInteger(NULL,TransparentVertexSize,Stride,0,3,5,8,10,11,12,
+                                                                                         NumTransparentFaces * 3);
         
         for( i = 0; i < Iterator->Header.NumNodes; i++ ) {
             if( Iterator->Node[i].NumFaces != 0 ) {
-                TSPCreateFaceVAO(Iterator,&Iterator->Node[i]);
+                TSPRegisterNodeFaces(Iterator,&Iterator->Node[i]);
             }
             
           //       XYZ RGB
@@ -765,6 +1568,8 @@ void TSPCreateNodeBBoxVAO(TSP_t *TSPList)
             Iterator->Node[i].BBoxVAO = VAOInitXYZRGBIBO(VertexData,VertexSize * 8,Stride,BBoxIndices,sizeof(BBoxIndices),0,3);            
             free(VertexData);
         }
+        Iterator->TransparentBatch = TSPCreateTransparentBatch(Iterator);
+        TSPSortDynamicFaceTargets(Iterator);
     }
 }
 
@@ -813,10 +1618,45 @@ void TSPCreateCollisionVAO(TSP_t *TSPList)
     }
 }
 
+/*
+ * Uploads the vertex buffers of all the leaves,used when the level is not streamed.
+ */
+void TSPUploadAllNodes(TSP_t *TSP)
+{
+    int i;
+    
+    for( i = 0; i < TSP->Header.NumNodes; i++ ) {
+        if( !TSP->Node[i].NumFaces || !TSP->Node[i].NumOpaqueFaces ) {
+            continue;
+        }
+        if( !TSPBuildNodeVertexData(TSP,&TSP->Node[i]) ) {
+            continue;
+        }
+        TSPUploadNodeVertexData(TSP,&TSP->Node[i]);
+        //NOTE(Adriano):The leaves are never evicted when the level is not streamed.
+        TSPFreeNodeMesh(&TSP->Node[i]);
+    }
+}
+
 void TSPCreateVAOs(TSP_t *TSPList)
 {
+    TSP_t *Iterator;
+    
     TSPCreateNodeBBoxVAO(TSPList);
+    OcclusionSelectOccluders(TSPList);
+    //NOTE(Adriano):Leaf buffers are streamed around the camera,only the bounding boxes are available
+    //              until a leaf is uploaded.
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        if( EnableLevelStreaming->IValue ) {
+            Iterator->Streaming = StreamingCreate(Iterator);
+        }
+        if( !Iterator->Streaming ) {
+            TSPUploadAllNodes(Iterator);
+        }
+    }
     TSPList->VAOCreated = true;
+    //NOTE(Adriano):Walk mode needs the heightfield,load or bake it now so that it is never done while drawing.
+    HeightfieldGet(TSPList,HEIGHTFIELD_DEFAULT_RESOLUTION);
 //     TSPCreateCollisionVAO(TSPList);
 }
 
@@ -896,11 +1736,26 @@ void TSPDrawNode(TSPNode_t *Node,RenderObjectShader_t *RenderObjectShader,VRAM_t
         return;
     }
     
+    if( !Node->PVSVisible ) {
+        return;
+    }
+    
+    if( !OcclusionIsBoxVisible(Node->BBox,MVPMatrix) ) {
+        return;
+    }
+    
     if( 0/*LevelDrawTSPTree->IValue*/ ) {
         TSPDrawNodeBBox(Node,MVPMatrix);
     }
 
     if( Node->NumFaces != 0 ) {
+        if( !Node->OpaqueFacesVAO ) {
+            //NOTE(Adriano):Leaf not streamed in yet,draw its bounds as a placeholder.
+            if( Node->NumOpaqueFaces ) {
+                TSPDrawNodeBBox(Node,MVPMatrix);
+            }
+            return;
+        }
         if( 1/*LevelDrawSurfaces->IValue*/ ) {
             if( RenderObjectShader ) {
                 if( EnableWireFrameMode->IValue ) {
@@ -909,14 +1764,15 @@ void TSPDrawNode(TSPNode_t *Node,RenderObjectShader_t *RenderObjectShader,VRAM_t
                     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
                 }
                 glUseProgram(RenderObjectShader->Shader->ProgramId);
-                glActiveTexture(GL_TEXTURE0 + 0);
-                glBindTexture(GL_TEXTURE_2D, VRAM->TextureIndexPage.TextureId);
-                glActiveTexture(GL_TEXTURE0 + 1);
-                glBindTexture(GL_TEXTURE_2D, VRAM->PalettePage.TextureId);
+                VRAMBindTextures(VRAM);
 
                 glDisable(GL_BLEND);
                 glBindVertexArray(Node->OpaqueFacesVAO->VAOId[0]);
-                glDrawArrays(GL_TRIANGLES, 0, Node->OpaqueFacesVAO->Count);
+                if( Node->OpaqueFacesVAO->IBOId[0] ) {
+                    LODDrawElements(Node->OpaqueFacesVAO,&Node->LOD);
+                } else {
+                    glDrawArrays(GL_TRIANGLES, 0, Node->OpaqueFacesVAO->Count);
+                }
                 glBindVertexArray(0);
                 glActiveTexture(GL_TEXTURE0 + 0);
                 glBindTexture(GL_TEXTURE_2D,0);
@@ -935,131 +1791,268 @@ void TSPDrawNode(TSPNode_t *Node,RenderObjectShader_t *RenderObjectShader,VRAM_t
     }
 }
 
-void TSPUpdateAnimatedRenderingFace(TSPRenderingFace_t *Face,VAO_t *VAO,BSD_t *BSD,int Reset)
+/*
+ * Moves the given dynamic block to the next frame based on its effect type.
+ */
+void TSPStepDynamicData(TSPDynamicData_t *DynamicData)
 {
-    Color1i_t OriginalColor;
-    Color1i_t FinalColor;
-    int ColorData[3];
-    int Stride;
-    int CurrentColor;
-    int BaseOffset;
-    if( !Face ) {
-        DPrintf("TSPUpdateAnimatedRenderingFace:Invalid face data\n");
-        return;
-    }
-    
-    if( !(Face->Flags & TSP_FX_ANIMATED_LIGHT_FACE) ) {
-        return;
+    int LastFrame;
+    int NextFrame;
+    
+    LastFrame = DynamicData->NumFrames - 1;
+    switch( DynamicData->Header.EffectType ) {
+        case TSP_DYNAMIC_FACE_EFFECT_PLAY_AND_STOP_TO_LAST:
+            if( DynamicData->CurrentStride < LastFrame ) {
+                DynamicData->CurrentStride++;
+            }
+            break;
+        case TSP_DYNAMIC_FACE_EFFECT_JUMP_TO_LAST:
+            DynamicData->CurrentStride = LastFrame;
+            break;
+        case TSP_DYNAMIC_FACE_EFFECT_CYCLE:
+            DynamicData->CurrentStride = (DynamicData->CurrentStride + 1) % DynamicData->NumFrames;
+            break;
+        case TSP_DYNAMIC_FACE_EFFECT_PULSE:
+            NextFrame = DynamicData->CurrentStride + DynamicData->IncrementOffset;
+            if( NextFrame < 0 || NextFrame > LastFrame ) {
+                DynamicData->IncrementOffset = -DynamicData->IncrementOffset;
+                NextFrame = DynamicData->CurrentStride + DynamicData->IncrementOffset;
+            }
+            //NOTE(Adriano):Blocks with a single frame have nowhere to move.
+            if( NextFrame >= 0 && NextFrame <= LastFrame ) {
+                DynamicData->CurrentStride = NextFrame;
+            }
+            break;
+        default:
+            DPrintf("TSPStepDynamicData:Unknown effect type %i\n",DynamicData->Header.EffectType);
+            break;
     }
+    DynamicData->LastUpdateTime = SysMilliseconds();
+}
+
+/*
+ * Writes the current frame of the given dynamic block into the vertex buffers.
+ * Only the vertices of the faces referenced by the block are uploaded,merging faces that are stored
+ * next to each other into a single range.
+ * NOTE that faces keep the buffer they were created into,a frame that changes the transparency flag only
+ * updates the blending mode.
+ */
+void TSPUploadDynamicData(TSP_t *TSP,TSPDynamicData_t *DynamicData)
+{
+    TSPDynamicFaceTarget_t *Target;
+    TSPDynamicFaceData_t *FaceData;
+    TSPRenderingFaceData_t *RenderingFaceData;
+    TSPRenderingFace_t *RenderingFace;
+    TSPFace_t Face;
+    int VertexPointer;
+    int RunStart;
+    int i;
     
-    Stride = (3 + 2 + 3 + 2 + 1 + 1) * sizeof(int);
-    glBindBuffer(GL_ARRAY_BUFFER, VAO->VBOId[0]);
-    BaseOffset = (Face->VAOBufferOffset * Stride );
+    i = 0;
+    while( i < DynamicData->NumTargets ) {
+        RunStart = i;
+        VertexPointer = 0;
+        do {
+            Target = &DynamicData->TargetList[i];
+            FaceData = &DynamicData->FaceDataList[DynamicData->CurrentStride * DynamicData->Header.NumFacesIndex + Target->Slot];
+            RenderingFace = &TSP->RenderingFaceList[Target->RenderingFaceIndex];
+            RenderingFaceData = &TSP->RenderingFaceDataList[Target->RenderingFaceIndex];
+            Face.V0 = RenderingFaceData->Vert[0];
+            Face.V1 = RenderingFaceData->Vert[1];
+            Face.V2 = RenderingFaceData->Vert[2];
+            Face.UV0 = FaceData->UV0;
+            Face.UV1 = FaceData->UV1;
+            Face.UV2 = FaceData->UV2;
+            Face.CBA = FaceData->CBA;
+            Face.TSB = FaceData->TSB;
+            //NOTE(Adriano):Dynamic data always carries texture information.
+            Face.IsTextured = true;
+            TSPFillFaceVertices(TSP,&Face,DynamicData->VertexData,&VertexPointer);
+            if( RenderingFace->Flags & TSP_FX_TRANSPARENT_FACE ) {
+                RenderingFace->BlendingMode = (Face.TSB >> 5 ) & 3;
+            }
+            i++;
+        } while( i < DynamicData->NumTargets && DynamicData->TargetList[i].VAO == DynamicData->TargetList[i - 1].VAO &&
+                 DynamicData->TargetList[i].VAOBufferOffset == DynamicData->TargetList[i - 1].VAOBufferOffset + 3 );
+        Target = &DynamicData->TargetList[RunStart];
+        glBindBuffer(GL_ARRAY_BUFFER, Target->VAO->VBOId[0]);
+        glBufferSubData(GL_ARRAY_BUFFER, Target->VAOBufferOffset * Target->VAO->Stride, VertexPointer * sizeof(int), DynamicData->VertexData);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*
+ * Advances all the dynamic blocks (doors,moving surfaces...) whose index matches DynamicDataIndex
+ * and updates the affected faces.
+ */
+void TSPUpdateDynamicFaces(TSP_t *TSPList,Camera_t *Camera,int DynamicDataIndex)
+{
+    TSP_t *Iterator;
+    TSPDynamicData_t *DynamicData;
+    int i;
     
-    for( int i = 0; i < 3; i++ ) {
-        if( Face->ColorIndex[i] == -1 ) {
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
+        if( !Iterator->VAOCreated ) {
             continue;
         }
-        CurrentColor = 0/*BSDGetCurrentAnimatedLightColorByIndex(BSD,Face->ColorIndex[i])*/;
-        OriginalColor.c = Face->Colors[i].c;
-        FinalColor.c = (OriginalColor.c & 0xFF00) | (CurrentColor & 0xFFFFFF);
-        if( Reset ) {
-            ColorData[0] = OriginalColor.rgba[0];
-            ColorData[1] = OriginalColor.rgba[1];
-            ColorData[2] = OriginalColor.rgba[2];    
-        } else {
-            ColorData[0] = FinalColor.rgba[0];
-            ColorData[1] = FinalColor.rgba[1];
-            ColorData[2] = FinalColor.rgba[2];    
+        for( i = 0; i < Iterator->Header.NumDynamicDataBlock; i++ ) {
+            DynamicData = &Iterator->DynamicData[i];
+            if( DynamicData->Header.DynamicDataIndex != DynamicDataIndex ) {
+                continue;
+            }
+            TSPStepDynamicData(DynamicData);
+            TSPUploadDynamicData(Iterator,DynamicData);
         }
-        //The offset in which we write the color is based on the current VAO Offset to which
-        //we add the stride times i which moves the pointer to one of the three vertices (each vertex takes Stride amount of bytes)
-        //and finally we add 5 times sizeof(int) in order to grab the starting definition of the color data inside the vertex array.
-        glBufferSubData(GL_ARRAY_BUFFER, BaseOffset + (Stride * i) + (5*sizeof(int)), 3 * sizeof(int), &ColorData);
     }
 }
 
-void TSPUpdateAnimatedFaceNodes(TSPNode_t *Node,BSD_t *BSD,mat4 MVPMatrix,int Reset)
+/*
+ * Advances the blocks that loop on their own (moving surfaces) once every TSP_DYNAMIC_FACE_FRAME_TIME milliseconds,
+ * the other effects only move when their index is triggered using TSPUpdateDynamicFaces.
+ */
+void TSPUpdateLoopingDynamicFaces(TSP_t *TSP)
 {
-    TSPRenderingFace_t *Iterator;
-
-    if( !Node ) {
-        return;
-    }
-    //NOTE(Adriano):Make sure we don't want to reset all the faces to the default state...
-    if( !Reset ) {
-        assert(MVPMatrix != NULL);
-        //NOTE(Adriano):Always enable culling regardless of 'LevelEnableFrustumCulling' settings.
-        if( !TSPBoxInFrustum(Node->BBox,MVPMatrix) ) {
-            return;
-        }
-    }
+    TSPDynamicData_t *DynamicData;
+    int Now;
+    int i;
     
-    if( Node->NumFaces != 0 ) {
-        for( Iterator = Node->OpaqueFaceList; Iterator; Iterator = Iterator->Next ) {
-           TSPUpdateAnimatedRenderingFace(Iterator,Node->OpaqueFacesVAO,BSD,Reset);
+    Now = SysMilliseconds();
+    for( i = 0; i < TSP->Header.NumDynamicDataBlock; i++ ) {
+        DynamicData = &TSP->DynamicData[i];
+        if( DynamicData->Header.EffectType != TSP_DYNAMIC_FACE_EFFECT_CYCLE &&
+            DynamicData->Header.EffectType != TSP_DYNAMIC_FACE_EFFECT_PULSE ) {
+            continue;
         }
-    } else {
-        TSPUpdateAnimatedFaceNodes(Node->Child[1],BSD,MVPMatrix,Reset);
-        TSPUpdateAnimatedFaceNodes(Node->Child[2],BSD,MVPMatrix,Reset);
-        TSPUpdateAnimatedFaceNodes(Node->Child[0],BSD,MVPMatrix,Reset);
+        if( Now - DynamicData->LastUpdateTime < TSP_DYNAMIC_FACE_FRAME_TIME ) {
+            continue;
+        }
+        TSPStepDynamicData(DynamicData);
+        TSPUploadDynamicData(TSP,DynamicData);
     }
 }
-void TSPUpdateTransparentAnimatedFaces(TSP_t *TSP,BSD_t *BSD,int Reset)
+/*
+ * Converts a float into an unsigned integer that preserves the ordering when compared as an integer.
+ */
+unsigned int TSPFloatToSortableKey(float Value)
 {
-    TSPRenderingFace_t *Iterator;
+    unsigned int Key;
     
-    for( Iterator = TSP->TransparentFaceList; Iterator; Iterator = Iterator->Next ) {
-        TSPUpdateAnimatedRenderingFace(Iterator,TSP->TransparentVAO,BSD,Reset);
-    }
+    memcpy(&Key,&Value,sizeof(Key));
+    return (Key & 0x80000000) ? ~Key : Key | 0x80000000;
 }
+
 /*
- * Updates all the animated faces inside each loaded TSP file.
- * When ProjectionMatrix is not NULL, it attempts to cull invisible faces that lies outside the view frustum.
- * NOTE that frustum culling only applies to the faces belonging to the TSP tree and not to the transparent one.
- * NOTE that when Reset is 1 then the ProjectionMatrix parameter is ignored when performing frustum culling...
- * this means that all the faces will be reset.
-*/
-void TSPUpdateAnimatedFaces(TSP_t *TSPList,BSD_t *BSD,Camera_t *Camera,mat4 ProjectionMatrix,int Reset)
+ * Sorts the transparent faces back to front using an 8 bit LSD radix sort on the view depth,
+ * then splits them by blending mode keeping the order and fills the index buffer.
+ * Must be called with the transparent VAO bound since the index buffer is part of its state.
+ */
+void TSPSortTransparentFaces(TSP_t *TSP,mat4 MVPMatrix)
 {
-    TSP_t *Iterator;
-    mat4 MVPMatrix;
+    TSPTransparentBatch_t *Batch;
+    TSPRenderingFace_t *Face;
+    int Histogram[256];
+    int Fill[TSP_NUM_BLENDING_MODES];
+    int *Temp;
+    float Depth;
+    int Shift;
+    int Sum;
+    int Count;
+    int Mode;
+    int Index;
+    int i;
     
-    if( ProjectionMatrix ) {
-        glm_mat4_mul(ProjectionMatrix,Camera->ViewMatrix,MVPMatrix);
-        //Emulate PSX Coordinate system...
-        glm_rotate_x(MVPMatrix,glm_rad(180.f), MVPMatrix);
-    }
-    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
-        TSPUpdateAnimatedFaceNodes(&Iterator->Node[0],BSD,MVPMatrix,Reset);
-        TSPUpdateTransparentAnimatedFaces(Iterator,BSD,Reset);
-    }
+    Batch = TSP->TransparentBatch;
+    for( i = 0; i < Batch->NumFaces; i++ ) {
+        //NOTE(Adriano):Clip space W is the distance along the view direction.
+        Depth = MVPMatrix[0][3] * Batch->CenterList[i][0] + MVPMatrix[1][3] * Batch->CenterList[i][1] + 
+                MVPMatrix[2][3] * Batch->CenterList[i][2] + MVPMatrix[3][3];
+        //Farthest first.
+        Batch->KeyList[i] = ~TSPFloatToSortableKey(Depth);
+        Batch->SortedList[i] = i;
+    }
+    for( Shift = 0; Shift < 32; Shift += 8 ) {
+        memset(Histogram,0,sizeof(Histogram));
+        for( i = 0; i < Batch->NumFaces; i++ ) {
+            Histogram[(Batch->KeyList[i] >> Shift) & 0xFF]++;
+        }
+        //NOTE(Adriano):All the keys share the same digit,this pass wouldn't change the order.
+        if( Histogram[(Batch->KeyList[0] >> Shift) & 0xFF] == Batch->NumFaces ) {
+            continue;
+        }
+        Sum = 0;
+        for( i = 0; i < 256; i++ ) {
+            Count = Histogram[i];
+            Histogram[i] = Sum;
+            Sum += Count;
+        }
+        for( i = 0; i < Batch->NumFaces; i++ ) {
+            Index = Batch->SortedList[i];
+            Batch->TempSortedList[Histogram[(Batch->KeyList[Index] >> Shift) & 0xFF]++] = Index;
+        }
+        Temp = Batch->SortedList;
+        Batch->SortedList = Batch->TempSortedList;
+        Batch->TempSortedList = Temp;
+    }
+    for( i = 0; i < TSP_NUM_BLENDING_MODES; i++ ) {
+        Batch->Count[i] = 0;
+    }
+    for( i = 0; i < Batch->NumFaces; i++ ) {
+        Batch->Count[TSP->RenderingFaceList[TSP->TransparentFaceStart + i].BlendingMode & 3]++;
+    }
+    Sum = 0;
+    for( i = 0; i < TSP_NUM_BLENDING_MODES; i++ ) {
+        Batch->Offset[i] = Sum;
+        Fill[i] = Sum;
+        Sum += Batch->Count[i];
+    }
+    for( i = 0; i < Batch->NumFaces; i++ ) {
+        Face = &TSP->RenderingFaceList[TSP->TransparentFaceStart + Batch->SortedList[i]];
+        Mode = Face->BlendingMode & 3;
+        Batch->IndexList[Fill[Mode] * 3] = Face->VAOBufferOffset;
+        Batch->IndexList[Fill[Mode] * 3 + 1] = Face->VAOBufferOffset + 1;
+        Batch->IndexList[Fill[Mode] * 3 + 2] = Face->VAOBufferOffset + 2;
+        Fill[Mode]++;
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,TSP->TransparentVAO->IBOId[0]);
+    //NOTE(Adriano):Orphan the previous storage so that we don't stall on the previous frame.
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,Batch->NumFaces * 3 * sizeof(unsigned int),NULL,GL_STREAM_DRAW);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER,0,Batch->NumFaces * 3 * sizeof(unsigned int),Batch->IndexList);
 }
-void TSPDrawTransparentFaces(TSP_t *TSP,VRAM_t *VRAM)
+
+void TSPDrawTransparentFaces(TSP_t *TSP,VRAM_t *VRAM,mat4 MVPMatrix)
 {
-    TSPRenderingFace_t *TransparentFaceIterator;
+    TSPTransparentBatch_t *Batch;
+    int i;
 
     if( 0/*!LevelDrawSurfaces->IValue*/ ) {
         return;
     }
+    Batch = TSP->TransparentBatch;
+    if( !Batch ) {
+        return;
+    }
     
     if( EnableWireFrameMode->IValue ) {
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     } else {
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
-    glActiveTexture(GL_TEXTURE0 + 0);
-    glBindTexture(GL_TEXTURE_2D, VRAM->TextureIndexPage.TextureId);
-    glActiveTexture(GL_TEXTURE0 + 1);
-    glBindTexture(GL_TEXTURE_2D, VRAM->PalettePage.TextureId);
+    VRAMBindTextures(VRAM);
     glBindVertexArray(TSP->TransparentVAO->VAOId[0]);
     if( 0/*!LevelEnableSemiTransparency->IValue*/ ) {
         glDrawArrays(GL_TRIANGLES, 0, TSP->TransparentVAO->Count);
     } else {
+        TSPSortTransparentFaces(TSP,MVPMatrix);
         glDepthMask(0);
         glEnable(GL_BLEND);
-        for( TransparentFaceIterator = TSP->TransparentFaceList; TransparentFaceIterator; TransparentFaceIterator = TransparentFaceIterator->Next) {
-            switch( TransparentFaceIterator->BlendingMode ) {
+        glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+        //NOTE(Adriano):Each blending mode is drawn as a single batch so the back to front order
+        //only holds between faces that share the same mode.
+        for( i = 0; i < TSP_NUM_BLENDING_MODES; i++ ) {
+            if( !Batch->Count[i] ) {
+                continue;
+            }
+            switch( i ) {
                 case TSP_BLENDING_MODE_HALF_BACKGROUND_PLUS_HALF_FOREGROUND:
                 case TSP_BLENDING_MODE_BACKGROUND_PLUS_FOREGROUND:
                 case TSP_BLENDING_MODE_BACKGROUND_PLUS_QUARTER_FOREGROUND:
@@ -1069,9 +2062,9 @@ void TSPDrawTransparentFaces(TSP_t *TSP,VRAM_t *VRAM)
                     glBlendEquationSeparate(GL_FUNC_REVERSE_SUBTRACT, GL_FUNC_ADD);
                     break;
             }
-            glBlendFunc(GL_ONE, GL_SRC_ALPHA);
-            glDrawArrays(GL_TRIANGLES, TransparentFaceIterator->VAOBufferOffset, 3);
+            glDrawElements(GL_TRIANGLES, Batch->Count[i] * 3, GL_UNSIGNED_INT, BUFFER_INT_OFFSET(Batch->Offset[i] * 3));
         }
+        glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
     }
     glBindVertexArray(0);
     glDepthMask(1);
@@ -1082,10 +2075,26 @@ void TSPDrawTransparentFaces(TSP_t *TSP,VRAM_t *VRAM)
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
 }
-void TSPDrawList(TSP_t *TSPList,VRAM_t *VRAM,Camera_t *Camera,RenderObjectShader_t *RenderObjectShader,mat4 ProjectionMatrix)
+/*
+ * Selects the detail level of the resident leaves.
+ */
+void TSPUpdateLOD(TSP_t *TSP,mat4 MVPMatrix,float ProjectionScale)
+{
+    int i;
+    
+    for( i = 0; i < TSP->Header.NumNodes; i++ ) {
+        if( TSP->Node[i].OpaqueFacesVAO ) {
+            LODUpdateLevel(&TSP->Node[i].LOD,MVPMatrix,ProjectionScale);
+        }
+    }
+}
+
+void TSPDrawList(TSP_t *TSPList,VRAM_t *VRAM,Camera_t *Camera,RenderObjectShader_t *RenderObjectShader,
+                 BSDAnimatedLightTable_t *AnimatedLightTable,mat4 ProjectionMatrix)
 {
     TSP_t *Iterator;
     mat4 MVPMatrix;
+    vec3 CameraPosition;
     
     if( !TSPList ) {
         DPrintf("TSPDrawList:Invalid TSP data\n");
@@ -1103,16 +2112,37 @@ void TSPDrawList(TSP_t *TSPList,VRAM_t *VRAM,Camera_t *Camera,RenderObjectShader
     glUseProgram(RenderObjectShader->Shader->ProgramId);
     glUniform1i(RenderObjectShader->EnableLightingId, EnableAmbientLight->IValue);
     glUniformMatrix4fv(RenderObjectShader->MVPMatrixId,1,false,&MVPMatrix[0][0]);
-
+    glUniform1i(RenderObjectShader->NativeVRAMId, VRAM->NativeLayout);
+    glUniform1i(RenderObjectShader->AtlasModeId, TSPList->Atlas != NULL);
+    //NOTE(Adriano):Animated lights are resolved in the vertex shader,this is the only data that changes every frame.
+    if( AnimatedLightTable ) {
+        glUniform1i(RenderObjectShader->EnableAnimatedLightsId, 1);
+        glUniform3iv(RenderObjectShader->AnimatedLightColorsId,BSD_ANIMATED_LIGHTS_TABLE_SIZE,AnimatedLightTable->ColorList);
+    } else {
+        glUniform1i(RenderObjectShader->EnableAnimatedLightsId, 0);
+    }
+    
+    //NOTE(Adriano):Bring the camera back into the PSX coordinate system.
+    CameraPosition[0] = Camera->Eye[0];
+    CameraPosition[1] = -Camera->Eye[1];
+    CameraPosition[2] = -Camera->Eye[2];
     for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
         if( !Iterator->VAOCreated ) {
             TSPCreateVAOs(Iterator);
         }
+        PVSUpdate(Iterator,CameraPosition);
+        StreamingUpdate(Iterator->Streaming,CameraPosition);
+        TSPUpdateLoopingDynamicFaces(Iterator);
+        TSPUpdateLOD(Iterator,MVPMatrix,ProjectionMatrix[1][1]);
+    }
+    OcclusionBeginFrame(TSPList,MVPMatrix);
+    for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
         TSPDrawNode(&Iterator->Node[0],RenderObjectShader,VRAM,MVPMatrix);
     }
     // Alpha pass.
+    glUseProgram(RenderObjectShader->Shader->ProgramId);
     for( Iterator = TSPList; Iterator; Iterator = Iterator->Next ) {
-        TSPDrawTransparentFaces(Iterator,VRAM);
+        TSPDrawTransparentFaces(Iterator,VRAM,MVPMatrix);
         
     }
     glUseProgram(0);
@@ -1217,6 +2247,16 @@ int TSPReadNodeChunk(TSP_t *TSP,FILE *InFile,int TSPOffset)
         fread(&TSP->Node[i].U6,sizeof(TSP->Node[i].U6),1,InFile);
 
         TSP->Node[i].FaceList = NULL;
+        TSP->Node[i].BBoxVAO = NULL;
+        TSP->Node[i].OpaqueFacesVAO = NULL;
+        TSP->Node[i].LeafCollisionFaceListVAO = NULL;
+        TSP->Node[i].OpaqueFaceStart = 0;
+        TSP->Node[i].NumOpaqueFaces = 0;
+        TSP->Node[i].LeafIndex = -1;
+        TSP->Node[i].FirstFaceIndex = 0;
+        TSP->Node[i].PVSVisible = true;
+        TSP->Node[i].Mesh = NULL;
+        memset(&TSP->Node[i].LOD,0,sizeof(LODMesh_t));
         DPrintf("Read %li bytes for node %i\n",ftell(InFile) - TSP->Node[i].FileOffset.Offset,i);
         DPrintf("TSPReadNodeChunk:Node BaseData %i (References offset %i)\n",TSP->Node[i].BaseData,
                 TSP->Node[i].BaseData + TSP->Header.NodeOffset);
@@ -1227,7 +2267,6 @@ int TSPReadNodeChunk(TSP_t *TSP,FILE *InFile,int TSPOffset)
         DPrintf("TSPReadNodeChunk:Node Type %i\n",TSP->Node[i].Type);
         DPrintf("TSPReadNodeChunk:Node U6 %i\n",TSP->Node[i].U6);
         if( TSP->Node[i].NumFaces != 0 ) {
-            TSP->Node[i].OpaqueFaceList = NULL;
             TSP->Node[i].FaceList = malloc(TSP->Node[i].NumFaces * sizeof(TSPFace_t));
             if( !TSP->Node[i].FaceList ) {
                 DPrintf("TSPReadNodeChunk:Failed to allocate memory for face list\n");
@@ -1350,6 +2389,175 @@ int TSPReadColorChunk(TSP_t *TSP,FILE *InFile)
     return 1;
 }
 
+int TSPCompareNodeBaseData(const void *a,const void *b)
+{
+    const TSPNode_t *NodeA;
+    const TSPNode_t *NodeB;
+    
+    NodeA = *(const TSPNode_t **) a;
+    NodeB = *(const TSPNode_t **) b;
+    return (NodeA->BaseData > NodeB->BaseData) - (NodeA->BaseData < NodeB->BaseData);
+}
+
+/*
+ * Assigns to each leaf the index of its first face,counting faces in the order they appear inside the file.
+ * Faces don't have a fixed size (textured ones are bigger) so they cannot be indexed by their offset.
+ * Returns the total number of faces.
+ */
+int TSPComputeFaceIndices(TSP_t *TSP)
+{
+    TSPNode_t **LeafList;
+    int NumLeaves;
+    int NumFaces;
+    int i;
+    
+    LeafList = malloc(TSP->Header.NumNodes * sizeof(TSPNode_t *));
+    if( !LeafList ) {
+        DPrintf("TSPComputeFaceIndices:Failed to allocate memory for leaf list\n");
+        return -1;
+    }
+    NumLeaves = 0;
+    for( i = 0; i < TSP->Header.NumNodes; i++ ) {
+        if( TSP->Node[i].NumFaces != 0 ) {
+            LeafList[NumLeaves++] = &TSP->Node[i];
+        }
+    }
+    qsort(LeafList,NumLeaves,sizeof(TSPNode_t *),TSPCompareNodeBaseData);
+    NumFaces = 0;
+    for( i = 0; i < NumLeaves; i++ ) {
+        LeafList[i]->FirstFaceIndex = NumFaces;
+        NumFaces += LeafList[i]->NumFaces;
+    }
+    free(LeafList);
+    return NumFaces;
+}
+
+int TSPReadDynamicDataChunk(TSP_t *TSP,FILE *InFile)
+{
+    TSPDynamicData_t *DynamicData;
+    int BlockStart;
+    int FileLength;
+    int NumFaceData;
+    int i;
+    
+    if( !TSP || !InFile ) {
+        bool InvalidFile = (InFile == NULL ? true : false);
+        printf("TSPReadDynamicDataChunk: Invalid %s\n",InvalidFile ? "file" : "tsp struct");
+        return 0;
+    }
+    FileLength = GetFileLength(InFile);
+    if( ftell(InFile) + TSP->Header.NumDynamicDataBlock * (int) sizeof(TSPDynamicDataHeader_t) > FileLength ) {
+        DPrintf("TSPReadDynamicDataChunk:Invalid number of blocks %i\n",TSP->Header.NumDynamicDataBlock);
+        return 0;
+    }
+    TSP->DynamicData = malloc(TSP->Header.NumDynamicDataBlock * sizeof(TSPDynamicData_t));
+    if( !TSP->DynamicData ) {
+        DPrintf("TSPReadDynamicDataChunk:Failed to allocate memory for dynamic data array\n");
+        return 0;
+    }
+    memset(TSP->DynamicData,0,TSP->Header.NumDynamicDataBlock * sizeof(TSPDynamicData_t));
+    assert(sizeof(TSPDynamicDataHeader_t) == 24);
+    assert(sizeof(TSPDynamicFaceData_t) == 10);
+    for( i = 0; i < TSP->Header.NumDynamicDataBlock; i++ ) {
+        DynamicData = &TSP->DynamicData[i];
+        BlockStart = ftell(InFile);
+        if( fread(&DynamicData->Header,sizeof(DynamicData->Header),1,InFile) != 1 ) {
+            DPrintf("TSPReadDynamicDataChunk:Early failure when reading block %i header\n",i);
+            return 0;
+        }
+        DPrintf("TSPReadDynamicDataChunk:Block %i Size:%i EffectType:%i DynamicDataIndex:%i NumFacesIndex:%i\n",i,
+                DynamicData->Header.Size,DynamicData->Header.EffectType,DynamicData->Header.DynamicDataIndex,
+                DynamicData->Header.NumFacesIndex);
+        if( DynamicData->Header.Size < (int) sizeof(DynamicData->Header) || BlockStart + DynamicData->Header.Size > FileLength ||
+            DynamicData->Header.NumFacesIndex <= 0 || DynamicData->Header.FaceIndexOffset < 0 || DynamicData->Header.FaceDataOffset < 0 ||
+            DynamicData->Header.FaceIndexOffset + DynamicData->Header.NumFacesIndex * (int) sizeof(short) > DynamicData->Header.Size ||
+            DynamicData->Header.FaceDataOffset >= DynamicData->Header.Size ||
+            DynamicData->Header.EffectType < TSP_DYNAMIC_FACE_EFFECT_PLAY_AND_STOP_TO_LAST ||
+            DynamicData->Header.EffectType > TSP_DYNAMIC_FACE_EFFECT_PULSE ) {
+            DPrintf("TSPReadDynamicDataChunk:Invalid header for block %i\n",i);
+            return 0;
+        }
+        NumFaceData = (DynamicData->Header.Size - DynamicData->Header.FaceDataOffset) / sizeof(TSPDynamicFaceData_t);
+        DynamicData->NumFrames = NumFaceData / DynamicData->Header.NumFacesIndex;
+        if( DynamicData->NumFrames == 0 ) {
+            DPrintf("TSPReadDynamicDataChunk:Block %i has no face data\n",i);
+            return 0;
+        }
+        DynamicData->FaceIndexList = malloc(DynamicData->Header.NumFacesIndex * sizeof(short));
+        DynamicData->FaceDataList = malloc(DynamicData->NumFrames * DynamicData->Header.NumFacesIndex * sizeof(TSPDynamicFaceData_t));
+        DynamicData->TargetList = malloc(DynamicData->Header.NumFacesIndex * sizeof(TSPDynamicFaceTarget_t));
+        DynamicData->VertexData = malloc(DynamicData->Header.NumFacesIndex * 3 * (3 + 2 + 3 + 2 + 1 + 1 + 1) * sizeof(int));
+        if( !DynamicData->FaceIndexList || !DynamicData->FaceDataList || !DynamicData->TargetList || !DynamicData->VertexData ) {
+            DPrintf("TSPReadDynamicDataChunk:Failed to allocate memory for block %i\n",i);
+            return 0;
+        }
+        fseek(InFile,BlockStart + DynamicData->Header.FaceIndexOffset,SEEK_SET);
+        if( fread(DynamicData->FaceIndexList,sizeof(short),DynamicData->Header.NumFacesIndex,InFile) != 
+            DynamicData->Header.NumFacesIndex ) {
+            DPrintf("TSPReadDynamicDataChunk:Early failure when reading block %i face indices\n",i);
+            return 0;
+        }
+        fseek(InFile,BlockStart + DynamicData->Header.FaceDataOffset,SEEK_SET);
+        if( fread(DynamicData->FaceDataList,sizeof(TSPDynamicFaceData_t),DynamicData->NumFrames * DynamicData->Header.NumFacesIndex,InFile) != 
+            DynamicData->NumFrames * DynamicData->Header.NumFacesIndex ) {
+            DPrintf("TSPReadDynamicDataChunk:Early failure when reading block %i face data\n",i);
+            return 0;
+        }
+        DynamicData->FaceDataListV3 = NULL;
+        DynamicData->NumTargets = 0;
+        DynamicData->CurrentStride = 0;
+        DynamicData->IncrementOffset = 1;
+        DynamicData->LastUpdateTime = 0;
+        fseek(InFile,BlockStart + DynamicData->Header.Size,SEEK_SET);
+    }
+    return 1;
+}
+
+/*
+ * Builds the bitset and the table that map each face to the dynamic block (and the slot inside it) that references it.
+ * This is done once at load time so that checking if a face is dynamic doesn't require scanning all the blocks.
+ */
+int TSPBuildDynamicFaceLookUp(TSP_t *TSP)
+{
+    TSPDynamicData_t *DynamicData;
+    int Face;
+    int i;
+    int j;
+    
+    TSP->NumIndexedFaces = TSPComputeFaceIndices(TSP);
+    if( TSP->NumIndexedFaces < 0 ) {
+        return 0;
+    }
+    if( TSP->Header.NumDynamicDataBlock == 0 || TSP->NumIndexedFaces == 0 ) {
+        return 1;
+    }
+    TSP->DynamicFaceBitSet = malloc(((TSP->NumIndexedFaces + 31) / 32) * sizeof(unsigned int));
+    TSP->DynamicFaceLookUp = malloc(TSP->NumIndexedFaces * sizeof(TSPDynamicFaceRef_t));
+    if( !TSP->DynamicFaceBitSet || !TSP->DynamicFaceLookUp ) {
+        DPrintf("TSPBuildDynamicFaceLookUp:Failed to allocate memory for %i faces\n",TSP->NumIndexedFaces);
+        return 0;
+    }
+    memset(TSP->DynamicFaceBitSet,0,((TSP->NumIndexedFaces + 31) / 32) * sizeof(unsigned int));
+    for( i = 0; i < TSP->Header.NumDynamicDataBlock; i++ ) {
+        DynamicData = &TSP->DynamicData[i];
+        for( j = 0; j < DynamicData->Header.NumFacesIndex; j++ ) {
+            Face = DynamicData->FaceIndexList[j];
+            if( Face < 0 || Face >= TSP->NumIndexedFaces ) {
+                DPrintf("TSPBuildDynamicFaceLookUp:Block %i references invalid face %i\n",i,Face);
+                continue;
+            }
+            //NOTE(Adriano):If more than one block references the same face the first one wins.
+            if( TSPIsFaceDynamic(TSP,Face) ) {
+                continue;
+            }
+            TSP->DynamicFaceBitSet[Face >> 5] |= 1u << (Face & 31);
+            TSP->DynamicFaceLookUp[Face].Block = i;
+            TSP->DynamicFaceLookUp[Face].Slot = j;
+        }
+    }
+    return 1;
+}
+
 int TSPReadCollisionChunk(TSP_t *TSP,FILE *InFile)
 {
     short Pad;
@@ -1392,6 +2600,11 @@ int TSPReadCollisionChunk(TSP_t *TSP,FILE *InFile)
     DPrintf("NumVertices:%u\n",TSP->CollisionData->Header.NumVertices);
     DPrintf("NumNormals:%u\n",TSP->CollisionData->Header.NumNormals);
     DPrintf("NumFaces:%u\n",TSP->CollisionData->Header.NumFaces);
+    if( TSP->CollisionData->Header.CollisionBoundMinX > TSP->CollisionData->Header.CollisionBoundMaxX ||
+        TSP->CollisionData->Header.CollisionBoundMinZ > TSP->CollisionData->Header.CollisionBoundMaxZ ) {
+        DPrintf("TSPReadCollisionChunk:Invalid collision bounds.\n");
+        return 0;
+    }
 
     TSP->CollisionData->KDTree = malloc(TSP->CollisionData->Header.NumCollisionKDTreeNodes * sizeof(TSPCollisionKDTreeNode_t));
     if( !TSP->CollisionData->KDTree ) {
@@ -1474,7 +2687,13 @@ int TSPReadCollisionChunk(TSP_t *TSP,FILE *InFile)
         }
         DPrintf("-- Face %i --\n",i);
 //         DPrintf("V0|V1|V2:%u %u %u\n",TSP->CollisionData->Face[i].V0,TSP->CollisionData->Face[i].V1,TSP->CollisionData->Face[i].V2);
-        assert(TSP->CollisionData->Face[i].NormalIndex < TSP->CollisionData->Header.NumNormals);
+        if( TSP->CollisionData->Face[i].NormalIndex >= TSP->CollisionData->Header.NumNormals ||
+            TSP->CollisionData->Face[i].V0 >= TSP->CollisionData->Header.NumVertices ||
+            TSP->CollisionData->Face[i].V1 >= TSP->CollisionData->Header.NumVertices ||
+            TSP->CollisionData->Face[i].V2 >= TSP->CollisionData->Header.NumVertices ) {
+            DPrintf("TSPReadCollisionChunk:Face %i references invalid vertices or normal.\n",i);
+            return 0;
+        }
         DPrintf("Normal Index:%u\n",TSP->CollisionData->Face[i].NormalIndex);
 
     }
@@ -1485,13 +2704,14 @@ TSPCollision_t *TSPGetCollisionDataFromPoint(TSP_t *TSPList,TSPVec3_t Point)
 {
     TSP_t *TSP;
 
-    for( TSP = TSPList; TSP; TSP = TSP->Next ) {
-        if( Point.x >= TSP->CollisionData->Header.CollisionBoundMinX && Point.x <= TSP->CollisionData->Header.CollisionBoundMaxX &&
-        Point.z >= TSP->CollisionData->Header.CollisionBoundMinZ && Point.z <= TSP->CollisionData->Header.CollisionBoundMaxZ ) {
-            return TSP->CollisionData;
-        }
+    if( !TSPList ) {
+        return NULL;
     }
-    return NULL;
+    if( !TSPList->CollisionGrid ) {
+        TSPList->CollisionGrid = CollisionCreateGrid(TSPList);
+    }
+    TSP = CollisionGetTSPFromPoint(TSPList->CollisionGrid,Point.x,Point.z);
+    return TSP ? TSP->CollisionData : NULL;
 }
 
 int TSPGetYFromCollisionFace(TSPCollision_t *CollisionData,TSPVec3_t Point,TSPCollisionFace_t *Face)
@@ -1690,9 +2910,28 @@ TSP_t *TSPLoad(FILE *TSPFile,int TSPOffset)
     TSP->Face = NULL;
     TSP->Vertex = NULL;
     TSP->Color = NULL;
-    TSP->TransparentFaceList = NULL;
+    TSP->RenderingFaceList = NULL;
+    TSP->RenderingFaceDataList = NULL;
+    TSP->NumRenderingFaces = 0;
+    TSP->NumOpaqueRenderingFaces = 0;
+    TSP->TransparentFaceStart = 0;
+    TSP->NumTransparentRenderingFaces = 0;
     TSP->TransparentVAO = NULL;
+    TSP->TransparentBatch = NULL;
     TSP->DynamicData = NULL;
+    TSP->DynamicFaceBitSet = NULL;
+    TSP->DynamicFaceLookUp = NULL;
+    TSP->NumIndexedFaces = 0;
+    TSP->OccluderList = NULL;
+    TSP->NumOccluders = 0;
+    TSP->PVS = NULL;
+    TSP->CollisionGrid = NULL;
+    TSP->Heightfield = NULL;
+    TSP->HeightfieldFailed = false;
+    TSP->CollisionBVH = NULL;
+    TSP->Atlas = NULL;
+    TSP->Streaming = NULL;
+    TSP->LODCache = NULL;
     TSP->FName = StringCopy("World");
     
     fseek(TSPFile,TSPOffset,SEEK_SET);
@@ -1711,6 +2950,10 @@ TSP_t *TSPLoad(FILE *TSPFile,int TSPOffset)
     fread(&TSP->Header.ColorOffset,sizeof(TSP->Header.ColorOffset),1,TSPFile);
     fread(&TSP->Header.NumC,sizeof(TSP->Header.NumC),1,TSPFile);
     fread(&TSP->Header.COffset,sizeof(TSP->Header.COffset),1,TSPFile);
+    //NOTE(Adriano):The header ends right before the node chunk and has no dedicated dynamic data field,
+    //              the dynamic blocks (doors and moving surfaces) are stored in the B chunk.
+    TSP->Header.NumDynamicDataBlock = TSP->Header.NumB;
+    TSP->Header.DynamicDataOffset = TSP->Header.BOffset;
         
     DPrintf("Sizeof TSPHeader is %li\n",sizeof(TSPHeader_t));
     DPrintf(" -- TSP HEADER --\n");
@@ -1745,6 +2988,35 @@ TSP_t *TSPLoad(FILE *TSPFile,int TSPOffset)
     if( !TSPReadColorChunk(TSP,TSPFile) ) {
         goto Failure;
     }
+    //NOTE(Adriano):The collision data is stored in the C chunk.
+    //              It is only needed by the height queries and the walk camera,if it doesn't validate it is discarded
+    //              and the TSP can still be drawn.
+    if( TSP->Header.NumC != 0 ) {
+        fseek(TSPFile,TSP->Header.COffset + TSPOffset,SEEK_SET);
+        if( !TSPReadCollisionChunk(TSP,TSPFile) ) {
+            DPrintf("TSPLoad:Failed to read collision data at %i,discarding it\n",TSP->Header.COffset + TSPOffset);
+            TSPFreeCollisionData(TSP);
+        }
+    }
+    //NOTE(Adriano):Every block is validated while it is read,if one of them doesn't the dynamic data is discarded
+    //              and the TSP is drawn using the faces as they are stored in the file.
+    if( TSP->Header.NumDynamicDataBlock > 0 ) {
+        fseek(TSPFile,TSP->Header.DynamicDataOffset + TSPOffset,SEEK_SET);
+        if( !TSPReadDynamicDataChunk(TSP,TSPFile) ) {
+            DPrintf("TSPLoad:Failed to read dynamic data at %i,discarding it\n",TSP->Header.DynamicDataOffset + TSPOffset);
+            TSPFreeDynamicData(TSP);
+        }
+    } else {
+        TSP->Header.NumDynamicDataBlock = 0;
+    }
+    if( !TSPBuildDynamicFaceLookUp(TSP) ) {
+        goto Failure;
+    }
+    if( !PVSLoad(TSP) ) {
+        goto Failure;
+    }
+    //NOTE(Adriano):Not having the LOD cache is not an error,the levels are just built every time.
+    TSP->LODCache = LODCacheLoad(TSP->PVS->Hash);
     return TSP;
 Failure:
     TSPFree(TSP);
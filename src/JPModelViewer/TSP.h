@@ -22,6 +22,14 @@
 #include "../Common/Common.h"
 #include "../Common/VAO.h"
 #include "../Common/VRAM.h"
+#include "LOD.h"
+
+#define TSP_NUM_BLENDING_MODES 4
+//                           XYZ UV RGB CLUT ColorMode Textured LightIndex
+#define TSP_VERTEX_STRIDE   ((3 + 2 + 3 + 2 + 1 + 1 + 1) * sizeof(int))
+//NOTE(Adriano):A triangle clipped by the six region planes can have at most 9 vertices.
+#define TSP_EXPORT_MAX_CLIP_VERTICES 9
+#define TSP_DYNAMIC_FACE_FRAME_TIME 100
 
 typedef enum {
     TSP_FX_NONE = 1,
@@ -65,19 +73,33 @@ typedef struct TSPBBox_s {
     TSPVec3_t Max;
 } TSPBBox_t;
 
+//NOTE(Adriano):Rendering faces are stored inside two parallel arrays owned by the TSP.
+//              TSPRenderingFace_t holds the data that is accessed every frame while TSPRenderingFaceData_t
+//              holds the data that is only needed when building or resetting the faces.
 typedef struct TSPRenderingFace_s {
-    int VAOBufferOffset;
-    int BlendingMode;
-    TSPVert_t Vert0;
-    TSPVert_t Vert1;
-    TSPVert_t Vert2;
-    Color1i_t Colors[3];
-    int ColorIndex[3];
-    int DynamicDataIndex;
-    int Flags;
-    struct TSPRenderingFace_s *Next;
+    int     VAOBufferOffset;
+    short   Flags;
+    short   BlendingMode;
 } TSPRenderingFace_t;
 
+typedef struct TSPRenderingFaceData_s {
+    unsigned short  Vert[3];
+    int             DynamicDataIndex;
+} TSPRenderingFaceData_t;
+
+//NOTE(Adriano):Transparent faces are sorted back to front every frame and drawn using
+//              one index range for each blending mode.
+typedef struct TSPTransparentBatch_s {
+    vec3                *CenterList;
+    int                 NumFaces;
+    unsigned int        *KeyList;
+    int                 *SortedList;
+    int                 *TempSortedList;
+    unsigned int        *IndexList;
+    int                 Offset[TSP_NUM_BLENDING_MODES];
+    int                 Count[TSP_NUM_BLENDING_MODES];
+} TSPTransparentBatch_t;
+
 //16 Bytes.
 typedef struct TSPFace_s {
     unsigned short  V0;
@@ -99,6 +121,19 @@ typedef struct TSPNodeFileLookUp_s {
     int Child2Offset;
 } TSPNodeFileLookUp_t;
 
+//NOTE(Adriano):Opaque geometry of a leaf,built once (by the loader thread when the level is streamed) and kept
+//              with the leaf so that it can be uploaded again after being evicted.
+typedef struct TSPNodeMesh_s {
+    int             *VertexData;
+    int             NumVertices;
+    //NOTE(Adriano):NULL if the faces are drawn in order without an index buffer.
+    unsigned int    *IndexList;
+    int             NumIndices;
+    //NOTE(Adriano):Indices drawn when the detail levels are not used.
+    int             NumDrawIndices;
+    LODMesh_t       LOD;
+} TSPNodeMesh_t;
+
 typedef struct TSPNode_s {
     TSPBBox_t BBox; //12
     int Child1Index; // 20 This should be an offset relative to the face offset...
@@ -114,8 +149,14 @@ typedef struct TSPNode_s {
     VAO_t *BBoxVAO;
     VAO_t *OpaqueFacesVAO;
     VAO_t *LeafCollisionFaceListVAO;
-    TSPRenderingFace_t *OpaqueFaceList;
+    int    OpaqueFaceStart;
+    int    NumOpaqueFaces;
     int    NumTransparentFaces;
+    int    LeafIndex;
+    int    FirstFaceIndex;
+    bool   PVSVisible;
+    TSPNodeMesh_t *Mesh;
+    LODMesh_t LOD;
     struct TSPNode_s *Child[3];
 } TSPNode_t;
 
@@ -142,16 +183,34 @@ typedef struct TSPDynamicDataHeader_s
     short FaceDataOffset;
 } TSPDynamicDataHeader_t;
 
+//NOTE(Adriano):Location of a dynamic face inside the vertex buffers,sorted by VAO and offset
+//              in order to upload contiguous faces with a single call.
+typedef struct TSPDynamicFaceTarget_s {
+    int     Slot;
+    int     RenderingFaceIndex;
+    int     VAOBufferOffset;
+    VAO_t   *VAO;
+} TSPDynamicFaceTarget_t;
+
 typedef struct TSPDynamicData_s {
     TSPDynamicDataHeader_t Header;
     short *FaceIndexList;
     TSPDynamicFaceData_t *FaceDataList;
     short *FaceDataListV3;
+    int NumFrames;
+    TSPDynamicFaceTarget_t *TargetList;
+    int NumTargets;
+    int *VertexData;
     int CurrentStride;
     int IncrementOffset;
     int LastUpdateTime;
 } TSPDynamicData_t;
 
+typedef struct TSPDynamicFaceRef_s {
+    short Block;
+    short Slot;
+} TSPDynamicFaceRef_t;
+
 typedef struct TSPCollisionHeader_s {
     short CollisionBoundMinX;
     short CollisionBoundMinZ;
@@ -226,29 +285,106 @@ typedef struct TSP_s {
     TSPVert_t   *Vertex;
     Color1i_t     *Color;
     TSPDynamicData_t  *DynamicData;
+    //NOTE(Adriano):One bit for each face telling if it is referenced by a dynamic block and,if so,
+    //              its position inside the block.
+    unsigned int        *DynamicFaceBitSet;
+    TSPDynamicFaceRef_t *DynamicFaceLookUp;
+    int                 NumIndexedFaces;
     TSPCollision_t *CollisionData;
+    //NOTE(Adriano):Only set on the head of the list,built on the first collision query.
+    struct CollisionGrid_s *CollisionGrid;
+    struct Heightfield_s *Heightfield;
+    //NOTE(Adriano):Set when the heightfield could not be loaded nor baked,so that it is not retried.
+    bool         HeightfieldFailed;
+    struct BVH_s *CollisionBVH;
     //
     int          Number;
     VAO_t       *VAOList;
     VAO_t       *TransparentVAO;
-    TSPRenderingFace_t *TransparentFaceList;
+    TSPRenderingFace_t *RenderingFaceList;
+    TSPRenderingFaceData_t *RenderingFaceDataList;
+    int         NumRenderingFaces;
+    int         NumOpaqueRenderingFaces;
+    int         TransparentFaceStart;
+    int         NumTransparentRenderingFaces;
+    TSPTransparentBatch_t *TransparentBatch;
     VAO_t       *CollisionVAOList;
+    //NOTE(Adriano):Triangle list (3 vertices xyz) of the largest opaque faces, used to fill the occlusion buffer.
+    float       *OccluderList;
+    int         NumOccluders;
+    struct PVS_s *PVS;
+    struct Streaming_s *Streaming;
+    LODCache_t  *LODCache;
+    //NOTE(Adriano):Not owned,when set face UVs point inside the atlas instead of the expanded VRAM.
+    VRAMAtlas_t *Atlas;
     bool        VAOCreated;
     struct TSP_s *Next;
 } TSP_t;
 
+typedef enum {
+    TSP_EXPORT_FORMAT_PLY,
+    TSP_EXPORT_FORMAT_OBJ
+} TSPExportFormat_t;
+
+//NOTE(Adriano):Planes are in level space,a point is inside the region when it is in front of every plane.
+typedef struct TSPExportRegion_s {
+    vec4    PlaneList[6];
+    bool    ClipFaces;
+} TSPExportRegion_t;
+
+//NOTE(Adriano):UV are relative to the texture page stored in Tile.
+typedef struct TSPExportVertex_s {
+    float   Position[3];
+    float   Color[3];
+    float   UV[2];
+    int     Tile;
+} TSPExportVertex_t;
+
+typedef struct TSPExportMesh_s {
+    TSPExportVertex_t   *VertexList;
+    int                 NumVertices;
+    int                 MaxVertices;
+    int                 *IndexList;
+    int                 NumIndices;
+    int                 MaxIndices;
+    int                 *HashTable;
+    int                 HashTableSize;
+    int                 TileSlot[VRAM_NUM_TILES];
+    int                 TileList[VRAM_NUM_TILES];
+    int                 NumTiles;
+    int                 NumVisitedNodes;
+    int                 NumSkippedNodes;
+    int                 NumClippedFaces;
+} TSPExportMesh_t;
+
 typedef struct Camera_s Camera_t;
 typedef struct BSD_s BSD_t;
 typedef struct RenderObjectShader_s RenderObjectShader_t;
+typedef struct BSDAnimatedLightTable_s BSDAnimatedLightTable_t;
 
 TSP_t  *TSPLoad(FILE *TSPFile,int TSPOffset);
-void    TSPDrawList(TSP_t *TSPList,VRAM_t *VRAM,Camera_t *Camera,RenderObjectShader_t *RenderObjectShader,mat4 ProjectionMatrix);
-void    TSPUpdateAnimatedFaces(TSP_t *TSPList,BSD_t *BSD,Camera_t *Camera,mat4 ProjectionMatrix,int Reset);
+void    TSPDrawList(TSP_t *TSPList,VRAM_t *VRAM,Camera_t *Camera,RenderObjectShader_t *RenderObjectShader,
+                    BSDAnimatedLightTable_t *AnimatedLightTable,mat4 ProjectionMatrix);
 void    TSPUpdateDynamicFaces(TSP_t *TSPList,Camera_t *Camera,int DynamicDataIndex);
+void    TSPUploadDynamicData(TSP_t *TSP,TSPDynamicData_t *DynamicData);
 void    TSPCreateVAOs(TSP_t *TSPList);
+TSPNodeMesh_t *TSPBuildNodeVertexData(TSP_t *TSP,TSPNode_t *Node);
+bool    TSPUploadNodeVertexData(TSP_t *TSP,TSPNode_t *Node);
+bool    TSPNodeHasDynamicFaces(TSP_t *TSP,TSPNode_t *Node);
+int     TSPIsFaceDynamic(TSP_t *TSP,int Face);
+void    TSPEvictNodeVertexData(TSPNode_t *Node);
+void    TSPSortDynamicFaceTargets(TSP_t *TSP);
+int     TSPBuildLOD(TSP_t *TSP);
+void    TSPUpdateLOD(TSP_t *TSP,mat4 MVPMatrix,float ProjectionScale);
+void    TSPVec3ToGLMVec3(TSPVec3_t In,vec3 Out);
+TSPVec3_t TSPGLMVec3ToTSPVec3(vec3 In);
 int     TSPGetPointYComponentFromKDTree(vec3 Point,TSP_t *TSPList,int *PropertySetFileIndex,int *OutY);
 void    TSPDumpDataToObjFile(TSP_t *TSPList,VRAM_t *VRAM,FILE* OutFile);
 void    TSPDumpDataToPlyFile(TSP_t *TSPList,VRAM_t *VRAM,FILE* OutFile);
+void    TSPExportRegionFromBox(TSPExportRegion_t *Region,vec3 Min,vec3 Max,bool ClipFaces);
+void    TSPExportRegionFromFrustum(TSPExportRegion_t *Region,mat4 MVPMatrix,bool ClipFaces);
+int     TSPExportRegion(TSP_t *TSPList,VRAM_t *VRAM,const TSPExportRegion_t *Region,int Format,const char *Directory,
+                        const char *BaseName);
 void    TSPFree(TSP_t *TSP);
 void    TSPFreeList(TSP_t *List);
 #endif //__TSPVIEWER_H_
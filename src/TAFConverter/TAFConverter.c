@@ -0,0 +1,398 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: https://pvs-studio.com
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    TAFConverter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    TAFConverter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TAFConverter.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#include "TAFConverter.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/VRAM.h"
+#include <dirent.h>
+#include <ctype.h>
+
+static void TAFConverterFree(TAFConverter_t *Converter)
+{
+    int i;
+    
+    for( i = 0; i < Converter->NumFiles; i++ ) {
+        free(Converter->FileList[i].Path);
+        free(Converter->FileList[i].OutputDirectory);
+    }
+    free(Converter->FileList);
+    free(Converter->InputDirectory);
+    free(Converter->OutputDirectory);
+}
+
+static bool TAFConverterIsTAFFile(const char *FileName)
+{
+    const char *Extension;
+    
+    Extension = GetFileExtension(FileName);
+    if( !Extension || strlen(Extension) != 3 ) {
+        return false;
+    }
+    return tolower(Extension[0]) == 't' && tolower(Extension[1]) == 'a' && tolower(Extension[2]) == 'f';
+}
+
+static int TAFConverterCompareFile(const void *a,const void *b)
+{
+    return strcmp(((const TAFConverterFile_t *) a)->Path,((const TAFConverterFile_t *) b)->Path);
+}
+
+static int TAFConverterAddFile(TAFConverter_t *Converter,const char *Path,int Size)
+{
+    TAFConverterFile_t *Temp;
+    TAFConverterFile_t *File;
+    char *RelativePath;
+    
+    if( Converter->NumFiles == Converter->FileListSize ) {
+        Converter->FileListSize = Converter->FileListSize ? Converter->FileListSize * 2 : 64;
+        Temp = realloc(Converter->FileList,Converter->FileListSize * sizeof(TAFConverterFile_t));
+        if( !Temp ) {
+            DPrintf("TAFConverterAddFile:Failed to allocate memory for %i files\n",Converter->FileListSize);
+            return 0;
+        }
+        Converter->FileList = Temp;
+    }
+    File = &Converter->FileList[Converter->NumFiles];
+    memset(File,0,sizeof(TAFConverterFile_t));
+    File->Path = StringCopy(Path);
+    File->Size = Size;
+    //NOTE(Adriano):Images are written inside a folder that mirrors the position of the TAF file inside the input directory.
+    RelativePath = SwitchExt(Path + strlen(Converter->InputDirectory) + 1,"");
+    asprintf(&File->OutputDirectory,"%s%c%s",Converter->OutputDirectory,PATH_SEPARATOR,RelativePath);
+    free(RelativePath);
+    Converter->NumFiles++;
+    return 1;
+}
+
+static void TAFConverterScanDirectory(TAFConverter_t *Converter,const char *Directory)
+{
+    DIR *Dir;
+    struct dirent *Entry;
+    struct stat FileStat;
+    char *Path;
+    
+    Dir = opendir(Directory);
+    if( !Dir ) {
+        printf("TAFConverterScanDirectory:Failed to open directory %s\n",Directory);
+        return;
+    }
+    while( (Entry = readdir(Dir)) != NULL ) {
+        if( !strcmp(Entry->d_name,".") || !strcmp(Entry->d_name,"..") ) {
+            continue;
+        }
+        asprintf(&Path,"%s%c%s",Directory,PATH_SEPARATOR,Entry->d_name);
+        if( stat(Path,&FileStat) == -1 ) {
+            free(Path);
+            continue;
+        }
+        if( S_ISDIR(FileStat.st_mode) ) {
+            TAFConverterScanDirectory(Converter,Path);
+        } else if( TAFConverterIsTAFFile(Entry->d_name) ) {
+            TAFConverterAddFile(Converter,Path,FileStat.st_size);
+        }
+        free(Path);
+    }
+    closedir(Dir);
+}
+
+/*
+ * Creates every missing directory of the path.
+ */
+static void TAFConverterCreateDirectories(const char *Path)
+{
+    char *Temp;
+    char *Separator;
+    
+    Temp = StringCopy(Path);
+    for( Separator = strchr(Temp + 1,PATH_SEPARATOR); Separator; Separator = strchr(Separator + 1,PATH_SEPARATOR) ) {
+        *Separator = '\0';
+        CreateDirIfNotExists(Temp);
+        *Separator = PATH_SEPARATOR;
+    }
+    CreateDirIfNotExists(Temp);
+    free(Temp);
+}
+
+/*
+ * Hashes the content of the TAF file together with the export options,so that the images are converted again
+ * when any of them changes.
+ */
+static int TAFConverterGetFileHash(TAFConverter_t *Converter,const char *Path,unsigned int *Hash)
+{
+    FILE *TAFFile;
+    Byte *Data;
+    int Size;
+    int Ret;
+    
+    TAFFile = fopen(Path,"rb");
+    if( !TAFFile ) {
+        return 0;
+    }
+    Size = GetFileLength(TAFFile);
+    Data = Size > 0 ? malloc(Size) : NULL;
+    if( !Data ) {
+        fclose(TAFFile);
+        return 0;
+    }
+    Ret = fread(Data,1,Size,TAFFile);
+    fclose(TAFFile);
+    if( Ret != Size ) {
+        free(Data);
+        return 0;
+    }
+    *Hash = HashFNV1a(HASH_FNV1A_INITIAL_VALUE,Data,Size);
+    *Hash = HashFNV1a(*Hash,&Converter->ExportVRAM,sizeof(Converter->ExportVRAM));
+    free(Data);
+    return 1;
+}
+
+static int TAFConverterReadHash(const char *Path,unsigned int *Hash)
+{
+    FILE *HashFile;
+    int Magic;
+    int Version;
+    int Ret;
+    
+    HashFile = fopen(Path,"rb");
+    if( !HashFile ) {
+        return 0;
+    }
+    Ret = fread(&Magic,sizeof(Magic),1,HashFile);
+    Ret += fread(&Version,sizeof(Version),1,HashFile);
+    Ret += fread(Hash,sizeof(unsigned int),1,HashFile);
+    fclose(HashFile);
+    return Ret == 3 && Magic == TAF_CONVERTER_HASH_FILE_MAGIC && Version == TAF_CONVERTER_HASH_FILE_VERSION;
+}
+
+static void TAFConverterWriteHash(const char *Path,unsigned int Hash)
+{
+    FILE *HashFile;
+    int Magic;
+    int Version;
+    
+    HashFile = fopen(Path,"wb");
+    if( !HashFile ) {
+        DPrintf("TAFConverterWriteHash:Failed to open %s for writing\n",Path);
+        return;
+    }
+    Magic = TAF_CONVERTER_HASH_FILE_MAGIC;
+    Version = TAF_CONVERTER_HASH_FILE_VERSION;
+    fwrite(&Magic,sizeof(Magic),1,HashFile);
+    fwrite(&Version,sizeof(Version),1,HashFile);
+    fwrite(&Hash,sizeof(Hash),1,HashFile);
+    fclose(HashFile);
+}
+
+static void TAFConverterConvertFile(void *UserData,int TaskIndex)
+{
+    TAFConverterBatch_t *Batch;
+    TAFConverterFile_t *File;
+    TIMImage_t *ImageList;
+    TIMImage_t *Iterator;
+    char *HashPath;
+    char *OutName;
+    unsigned int Hash;
+    unsigned int StoredHash;
+    int NumImages;
+    
+    Batch = (TAFConverterBatch_t *) UserData;
+    File = &Batch->Converter->FileList[Batch->FirstFile + TaskIndex];
+    if( !TAFConverterGetFileHash(Batch->Converter,File->Path,&Hash) ) {
+        printf("TAFConverterConvertFile:Failed to read %s\n",File->Path);
+        File->Failed = true;
+        return;
+    }
+    asprintf(&HashPath,"%s%cTAF.hash",File->OutputDirectory,PATH_SEPARATOR);
+    if( !Batch->Converter->Force && TAFConverterReadHash(HashPath,&StoredHash) && StoredHash == Hash ) {
+        File->Skipped = true;
+        free(HashPath);
+        return;
+    }
+    ImageList = TIMLoadAllImages(File->Path,&NumImages);
+    if( !ImageList ) {
+        File->Failed = true;
+        free(HashPath);
+        return;
+    }
+    TAFConverterCreateDirectories(File->OutputDirectory);
+    for( Iterator = ImageList; Iterator; Iterator = Iterator->Next ) {
+        asprintf(&OutName,"%s%c%s.png",File->OutputDirectory,PATH_SEPARATOR,Iterator->Name);
+        if( !TIMWritePNGImage(Iterator,OutName) ) {
+            printf("TAFConverterConvertFile:Failed to write %s\n",OutName);
+            File->Failed = true;
+        }
+        free(OutName);
+        File->NumImages++;
+        File->NumPixelBytes += Iterator->Width * Iterator->Height * 3;
+    }
+    if( Batch->Converter->ExportVRAM ) {
+        asprintf(&OutName,"%s%cVRAM.png",File->OutputDirectory,PATH_SEPARATOR);
+        if( !VRAMSaveImageList(ImageList,OutName) ) {
+            printf("TAFConverterConvertFile:Failed to write %s\n",OutName);
+            File->Failed = true;
+        }
+        free(OutName);
+    }
+    TIMImageListFree(ImageList);
+    //NOTE(Adriano):The hash marks the output as up to date,a partial conversion must be done again on the next run.
+    if( !File->Failed ) {
+        TAFConverterWriteHash(HashPath,Hash);
+    }
+    free(HashPath);
+}
+
+static int TAFConverterGetFileMemory(TAFConverter_t *Converter,const TAFConverterFile_t *File)
+{
+    int Memory;
+    
+    Memory = File->Size * TAF_CONVERTER_MEMORY_FACTOR;
+    if( Converter->ExportVRAM ) {
+        //NOTE(Adriano):RGBA page plus the filtered rows used by the PNG writer.
+        Memory += VRAM_NUM_TILES_X * VRAM_TILE_SIZE * VRAM_NUM_TILES_Y * VRAM_TILE_SIZE * 4 * 2;
+    }
+    return Memory;
+}
+
+/*
+ * Converts the files in batches,each batch is converted in parallel and contains as many files as the memory
+ * budget allows (at least one).
+ * Returns 1 if every file was converted or skipped.
+ */
+static int TAFConverterRun(TAFConverter_t *Converter)
+{
+    TAFConverterBatch_t Batch;
+    long long Budget;
+    long long BatchMemory;
+    long long NumPixelBytes;
+    double StartTime;
+    double Time;
+    int NumBatchFiles;
+    int NumImages;
+    int NumSkipped;
+    int NumFailed;
+    int i;
+    
+    StartTime = SysPreciseMilliseconds();
+    Budget = (long long) Converter->MemoryBudget * 1024 * 1024;
+    Batch.Converter = Converter;
+    Batch.FirstFile = 0;
+    while( Batch.FirstFile < Converter->NumFiles ) {
+        NumBatchFiles = 0;
+        BatchMemory = 0;
+        while( Batch.FirstFile + NumBatchFiles < Converter->NumFiles ) {
+            BatchMemory += TAFConverterGetFileMemory(Converter,&Converter->FileList[Batch.FirstFile + NumBatchFiles]);
+            if( NumBatchFiles > 0 && BatchMemory > Budget ) {
+                break;
+            }
+            NumBatchFiles++;
+        }
+        ThreadPoolParallelFor(NumBatchFiles,TAFConverterConvertFile,&Batch);
+        Batch.FirstFile += NumBatchFiles;
+    }
+    Time = (SysPreciseMilliseconds() - StartTime) / 1000.;
+    NumImages = 0;
+    NumSkipped = 0;
+    NumFailed = 0;
+    NumPixelBytes = 0;
+    for( i = 0; i < Converter->NumFiles; i++ ) {
+        if( Converter->FileList[i].Failed ) {
+            NumFailed++;
+        } else if( Converter->FileList[i].Skipped ) {
+            NumSkipped++;
+        }
+        NumImages += Converter->FileList[i].NumImages;
+        NumPixelBytes += Converter->FileList[i].NumPixelBytes;
+    }
+    printf("Converted %i files (%i unchanged,%i failed) with %i threads.\n",Converter->NumFiles - NumSkipped - NumFailed,NumSkipped,
+           NumFailed,ThreadPoolGetNumThreads());
+    printf("Wrote %i images in %.2f sec:%.2f images/sec %.2f MB/sec\n",NumImages,Time,Time > 0. ? NumImages / Time : 0.,
+           Time > 0. ? (NumPixelBytes / (1024. * 1024.)) / Time : 0.);
+    return NumFailed == 0;
+}
+
+static void TAFConverterPrintUsage(const char *ProgramName)
+{
+    printf("Usage:%s <Input Directory> <Output Directory> [-vram] [-force] [-threads <Count>] [-memory <MB>]\n",ProgramName);
+    printf("    -vram       Also writes the VRAM page built from the images of each TAF file.\n");
+    printf("    -force      Converts every file even if it did not change since the last run.\n");
+    printf("    -threads    Number of threads used for the conversion,0 uses every core (Default).\n");
+    printf("    -memory     Upper bound in MB of the memory used by the files that are converted at the same time "
+           "(Default:%i).\n",TAF_CONVERTER_DEFAULT_MEMORY_BUDGET);
+}
+
+int main(int argc,char **argv)
+{
+    TAFConverter_t Converter;
+    int Result;
+    int NumThreads;
+    int Length;
+    int i;
+    
+    if( argc < 3 ) {
+        TAFConverterPrintUsage(argv[0]);
+        return -1;
+    }
+    memset(&Converter,0,sizeof(TAFConverter_t));
+    Converter.InputDirectory = StringCopy(argv[1]);
+    Converter.OutputDirectory = StringCopy(argv[2]);
+    Converter.MemoryBudget = TAF_CONVERTER_DEFAULT_MEMORY_BUDGET;
+    NumThreads = 0;
+    for( i = 3; i < argc; i++ ) {
+        if( !strcmp(argv[i],"-vram") ) {
+            Converter.ExportVRAM = true;
+        } else if( !strcmp(argv[i],"-force") ) {
+            Converter.Force = true;
+        } else if( !strcmp(argv[i],"-threads") && i + 1 < argc ) {
+            NumThreads = StringToInt(argv[++i]);
+        } else if( !strcmp(argv[i],"-memory") && i + 1 < argc ) {
+            Converter.MemoryBudget = StringToInt(argv[++i]);
+        } else {
+            printf("Unknown option %s\n",argv[i]);
+            TAFConverterPrintUsage(argv[0]);
+            TAFConverterFree(&Converter);
+            return -1;
+        }
+    }
+    //NOTE(Adriano):Trailing separators would end up inside the relative path of every file.
+    Length = strlen(Converter.InputDirectory);
+    while( Length > 1 && Converter.InputDirectory[Length - 1] == PATH_SEPARATOR ) {
+        Converter.InputDirectory[--Length] = '\0';
+    }
+    CommonInit("TAFConverter");
+    if( !ThreadPoolInit(NumThreads) ) {
+        printf("Failed to initialize the thread pool\n");
+        TAFConverterFree(&Converter);
+        CommonShutdown();
+        return -1;
+    }
+    TAFConverterScanDirectory(&Converter,Converter.InputDirectory);
+    Result = 0;
+    if( !Converter.NumFiles ) {
+        printf("No TAF file found inside %s\n",Converter.InputDirectory);
+    } else {
+        qsort(Converter.FileList,Converter.NumFiles,sizeof(TAFConverterFile_t),TAFConverterCompareFile);
+        printf("Found %i TAF files inside %s\n",Converter.NumFiles,Converter.InputDirectory);
+        TAFConverterCreateDirectories(Converter.OutputDirectory);
+        Result = TAFConverterRun(&Converter) ? 0 : -1;
+    }
+    ThreadPoolShutdown();
+    TAFConverterFree(&Converter);
+    CommonShutdown();
+    return Result;
+}
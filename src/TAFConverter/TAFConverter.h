@@ -0,0 +1,58 @@
+/*
+===========================================================================
+    Copyright (C) 2024- Adriano Di Dio.
+    
+    TAFConverter is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    TAFConverter is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TAFConverter.  If not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+#ifndef __TAFCONVERTER_H_
+#define __TAFCONVERTER_H_
+
+#include "../Common/Common.h"
+#include "../Common/TIM.h"
+
+#define TAF_CONVERTER_DEFAULT_MEMORY_BUDGET 256
+#define TAF_CONVERTER_HASH_FILE_MAGIC 0x48464154 //TAFH
+#define TAF_CONVERTER_HASH_FILE_VERSION 1
+//NOTE(Adriano):Upper bound on the memory used to convert a TAF file compared to its size,4bpp images take 12 times
+//              more space once expanded to RGB and the PNG writer needs about the same amount for the filtered rows.
+#define TAF_CONVERTER_MEMORY_FACTOR 24
+
+typedef struct TAFConverterFile_s {
+    char            *Path;
+    char            *OutputDirectory;
+    int             Size;
+    bool            Skipped;
+    bool            Failed;
+    int             NumImages;
+    long long       NumPixelBytes;
+} TAFConverterFile_t;
+
+typedef struct TAFConverter_s {
+    char                *InputDirectory;
+    char                *OutputDirectory;
+    bool                ExportVRAM;
+    bool                Force;
+    int                 MemoryBudget;
+    TAFConverterFile_t  *FileList;
+    int                 NumFiles;
+    int                 FileListSize;
+} TAFConverter_t;
+
+typedef struct TAFConverterBatch_s {
+    TAFConverter_t      *Converter;
+    int                 FirstFile;
+} TAFConverterBatch_t;
+
+#endif //__TAFCONVERTER_H_